@@ -16,6 +16,12 @@
 #include <memory>
 #include <utility>
 #include <atomic>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
 
 #include <openvpn/io/io.hpp>
 
@@ -80,7 +86,9 @@
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/platform_string.hpp>
 #include <openvpn/common/count.hpp>
+#include <openvpn/asio/asiobusypoll.hpp>
 #include <openvpn/asio/asiostop.hpp>
+#include <openvpn/asio/asiowork.hpp>
 #include <openvpn/time/asiotimer.hpp>
 #include <openvpn/client/cliconnect.hpp>
 #include <openvpn/client/cliopthelper.hpp>
@@ -90,6 +98,9 @@
 #include <openvpn/crypto/selftest.hpp>
 #include <openvpn/client/clievent.hpp>
 #include <openvpn/log/sessionstats.hpp>
+#include <openvpn/log/packetcapture.hpp>
+#include <openvpn/log/metrics.hpp>
+#include <openvpn/ws/metricsserv.hpp>
 
 // copyright
 #include <openvpn/legal/copyright.hpp>
@@ -178,6 +189,40 @@ class MySessionStats : public SessionStats
     count_t errors[Error::N_ERRORS];
 };
 
+inline SelfTestThroughput self_test_throughput(const SelfTest::Throughput &t)
+{
+    SelfTestThroughput ret;
+    ret.defined = t.defined;
+    ret.sent = t.sent;
+    ret.received = t.received;
+    ret.duplicates = t.duplicates;
+    ret.reordered = t.reordered;
+    ret.seconds = double(t.usec) / 1e6;
+    ret.goodputMbps = t.goodput_mbps();
+    ret.loss = t.loss();
+    return ret;
+}
+
+inline SelfTestResult self_test_result(const SelfTest::Result &r)
+{
+    SelfTestResult ret;
+    ret.status = r.status;
+    ret.pingsSent = static_cast<int>(r.ping.sent);
+    ret.pingsReceived = static_cast<int>(r.ping.received);
+    if (!r.ping.rtt_ms.empty())
+    {
+        ret.rttMinMS = r.ping.rtt_ms.front();
+        ret.rttAvgMS = r.ping.avg();
+        ret.rttP50MS = r.ping.percentile(50);
+        ret.rttP90MS = r.ping.percentile(90);
+        ret.rttP99MS = r.ping.percentile(99);
+        ret.rttMaxMS = r.ping.rtt_ms.back();
+    }
+    ret.up = self_test_throughput(r.up);
+    ret.down = self_test_throughput(r.down);
+    return ret;
+}
+
 class MyClientEvents : public ClientEvent::Queue
 {
   public:
@@ -202,6 +247,12 @@ class MyClientEvents : public ClientEvent::Queue
             }
             else
             {
+                if (event->id() == ClientEvent::SELF_TEST)
+                {
+                    const SelfTest::Result &r = static_cast<ClientEvent::SelfTestResult *>(event.get())->result;
+                    parent->self_test_event(self_test_result(r));
+                }
+
                 Event ev;
                 ev.name = event->name();
                 ev.info = event->render();
@@ -210,9 +261,17 @@ class MyClientEvents : public ClientEvent::Queue
 
                 // save connected event
                 if (event->id() == ClientEvent::CONNECTED)
+                {
                     last_connected = std::move(event);
+                    connected = true;
+                }
+                else if (event->id() == ClientEvent::RECONNECTING || event->id() == ClientEvent::PAUSE)
+                    connected = false;
                 else if (event->id() == ClientEvent::DISCONNECTED)
+                {
+                    connected = false;
                     parent->on_disconnect();
+                }
 
                 parent->event(ev);
             }
@@ -246,6 +305,12 @@ class MyClientEvents : public ClientEvent::Queue
         ci.defined = false;
     }
 
+    // only valid on the session thread
+    bool is_connected() const
+    {
+        return connected;
+    }
+
     void detach_from_parent()
     {
         parent = nullptr;
@@ -254,6 +319,7 @@ class MyClientEvents : public ClientEvent::Queue
   private:
     OpenVPNClient *parent;
     ClientEvent::Base::Ptr last_connected;
+    bool connected = false;
 };
 
 class MySocketProtect : public SocketProtect
@@ -426,6 +492,67 @@ class MyClockTick
     const Time::Duration period;
 };
 
+// Periodically publishes the counters of a session hosted by
+// OpenVPNClientHost into its metrics slot.  Runs on the session thread,
+// whose io_context outlives the session, so a completion that is already
+// queued when finish() cancels the timer holds a reference and is ignored.
+class MyMetricsTick : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<MyMetricsTick> Ptr;
+
+    MyMetricsTick(openvpn_io::io_context &io_context,
+                  const MySessionStats::Ptr &stats_arg,
+                  const MyClientEvents::Ptr &events_arg,
+                  const Metrics::Slot::Ptr &slot_arg,
+                  const unsigned int ms)
+        : timer(io_context),
+          stats(stats_arg),
+          events(events_arg),
+          slot(slot_arg),
+          period(Time::Duration::milliseconds(ms))
+    {
+    }
+
+    void schedule()
+    {
+        publish();
+        timer.expires_after(period);
+        timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
+                         {
+			   if (!error && !self->halted)
+			     self->schedule(); });
+    }
+
+    // publish the final counters and retire the slot
+    void finish()
+    {
+        halted = true;
+        timer.cancel();
+        publish();
+        slot->close();
+    }
+
+  private:
+    void publish()
+    {
+        Metrics::Snapshot s;
+        for (size_t i = 0; i < SessionStats::N_STATS; ++i)
+            s.stat(i) = stats->stat_count(i);
+        for (size_t i = 0; i < Error::N_ERRORS; ++i)
+            s.error(i) = stats->error_count(i);
+        s.set_connected(events->is_connected());
+        slot->publish(s);
+    }
+
+    AsioTimer timer;
+    MySessionStats::Ptr stats;
+    MyClientEvents::Ptr events;
+    Metrics::Slot::Ptr slot;
+    const Time::Duration period;
+    bool halted = false;
+};
+
 namespace Private {
 class ClientState
 {
@@ -441,6 +568,7 @@ class ClientState
     MyClientEvents::Ptr events;
     ClientConnect::Ptr session;
     std::unique_ptr<MyClockTick> clock_tick;
+    MyMetricsTick::Ptr metrics_tick; // set by OpenVPNClientHost
 
     // extra settings submitted by API client
     ClientConfigParsed clientconf;
@@ -448,6 +576,7 @@ class ClientState
     ProtoContextCompressionOptions::Ptr proto_context_options;
     PeerInfo::Set::Ptr extra_peer_info;
     HTTPProxyTransport::Options::Ptr http_proxy_options;
+    PacketCapture::Ptr capture{new PacketCapture};
 
 #ifdef OPENVPN_GREMLIN
     Gremlin::Config::Ptr gremlin_config;
@@ -556,8 +685,13 @@ class ClientState
     {
         if (clock_tick)
             clock_tick->cancel();
+        if (disconnect_notify)
+            disconnect_notify();
     }
 
+    // set by OpenVPNClientHost to learn when a hosted session has ended
+    std::function<void()> disconnect_notify;
+
     void setup_async_stop_scopes()
     {
         stop_scope_local.reset(new AsioStopScope(*io_context(), async_stop_local(), [this]()
@@ -571,6 +705,12 @@ class ClientState
 	      trigger_async_stop_local(); }));
     }
 
+    void clear_async_stop_scopes()
+    {
+        stop_scope_local.reset();
+        stop_scope_global.reset();
+    }
+
   private:
     ClientState(const ClientState &) = delete;
     ClientState &operator=(const ClientState &) = delete;
@@ -588,6 +728,300 @@ class ClientState
 
     std::atomic<bool> foreign_thread_ready{false};
 };
+
+// pool threads and session bookkeeping of OpenVPNClientHost
+class HostState
+{
+  public:
+    struct Thread
+    {
+        openvpn_io::io_context io_context{1}; // concurrency hint=1
+        std::unique_ptr<AsioWork> work;
+        std::thread thread;
+        unsigned int sessions = 0; // protected by HostState::mutex
+    };
+
+    explicit HostState(OpenVPNClientHost *parent_arg)
+        : parent(parent_arg)
+    {
+    }
+
+    // start a thread running t.io_context until t.work is reset
+    void spawn(Thread &t)
+    {
+        t.work.reset(new AsioWork(t.io_context));
+        t.thread = std::thread([this, &t]()
+                               {
+#if !defined(OPENVPN_OVPNCLI_SINGLE_THREAD)
+	  openvpn_io::detail::signal_blocker signal_blocker; // signals should be handled by parent thread
+#endif
+#if defined(OPENVPN_LOG_LOGTHREAD_H) && !defined(OPENVPN_LOG_LOGBASE_H) && !defined(OPENVPN_LOG_GLOBAL)
+	  Log::Context log_context(parent);
+#endif
+	  run(t); });
+    }
+
+    // called from the pool thread
+    void run(Thread &t)
+    {
+        while (true)
+        {
+            try
+            {
+                t.io_context.run();
+            }
+            catch (const std::exception &e)
+            {
+                OPENVPN_LOG("client host thread exception: " << e.what());
+                continue;
+            }
+
+            // run() also returns when a session stops the io_context,
+            // see OPENVPN_IO_REQUIRES_STOP
+            if (!t.work)
+                break;
+            t.io_context.restart();
+        }
+    }
+
+    Status start(OpenVPNClient *client)
+    {
+        Thread *t = nullptr;
+        unsigned int id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (halt)
+            {
+                Status ret;
+                ret.error = true;
+                ret.message = "client host is stopped";
+                return ret;
+            }
+
+            // least loaded thread
+            for (auto &th : threads)
+                if (!t || th->sessions < t->sessions)
+                    t = th.get();
+            ++t->sessions;
+            ++sessions;
+            id = next_session_id++;
+        }
+
+        try
+        {
+            client->state->attach<MySessionStats, MyClientEvents>(client,
+                                                                  &t->io_context,
+                                                                  &async_stop);
+        }
+        catch (const std::exception &e)
+        {
+            session_removed(*t);
+            return OpenVPNClient::status_from_exception(e);
+        }
+
+        openvpn_io::post(t->io_context, [this, client, t, id]()
+                         { setup_session(client, *t, id); });
+        return Status();
+    }
+
+    Status start_metrics(const MetricsConfig &config)
+    {
+        Status ret;
+        if (config.intervalMS <= 0)
+        {
+            ret.error = true;
+            ret.message = "metrics interval must be positive";
+            return ret;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (halt)
+            {
+                ret.error = true;
+                ret.message = "client host is stopped";
+                return ret;
+            }
+
+            // the listener gets a thread of its own, so that waiting for
+            // it below never blocks a pool thread's io_context
+            if (!metrics_thread.thread.joinable())
+                spawn(metrics_thread);
+        }
+
+        if (std::this_thread::get_id() == metrics_thread.thread.get_id())
+            ret = restart_metrics_server(config);
+        else
+        {
+            std::promise<Status> started;
+            openvpn_io::post(metrics_thread.io_context, [this, &config, &started]()
+                             { started.set_value(restart_metrics_server(config)); });
+            ret = started.get_future().get();
+        }
+        if (!ret.error)
+            metrics_interval_ms.store(config.intervalMS, std::memory_order_release);
+        return ret;
+    }
+
+    void stop_all()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            halt = true;
+        }
+        async_stop.stop();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this]()
+                     { return sessions == 0; });
+    }
+
+    void join()
+    {
+        if (metrics_thread.thread.joinable())
+        {
+            openvpn_io::post(metrics_thread.io_context, [this]()
+                             {
+                stop_metrics_server();
+                metrics_thread.work.reset(); });
+            metrics_thread.thread.join();
+        }
+        for (auto &t : threads)
+        {
+            if (!t->thread.joinable())
+                continue;
+            openvpn_io::post(t->io_context, [t = t.get()]()
+                             { t->work.reset(); });
+            t->thread.join();
+        }
+    }
+
+    int session_count()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<int>(sessions);
+    }
+
+    std::vector<std::unique_ptr<Thread>> threads;
+    Metrics::Ptr metrics{new Metrics};
+
+  private:
+    // called from the metrics thread
+    Status restart_metrics_server(const MetricsConfig &config)
+    {
+        try
+        {
+            stop_metrics_server();
+            if (!config.port.empty())
+            {
+                metrics_server.reset(new WS::MetricsServer(metrics_thread.io_context,
+                                                           metrics,
+                                                           config.address,
+                                                           config.port));
+                metrics_server->start();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            stop_metrics_server();
+            return OpenVPNClient::status_from_exception(e);
+        }
+        return Status();
+    }
+
+    // called from the metrics thread
+    void stop_metrics_server()
+    {
+        if (metrics_server)
+        {
+            metrics_server->stop();
+            metrics_server.reset();
+        }
+    }
+
+    // called from the pool thread
+    void setup_session(OpenVPNClient *client, Thread &t, const unsigned int id)
+    {
+        ClientState *cs = client->state;
+        auto status = std::make_shared<Status>();
+        cs->disconnect_notify = [this, client, &t, status]()
+        {
+            // let the disconnect event finish before ending the session
+            openvpn_io::post(t.io_context, [this, client, &t, status]()
+                             { end_session(client, t, *status); });
+        };
+
+        bool session_started = false;
+        try
+        {
+            client->connect_setup(*status, session_started);
+        }
+        catch (const std::exception &e)
+        {
+            *status = OpenVPNClient::status_from_exception(e);
+        }
+
+        if (status->error)
+        {
+            if (session_started)
+                cs->session->stop(); // ends the session via disconnect_notify
+            else
+                end_session(client, t, *status);
+            return;
+        }
+
+        const int ms = metrics_interval_ms.load(std::memory_order_acquire);
+        if (ms > 0)
+        {
+            cs->metrics_tick.reset(new MyMetricsTick(t.io_context,
+                                                     cs->stats,
+                                                     cs->events,
+                                                     metrics->add(openvpn::to_string(id)),
+                                                     static_cast<unsigned int>(ms)));
+            cs->metrics_tick->schedule();
+        }
+    }
+
+    // called from the pool thread
+    void end_session(OpenVPNClient *client, Thread &t, const Status status)
+    {
+        ClientState *cs = client->state;
+        cs->disconnect_notify = nullptr;
+        cs->clear_async_stop_scopes();
+        if (cs->metrics_tick)
+        {
+            cs->metrics_tick->finish();
+            cs->metrics_tick.reset();
+        }
+        parent->session_done(client, status);
+        session_removed(t);
+    }
+
+    void session_removed(Thread &t)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --t.sessions;
+            --sessions;
+        }
+        done_cv.notify_all();
+    }
+
+    OpenVPNClientHost *parent;
+    Stop async_stop; // global stop of all hosted sessions
+
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    unsigned int sessions = 0;
+    unsigned int next_session_id = 0;
+    bool halt = false;
+
+    std::atomic<int> metrics_interval_ms{0}; // 0: metrics disabled
+    Thread metrics_thread;                   // started by the first start_metrics()
+    WS::MetricsServer::Ptr metrics_server;   // owned by metrics_thread
+};
 }; // namespace Private
 
 OPENVPN_CLIENT_EXPORT OpenVPNClient::OpenVPNClient()
@@ -951,6 +1385,7 @@ OPENVPN_CLIENT_EXPORT void OpenVPNClient::connect_setup(Status &status, bool &se
     if (remote_override_enabled())
         cc.remote_override = &state->remote_override;
     cc.extra_peer_info = state->extra_peer_info;
+    cc.capture = state->capture;
     cc.stop = state->async_stop_local();
     cc.socket_protect = &state->socket_protect;
 #if defined(USE_TUN_BUILDER)
@@ -1059,7 +1494,16 @@ OPENVPN_CLIENT_EXPORT void OpenVPNClient::connect_pre_run()
 
 OPENVPN_CLIENT_EXPORT void OpenVPNClient::connect_run()
 {
-    state->io_context()->run();
+    if (state->clientconf.busyPollUS)
+    {
+        AsioBusyPoll::Config bpconf;
+        bpconf.max_us = state->clientconf.busyPollUS;
+        AsioBusyPoll busy_poll(*state->io_context(), bpconf);
+        busy_poll.run();
+        OPENVPN_LOG("Busy poll: " << busy_poll.to_string());
+    }
+    else
+        state->io_context()->run();
 }
 
 OPENVPN_CLIENT_EXPORT void OpenVPNClient::connect_session_stop()
@@ -1271,6 +1715,26 @@ OPENVPN_CLIENT_EXPORT TransportStats OpenVPNClient::transport_stats() const
     return ret;
 }
 
+OPENVPN_CLIENT_EXPORT DnsCacheStats OpenVPNClient::dns_cache_stats() const
+{
+    DnsCacheStats ret;
+    if (state->is_foreign_thread_access())
+    {
+        MySessionStats *stats = state->stats.get();
+        if (stats)
+        {
+            ret.queries = stats->stat_count(SessionStats::DNS_CACHE_QUERIES);
+            ret.hits = stats->stat_count(SessionStats::DNS_CACHE_HITS);
+            ret.negativeHits = stats->stat_count(SessionStats::DNS_CACHE_NEGATIVE_HITS);
+            ret.coalesced = stats->stat_count(SessionStats::DNS_CACHE_COALESCED);
+            ret.forwarded = stats->stat_count(SessionStats::DNS_CACHE_FORWARDED);
+            if (ret.queries)
+                ret.hitRate = double(ret.hits + ret.negativeHits + ret.coalesced) / double(ret.queries);
+        }
+    }
+    return ret;
+}
+
 OPENVPN_CLIENT_EXPORT void OpenVPNClient::stop()
 {
     if (state->is_foreign_thread_access())
@@ -1317,6 +1781,46 @@ OPENVPN_CLIENT_EXPORT void OpenVPNClient::post_cc_msg(const std::string &msg)
     }
 }
 
+OPENVPN_CLIENT_EXPORT Status OpenVPNClient::start_capture(const CaptureConfig &config)
+{
+    Status ret;
+    try
+    {
+        PacketCapture::Config pc;
+        pc.path = config.path;
+        pc.filter = config.filter;
+        if (config.snaplen > 0)
+            pc.snaplen = config.snaplen;
+        if (config.ringBytes > 0)
+            pc.ring_bytes = config.ringBytes;
+        pc.transport = config.transport;
+        state->capture->start(pc);
+    }
+    catch (const std::exception &e)
+    {
+        ret.error = true;
+        ret.message = Unicode::utf8_printable<std::string>(e.what(), 256);
+    }
+    return ret;
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClient::stop_capture()
+{
+    state->capture->stop();
+}
+
+OPENVPN_CLIENT_EXPORT CaptureStats OpenVPNClient::capture_stats() const
+{
+    const PacketCapture::Stats s = state->capture->stats();
+    CaptureStats ret;
+    ret.running = s.running;
+    ret.captured = s.captured;
+    ret.filtered = s.filtered;
+    ret.dropped = s.dropped;
+    ret.bytesWritten = s.bytes_written;
+    return ret;
+}
+
 OPENVPN_CLIENT_EXPORT void OpenVPNClient::send_app_control_channel_msg(const std::string &protocol, const std::string &msg)
 {
     if (state->is_foreign_thread_access())
@@ -1327,6 +1831,25 @@ OPENVPN_CLIENT_EXPORT void OpenVPNClient::send_app_control_channel_msg(const std
     }
 }
 
+OPENVPN_CLIENT_EXPORT void OpenVPNClient::start_self_test(const SelfTestConfig &config)
+{
+    if (state->is_foreign_thread_access())
+    {
+        ClientConnect *session = state->session.get();
+        if (session)
+        {
+            SelfTest::Initiator::Config c;
+            c.pings = std::max(config.pings, 0);
+            c.ping_interval_ms = std::max(config.pingIntervalMS, 1);
+            c.count = std::max(config.count, 0);
+            c.size = std::max(config.size, 0);
+            c.rate_mbps = std::max(config.rateMbps, 0);
+            c.timeout_ms = std::max(config.timeoutMS, 1);
+            session->thread_safe_start_self_test(c);
+        }
+    }
+}
+
 static SSLLib::SSLAPI::Config::Ptr setup_certcheck_ssl_config(const std::string &client_cert,
                                                               const std::string &extra_certs,
                                                               const std::optional<const std::string> &ca)
@@ -1434,5 +1957,73 @@ OPENVPN_CLIENT_EXPORT OpenVPNClient::~OpenVPNClient()
 {
     delete state;
 }
+
+OPENVPN_CLIENT_EXPORT OpenVPNClientHost::OpenVPNClientHost(int n_threads)
+    : state(new Private::HostState(this))
+{
+    if (n_threads <= 0)
+        n_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int i = 0; i < n_threads; ++i)
+    {
+        state->threads.emplace_back(new Private::HostState::Thread);
+        state->spawn(*state->threads.back());
+    }
+}
+
+OPENVPN_CLIENT_EXPORT OpenVPNClientHost::~OpenVPNClientHost()
+{
+    shutdown();
+    delete state;
+}
+
+OPENVPN_CLIENT_EXPORT Status OpenVPNClientHost::start(OpenVPNClient *client)
+{
+    return state->start(client);
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClientHost::stop_all()
+{
+    state->stop_all();
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClientHost::wait()
+{
+    state->wait();
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClientHost::shutdown()
+{
+    state->stop_all();
+    state->wait();
+    state->join();
+}
+
+OPENVPN_CLIENT_EXPORT int OpenVPNClientHost::thread_count() const
+{
+    return static_cast<int>(state->threads.size());
+}
+
+OPENVPN_CLIENT_EXPORT int OpenVPNClientHost::session_count() const
+{
+    return state->session_count();
+}
+
+OPENVPN_CLIENT_EXPORT Status OpenVPNClientHost::start_metrics(const MetricsConfig &config)
+{
+    return state->start_metrics(config);
+}
+
+OPENVPN_CLIENT_EXPORT std::string OpenVPNClientHost::metrics(bool json) const
+{
+    return json ? state->metrics->json() : state->metrics->prometheus();
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClientHost::session_done(OpenVPNClient *client, const Status &status)
+{
+}
+
+OPENVPN_CLIENT_EXPORT void OpenVPNClientHost::log(const LogInfo &)
+{
+}
 } // namespace ClientAPI
 } // namespace openvpn
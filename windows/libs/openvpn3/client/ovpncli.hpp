@@ -291,6 +291,25 @@ struct ConfigCommon
     bool dco = false;
 #endif
 
+    // Linux: use io_uring for the UDP transport and the tun device,
+    // if built with OPENVPN_IO_URING and supported by the kernel
+    bool ioUring = false;
+
+    // Linux: open the tun device with IFF_VNET_HDR, so that TCP and UDP
+    // segments are coalesced and split with the virtio-net offloads
+    bool vnetHdr = false;
+
+    // Low latency mode: spin on the event loop for up to busyPollUS
+    // microseconds before sleeping, 0 to disable.  The spin budget
+    // adapts to the traffic, and the UDP socket gets SO_BUSY_POLL
+    // set to the same value (Linux).
+    unsigned int busyPollUS = 0;
+
+    // Answer queries to the pushed (plain UDP) DNS servers from a
+    // local cache inside the tunnel, see dns_cache_stats().  Also
+    // enabled by the "dns-cache 1" profile directive.
+    bool dnsCache = false;
+
     // pass through pushed "echo" directives via "ECHO" event
     bool echo = false;
 
@@ -475,6 +494,100 @@ struct TransportStats
     int lastPacketReceived;
 };
 
+// DNS cache stats, see ConfigCommon::dnsCache
+struct DnsCacheStats
+{
+    long long queries = 0;      // queries to the pushed DNS servers
+    long long hits = 0;         // answered from a cached answer
+    long long negativeHits = 0; // answered from a cached NXDOMAIN/NODATA
+    long long coalesced = 0;    // answered with the reply to an identical pending query
+    long long forwarded = 0;    // sent to the DNS server
+
+    // fraction of queries answered without a round trip of their own
+    double hitRate = 0.0;
+};
+
+// used to start a packet capture of tunnel traffic
+// (client writes)
+struct CaptureConfig
+{
+    std::string path;   // pcapng output file
+    std::string filter; // tcpdump-style filter for tunnel packets, empty for all
+    int snaplen = 65535;
+    int ringBytes = 4 * 1024 * 1024;
+    bool transport = false; // also capture encrypted transport packets
+};
+
+// used to pass packet capture stats
+struct CaptureStats
+{
+    bool running;
+    long long captured;
+    long long filtered;
+    long long dropped;
+    long long bytesWritten;
+};
+
+// used to start an in-band throughput and latency self test
+// (client writes)
+struct SelfTestConfig
+{
+    int pings = 20; // ICMP echo requests to the VPN gateway, 0 to skip
+    int pingIntervalMS = 20;
+
+    // padded packets per direction, 0 to skip the throughput test,
+    // which also needs the server to support the "selftest1" ACC protocol
+    int count = 1000;
+    int size = 1200;    // packet size including IP header
+    int rateMbps = 0;   // 0 for as fast as possible
+    int timeoutMS = 5000;
+};
+
+// one direction of the self test throughput measurement
+struct SelfTestThroughput
+{
+    bool defined = false; // false if this direction wasn't measured
+    long long sent = 0;
+    long long received = 0;
+    long long duplicates = 0;
+    long long reordered = 0;
+    double seconds = 0.0; // from first to last packet received
+    double goodputMbps = 0.0;
+    double loss = 0.0; // fraction of packets lost
+};
+
+// self test results
+// (client reads)
+struct SelfTestResult
+{
+    std::string status; // "ok", or why the test ended early
+
+    // round trip times to the VPN gateway
+    int pingsSent = 0;
+    int pingsReceived = 0;
+    double rttMinMS = 0.0;
+    double rttAvgMS = 0.0;
+    double rttP50MS = 0.0;
+    double rttP90MS = 0.0;
+    double rttP99MS = 0.0;
+    double rttMaxMS = 0.0;
+
+    SelfTestThroughput up;   // client to server
+    SelfTestThroughput down; // server to client
+};
+
+// used to pass metrics export settings to OpenVPNClientHost
+struct MetricsConfig
+{
+    // serve GET /metrics (Prometheus text) and /metrics.json over
+    // HTTP on address:port, no listener if port is empty
+    std::string address = "127.0.0.1";
+    std::string port;
+
+    // how often each session publishes its counters
+    int intervalMS = 1000;
+};
+
 // return value of merge_config methods
 struct MergeConfig
 {
@@ -541,6 +654,7 @@ struct RemoteOverride
 
 namespace Private {
 class ClientState;
+class HostState;
 };
 
 /**
@@ -682,12 +796,32 @@ class OpenVPNClient : public TunBuilderBase,             // expose tun builder v
     // return transport stats only
     TransportStats transport_stats() const;
 
+    // return DNS cache stats, all zero if the cache isn't enabled
+    DnsCacheStats dns_cache_stats() const;
+
     // post control channel message
     void post_cc_msg(const std::string &msg);
 
+    // Start capturing tunnel traffic into a pcapng file, replacing a
+    // running capture.  May be called from a different thread, before
+    // or while connect() is running.
+    Status start_capture(const CaptureConfig &config);
+
+    // Stop capturing and close the file.  May be called from a
+    // different thread.
+    void stop_capture();
+
+    // return packet capture stats
+    CaptureStats capture_stats() const;
+
     // send custom app control channel message
     void send_app_control_channel_msg(const std::string &protocol, const std::string &msg);
 
+    // Start an in-band throughput and latency self test on the
+    // connected session.  The result is delivered to self_test_event()
+    // and as a SELF_TEST event.  May be called from a different thread.
+    void start_self_test(const SelfTestConfig &config);
+
     /**
       @brief Start up the cert check handshake using the given certs and key
       @param client_cert String containing the properly encoded client certificate
@@ -722,6 +856,12 @@ class OpenVPNClient : public TunBuilderBase,             // expose tun builder v
     // Call for delivering event from app custom control channel
     virtual void acc_event(const AppCustomControlMessageEvent &) = 0;
 
+    // Callback for delivering self test results.
+    // Will be called from the thread executing connect().
+    virtual void self_test_event(const SelfTestResult &)
+    {
+    }
+
     // Callback for logging.
     // Will be called from the thread executing connect().
     virtual void log(const LogInfo &) override = 0;
@@ -765,6 +905,7 @@ class OpenVPNClient : public TunBuilderBase,             // expose tun builder v
     void process_epki_cert_chain(const ExternalPKICertRequest &);
 
     friend class MyClientEvents;
+    friend class Private::HostState;
     void on_disconnect();
 
     // from ExternalPKIBase
@@ -780,5 +921,70 @@ class OpenVPNClient : public TunBuilderBase,             // expose tun builder v
     OpenVPNClient &operator=(const OpenVPNClient &) = delete;
 };
 
+// Runs many OpenVPNClient sessions on a fixed pool of event-loop
+// threads, as an alternative to calling connect() from a dedicated
+// thread per session.  Each session keeps its own stats, events and
+// stop() as with connect().
+//
+// The client callbacks of a hosted session (event, external PKI,
+// tun builder, ...) are called from the pool thread running it.
+// Since the pool threads are shared, core log output of all hosted
+// sessions goes to the host's log() method rather than to the
+// clients.  Classes overriding log() or session_done() must call
+// shutdown() in their destructor.
+class OpenVPNClientHost : public LogReceiver
+{
+  public:
+    // n_threads <= 0 starts one thread per CPU
+    explicit OpenVPNClientHost(int n_threads = 0);
+    virtual ~OpenVPNClientHost();
+
+    // Start a session for a client that eval_config() and, if needed,
+    // provide_creds() were called on, like connect() but without
+    // blocking.  A client can only be started once, and must not be
+    // destroyed before session_done() was called for it.  Returns an
+    // error if the host was stopped.  Thread-safe.
+    Status start(OpenVPNClient *client);
+
+    // Stop all sessions and refuse new ones.  Thread-safe.
+    void stop_all();
+
+    // Wait until all sessions have ended.  Must not be called from a
+    // pool thread.
+    void wait();
+
+    // stop_all(), wait() and terminate the pool threads
+    void shutdown();
+
+    int thread_count() const;
+
+    // number of sessions started and not yet done
+    int session_count() const;
+
+    // Export the transport, tun and error counters of the sessions
+    // started from here on, per session and aggregated.  Sessions
+    // publish from their own thread, so scrapes never block them.
+    // Can be called again to change the listener, also from a pool
+    // thread.  The listener runs on a thread of its own.
+    Status start_metrics(const MetricsConfig &config);
+
+    // current metrics as Prometheus text, or JSON.  Thread-safe.
+    std::string metrics(bool json = false) const;
+
+    // Called from the pool thread when the session of client has
+    // ended, with the status connect() would have returned.  The
+    // client may be destroyed from here on.
+    virtual void session_done(OpenVPNClient *client, const Status &status);
+
+    // core log output of all hosted sessions, discarded by default
+    void log(const LogInfo &) override;
+
+  private:
+    Private::HostState *state;
+
+    OpenVPNClientHost(const OpenVPNClientHost &) = delete;
+    OpenVPNClientHost &operator=(const OpenVPNClientHost &) = delete;
+};
+
 } // namespace ClientAPI
 } // namespace openvpn
@@ -3,6 +3,7 @@
 // enable director feature for OpenVPNClientBase virtual method callbacks
 %module(directors="1") ovpncli
 %feature("director") OpenVPNClient;
+%feature("director") OpenVPNClientHost;
 
 %include "std_string.i" // for std::string typemaps
 %include "std_vector.i"
@@ -29,6 +30,7 @@
 // modify exported C++ class names to incorporate their enclosing namespace
 %rename(ClientAPI_OpenVPNClient) OpenVPNClient;
 %rename(ClientAPI_OpenVPNClientHelper) OpenVPNClientHelper;
+%rename(ClientAPI_OpenVPNClientHost) OpenVPNClientHost;
 %rename(ClientAPI_TunBuilderBase) TunBuilderBase;
 %rename(ClientAPI_ExternalPKIBase) ExternalPKIBase;
 %rename(ClientAPI_ServerEntry) ServerEntry;
@@ -45,6 +47,13 @@
 %rename(ClientAPI_LogInfo) LogInfo;
 %rename(ClientAPI_InterfaceStats) InterfaceStats;
 %rename(ClientAPI_TransportStats) TransportStats;
+%rename(ClientAPI_DnsCacheStats) DnsCacheStats;
+%rename(ClientAPI_CaptureConfig) CaptureConfig;
+%rename(ClientAPI_CaptureStats) CaptureStats;
+%rename(ClientAPI_SelfTestConfig) SelfTestConfig;
+%rename(ClientAPI_SelfTestThroughput) SelfTestThroughput;
+%rename(ClientAPI_SelfTestResult) SelfTestResult;
+%rename(ClientAPI_MetricsConfig) MetricsConfig;
 %rename(ClientAPI_MergeConfig) MergeConfig;
 %rename(ClientAPI_ExternalPKIRequestBase) ExternalPKIRequestBase;
 %rename(ClientAPI_ExternalPKICertRequest) ExternalPKICertRequest;
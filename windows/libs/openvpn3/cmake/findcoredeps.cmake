@@ -11,6 +11,7 @@ option(USE_MBEDTLS "Use mbed TLS instead of OpenSSL")
 
 option(USE_WERROR "Treat compiler warnings as errors (-Werror)")
 option(USE_WCONVERSION "Enable -Wconversion")
+option(USE_IO_URING "Linux: allow io_uring for the UDP transport and tun device")
 
 if (DEFINED ENV{DEP_DIR})
     message("Overriding DEP_DIR setting with environment variable $ENV{DEP_DIR}")
@@ -149,6 +150,10 @@ function(add_corelibrary_dependencies target)
         target_link_libraries(${target} pthread)
     endif()
 
+    if (USE_IO_URING AND ${CMAKE_SYSTEM_NAME} STREQUAL "Linux")
+        target_compile_definitions(${target} PRIVATE -DOPENVPN_IO_URING)
+    endif ()
+
     target_link_libraries(${target} ${EXTRA_LIBS})
 
     if (USE_WERROR)
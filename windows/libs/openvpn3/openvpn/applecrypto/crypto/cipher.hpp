@@ -53,6 +53,9 @@ class CipherContext
         CIPH_CBC_MODE = 0
     };
 
+    // always encrypt and decrypt into a separate buffer
+    static constexpr bool SUPPORTS_IN_PLACE = false;
+
     CipherContext()
         : cinfo(nullptr), cref(nullptr)
     {
@@ -0,0 +1,180 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Low latency replacement for io_context::run().  When the event loop
+// runs out of ready handlers, it keeps polling the reactor without
+// blocking for up to a spin budget before going to sleep in epoll, so
+// that a packet arriving shortly after the previous one is picked up
+// without paying for a wakeup.  The budget adapts to the observed
+// gaps between events: it grows towards twice the gap while events
+// keep arriving within max_us, and halves while they don't, so an idle
+// loop burns little CPU.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/socktypes.hpp> // for SO_BUSY_POLL
+
+namespace openvpn {
+class AsioBusyPoll
+{
+  public:
+    struct Config
+    {
+        // spin budget bounds in microseconds, max_us == 0 disables spinning
+        unsigned int min_us = 5;
+        unsigned int max_us = 0;
+
+        // estimated cost of an epoll sleep and wakeup, only used to
+        // report the latency saved
+        unsigned int wakeup_cost_us = 20;
+
+        bool enabled() const
+        {
+            return max_us > 0;
+        }
+    };
+
+    struct Stats
+    {
+        std::uint64_t handlers = 0; // handlers run
+        std::uint64_t hits = 0;     // spins that found work, i.e. wakeups avoided
+        std::uint64_t misses = 0;   // spins that ran out of budget
+        std::uint64_t sleeps = 0;   // blocking waits in the reactor
+        std::uint64_t spin_ns = 0;  // time spent spinning, CPU burned
+        unsigned int budget_us = 0; // current spin budget
+
+        std::uint64_t latency_saved_ns(const unsigned int wakeup_cost_us) const
+        {
+            return hits * wakeup_cost_us * 1000;
+        }
+
+        std::string to_string(const unsigned int wakeup_cost_us) const
+        {
+            std::ostringstream os;
+            os << "handlers=" << handlers
+               << " hits=" << hits
+               << " misses=" << misses
+               << " sleeps=" << sleeps
+               << " spin_ms=" << spin_ns / 1000000
+               << " saved_ms=" << latency_saved_ns(wakeup_cost_us) / 1000000
+               << " budget_us=" << budget_us;
+            return os.str();
+        }
+    };
+
+    AsioBusyPoll(openvpn_io::io_context &io_context_arg, const Config &config_arg)
+        : io_context(io_context_arg),
+          config(config_arg)
+    {
+        config.min_us = std::min(config.min_us, config.max_us);
+        stats_.budget_us = config.max_us;
+    }
+
+    // Run the event loop until it runs out of work or is stopped,
+    // with the semantics of io_context::run().  Returns the number
+    // of handlers run.
+    size_t run()
+    {
+        typedef std::chrono::steady_clock clock;
+        size_t n = 0;
+        while (!io_context.stopped())
+        {
+            size_t k = io_context.poll();
+            if (k)
+            {
+                n += k;
+                stats_.handlers += k;
+                continue;
+            }
+            if (io_context.stopped())
+                break;
+
+            // no ready handlers, spin
+            const clock::time_point start = clock::now();
+            const clock::duration budget = std::chrono::microseconds(stats_.budget_us);
+            clock::duration spun;
+            do
+            {
+                k = io_context.poll();
+                spun = clock::now() - start;
+            } while (!k && spun < budget && !io_context.stopped());
+            stats_.spin_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(spun).count();
+            if (k)
+            {
+                ++stats_.hits;
+                n += k;
+                stats_.handlers += k;
+                adapt(spun, true);
+                continue;
+            }
+            if (io_context.stopped())
+                break;
+
+            // out of budget, sleep
+            ++stats_.misses;
+            ++stats_.sleeps;
+            k = io_context.run_one();
+            n += k;
+            stats_.handlers += k;
+            adapt(clock::now() - start, false);
+        }
+        return n;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    std::string to_string() const
+    {
+        return stats_.to_string(config.wakeup_cost_us);
+    }
+
+    // Set SO_BUSY_POLL on a socket, so that a blocking wait on it
+    // busy-polls the device queue for usec microseconds.  Raising
+    // the value above net.core.busy_read requires CAP_NET_ADMIN.
+    template <typename SOCKET>
+    static bool set_socket(SOCKET &sock, const unsigned int usec)
+    {
+#ifdef SO_BUSY_POLL
+        const int value = static_cast<int>(usec);
+        return ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) == 0;
+#else
+        return false;
+#endif
+    }
+
+  private:
+    // gap is the time from running out of handlers to the next event
+    void adapt(const std::chrono::steady_clock::duration gap, const bool hit)
+    {
+        const auto gap_us = std::chrono::duration_cast<std::chrono::microseconds>(gap).count();
+        unsigned int budget = stats_.budget_us;
+        if (gap_us <= config.max_us)
+            budget = std::max(budget, static_cast<unsigned int>(gap_us) * 2);
+        else if (!hit)
+            budget /= 2;
+        stats_.budget_us = std::clamp(budget, config.min_us, config.max_us);
+    }
+
+    openvpn_io::io_context &io_context;
+    Config config;
+    Stats stats_;
+};
+} // namespace openvpn
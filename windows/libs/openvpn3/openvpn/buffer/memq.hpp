@@ -9,14 +9,13 @@
 //    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
 //
 
-// A queue of buffers, implemented as std::deque<BufferPtr>.
+// A queue of buffers, implemented as a lazily allocated std::deque<BufferPtr>.
 
 #ifndef OPENVPN_BUFFER_MEMQ_H
 #define OPENVPN_BUFFER_MEMQ_H
 
-#include <deque>
-
 #include <openvpn/common/size.hpp>
+#include <openvpn/common/lazydeque.hpp>
 #include <openvpn/buffer/buffer.hpp>
 
 namespace openvpn {
@@ -81,8 +80,20 @@ class MemQBase
         q.resize(cap);
     }
 
+    // Free the queue storage if the queue is empty
+    void compact()
+    {
+        q.compact();
+    }
+
+    // Estimated heap bytes held by the queue and the data it holds
+    size_t memory_usage() const
+    {
+        return q.memory_usage() + length;
+    }
+
   protected:
-    typedef std::deque<BufferPtr> q_type;
+    typedef LazyDeque<BufferPtr> q_type;
     size_t length;
     q_type q;
 };
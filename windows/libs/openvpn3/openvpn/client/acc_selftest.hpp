@@ -0,0 +1,990 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// In-band throughput and latency self test.  The test is negotiated
+// over the app custom control channel and measured with ICMP probes
+// that travel over the data channel, so it tells apart a slow tunnel
+// from a slow underlay without leaving the tunnel.
+//
+// A test has three phases:
+//
+//   ping: ICMP echo requests to the VPN gateway.  Any peer answers
+//         these, so RTT and loss are available even if the server
+//         doesn't speak the self test protocol.
+//   up:   the initiator blasts padded data packets to the responder,
+//         which reports what arrived.
+//   down: the responder blasts padded data packets to the initiator.
+//
+// Data packets are unsolicited ICMP echo replies, which a peer that
+// doesn't run the test silently drops.  Every probe carries a
+// ProbeHeader at the start of its ICMP payload.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/frame/frame.hpp>
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/icmp4.hpp>
+#include <openvpn/ip/icmp6.hpp>
+#include <openvpn/ip/ping4.hpp>
+#include <openvpn/ip/ping6.hpp>
+#include <openvpn/time/asiotimer.hpp>
+
+namespace openvpn::SelfTest {
+
+OPENVPN_EXCEPTION(selftest_error);
+
+// ACC protocol that carries the test negotiation
+inline const std::string protocol = "selftest1";
+
+enum Kind : std::uint32_t
+{
+    PING = 1,
+    DATA = 2,
+};
+
+inline std::uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// start of the ICMP payload of a probe, in network byte order
+struct ProbeHeader
+{
+    static constexpr std::uint32_t MAGIC = 0x6f767374; // "ovst"
+
+    std::uint32_t magic;
+    std::uint32_t test_id;
+    std::uint32_t seq;
+    std::uint32_t kind;
+    std::uint32_t time_hi; // sender's clock in ns
+    std::uint32_t time_lo;
+};
+
+struct Probe
+{
+    Kind kind;
+    std::uint32_t test_id;
+    std::uint32_t seq;
+    std::uint64_t time_ns;
+    bool request; // ICMP echo request
+};
+
+// smallest probe, IP and ICMP headers included
+inline size_t min_probe_size(const bool ipv6)
+{
+    return (ipv6 ? sizeof(ICMPv6) : sizeof(ICMPv4)) + sizeof(ProbeHeader);
+}
+
+// Build a probe of size bytes (IP header included) from src to dst.
+// Pings are echo requests, data packets are echo replies.
+inline void make_probe(Buffer &buf,
+                       const IP::Addr &src,
+                       const IP::Addr &dst,
+                       const Kind kind,
+                       const std::uint32_t test_id,
+                       const std::uint32_t seq,
+                       const std::uint64_t time_ns,
+                       size_t size)
+{
+    ProbeHeader h;
+    h.magic = htonl(ProbeHeader::MAGIC);
+    h.test_id = htonl(test_id);
+    h.seq = htonl(seq);
+    h.kind = htonl(kind);
+    h.time_hi = htonl(static_cast<std::uint32_t>(time_ns >> 32));
+    h.time_lo = htonl(static_cast<std::uint32_t>(time_ns));
+
+    const bool ipv6 = src.is_ipv6();
+    size = std::max(size, min_probe_size(ipv6));
+    const auto id = static_cast<std::uint16_t>(test_id);
+    const auto sn = static_cast<std::uint16_t>(seq);
+
+    // a reply is built as a request in the opposite direction and turned around
+    const bool reply = kind == DATA;
+    const IP::Addr &from = reply ? dst : src;
+    const IP::Addr &to = reply ? src : dst;
+    if (ipv6)
+    {
+        Ping6::generate_echo_request(buf, from.to_ipv6(), to.to_ipv6(), &h, sizeof(h), id, sn, size, nullptr);
+        if (reply)
+            Ping6::generate_echo_reply(buf, nullptr);
+    }
+    else
+    {
+        Ping4::generate_echo_request(buf, from.to_ipv4(), to.to_ipv4(), &h, sizeof(h), id, sn, size, nullptr);
+        if (reply)
+            Ping4::generate_echo_reply(buf, nullptr);
+    }
+}
+
+// Returns true if buf is a probe of any test.
+inline bool parse_probe(const Buffer &buf, Probe &probe)
+{
+    if (buf.empty())
+        return false;
+    const std::uint8_t *data = buf.c_data();
+    size_t offset;
+    switch (IPCommon::version(data[0]))
+    {
+    case IPCommon::IPv4:
+        {
+            if (buf.size() < min_probe_size(false))
+                return false;
+            const ICMPv4 *icmp = reinterpret_cast<const ICMPv4 *>(data);
+            if (IPv4Header::length(icmp->head.version_len) != sizeof(IPv4Header)
+                || icmp->head.protocol != IPCommon::ICMPv4)
+                return false;
+            if (icmp->type == ICMPv4::ECHO_REQUEST)
+                probe.request = true;
+            else if (icmp->type == ICMPv4::ECHO_REPLY)
+                probe.request = false;
+            else
+                return false;
+            offset = sizeof(ICMPv4);
+            break;
+        }
+    case IPCommon::IPv6:
+        {
+            if (buf.size() < min_probe_size(true))
+                return false;
+            const ICMPv6 *icmp = reinterpret_cast<const ICMPv6 *>(data);
+            if (icmp->head.nexthdr != IPCommon::ICMPv6)
+                return false;
+            if (icmp->type == ICMPv6::ECHO_REQUEST)
+                probe.request = true;
+            else if (icmp->type == ICMPv6::ECHO_REPLY)
+                probe.request = false;
+            else
+                return false;
+            offset = sizeof(ICMPv6);
+            break;
+        }
+    default:
+        return false;
+    }
+
+    ProbeHeader h;
+    std::memcpy(&h, data + offset, sizeof(h));
+    const std::uint32_t kind = ntohl(h.kind);
+    if (ntohl(h.magic) != ProbeHeader::MAGIC || (kind != PING && kind != DATA))
+        return false;
+    probe.kind = static_cast<Kind>(kind);
+    probe.test_id = ntohl(h.test_id);
+    probe.seq = ntohl(h.seq);
+    probe.time_ns = (std::uint64_t(ntohl(h.time_hi)) << 32) | ntohl(h.time_lo);
+    return true;
+}
+
+// turn a received echo request around in place
+inline void echo_reply(Buffer &buf)
+{
+    if (IPCommon::version(buf[0]) == IPCommon::IPv6)
+        Ping6::generate_echo_reply(buf, nullptr);
+    else
+        Ping4::generate_echo_reply(buf, nullptr);
+}
+
+// Negotiation messages are a verb followed by key=value pairs, e.g.
+// "start id=7 dir=down count=1000 size=1200 src=10.8.0.2 dst=10.8.0.1"
+struct Message
+{
+    Message() = default;
+
+    explicit Message(std::string verb_arg)
+        : verb(std::move(verb_arg))
+    {
+    }
+
+    static Message parse(const std::string &str)
+    {
+        Message m;
+        std::istringstream is(str);
+        is >> m.verb;
+        std::string kv;
+        while (is >> kv)
+        {
+            const size_t eq = kv.find('=');
+            if (eq == std::string::npos)
+                OPENVPN_THROW(selftest_error, "bad message '" << str << '\'');
+            m.args[kv.substr(0, eq)] = kv.substr(eq + 1);
+        }
+        return m;
+    }
+
+    template <typename T>
+    Message &set(const std::string &key, const T &value)
+    {
+        std::ostringstream os;
+        os << value;
+        args[key] = os.str();
+        return *this;
+    }
+
+    const std::string &get(const std::string &key) const
+    {
+        const auto i = args.find(key);
+        if (i == args.end())
+            OPENVPN_THROW(selftest_error, verb << ": missing " << key);
+        return i->second;
+    }
+
+    template <typename T>
+    T get_num(const std::string &key) const
+    {
+        T ret;
+        if (!parse_number(get(key), ret))
+            OPENVPN_THROW(selftest_error, verb << ": bad " << key);
+        return ret;
+    }
+
+    std::string to_string() const
+    {
+        std::string ret = verb;
+        for (const auto &a : args)
+            ret += ' ' + a.first + '=' + a.second;
+        return ret;
+    }
+
+    std::string verb;
+    std::map<std::string, std::string> args;
+};
+
+// one direction of a blast
+struct Throughput
+{
+    bool defined = false;
+    std::uint64_t sent = 0;
+    std::uint64_t received = 0; // distinct packets
+    std::uint64_t duplicates = 0;
+    std::uint64_t reordered = 0; // arrived after a higher sequence number
+    std::uint64_t bytes = 0;     // IP bytes of distinct packets
+    std::uint64_t usec = 0;      // first to last arrival
+
+    double goodput_mbps() const
+    {
+        return usec ? double(bytes) * 8.0 / double(usec) : 0.0;
+    }
+
+    double loss() const
+    {
+        return sent ? double(sent - std::min(received, sent)) / double(sent) : 0.0;
+    }
+
+    // the receiver's report to the sender
+    Message to_message(const std::uint32_t id) const
+    {
+        Message m("result");
+        m.set("id", id)
+            .set("received", received)
+            .set("duplicates", duplicates)
+            .set("reordered", reordered)
+            .set("bytes", bytes)
+            .set("usec", usec);
+        return m;
+    }
+
+    static Throughput from_message(const Message &m, const std::uint64_t sent)
+    {
+        Throughput ret;
+        ret.defined = true;
+        ret.sent = sent;
+        ret.received = m.get_num<std::uint64_t>("received");
+        ret.duplicates = m.get_num<std::uint64_t>("duplicates");
+        ret.reordered = m.get_num<std::uint64_t>("reordered");
+        ret.bytes = m.get_num<std::uint64_t>("bytes");
+        ret.usec = m.get_num<std::uint64_t>("usec");
+        return ret;
+    }
+
+    std::string to_string() const
+    {
+        if (!defined)
+            return "n/a";
+        std::ostringstream os;
+        os << "sent=" << sent
+           << " received=" << received
+           << " loss=" << loss() * 100.0 << '%'
+           << " reordered=" << reordered
+           << " dup=" << duplicates
+           << " goodput_mbps=" << goodput_mbps();
+        return os.str();
+    }
+};
+
+struct Latency
+{
+    std::uint64_t sent = 0;
+    std::uint64_t received = 0;
+    std::vector<double> rtt_ms; // sorted once the phase is over
+
+    double loss() const
+    {
+        return sent ? double(sent - std::min(received, sent)) / double(sent) : 0.0;
+    }
+
+    // p in [0, 100]
+    double percentile(const double p) const
+    {
+        if (rtt_ms.empty())
+            return 0.0;
+        const size_t i = static_cast<size_t>(p / 100.0 * double(rtt_ms.size() - 1) + 0.5);
+        return rtt_ms[std::min(i, rtt_ms.size() - 1)];
+    }
+
+    double avg() const
+    {
+        double sum = 0.0;
+        for (const double r : rtt_ms)
+            sum += r;
+        return rtt_ms.empty() ? 0.0 : sum / double(rtt_ms.size());
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        os << "sent=" << sent
+           << " received=" << received
+           << " loss=" << loss() * 100.0 << '%';
+        if (!rtt_ms.empty())
+            os << " rtt_ms min=" << rtt_ms.front()
+               << " avg=" << avg()
+               << " p50=" << percentile(50)
+               << " p90=" << percentile(90)
+               << " p99=" << percentile(99)
+               << " max=" << rtt_ms.back();
+        return os.str();
+    }
+};
+
+struct Result
+{
+    std::string status = "ok"; // or why the test ended early
+    Latency ping;
+    Throughput up;
+    Throughput down;
+
+    std::string to_string() const
+    {
+        return "status=" + status
+               + " ping[" + ping.to_string() + ']'
+               + " up[" + up.to_string() + ']'
+               + " down[" + down.to_string() + ']';
+    }
+};
+
+// Arrival statistics of a blast, kept by the receiving side
+class Receiver
+{
+  public:
+    void reset(const std::uint32_t count)
+    {
+        seen.assign(count, false);
+        stats = Throughput();
+        stats.defined = true;
+        highest = 0;
+        first_ns = last_ns = 0;
+    }
+
+    void add(const std::uint32_t seq, const size_t size, const std::uint64_t now)
+    {
+        if (seq >= seen.size())
+            return;
+        if (seen[seq])
+        {
+            ++stats.duplicates;
+            return;
+        }
+        seen[seq] = true;
+        if (!stats.received)
+            first_ns = now;
+        else if (seq < highest)
+            ++stats.reordered;
+        highest = std::max(highest, seq);
+        ++stats.received;
+        stats.bytes += size;
+        last_ns = now;
+    }
+
+    Throughput result(const std::uint64_t sent) const
+    {
+        Throughput ret = stats;
+        ret.sent = sent;
+        ret.usec = (last_ns - first_ns) / 1000;
+        return ret;
+    }
+
+  private:
+    std::vector<bool> seen;
+    Throughput stats;
+    std::uint32_t highest = 0;
+    std::uint64_t first_ns = 0;
+    std::uint64_t last_ns = 0;
+};
+
+// implemented by the session that carries the test
+struct Link
+{
+    // send an IP packet over the data channel
+    virtual void selftest_send_packet(BufferAllocated &buf) = 0;
+
+    // send a message on the self test ACC protocol
+    virtual void selftest_send_control(const std::string &msg) = 0;
+
+    // the initiator has finished
+    virtual void selftest_done(const Result &result)
+    {
+    }
+
+    virtual ~Link() = default;
+};
+
+// common part of both ends: sending a blast in batches, yielding to
+// the event loop in between so that the transport can drain
+class Engine : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<Engine> Ptr;
+
+    // Returns true if buf was a probe of this test and was consumed.
+    virtual bool recv_packet(BufferAllocated &buf) = 0;
+
+    // a message received on the self test ACC protocol
+    virtual void recv_control(const std::string &msg) = 0;
+
+    virtual void stop()
+    {
+        halt = true;
+        blast_timer.cancel();
+    }
+
+  protected:
+    Engine(openvpn_io::io_context &io_context_arg,
+           Link &link_arg,
+           Frame::Ptr frame_arg,
+           const unsigned int batch_arg)
+        : io_context(io_context_arg),
+          link(link_arg),
+          frame(std::move(frame_arg)),
+          batch(std::max(batch_arg, 1u)),
+          blast_timer(io_context_arg)
+    {
+    }
+
+    // largest probe that fits a tun buffer
+    size_t max_probe_size() const
+    {
+        return (*frame)[Frame::READ_TUN].payload();
+    }
+
+    void send_control(const Message &m)
+    {
+        link.selftest_send_control(m.to_string());
+    }
+
+    void blast(const std::uint32_t id,
+               const IP::Addr &from,
+               const IP::Addr &to,
+               const std::uint32_t count,
+               const size_t size,
+               const unsigned int rate_mbps)
+    {
+        bl.id = id;
+        bl.from = from;
+        bl.to = to;
+        bl.count = count;
+        bl.size = std::clamp(size, min_probe_size(from.is_ipv6()), max_probe_size());
+        bl.rate_mbps = rate_mbps;
+        bl.next = 0;
+        bl.start_ns = now_ns();
+        blast_batch();
+    }
+
+    // all packets of the blast have been handed to the link
+    virtual void blast_done(const std::uint32_t id, const std::uint32_t sent) = 0;
+
+    openvpn_io::io_context &io_context;
+    Link &link;
+    Frame::Ptr frame;
+    bool halt = false;
+
+  private:
+    void blast_batch()
+    {
+        if (halt)
+            return;
+        for (unsigned int i = 0; i < batch && bl.next < bl.count; ++i, ++bl.next)
+        {
+            BufferAllocated buf;
+            frame->prepare(Frame::READ_TUN, buf);
+            make_probe(buf, bl.from, bl.to, DATA, bl.id, bl.next, now_ns(), bl.size);
+            link.selftest_send_packet(buf);
+            if (halt)
+                return;
+        }
+        if (bl.next == bl.count)
+        {
+            blast_done(bl.id, bl.count);
+            return;
+        }
+
+        if (bl.rate_mbps)
+        {
+            // bits / (Mbit/s) = usec
+            const std::uint64_t due_ns = bl.start_ns + std::uint64_t(bl.next) * bl.size * 8 * 1000 / bl.rate_mbps;
+            const std::uint64_t now = now_ns();
+            if (due_ns > now + 1000000)
+            {
+                blast_timer.expires_after(Time::Duration::milliseconds((due_ns - now) / 1000000));
+                blast_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
+                                       {
+                                           OPENVPN_ASYNC_HANDLER;
+                                           if (!error)
+                                               self->blast_batch(); });
+                return;
+            }
+        }
+        openvpn_io::post(io_context, [self = Ptr(this)]()
+                         {
+                             OPENVPN_ASYNC_HANDLER;
+                             self->blast_batch(); });
+    }
+
+    struct Blast
+    {
+        std::uint32_t id = 0;
+        IP::Addr from;
+        IP::Addr to;
+        std::uint32_t count = 0;
+        std::uint32_t next = 0;
+        size_t size = 0;
+        unsigned int rate_mbps = 0;
+        std::uint64_t start_ns = 0;
+    };
+
+    const unsigned int batch;
+    Blast bl;
+    AsioTimer blast_timer;
+};
+
+// client side, runs the three phases and reports a Result
+class Initiator : public Engine
+{
+  public:
+    typedef RCPtr<Initiator> Ptr;
+
+    struct Config
+    {
+        unsigned int pings = 20; // 0 skips the ping phase
+        unsigned int ping_interval_ms = 20;
+        unsigned int count = 1000; // packets per blast, 0 skips up and down
+        unsigned int size = 1200;  // probe size including IP header
+        unsigned int rate_mbps = 0; // blast rate, 0 for as fast as possible
+        unsigned int batch = 32;    // packets sent per event loop turn
+        unsigned int timeout_ms = 5000; // give up after this long without progress
+        unsigned int drain_ms = 200;    // wait for stragglers after the end of a blast
+    };
+
+    // local and peer are the VPN addresses of both ends.  Without
+    // peer_supported only the ping phase runs.
+    Initiator(openvpn_io::io_context &io_context_arg,
+              Link &link_arg,
+              Frame::Ptr frame_arg,
+              const Config &config_arg,
+              const IP::Addr &local_arg,
+              const IP::Addr &peer_arg,
+              const bool peer_supported_arg,
+              const std::uint32_t test_id_arg)
+        : Engine(io_context_arg, link_arg, std::move(frame_arg), config_arg.batch),
+          config(config_arg),
+          local(local_arg),
+          peer(peer_arg),
+          peer_supported(peer_supported_arg),
+          test_id(test_id_arg),
+          timer(io_context_arg)
+    {
+        if (local.version() != peer.version())
+            throw selftest_error("local and peer address family differ");
+        config.size = static_cast<unsigned int>(std::clamp(size_t(config.size), min_probe_size(local.is_ipv6()), max_probe_size()));
+    }
+
+    void start()
+    {
+        if (config.pings)
+        {
+            phase = PINGING;
+            ping_seen.assign(config.pings, false);
+            send_ping();
+        }
+        else
+            next_phase();
+    }
+
+    bool finished() const
+    {
+        return phase == DONE;
+    }
+
+    const Result &result() const
+    {
+        return result_;
+    }
+
+    std::uint32_t id() const
+    {
+        return test_id;
+    }
+
+    bool recv_packet(BufferAllocated &buf) override
+    {
+        Probe p;
+        if (phase == DONE || !parse_probe(buf, p) || p.test_id != test_id || p.request)
+            return false;
+        const std::uint64_t now = now_ns();
+        if (p.kind == PING)
+        {
+            if (phase == PINGING && p.seq < ping_seen.size() && !ping_seen[p.seq])
+            {
+                ping_seen[p.seq] = true;
+                ++result_.ping.received;
+                result_.ping.rtt_ms.push_back(double(now - p.time_ns) / 1e6);
+                if (result_.ping.received == config.pings)
+                    next_phase();
+            }
+        }
+        else if (phase == DOWN)
+        {
+            receiver.add(p.seq, buf.size(), now);
+            progress_ns = now;
+        }
+        return true;
+    }
+
+    void recv_control(const std::string &msg) override
+    {
+        if (phase == DONE)
+            return;
+        const Message m = Message::parse(msg);
+        if (m.get_num<std::uint32_t>("id") != test_id)
+            return;
+        if (m.verb == "result" && phase == UP)
+        {
+            result_.up = Throughput::from_message(m, config.count);
+            next_phase();
+        }
+        else if (m.verb == "end" && phase == DOWN)
+        {
+            // the end may overtake the last packets, give them a moment
+            down_sent = m.get_num<std::uint64_t>("sent");
+            schedule(config.drain_ms);
+        }
+        else if (m.verb == "error")
+            finish("peer error: " + m.get("text"));
+    }
+
+    void stop() override
+    {
+        Engine::stop();
+        timer.cancel();
+        if (phase != DONE)
+        {
+            phase = DONE;
+            result_.status = "stopped";
+        }
+    }
+
+  private:
+    enum Phase
+    {
+        IDLE,
+        PINGING,
+        UP,
+        DOWN,
+        DONE,
+    };
+
+    void send_ping()
+    {
+        BufferAllocated buf;
+        frame->prepare(Frame::READ_TUN, buf);
+        make_probe(buf, local, peer, PING, test_id, static_cast<std::uint32_t>(result_.ping.sent), now_ns(), config.size);
+        ++result_.ping.sent;
+        link.selftest_send_packet(buf);
+        if (halt)
+            return;
+
+        // after the last ping, wait for the replies
+        schedule(result_.ping.sent < config.pings ? config.ping_interval_ms : config.timeout_ms);
+    }
+
+    void next_phase()
+    {
+        timer.cancel();
+        progress_ns = now_ns();
+        switch (phase)
+        {
+        case IDLE:
+        case PINGING:
+            std::sort(result_.ping.rtt_ms.begin(), result_.ping.rtt_ms.end());
+            if (!config.count)
+                finish("ok");
+            else if (!peer_supported)
+                finish("peer doesn't support " + protocol + ", throughput not measured");
+            else
+            {
+                phase = UP;
+                send_control(start_message("up"));
+                blast(test_id, local, peer, config.count, config.size, config.rate_mbps);
+            }
+            break;
+        case UP:
+            phase = DOWN;
+            receiver.reset(config.count);
+            send_control(start_message("down"));
+            schedule(config.timeout_ms);
+            break;
+        case DOWN:
+            result_.down = receiver.result(down_sent);
+            finish("ok");
+            break;
+        case DONE:
+            break;
+        }
+    }
+
+    Message start_message(const std::string &dir) const
+    {
+        Message m("start");
+        m.set("id", test_id)
+            .set("dir", dir)
+            .set("count", config.count)
+            .set("size", config.size)
+            .set("rate", config.rate_mbps)
+            .set("src", local.to_string())
+            .set("dst", peer.to_string());
+        return m;
+    }
+
+    void blast_done(const std::uint32_t id, const std::uint32_t sent) override
+    {
+        // the responder waits drain_ms before it reports
+        Message m("end");
+        m.set("id", id).set("sent", sent).set("drain", config.drain_ms);
+        send_control(m);
+        schedule(config.drain_ms + config.timeout_ms);
+    }
+
+    void schedule(const unsigned int ms)
+    {
+        timer.expires_after(Time::Duration::milliseconds(ms));
+        timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
+                         {
+                             OPENVPN_ASYNC_HANDLER;
+                             if (!error)
+                                 self->timer_callback(); });
+    }
+
+    void timer_callback()
+    {
+        if (halt || phase == DONE)
+            return;
+        switch (phase)
+        {
+        case PINGING:
+            if (result_.ping.sent < config.pings)
+                send_ping();
+            else
+                next_phase(); // out of time for the missing replies
+            break;
+        case UP:
+            finish("timeout waiting for the up result");
+            break;
+        case DOWN:
+            if (down_sent)
+                next_phase();
+            else
+            {
+                // time out only once packets have stopped coming
+                const std::uint64_t idle_ms = (now_ns() - progress_ns) / 1000000;
+                if (idle_ms >= config.timeout_ms)
+                    finish("timeout waiting for the down blast");
+                else
+                    schedule(static_cast<unsigned int>(config.timeout_ms - idle_ms));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void finish(const std::string &status)
+    {
+        timer.cancel();
+        halt = true;
+        phase = DONE;
+        result_.status = status;
+        link.selftest_done(result_);
+    }
+
+    Config config;
+    IP::Addr local;
+    IP::Addr peer;
+    bool peer_supported;
+    std::uint32_t test_id;
+    Phase phase = IDLE;
+    Result result_;
+    std::vector<bool> ping_seen;
+    Receiver receiver;
+    std::uint64_t down_sent = 0;
+    std::uint64_t progress_ns = 0;
+    AsioTimer timer;
+};
+
+// Peer side: answers pings, counts the up blast and sends the down
+// blast.  Used by a server session, or back to back in tests.
+class Responder : public Engine
+{
+  public:
+    typedef RCPtr<Responder> Ptr;
+
+    struct Config
+    {
+        unsigned int max_count = 100000; // largest blast accepted
+        unsigned int batch = 32;
+        unsigned int max_drain_ms = 5000; // cap on the wait the initiator asks for
+    };
+
+    Responder(openvpn_io::io_context &io_context_arg,
+              Link &link_arg,
+              Frame::Ptr frame_arg,
+              const Config &config_arg)
+        : Engine(io_context_arg, link_arg, std::move(frame_arg), config_arg.batch),
+          config(config_arg),
+          drain_timer(io_context_arg)
+    {
+    }
+
+    bool recv_packet(BufferAllocated &buf) override
+    {
+        Probe p;
+        if (halt || !parse_probe(buf, p))
+            return false;
+        if (p.kind == PING && p.request)
+        {
+            // answer here, so that the probe never reaches the host
+            echo_reply(buf);
+            link.selftest_send_packet(buf);
+        }
+        else if (p.kind == DATA && !p.request && up_active && p.test_id == up_id)
+            receiver.add(p.seq, buf.size(), now_ns());
+        return true;
+    }
+
+    void recv_control(const std::string &msg) override
+    {
+        if (halt)
+            return;
+        const Message m = Message::parse(msg);
+        const std::uint32_t id = m.get_num<std::uint32_t>("id");
+        try
+        {
+            if (m.verb == "start")
+            {
+                const std::uint32_t count = m.get_num<std::uint32_t>("count");
+                if (count > config.max_count)
+                    OPENVPN_THROW(selftest_error, "count " << count << " exceeds " << config.max_count);
+                const std::string &dir = m.get("dir");
+                if (dir == "up")
+                {
+                    up_id = id;
+                    up_active = true;
+                    receiver.reset(count);
+                }
+                else if (dir == "down")
+                {
+                    // back to the initiator
+                    const IP::Addr src = IP::Addr::from_string(m.get("src"));
+                    const IP::Addr dst = IP::Addr::from_string(m.get("dst"));
+                    if (src.version() != dst.version())
+                        throw selftest_error("start: address family mismatch");
+                    blast(id, dst, src, count, m.get_num<size_t>("size"), m.get_num<unsigned int>("rate"));
+                }
+                else
+                    OPENVPN_THROW(selftest_error, "start: bad dir " << dir);
+            }
+            else if (m.verb == "end" && up_active && id == up_id)
+            {
+                const std::uint64_t sent = m.get_num<std::uint64_t>("sent");
+                const unsigned int drain_ms = std::min(m.get_num<unsigned int>("drain"), config.max_drain_ms);
+                drain_timer.expires_after(Time::Duration::milliseconds(drain_ms));
+                drain_timer.async_wait([self = Ptr(this), id, sent](const openvpn_io::error_code &error)
+                                       {
+                                           OPENVPN_ASYNC_HANDLER;
+                                           if (!error)
+                                               self->report_up(id, sent); });
+            }
+        }
+        catch (const std::exception &e)
+        {
+            Message err("error");
+            std::string text = e.what();
+            std::replace(text.begin(), text.end(), ' ', '_');
+            err.set("id", id).set("text", text);
+            send_control(err);
+        }
+    }
+
+    void stop() override
+    {
+        Engine::stop();
+        drain_timer.cancel();
+    }
+
+  private:
+    void report_up(const std::uint32_t id, const std::uint64_t sent)
+    {
+        if (halt || !up_active || id != up_id)
+            return;
+        up_active = false;
+        send_control(receiver.result(sent).to_message(id));
+    }
+
+    void blast_done(const std::uint32_t id, const std::uint32_t sent) override
+    {
+        Message m("end");
+        m.set("id", id).set("sent", sent);
+        send_control(m);
+    }
+
+    Config config;
+    Receiver receiver;
+    std::uint32_t up_id = 0;
+    bool up_active = false;
+    AsioTimer drain_timer;
+};
+
+} // namespace openvpn::SelfTest
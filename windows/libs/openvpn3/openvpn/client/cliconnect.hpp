@@ -294,6 +294,23 @@ class ClientConnect : ClientProto::NotifyCallback,
         }
     }
 
+    void start_self_test(const SelfTest::Initiator::Config &config)
+    {
+        if (!halt && client)
+            client->start_self_test(config);
+    }
+
+    void thread_safe_start_self_test(const SelfTest::Initiator::Config &config)
+    {
+        if (!halt)
+        {
+            openvpn_io::post(io_context, [self = Ptr(this), config]()
+                             {
+                OPENVPN_ASYNC_HANDLER;
+                self->start_self_test(config); });
+        }
+    }
+
     ~ClientConnect()
     {
         stop();
@@ -23,6 +23,7 @@
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/rc.hpp>
 #include <openvpn/transport/protocol.hpp>
+#include <openvpn/client/acc_selftest.hpp>
 
 #ifdef HAVE_JSON
 #include <openvpn/common/jsonhelper.hpp>
@@ -55,6 +56,8 @@ enum Type
     RELAY,
     COMPRESSION_ENABLED,
     UNSUPPORTED_FEATURE,
+    PATH_MTU,
+    SELF_TEST,
 
     // start of nonfatal errors, must be marked by NONFATAL_ERROR_START below
     TRANSPORT_ERROR,
@@ -128,6 +131,8 @@ inline const char *event_name(const Type type)
         "RELAY",
         "COMPRESSION_ENABLED",
         "UNSUPPORTED_FEATURE",
+        "PATH_MTU",
+        "SELF_TEST",
 
         // nonfatal errors
         "TRANSPORT_ERROR",
@@ -725,6 +730,43 @@ struct Info : public ReasonBase
     }
 };
 
+/**
+ * The data channel path MTU discovered by probing changed.  mtu is the
+ * largest tunnel packet that reaches the peer without fragmentation in
+ * the underlay, mssfix the resulting TCP MSS clamp (0 if disabled).
+ */
+struct PathMTU : public Base
+{
+    PathMTU(const size_t mtu_arg, const unsigned int mssfix_arg, std::string state_arg)
+        : Base(PATH_MTU), mtu(mtu_arg), mssfix(mssfix_arg), state(std::move(state_arg))
+    {
+    }
+
+    std::string render() const override
+    {
+        return "mtu=" + std::to_string(mtu) + " mssfix=" + std::to_string(mssfix) + " [" + state + ']';
+    }
+
+    size_t mtu;
+    unsigned int mssfix;
+    std::string state;
+};
+
+struct SelfTestResult : public Base
+{
+    SelfTestResult(SelfTest::Result result_arg)
+        : Base(SELF_TEST), result(std::move(result_arg))
+    {
+    }
+
+    std::string render() const override
+    {
+        return result.to_string();
+    }
+
+    SelfTest::Result result;
+};
+
 /**
  * Message to signal a custom app control message from the peer
  */
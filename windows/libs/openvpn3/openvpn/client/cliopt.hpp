@@ -166,6 +166,7 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         int default_key_direction = -1;
 
         PeerInfo::Set::Ptr extra_peer_info;
+        PacketCapture::Ptr capture;
 #ifdef OPENVPN_PLATFORM_ANDROID
         bool enable_route_emulation = true;
 #endif
@@ -201,6 +202,7 @@ class ClientOptions : public RC<thread_unsafe_refcount>
           reconnect_notify(config.reconnect_notify),
           cli_stats(config.cli_stats),
           cli_events(config.cli_events),
+          capture(config.capture),
           server_poll_timeout_(10),
           tcp_queue_limit(64),
           proto_context_options(config.proto_context_options),
@@ -241,6 +243,17 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         // TCP queue limit
         tcp_queue_limit = opt.get_num<decltype(tcp_queue_limit)>("tcp-queue-limit", 1, tcp_queue_limit, 1, 65536);
 
+        // per-flow scheduling of tun packets on TCP transports
+        tcp_queue_fq = opt.get_num<unsigned int>("tcp-queue-fq", 1, tcp_queue_fq, 0, 1);
+        tcp_queue_fq_config.byte_limit = opt.get_num<size_t>("tcp-queue-bytes", 1, tcp_queue_fq_config.byte_limit, 16 * 1024, 64 * 1024 * 1024);
+
+        // data channel path MTU discovery
+        pmtud = opt.get_num<unsigned int>("pmtu-discovery", 1, pmtud, 0, 1);
+
+        // local cache for queries to the pushed DNS servers
+        dns_cache = opt.get_num<unsigned int>("dns-cache", 1, config.clientconf.dnsCache, 0, 1);
+        dns_cache_config.max_entries = opt.get_num<size_t>("dns-cache-size", 1, dns_cache_config.max_entries, 1, 1024 * 1024);
+
         // route-nopull
         pushed_options_filter.reset(new PushedOptionsFilter(opt));
 
@@ -443,6 +456,8 @@ class ClientOptions : public RC<thread_unsafe_refcount>
                 tunconf->stats = cli_stats;
                 if (config.clientconf.tunPersist)
                     tunconf->tun_persist.reset(new TunLinux::TunPersist(true, TunWrapObjRetain::NO_RETAIN, nullptr));
+                tunconf->vnet_hdr = config.clientconf.vnetHdr;
+                tunconf->io_uring = config.clientconf.ioUring;
                 tunconf->load(opt);
                 tun_factory = tunconf;
             }
@@ -1162,6 +1177,12 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         cli_config->creds = creds;
         cli_config->pushed_options_filter = pushed_options_filter;
         cli_config->tcp_queue_limit = tcp_queue_limit;
+        cli_config->tcp_queue_fq = tcp_queue_fq;
+        cli_config->tcp_queue_fq_config = tcp_queue_fq_config;
+        cli_config->pmtud = pmtud;
+        cli_config->dns_cache = dns_cache;
+        cli_config->dns_cache_config = dns_cache_config;
+        cli_config->capture = capture;
         cli_config->echo = clientconf.echo;
         cli_config->info = clientconf.info;
         cli_config->autologin_sessions = autologin_sessions;
@@ -1324,6 +1345,7 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         cp->set_xmit_creds(!autologin || pcc.hasEmbeddedPassword() || autologin_sessions);
         cp->extra_peer_info = build_peer_info(config, pcc, autologin_sessions);
         cp->extra_peer_info_push_peerinfo = pcc.pushPeerInfo();
+        cp->pmtu_probe_advertise = pmtud;
         cp->frame = frame;
         cp->now = &now_;
         cp->rng = rng;
@@ -1411,6 +1433,8 @@ class ClientOptions : public RC<thread_unsafe_refcount>
                 udpconf->stats = cli_stats;
                 udpconf->socket_protect = socket_protect;
                 udpconf->server_addr_float = server_addr_float;
+                udpconf->io_uring = clientconf.ioUring;
+                udpconf->busy_poll = clientconf.busyPollUS;
 #ifdef OPENVPN_GREMLIN
                 udpconf->gremlin_config = gremlin_config;
 #endif
@@ -1462,9 +1486,15 @@ class ClientOptions : public RC<thread_unsafe_refcount>
     ReconnectNotify *reconnect_notify;
     SessionStats::Ptr cli_stats;
     ClientEvent::Queue::Ptr cli_events;
+    PacketCapture::Ptr capture;
     ClientCreds::Ptr creds;
     unsigned int server_poll_timeout_;
     unsigned int tcp_queue_limit;
+    bool tcp_queue_fq = false;
+    FQCoDel::Config tcp_queue_fq_config;
+    bool pmtud = true;
+    bool dns_cache = false;
+    DnsStub::Config dns_cache_config;
     ProtoContextCompressionOptions::Ptr proto_context_options;
     HTTPProxyTransport::Options::Ptr http_proxy_options;
 #ifdef OPENVPN_GREMLIN
@@ -300,19 +300,12 @@ class ParseClientConfig
                 protoConfig->load(options, ProtoContextCompressionOptions(), -1, false);
             }
 
-            unsigned int lflags = SSLConfigAPI::LF_PARSE_MODE;
-
-            // ssl lib configuration
-            try
-            {
-                sslConfig.reset(new SSLLib::SSLAPI::Config());
-                sslConfig->set_rng(new SSLLib::RandomAPI());
-                sslConfig->load(options, lflags);
-            }
-            catch (...)
-            {
-                sslConfig.reset();
-            }
+            // ssl lib configuration -- parsing the PEM blocks is expensive for large
+            // CA bundles and only needed to render the config, so just keep the
+            // relevant options here and build the SSL config in ssl_config()
+            for (const char *name : ssl_option_names)
+                sslOptions_.extend(options, name);
+            sslOptions_.update_map();
         }
         catch (const option_error &e)
         {
@@ -561,7 +554,7 @@ class ParseClientConfig
         }
 
         // SSL parameters
-        if (sslConfig)
+        if (const SSLLib::SSLAPI::Config *sslConfig = ssl_config())
         {
             print_pem(os, "ca", sslConfig->extract_ca());
             print_pem(os, "crl", sslConfig->extract_crl());
@@ -636,7 +629,7 @@ class ParseClientConfig
         }
 
         // SSL parameters
-        if (sslConfig)
+        if (const SSLLib::SSLAPI::Config *sslConfig = ssl_config())
         {
             json_pem(root, "ca", sslConfig->extract_ca());
             json_pem(root, "crl", sslConfig->extract_crl());
@@ -680,6 +673,51 @@ class ParseClientConfig
 #endif /* HAVE_CONFIG_JSONCPP */
 
   private:
+    // options consumed by SSLAPI::Config::load()
+    static constexpr const char *ssl_option_names[] = {
+        "client",
+        "sni",
+        "ca",
+        "crl-verify",
+        "cert",
+        "extra-certs",
+        "key",
+        "dh",
+        "ns-cert-type",
+        "remote-cert-tls",
+        "remote-cert-ku",
+        "remote-cert-eku",
+        "tls-remote",
+        "verify-x509-name",
+        "peer-fingerprint",
+        "tls-version-min",
+        "tls-cert-profile",
+        "tls-cipher",
+        "tls-ciphersuites",
+        "tls-groups",
+    };
+
+    // Build the SSL configuration on first use, returns nullptr if the
+    // profile's SSL parameters could not be loaded.
+    const SSLLib::SSLAPI::Config *ssl_config() const
+    {
+        if (!sslConfigLoaded_)
+        {
+            sslConfigLoaded_ = true;
+            try
+            {
+                sslConfig.reset(new SSLLib::SSLAPI::Config());
+                sslConfig->set_rng(new SSLLib::RandomAPI());
+                sslConfig->load(sslOptions_, SSLConfigAPI::LF_PARSE_MODE);
+            }
+            catch (...)
+            {
+                sslConfig.reset();
+            }
+        }
+        return sslConfig.get();
+    }
+
     static void print_pem(std::ostream &os, std::string label, std::string pem)
     {
         if (pem.empty())
@@ -800,7 +838,9 @@ class ParseClientConfig
     RemoteItem firstRemoteListItem_;
     PeerInfo::Set::Ptr peerInfoUV_;
     ProtoContext::ProtoConfig::Ptr protoConfig;
-    SSLLib::SSLAPI::Config::Ptr sslConfig;
+    OptionList sslOptions_;
+    mutable SSLLib::SSLAPI::Config::Ptr sslConfig;
+    mutable bool sslConfigLoaded_ = false;
     std::string dev;
     std::string windowsDriver_;
 };
@@ -42,16 +42,23 @@ using namespace std::chrono_literals;
 #include <openvpn/common/base64.hpp>
 #include <openvpn/common/clamp_typerange.hpp>
 #include <openvpn/ip/ptb.hpp>
+#include <openvpn/ip/flowhash.hpp>
 #include <openvpn/tun/client/tunbase.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/client/relay.hpp>
+#include <openvpn/transport/fqcodel.hpp>
+#include <openvpn/transport/dplpmtud.hpp>
+#include <openvpn/log/packetcapture.hpp>
 #include <openvpn/options/continuation.hpp>
 #include <openvpn/options/sanitize.hpp>
 #include <openvpn/client/acc_certcheck.hpp>
+#include <openvpn/client/acc_selftest.hpp>
 #include <openvpn/client/clievent.hpp>
 #include <openvpn/client/clicreds.hpp>
 #include <openvpn/client/cliconstants.hpp>
 #include <openvpn/client/clihalt.hpp>
+#include <openvpn/client/dns.hpp>
+#include <openvpn/client/dnsstub.hpp>
 #include <openvpn/client/optfilt.hpp>
 #include <openvpn/time/asiotimer.hpp>
 #include <openvpn/time/coarsetime.hpp>
@@ -90,6 +97,8 @@ struct NotifyCallback
 class Session : ProtoContextCallbackInterface,
                 TransportClientParent,
                 TunClientParent,
+                SelfTest::Link,
+                DnsStub::Link,
                 public RC<thread_unsafe_refcount>
 {
     static inline const std::string certcheckProto = "cck1";
@@ -134,6 +143,13 @@ class Session : ProtoContextCallbackInterface,
         OptionList::Limits pushed_options_limit;
         OptionList::FilterBase::Ptr pushed_options_filter;
         unsigned int tcp_queue_limit = 0;
+        bool tcp_queue_fq = false;         // schedule tun packets per flow on queued (TCP) transports
+        FQCoDel::Config tcp_queue_fq_config;
+        bool pmtud = false; // probe the path MTU if the server supports it (UDP only)
+        PathMTUDiscovery::Config pmtud_config;
+        bool dns_cache = false; // answer queries to the pushed DNS servers from a local cache
+        DnsStub::Config dns_cache_config;
+        PacketCapture::Ptr capture; // runtime packet capture, may be null
         bool echo = false;
         bool info = false;
         bool autologin_sessions = false;
@@ -147,6 +163,13 @@ class Session : ProtoContextCallbackInterface,
           transport_factory(config.transport_factory),
           tun_factory(config.tun_factory),
           tcp_queue_limit(config.tcp_queue_limit),
+          tcp_queue_fq(config.tcp_queue_fq),
+          tcp_queue_fq_config(config.tcp_queue_fq_config),
+          pmtud_enabled(config.pmtud),
+          pmtud_config(config.pmtud_config),
+          dns_cache(config.dns_cache),
+          dns_cache_config(config.dns_cache_config),
+          capture(config.capture),
           notify_callback(notify_callback_arg),
           housekeeping_timer(io_context_arg),
           push_request_timer(io_context_arg),
@@ -160,7 +183,8 @@ class Session : ProtoContextCallbackInterface,
           pushed_options_limit(config.pushed_options_limit),
           pushed_options_filter(config.pushed_options_filter),
           inactive_timer(io_context_arg),
-          info_hold_timer(io_context_arg)
+          info_hold_timer(io_context_arg),
+          pmtud_timer(io_context_arg)
     {
 #ifdef OPENVPN_PACKET_LOG
         packet_log.open(OPENVPN_PACKET_LOG, std::ios::binary);
@@ -191,6 +215,11 @@ class Session : ProtoContextCallbackInterface,
             // initialize transport-layer packet handler
             transport = transport_factory->new_transport_client_obj(io_context, this);
             transport_has_send_queue = transport->transport_has_send_queue();
+            if (transport_has_send_queue && tcp_queue_fq)
+            {
+                tcp_fq.reset(new FQCoDel(tcp_queue_fq_config));
+                tcp_fq_seed = proto_context.conf().prng->rand_get<std::uint32_t>();
+            }
             if (transport_factory->is_relay())
                 transport_connecting();
             else
@@ -279,6 +308,9 @@ class Session : ProtoContextCallbackInterface,
             inactive_timer.cancel();
 
             info_hold_timer.cancel();
+            pmtud_timer.cancel();
+            if (selftest)
+                selftest->stop();
             if (notify_callback && call_terminate_callback)
                 notify_callback->client_proto_terminate();
             if (tun)
@@ -336,6 +368,57 @@ class Session : ProtoContextCallbackInterface,
         do_acc_certcheck(std::string(""));
     }
 
+    /**
+      @brief Starts the in-band throughput and latency self test
+      @param config test parameters
+
+      Pings the VPN gateway and, if the server announced support for the
+      self test ACC protocol, blasts data channel packets in both
+      directions.  A test already running is abandoned.  The outcome is
+      reported with a ClientEvent::SelfTestResult.
+    */
+    void start_self_test(const SelfTest::Initiator::Config &config)
+    {
+        if (halt)
+            return;
+        if (selftest)
+            selftest->stop();
+        try
+        {
+            if (!connected_ || !tun)
+                throw SelfTest::selftest_error("not connected");
+            IP::Addr local, peer;
+            if (!tun->vpn_ip4().empty() && !tun->vpn_gw4().empty())
+            {
+                local = IP::Addr::from_string(tun->vpn_ip4());
+                peer = IP::Addr::from_string(tun->vpn_gw4());
+            }
+            else if (!tun->vpn_ip6().empty() && !tun->vpn_gw6().empty())
+            {
+                local = IP::Addr::from_string(tun->vpn_ip6());
+                peer = IP::Addr::from_string(tun->vpn_gw6());
+            }
+            else
+                throw SelfTest::selftest_error("no VPN gateway address");
+
+            selftest.reset(new SelfTest::Initiator(io_context,
+                                                   *this,
+                                                   proto_context.conf().frame,
+                                                   config,
+                                                   local,
+                                                   peer,
+                                                   proto_context.conf().app_control_config.supports_protocol(SelfTest::protocol),
+                                                   ++selftest_id));
+            selftest->start();
+        }
+        catch (const std::exception &e)
+        {
+            SelfTest::Result result;
+            result.status = e.what();
+            selftest_done(result);
+        }
+    }
+
     virtual ~Session()
     {
         stop(false);
@@ -354,6 +437,9 @@ class Session : ProtoContextCallbackInterface,
         {
             OPENVPN_LOG_CLIPROTO("Transport RECV " << server_endpoint_render() << ' ' << proto_context.dump_packet(buf));
 
+            if (capture)
+                capture->transport_packet(buf, PacketCapture::IN);
+
             // update current time
             proto_context.update_now();
 
@@ -381,8 +467,16 @@ class Session : ProtoContextCallbackInterface,
 #ifdef OPENVPN_PACKET_LOG
                     log_packet(buf, false);
 #endif
-                    // make packet appear as incoming on tun interface
-                    if (tun)
+                    if (capture)
+                        capture->tun_packet(buf, PacketCapture::IN);
+
+                    // DNS responses are cached on the way
+                    if (dns_stub)
+                        dns_stub->response(buf, proto_context.now());
+
+                    // make packet appear as incoming on tun interface,
+                    // unless it's a probe of a running self test
+                    if (tun && !(selftest && selftest->recv_packet(buf)))
                     {
                         OPENVPN_LOG_CLIPROTO("TUN send, size=" << buf.size());
                         tun->tun_send(buf);
@@ -426,6 +520,24 @@ class Session : ProtoContextCallbackInterface,
 
     void transport_needs_send() override
     {
+        if (tcp_fq && !halt)
+        {
+            try
+            {
+                proto_context.update_now();
+                tcp_fq_send();
+            }
+            catch (const std::exception &e)
+            {
+                process_exception(e, "transport_needs_send");
+            }
+        }
+    }
+
+    // Per-flow scheduler in front of a queued (TCP) transport, or nullptr
+    const FQCoDel *tcp_queue_scheduler() const
+    {
+        return tcp_fq.get();
     }
 
     // tun i/o driver calls here with incoming packets
@@ -442,53 +554,52 @@ class Session : ProtoContextCallbackInterface,
 #ifdef OPENVPN_PACKET_LOG
             log_packet(buf, true);
 #endif
+            if (capture)
+                capture->tun_packet(buf, PacketCapture::OUT);
 
-            // if transport layer has an output queue, check if it's full
-            if (transport_has_send_queue)
-            {
-                if (transport->transport_send_queue_size() > tcp_queue_limit)
-                {
-                    buf.reset_size(); // queue full, drop packet
-                    cli_stats->error(Error::TCP_OVERFLOW);
-                }
-            }
+            // answered by the DNS stub
+            if (dns_stub && dns_stub->query(buf, proto_context.now()))
+                return;
 
-            // encrypt packet
-            if (buf.size())
+            if (tcp_fq)
             {
-                const ProtoContext::ProtoConfig &c = proto_context.conf();
-
-                bool df = true;
-
-                if (IPCommon::version(buf[0]) == IPCommon::IPv4 && buf.size() >= sizeof(struct IPv4Header))
+                // hold the packet in the per-flow scheduler and pass packets
+                // on while the transport queue is short
+                if (buf.size())
                 {
-                    df = IPv4Header::is_df_set(buf.c_data());
-                }
+                    const std::uint32_t flow = IPFlow::hash(buf.c_data(), buf.size(), tcp_fq_seed);
 
-                // when calculating mss, we take IPv4 and TCP headers into account
-                // here we need to add it back since we check the whole IP packet size, not just TCP payload
-                constexpr size_t MinTcpHeader = 20;
-                constexpr size_t MinIpHeader = 20;
-                size_t mss_no_tcp_ip_encap = c.mss_fix + (MinTcpHeader + MinIpHeader);
+                    // trade the packet for the storage of an already sent one
+                    BufferPtr pkt;
+                    if (tcp_fq_free.empty())
+                        pkt = BufferAllocatedRc::Create();
+                    else
+                    {
+                        pkt = std::move(tcp_fq_free.back());
+                        tcp_fq_free.pop_back();
+                    }
+                    pkt->swap(buf);
 
-                if (df && c.mss_fix > 0 && buf.size() > mss_no_tcp_ip_encap)
-                {
-                    Ptb::generate_icmp_ptb(buf, clamp_to_typerange<unsigned short>(mss_no_tcp_ip_encap));
-                    tun->tun_send(buf);
+                    const size_t dropped = tcp_fq->enqueue(std::move(pkt), flow, proto_context.now());
+                    for (size_t i = 0; i < dropped; ++i)
+                        cli_stats->error(Error::TCP_OVERFLOW);
                 }
-                else
+                tcp_fq_send();
+            }
+            else
+            {
+                // if transport layer has an output queue, check if it's full
+                if (transport_has_send_queue)
                 {
-                    proto_context.data_encrypt(buf);
-                    if (buf.size())
+                    if (transport->transport_send_queue_size() > tcp_queue_limit)
                     {
-                        // send packet via transport to destination
-                        OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(buf));
-                        if (transport->transport_send(buf))
-                            proto_context.update_last_sent();
-                        else if (halt)
-                            return;
+                        buf.reset_size(); // queue full, drop packet
+                        cli_stats->error(Error::TCP_OVERFLOW);
                     }
                 }
+
+                if (!tun_send_packet(buf))
+                    return;
             }
 
             // do a lightweight flush
@@ -503,6 +614,142 @@ class Session : ProtoContextCallbackInterface,
         }
     }
 
+    // Move packets from the per-flow scheduler to the transport until the
+    // transport send queue holds TCP_FQ_LINK_PACKETS packets.  Keeping that
+    // queue short is what lets the scheduler decide the sending order.
+    void tcp_fq_send()
+    {
+        const Time &now = proto_context.now();
+        const std::uint64_t codel_drops = tcp_fq->stats().codel_drops;
+        bool sent = true;
+        while (sent && transport->transport_send_queue_size() < TCP_FQ_LINK_PACKETS)
+        {
+            BufferPtr pkt = tcp_fq->dequeue(now);
+            if (!pkt)
+                break;
+            sent = tun_send_packet(*pkt);
+            if (tcp_fq_free.size() < TCP_FQ_FREE_BUFFERS)
+                tcp_fq_free.push_back(std::move(pkt));
+        }
+
+        // packets CoDel dropped for excess sojourn time while dequeueing
+        for (std::uint64_t i = codel_drops; i < tcp_fq->stats().codel_drops; ++i)
+            cli_stats->error(Error::TCP_OVERFLOW);
+    }
+
+    // encrypt a packet from tun and send it via transport, returns false
+    // if the session was halted while sending
+    bool tun_send_packet(BufferAllocated &buf)
+    {
+        // encrypt packet
+        if (buf.size())
+        {
+            const ProtoContext::ProtoConfig &c = proto_context.conf();
+
+            bool df = true;
+
+            if (IPCommon::version(buf[0]) == IPCommon::IPv4 && buf.size() >= sizeof(struct IPv4Header))
+            {
+                df = IPv4Header::is_df_set(buf.c_data());
+            }
+
+            // when calculating mss, we take IPv4 and TCP headers into account
+            // here we need to add it back since we check the whole IP packet size, not just TCP payload
+            constexpr size_t MinTcpHeader = 20;
+            constexpr size_t MinIpHeader = 20;
+            size_t mss_no_tcp_ip_encap = c.mss_fix + (MinTcpHeader + MinIpHeader);
+
+            if (df && c.mss_fix > 0 && buf.size() > mss_no_tcp_ip_encap)
+            {
+                Ptb::generate_icmp_ptb(buf, clamp_to_typerange<unsigned short>(mss_no_tcp_ip_encap));
+                tun->tun_send(buf);
+            }
+            else
+                return data_send(buf);
+        }
+        return true;
+    }
+
+    // encrypt a packet and send it via transport, returns false if the
+    // session was halted while sending
+    bool data_send(BufferAllocated &buf)
+    {
+        proto_context.data_encrypt(buf);
+        if (buf.size())
+        {
+            // send packet via transport to destination
+            OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(buf));
+            if (capture)
+                capture->transport_packet(buf, PacketCapture::OUT);
+            if (transport->transport_send(buf))
+                proto_context.update_last_sent();
+            else if (halt)
+                return false;
+        }
+        return true;
+    }
+
+    // SelfTest::Link: probes bypass the mssfix check of tun_send_packet
+    void selftest_send_packet(BufferAllocated &buf) override
+    {
+        if (halt)
+            return;
+        try
+        {
+            proto_context.update_now();
+            data_send(buf);
+        }
+        catch (const std::exception &e)
+        {
+            process_exception(e, "selftest_send_packet");
+        }
+    }
+
+    void selftest_send_control(const std::string &msg) override
+    {
+        if (!halt)
+            post_app_control_message(SelfTest::protocol, msg);
+    }
+
+    void selftest_done(const SelfTest::Result &result) override
+    {
+        OPENVPN_LOG("Self test: " << result.to_string());
+        ClientEvent::Base::Ptr ev = new ClientEvent::SelfTestResult(result);
+        cli_events->add_event(std::move(ev));
+    }
+
+    // DnsStub::Link
+    void dns_stub_reply(BufferAllocated &buf) override
+    {
+        if (tun)
+            tun->tun_send(buf);
+    }
+
+    // (Re)start the DNS stub on the plain DNS servers of the pushed
+    // options.  Without any, queries go to the servers as usual.
+    void start_dns_stub()
+    {
+        if (!dns_cache)
+            return;
+        try
+        {
+            const DnsOptionsParser dns(received_options, false);
+            if (!dns_stub)
+                dns_stub.reset(new DnsStub::Stub(*this, proto_context.conf().frame, cli_stats, dns_cache_config));
+            dns_stub->set_servers(dns);
+            if (!dns_stub->enabled())
+            {
+                OPENVPN_LOG("DNS cache: no plain DNS servers pushed");
+                dns_stub.reset();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG("DNS cache: " << e.what());
+            dns_stub.reset();
+        }
+    }
+
     // Return true if keepalive parameter(s) are enabled.
     bool is_keepalive_enabled() const override
     {
@@ -722,6 +969,8 @@ class Session : ProtoContextCallbackInterface,
     void control_net_send(const Buffer &net_buf) override
     {
         OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(net_buf));
+        if (capture)
+            capture->transport_packet(net_buf, PacketCapture::OUT);
         if (transport->transport_send_const(net_buf))
             proto_context.update_last_sent();
     }
@@ -929,6 +1178,7 @@ class Session : ProtoContextCallbackInterface,
             {
                 tun->apply_push_update(received_options, *transport);
             }
+            start_dns_stub();
         }
     }
 
@@ -1003,6 +1253,18 @@ class Session : ProtoContextCallbackInterface,
         {
             do_acc_certcheck(app_proto_msg);
         }
+        else if (proto == SelfTest::protocol) // built-in as well, negotiates the self test
+        {
+            try
+            {
+                if (selftest)
+                    selftest->recv_control(app_proto_msg);
+            }
+            catch (const std::exception &e)
+            {
+                OPENVPN_LOG("Self test: " << e.what());
+            }
+        }
         else if (proto_context.conf().app_control_config.supports_protocol(proto))
         {
             ClientEvent::Base::Ptr ev = new ClientEvent::AppCustomControlMessage(std::move(proto), std::move(app_proto_msg));
@@ -1121,6 +1383,9 @@ class Session : ProtoContextCallbackInterface,
                 // we got pushed options and initializated crypto - now we can push mss to dco
                 tun->adjust_mss(proto_context.conf().mss_fix);
 
+                // start path MTU discovery if the server answers probes
+                pmtud_start();
+
                 // Allow ProtoContext to suggest an alignment adjustment
                 // hint for transport layer.
                 transport->reset_align_adjust(proto_context.align_adjust_hint());
@@ -1207,6 +1472,8 @@ class Session : ProtoContextCallbackInterface,
         }
         ev->tun_name = tun->tun_name();
         connected_ = std::move(ev);
+
+        start_dns_stub();
     }
 
     void tun_error(const Error::Type fatal_err, const std::string &err_text) override
@@ -1553,6 +1820,107 @@ class Session : ProtoContextCallbackInterface,
         }
     }
 
+    void pmtud_start()
+    {
+        const ProtoContext::ProtoConfig &c = proto_context.conf();
+        if (!pmtud_enabled || !c.pmtu_probe || !c.protocol.is_udp() || c.dc_deferred)
+            return;
+
+        // search up to the tun MTU, the largest packet we will ever send
+        PathMTUDiscovery::Config pc = pmtud_config;
+        pc.max_plpmtu = c.tun_mtu ? c.tun_mtu : TUN_MTU_DEFAULT;
+        if (pc.max_plpmtu <= pc.base_plpmtu)
+            return;
+
+        pmtud_static_mss_fix = c.mss_fix;
+        pmtud = PathMTUDiscovery(pc);
+        pmtud.start(proto_context.now());
+        pmtud_poll();
+    }
+
+    void pmtu_probe_acked(std::uint32_t seq, size_t size) override
+    {
+        if (pmtud.acked(seq, size, proto_context.now()))
+            pmtud_poll();
+    }
+
+    void pmtud_callback(const openvpn_io::error_code &e)
+    {
+        try
+        {
+            if (!e && !halt)
+            {
+                proto_context.update_now();
+                pmtud_poll();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            process_exception(e, "pmtud_callback");
+        }
+    }
+
+    // send a probe if one is due, apply the current path MTU and
+    // reschedule the timer
+    void pmtud_poll()
+    {
+        PathMTUDiscovery::Probe probe;
+        if (pmtud.poll(proto_context.now(), probe))
+            proto_context.send_pmtu_probe(probe.seq, probe.size);
+
+        pmtud_update();
+
+        if (pmtud.next_event().defined())
+        {
+            pmtud_timer.expires_at(pmtud.next_event());
+            pmtud_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
+                                   {
+                                       OPENVPN_ASYNC_HANDLER;
+                                       self->pmtud_callback(error); });
+        }
+    }
+
+    // Clamp MSS and ICMP PTB generation to the path MTU.  The search only
+    // ever lowers the configured mssfix, and only once a probe confirmed
+    // the size or a black hole was detected; the assumed base size alone
+    // leaves mssfix as configured.  It is restored once the whole tun MTU
+    // is known to get through.
+    void pmtud_update()
+    {
+        const size_t mtu = pmtud.plpmtu();
+        const PathMTUDiscovery::State state = pmtud.state();
+        ProtoContext::ProtoConfig &c = proto_context.conf();
+
+        constexpr size_t MinTcpHeader = 20;
+        constexpr size_t MinIpHeader = 20;
+        unsigned int mss_fix = pmtud_static_mss_fix;
+        if (pmtud.plpmtu_known() && mtu < pmtud.config().max_plpmtu && mtu > MinTcpHeader + MinIpHeader)
+        {
+            const auto mss = static_cast<unsigned int>(mtu - (MinTcpHeader + MinIpHeader));
+            if (!mss_fix || mss < mss_fix)
+                mss_fix = mss;
+        }
+        if (mss_fix != c.mss_fix)
+        {
+            c.mss_fix = mss_fix;
+            tun->adjust_mss(mss_fix);
+        }
+
+        // report results, and falling back to the base size after a
+        // black hole was detected
+        const bool settled = state == PathMTUDiscovery::SEARCH_COMPLETE
+                             || state == PathMTUDiscovery::ERROR
+                             || (state == PathMTUDiscovery::BASE && pmtud_reported_mtu);
+        if (settled && (mtu != pmtud_reported_mtu || state != pmtud_reported_state))
+        {
+            OPENVPN_LOG("Path MTU " << mtu << " (" << PathMTUDiscovery::state_name(state) << "), mssfix=" << mss_fix);
+            pmtud_reported_mtu = mtu;
+            pmtud_reported_state = state;
+            ClientEvent::Base::Ptr ev = new ClientEvent::PathMTU(mtu, mss_fix, PathMTUDiscovery::state_name(state));
+            cli_events->add_event(std::move(ev));
+        }
+    }
+
     void process_echo(const OptionList &opt)
     {
         OptionList::IndexMap::const_iterator echo_opt = opt.map().find("echo");
@@ -1657,6 +2025,30 @@ class Session : ProtoContextCallbackInterface,
     unsigned int tcp_queue_limit;
     bool transport_has_send_queue = false;
 
+    // packets handed to a queued transport ahead of the per-flow scheduler
+    static constexpr size_t TCP_FQ_LINK_PACKETS = 4;
+    bool tcp_queue_fq;
+    FQCoDel::Config tcp_queue_fq_config;
+    std::unique_ptr<FQCoDel> tcp_fq;
+    std::uint32_t tcp_fq_seed = 0;
+
+    // sent packets kept for the storage of the next ones tun_recv queues
+    static constexpr size_t TCP_FQ_FREE_BUFFERS = 64;
+    std::vector<BufferPtr> tcp_fq_free;
+
+    bool pmtud_enabled;
+    PathMTUDiscovery::Config pmtud_config;
+    PathMTUDiscovery pmtud;
+    unsigned int pmtud_static_mss_fix = 0;
+    size_t pmtud_reported_mtu = 0;
+    PathMTUDiscovery::State pmtud_reported_state = PathMTUDiscovery::DISABLED;
+
+    bool dns_cache;
+    DnsStub::Config dns_cache_config;
+    DnsStub::Stub::Ptr dns_stub;
+
+    PacketCapture::Ptr capture;
+
     NotifyCallback *notify_callback;
 
     CoarseTime housekeeping_schedule;
@@ -1700,6 +2092,7 @@ class Session : ProtoContextCallbackInterface,
 
     std::unique_ptr<std::vector<ClientEvent::Base::Ptr>> info_hold;
     AsioTimer info_hold_timer;
+    AsioTimer pmtud_timer;
 
     // AUTH_FAILED,TEMP flag values
     std::chrono::milliseconds temp_fail_backoff_{0};
@@ -1708,6 +2101,9 @@ class Session : ProtoContextCallbackInterface,
     // Client side certcheck
     AccHandshaker certcheck_hs;
 
+    SelfTest::Initiator::Ptr selftest;
+    std::uint32_t selftest_id = 0;
+
 #ifdef OPENVPN_PACKET_LOG
     std::ofstream packet_log;
 #endif
@@ -0,0 +1,761 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Caching DNS stub for the pushed name servers.  UDP queries from the
+// tun to a pushed plain DNS server are looked up in a cache first and
+// answered locally on a hit, so that repeated lookups don't cost a
+// round trip through the tunnel.  Misses travel on to the server as
+// usual, and the responses coming back are cached on the way to the
+// tun:
+//
+//   - entries live for the smallest TTL of the answer, capped by
+//     Config::max_ttl, and the TTLs of a cached answer count down
+//   - NXDOMAIN and NODATA answers are cached for the SOA minimum of
+//     the authority section (RFC 2308), capped by max_negative_ttl
+//   - while a query is on its way to the server, the same query from
+//     other clients waits for its response instead of being sent too
+//   - truncated and failed responses aren't cached
+//   - only a response that matches the ID, client and question of a
+//     query on its way to the server is cached, so that an unsolicited
+//     response cannot poison the cache
+//
+// The stub only looks at the packets, it never sends queries itself.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/frame/frame.hpp>
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/ip/udp.hpp>
+#include <openvpn/ip/csum.hpp>
+#include <openvpn/ip/ping6.hpp>
+#include <openvpn/log/sessionstats.hpp>
+#include <openvpn/time/time.hpp>
+#include <openvpn/client/dns_options.hpp>
+
+namespace openvpn::DnsStub {
+
+struct Config
+{
+    size_t max_entries = 1024;
+    unsigned int max_ttl = 3600;         // seconds
+    unsigned int max_negative_ttl = 300; // seconds
+
+    // a query that got no response within this time is sent to the
+    // server again instead of waiting for the earlier one
+    unsigned int forward_timeout_ms = 2000;
+
+    size_t max_pending = 256; // queries on their way to the server
+    size_t max_waiters = 32;  // per pending query
+};
+
+// receives the answers made up by the stub
+struct Link
+{
+    virtual void dns_stub_reply(BufferAllocated &buf) = 0;
+    virtual ~Link() = default;
+};
+
+// DNS wire format, RFC 1035
+namespace Message {
+
+enum
+{
+    HEADER_SIZE = 12,
+    MAX_NAME = 255,
+    PORT = 53,
+
+    QR = 0x8000,
+    OPCODE_MASK = 0x7800,
+    TC = 0x0200,
+    CD = 0x0010,
+    RCODE_MASK = 0x000f,
+
+    NOERROR = 0,
+    NXDOMAIN = 3,
+
+    TYPE_SOA = 6,
+    TYPE_OPT = 41,
+    EDNS_DO = 0x8000,
+};
+
+inline std::uint16_t get16(const std::uint8_t *p)
+{
+    return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline std::uint32_t get32(const std::uint8_t *p)
+{
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void put16(std::uint8_t *p, const std::uint16_t v)
+{
+    p[0] = static_cast<std::uint8_t>(v >> 8);
+    p[1] = static_cast<std::uint8_t>(v);
+}
+
+inline void put32(std::uint8_t *p, const std::uint32_t v)
+{
+    p[0] = static_cast<std::uint8_t>(v >> 24);
+    p[1] = static_cast<std::uint8_t>(v >> 16);
+    p[2] = static_cast<std::uint8_t>(v >> 8);
+    p[3] = static_cast<std::uint8_t>(v);
+}
+
+// Offset past a possibly compressed name at off, 0 if malformed.
+inline size_t skip_name(const std::uint8_t *msg, const size_t len, size_t off)
+{
+    while (off < len)
+    {
+        const std::uint8_t l = msg[off];
+        if ((l & 0xc0) == 0xc0)
+            return off + 2 <= len ? off + 2 : 0;
+        if (l & 0xc0)
+            return 0;
+        off += 1 + l;
+        if (!l)
+            return off;
+    }
+    return 0;
+}
+
+// The question of a message with exactly one, as cache key: the
+// lowercased name followed by type and class, the CD flag and the
+// EDNS DO bit, which both change what a server answers.  Returns the
+// offset past the question, or 0.
+inline size_t question_key(const std::uint8_t *msg, const size_t len, std::string &key)
+{
+    if (len < HEADER_SIZE || get16(msg + 4) != 1)
+        return 0;
+    key.clear();
+    size_t off = HEADER_SIZE;
+    while (true)
+    {
+        if (off >= len)
+            return 0;
+        const std::uint8_t l = msg[off++];
+        if (l & 0xc0) // no compression in the question of a query
+            return 0;
+        key += static_cast<char>(l);
+        if (!l)
+            break;
+        if (off + l > len || key.size() + l > MAX_NAME)
+            return 0;
+        for (size_t i = 0; i < l; ++i)
+        {
+            const char c = static_cast<char>(msg[off + i]);
+            key += (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+        }
+        off += l;
+    }
+    if (off + 4 > len)
+        return 0;
+    key.append(reinterpret_cast<const char *>(msg + off), 4);
+    off += 4;
+
+    // find the OPT record among the additional records
+    bool dnssec_ok = false;
+    size_t rr = off;
+    const unsigned int n_rr = get16(msg + 6) + get16(msg + 8) + get16(msg + 10);
+    for (unsigned int i = 0; i < n_rr; ++i)
+    {
+        rr = skip_name(msg, len, rr);
+        if (!rr || rr + 10 > len)
+            break;
+        if (get16(msg + rr) == TYPE_OPT)
+            dnssec_ok = get16(msg + rr + 6) & EDNS_DO;
+        rr += 10 + get16(msg + rr + 8);
+    }
+    key += static_cast<char>(((get16(msg + 2) & CD) ? 1 : 0) | (dnssec_ok ? 2 : 0));
+    return off;
+}
+
+// Key of a standard query that may be answered from the cache, see
+// question_key().  Returns the offset past the question, or 0.
+inline size_t parse_query(const std::uint8_t *msg, const size_t len, std::string &key)
+{
+    if (len < HEADER_SIZE
+        || (get16(msg + 2) & (QR | OPCODE_MASK))
+        || get16(msg + 6)
+        || get16(msg + 8))
+        return 0;
+    return question_key(msg, len, key);
+}
+
+struct Response
+{
+    size_t question_end = 0;
+    bool cacheable = false;
+    bool negative = false;
+    std::uint32_t ttl = 0;
+
+    // offsets of the TTL fields of all records but OPT
+    std::vector<std::uint16_t> ttl_offsets;
+};
+
+// Parse a response to a standard query.  Returns false if msg isn't
+// one, r.cacheable tells if it may be cached and for how long.
+inline bool parse_response(const std::uint8_t *msg, const size_t len, std::string &key, Response &r)
+{
+    if (len < HEADER_SIZE || len > 0xffff)
+        return false;
+    const std::uint16_t flags = get16(msg + 2);
+    if (!(flags & QR) || (flags & OPCODE_MASK))
+        return false;
+    r.question_end = question_key(msg, len, key);
+    if (!r.question_end)
+        return false;
+
+    const unsigned int n_answer = get16(msg + 6);
+    const unsigned int n_authority = get16(msg + 8);
+    const unsigned int n_rr = n_answer + n_authority + get16(msg + 10);
+    const unsigned int rcode = flags & RCODE_MASK;
+    r.negative = rcode == NXDOMAIN || (rcode == NOERROR && !n_answer);
+    r.ttl = 0xffffffff;
+    r.ttl_offsets.clear();
+    bool soa = false;
+
+    size_t off = r.question_end;
+    for (unsigned int i = 0; i < n_rr; ++i)
+    {
+        off = skip_name(msg, len, off);
+        if (!off || off + 10 > len)
+            return false;
+        const std::uint16_t type = get16(msg + off);
+        const std::uint32_t ttl = get32(msg + off + 4);
+        const size_t rdlen = get16(msg + off + 8);
+        if (off + 10 + rdlen > len)
+            return false;
+        if (type != TYPE_OPT)
+            r.ttl_offsets.push_back(static_cast<std::uint16_t>(off + 4));
+        if (i < n_answer && !r.negative)
+            r.ttl = std::min(r.ttl, ttl);
+        else if (r.negative && i >= n_answer && i < n_answer + n_authority && type == TYPE_SOA && rdlen >= 20)
+        {
+            // the SOA MINIMUM field ends the record
+            r.ttl = std::min({r.ttl, ttl, get32(msg + off + 10 + rdlen - 4)});
+            soa = true;
+        }
+        off += 10 + rdlen;
+    }
+
+    r.cacheable = !(flags & TC)
+                  && (rcode == NOERROR || rcode == NXDOMAIN)
+                  && (!r.negative || soa)
+                  && r.ttl > 0 && r.ttl != 0xffffffff;
+    return true;
+}
+
+} // namespace Message
+
+struct Stats
+{
+    count_t queries = 0;
+    count_t hits = 0;
+    count_t negative_hits = 0;
+    count_t coalesced = 0;
+    count_t forwarded = 0;
+
+    double hit_rate() const
+    {
+        return queries ? double(hits + negative_hits + coalesced) / double(queries) : 0.0;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        os << "queries=" << queries << " hits=" << hits << " negative_hits=" << negative_hits
+           << " coalesced=" << coalesced << " forwarded=" << forwarded
+           << " hit_rate=" << hit_rate();
+        return os.str();
+    }
+};
+
+class Stub : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<Stub> Ptr;
+
+    Stub(Link &link_arg,
+         Frame::Ptr frame_arg,
+         SessionStats::Ptr stats_arg,
+         const Config &config_arg)
+        : link(link_arg),
+          frame(std::move(frame_arg)),
+          session_stats(std::move(stats_arg)),
+          config(config_arg)
+    {
+    }
+
+    // The plain DNS servers of the pushed DNS options.  The cache is
+    // dropped if they changed.
+    void set_servers(const DnsOptions &dns)
+    {
+        std::vector<Address> s;
+        for (const auto &server : dns.servers)
+        {
+            if (server.second.transport != DnsServer::Transport::Unset
+                && server.second.transport != DnsServer::Transport::Plain)
+                continue;
+            for (const auto &a : server.second.addresses)
+            {
+                if (a.port && a.port != Message::PORT)
+                    continue;
+                try
+                {
+                    s.push_back(Address(IP::Addr::from_string(a.address)));
+                }
+                catch (const std::exception &)
+                {
+                }
+            }
+        }
+        if (s != servers)
+        {
+            servers = std::move(s);
+            clear();
+        }
+    }
+
+    bool enabled() const
+    {
+        return !servers.empty();
+    }
+
+    void clear()
+    {
+        cache.clear();
+        lru.clear();
+        pending.clear();
+    }
+
+    // A packet from the tun.  Returns true if it was a query that has
+    // been answered from the cache or waits for an earlier one, false
+    // if it has to go to the server.
+    bool query(const Buffer &buf, const Time &now)
+    {
+        Packet pkt;
+        if (!parse_packet(buf, true, pkt))
+            return false;
+        const size_t question_end = Message::parse_query(pkt.dns, pkt.dns_len, key);
+        if (!question_end)
+            return false;
+        count(SessionStats::DNS_CACHE_QUERIES, stats_.queries);
+
+        const std::uint16_t id = Message::get16(pkt.dns);
+        const std::string question(reinterpret_cast<const char *>(pkt.dns + Message::HEADER_SIZE),
+                                   question_end - Message::HEADER_SIZE);
+
+        auto ci = cache.find(key);
+        if (ci != cache.end())
+        {
+            Entry &e = ci->second;
+            if (now < e.expires)
+            {
+                if (e.negative)
+                    count(SessionStats::DNS_CACHE_NEGATIVE_HITS, stats_.negative_hits);
+                else
+                    count(SessionStats::DNS_CACHE_HITS, stats_.hits);
+                lru.splice(lru.begin(), lru, e.lru);
+                const std::uint32_t age = static_cast<std::uint32_t>((now - e.stored).to_seconds());
+                reply(pkt.ep, e.msg, id, question, &e.ttl_offsets, age);
+                return true;
+            }
+            lru.erase(e.lru);
+            cache.erase(ci);
+        }
+
+        const Waiter w{pkt.ep, id, question};
+        auto pi = pending.find(key);
+        if (pi != pending.end())
+        {
+            Pending &p = pi->second;
+            if (now < p.forwarded + Time::Duration::milliseconds(config.forward_timeout_ms))
+            {
+                // a retransmission of a waiting query is answered with it
+                if (p.waiting(w))
+                    return true;
+                if (p.waiters.size() < config.max_waiters)
+                {
+                    p.waiters.push_back(w);
+                    count(SessionStats::DNS_CACHE_COALESCED, stats_.coalesced);
+                    return true;
+                }
+            }
+            else
+            {
+                // the earlier query got no response, send this one
+                p.forwarded = now;
+                if (!p.waiting(w) && p.waiters.size() < config.max_waiters)
+                    p.waiters.push_back(w);
+            }
+        }
+        else
+        {
+            if (pending.size() >= config.max_pending)
+                expire_pending(now);
+            if (pending.size() < config.max_pending)
+            {
+                Pending &p = pending[key];
+                p.forwarded = now;
+                p.waiters.push_back(w);
+            }
+        }
+        count(SessionStats::DNS_CACHE_FORWARDED, stats_.forwarded);
+        return false;
+    }
+
+    // A packet on its way to the tun.  A response from a server to a
+    // pending query is cached and also answers the queries that waited
+    // for it; the packet itself goes on to the tun.
+    void response(const Buffer &buf, const Time &now)
+    {
+        Packet pkt;
+        if (!parse_packet(buf, false, pkt))
+            return;
+        Message::Response r;
+        if (!Message::parse_response(pkt.dns, pkt.dns_len, key, r))
+            return;
+
+        // the key matched the name and type, the addressee must be
+        // a waiter which sent the same question with the same ID
+        auto pi = pending.find(key);
+        if (pi == pending.end())
+            return;
+        const Waiter addressee{pkt.ep,
+                               Message::get16(pkt.dns),
+                               std::string(reinterpret_cast<const char *>(pkt.dns + Message::HEADER_SIZE),
+                                           r.question_end - Message::HEADER_SIZE)};
+        const std::vector<Waiter> &waiters = pi->second.waiters;
+        const auto ai = std::find_if(waiters.begin(), waiters.end(), [&addressee](const Waiter &w)
+                                     { return w.id == addressee.id && w.ep == addressee.ep && w.question == addressee.question; });
+        if (ai == waiters.end())
+            return;
+
+        if (r.cacheable)
+            store(pkt.dns, pkt.dns_len, r, now);
+
+        const std::vector<std::uint8_t> msg(pkt.dns, pkt.dns + pkt.dns_len);
+        for (const auto &w : waiters)
+        {
+            // the addressee of the response has it already
+            if (w.id != addressee.id || !(w.ep == addressee.ep))
+                reply(w.ep, msg, w.id, w.question, nullptr, 0);
+        }
+        pending.erase(pi);
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    size_t size() const
+    {
+        return cache.size();
+    }
+
+  private:
+    struct Address
+    {
+        Address() = default;
+
+        explicit Address(const IP::Addr &a)
+            : ipv6(a.is_ipv6())
+        {
+            a.to_byte_string_variable(bytes);
+        }
+
+        bool operator==(const Address &other) const
+        {
+            return ipv6 == other.ipv6 && !std::memcmp(bytes, other.bytes, ipv6 ? 16 : 4);
+        }
+
+        bool ipv6 = false;
+        std::uint8_t bytes[16] = {};
+    };
+
+    // the client and server end of a query
+    struct Endpoints
+    {
+        bool operator==(const Endpoints &other) const
+        {
+            return client == other.client && server == other.server && client_port == other.client_port;
+        }
+
+        Address client;
+        Address server;
+        std::uint16_t client_port = 0; // network byte order
+    };
+
+    struct Packet
+    {
+        Endpoints ep;
+        const std::uint8_t *dns = nullptr;
+        size_t dns_len = 0;
+    };
+
+    struct Waiter
+    {
+        Endpoints ep;
+        std::uint16_t id;
+        std::string question; // as the client sent it, letter case included
+    };
+
+    struct Pending
+    {
+        bool waiting(const Waiter &w) const
+        {
+            for (const auto &e : waiters)
+                if (e.id == w.id && e.ep == w.ep)
+                    return true;
+            return false;
+        }
+
+        Time forwarded;
+        std::vector<Waiter> waiters;
+    };
+
+    struct Entry
+    {
+        std::vector<std::uint8_t> msg;
+        std::vector<std::uint16_t> ttl_offsets;
+        Time stored;
+        Time expires;
+        bool negative = false;
+        std::list<std::string>::iterator lru;
+    };
+
+    void count(const SessionStats::Stats type, count_t &counter)
+    {
+        ++counter;
+        if (session_stats)
+            session_stats->inc_stat(type, 1);
+    }
+
+    // A UDP packet to (query) or from a DNS server port of one of the
+    // servers.  Fragments and IPv6 extension headers aren't looked at.
+    bool parse_packet(const Buffer &buf, const bool query, Packet &pkt) const
+    {
+        if (servers.empty() || buf.empty())
+            return false;
+        const std::uint8_t *data = buf.c_data();
+        size_t ip_len;
+        Address src, dst;
+        switch (IPCommon::version(data[0]))
+        {
+        case IPCommon::IPv4:
+            {
+                if (buf.size() < sizeof(IPv4Header) + sizeof(UDPHeader))
+                    return false;
+                const IPv4Header *ip = reinterpret_cast<const IPv4Header *>(data);
+                ip_len = IPv4Header::length(ip->version_len);
+                if (ip->protocol != IPCommon::UDP
+                    || (ntohs(ip->frag_off) & ~IPv4Header::DF)
+                    || ip_len < sizeof(IPv4Header)
+                    || buf.size() < ip_len + sizeof(UDPHeader))
+                    return false;
+                std::memcpy(src.bytes, &ip->saddr, 4);
+                std::memcpy(dst.bytes, &ip->daddr, 4);
+                break;
+            }
+        case IPCommon::IPv6:
+            {
+                if (buf.size() < sizeof(IPv6Header) + sizeof(UDPHeader))
+                    return false;
+                const IPv6Header *ip = reinterpret_cast<const IPv6Header *>(data);
+                if (ip->nexthdr != IPCommon::UDP)
+                    return false;
+                ip_len = sizeof(IPv6Header);
+                src.ipv6 = dst.ipv6 = true;
+                std::memcpy(src.bytes, &ip->saddr, 16);
+                std::memcpy(dst.bytes, &ip->daddr, 16);
+                break;
+            }
+        default:
+            return false;
+        }
+
+        const UDPHeader *udp = reinterpret_cast<const UDPHeader *>(data + ip_len);
+        const size_t udp_len = ntohs(udp->len);
+        if (ntohs(query ? udp->dest : udp->source) != Message::PORT
+            || udp_len < sizeof(UDPHeader)
+            || ip_len + udp_len > buf.size())
+            return false;
+
+        pkt.ep.client = query ? src : dst;
+        pkt.ep.server = query ? dst : src;
+        pkt.ep.client_port = query ? udp->source : udp->dest;
+        if (!is_server(pkt.ep.server))
+            return false;
+        pkt.dns = data + ip_len + sizeof(UDPHeader);
+        pkt.dns_len = udp_len - sizeof(UDPHeader);
+        return true;
+    }
+
+    bool is_server(const Address &a) const
+    {
+        for (const auto &s : servers)
+            if (s == a)
+                return true;
+        return false;
+    }
+
+    void store(const std::uint8_t *dns, const size_t len, const Message::Response &r, const Time &now)
+    {
+        const std::uint32_t ttl = std::min(r.ttl, r.negative ? config.max_negative_ttl : config.max_ttl);
+        if (!ttl || !config.max_entries)
+            return;
+
+        auto ci = cache.find(key);
+        if (ci == cache.end())
+        {
+            if (cache.size() >= config.max_entries)
+            {
+                cache.erase(lru.back());
+                lru.pop_back();
+            }
+            lru.push_front(key);
+            ci = cache.emplace(key, Entry()).first;
+            ci->second.lru = lru.begin();
+        }
+        else
+            lru.splice(lru.begin(), lru, ci->second.lru);
+
+        // no record outlives the entry, so that aging never wraps
+        Entry &e = ci->second;
+        e.msg.assign(dns, dns + len);
+        e.ttl_offsets = r.ttl_offsets;
+        for (const std::uint16_t off : e.ttl_offsets)
+            Message::put32(e.msg.data() + off, std::min(Message::get32(e.msg.data() + off), ttl));
+        e.stored = now;
+        e.expires = now + Time::Duration::seconds(ttl);
+        e.negative = r.negative;
+    }
+
+    void expire_pending(const Time &now)
+    {
+        const Time::Duration timeout = Time::Duration::milliseconds(config.forward_timeout_ms);
+        for (auto i = pending.begin(); i != pending.end();)
+        {
+            if (now >= i->second.forwarded + timeout)
+                i = pending.erase(i);
+            else
+                ++i;
+        }
+    }
+
+    // Send msg from the server to the client, with the ID and question
+    // of the client's query and TTLs reduced by age.
+    void reply(const Endpoints &ep,
+               const std::vector<std::uint8_t> &msg,
+               const std::uint16_t id,
+               const std::string &question,
+               const std::vector<std::uint16_t> *ttl_offsets,
+               const std::uint32_t age)
+    {
+        const size_t ip_len = ep.client.ipv6 ? sizeof(IPv6Header) : sizeof(IPv4Header);
+        const size_t udp_len = sizeof(UDPHeader) + msg.size();
+        BufferAllocated buf;
+        frame->prepare(Frame::READ_TUN, buf);
+        if (ip_len + udp_len > buf.remaining() || Message::HEADER_SIZE + question.size() > msg.size())
+            return;
+        std::uint8_t *data = buf.write_alloc(ip_len + udp_len);
+
+        std::uint8_t *dns = data + ip_len + sizeof(UDPHeader);
+        std::memcpy(dns, msg.data(), msg.size());
+        Message::put16(dns, id);
+        std::memcpy(dns + Message::HEADER_SIZE, question.data(), question.size());
+        if (ttl_offsets)
+        {
+            for (const std::uint16_t off : *ttl_offsets)
+            {
+                const std::uint32_t ttl = Message::get32(dns + off);
+                Message::put32(dns + off, ttl > age ? ttl - age : 0);
+            }
+        }
+
+        UDPHeader *udp = reinterpret_cast<UDPHeader *>(data + ip_len);
+        udp->source = htons(Message::PORT);
+        udp->dest = ep.client_port;
+        udp->len = htons(static_cast<std::uint16_t>(udp_len));
+        udp->check = 0;
+
+        if (ep.client.ipv6)
+        {
+            IPv6Header *ip = reinterpret_cast<IPv6Header *>(data);
+            std::memset(ip, 0, sizeof(IPv6Header));
+            ip->version_prio = 6 << 4;
+            ip->payload_len = htons(static_cast<std::uint16_t>(udp_len));
+            ip->nexthdr = IPCommon::UDP;
+            ip->hop_limit = 64;
+            std::memcpy(&ip->saddr, ep.server.bytes, 16);
+            std::memcpy(&ip->daddr, ep.client.bytes, 16);
+            udp->check = Ping6::csum_ipv6_pseudo(&ip->saddr,
+                                                 &ip->daddr,
+                                                 static_cast<std::uint32_t>(udp_len),
+                                                 IPCommon::UDP,
+                                                 IPChecksum::compute(udp, udp_len));
+        }
+        else
+        {
+            IPv4Header *ip = reinterpret_cast<IPv4Header *>(data);
+            ip->version_len = IPv4Header::ver_len(4, sizeof(IPv4Header));
+            ip->tos = 0;
+            ip->tot_len = htons(static_cast<std::uint16_t>(ip_len + udp_len));
+            ip->id = 0;
+            ip->frag_off = 0;
+            ip->ttl = 64;
+            ip->protocol = IPCommon::UDP;
+            ip->check = 0;
+            std::memcpy(&ip->saddr, ep.server.bytes, 4);
+            std::memcpy(&ip->daddr, ep.client.bytes, 4);
+            ip->check = IPChecksum::checksum(data, sizeof(IPv4Header));
+            udp->check = htons(udp_checksum(reinterpret_cast<const std::uint8_t *>(udp),
+                                            static_cast<unsigned int>(udp_len),
+                                            ep.server.bytes,
+                                            ep.client.bytes));
+        }
+        if (!udp->check)
+            udp->check = 0xffff;
+
+        link.dns_stub_reply(buf);
+    }
+
+    Link &link;
+    Frame::Ptr frame;
+    SessionStats::Ptr session_stats;
+    Config config;
+    Stats stats_;
+
+    std::vector<Address> servers;
+    std::unordered_map<std::string, Entry> cache;
+    std::list<std::string> lru; // most recently used first
+    std::unordered_map<std::string, Pending> pending;
+    std::string key; // scratch
+};
+
+} // namespace openvpn::DnsStub
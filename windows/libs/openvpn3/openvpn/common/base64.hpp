@@ -114,7 +114,7 @@ class Base64
 
         // build decoding map
         {
-            std::memset(dec, 0xFF, 128);
+            std::memset(dec, 0xFF, sizeof(dec));
             for (unsigned int i = 0; i < 64; ++i)
             {
                 const unsigned char c = enc[i];
@@ -185,6 +185,10 @@ class Base64
      */
     size_t decode(void *data, size_t len, const std::string &str) const
     {
+        // fast path if the destination is known to be large enough
+        if (len >= str.length() / 4 * 3 && str.length() % 4 == 0)
+            return decode_block(static_cast<unsigned char *>(data), str.c_str(), str.length());
+
         UCharWrap ret((unsigned char *)data, len);
         decode(ret, str);
         return ret.index;
@@ -193,14 +197,28 @@ class Base64
     std::string decode(const std::string &str) const
     {
         std::string ret;
-        ret.reserve(str.length());
-        decode(ret, str);
+        if (str.length() % 4)
+            throw base64_decode_error();
+        ret.resize(str.length() / 4 * 3);
+        ret.resize(decode_block(reinterpret_cast<unsigned char *>(ret.data()), str.c_str(), str.length()));
         return ret;
     }
 
     template <typename V>
     void decode(V &dest, const std::string &str) const
     {
+        // std::string-like containers; BufferType::resize() sets capacity, not size
+        if constexpr (sizeof(typename V::value_type) == 1 && requires { dest.resize(0); dest.data(); } && !requires { dest.set_size(0); })
+        {
+            if (str.length() % 4)
+                throw base64_decode_error();
+            const size_t offset = dest.size();
+            dest.resize(offset + str.length() / 4 * 3);
+            const size_t n = decode_block(reinterpret_cast<unsigned char *>(dest.data()) + offset, str.c_str(), str.length());
+            dest.resize(offset + n);
+            return;
+        }
+
         const char *endp = str.c_str() + str.length();
         for (const char *p = str.c_str(); p < endp; p += 4)
         {
@@ -257,6 +275,41 @@ class Base64
         return v;
     }
 
+    // Decode len (a multiple of 4) characters from src into dest, which must
+    // have room for len / 4 * 3 bytes.  Returns the number of bytes written.
+    // Quads made only of alphabet characters are decoded with a branch-free
+    // table lookup that the compiler can unroll and vectorize; quads with
+    // padding or invalid characters go through token_decode().
+    size_t decode_block(unsigned char *dest, const char *src, const size_t len) const
+    {
+        unsigned char *d = dest;
+        const unsigned char *s = reinterpret_cast<const unsigned char *>(src);
+        for (size_t i = 0; i < len; i += 4)
+        {
+            const unsigned int a = dec[s[i]];
+            const unsigned int b = dec[s[i + 1]];
+            const unsigned int c = dec[s[i + 2]];
+            const unsigned int e = dec[s[i + 3]];
+            if ((a | b | c | e) & 0x80)
+            {
+                unsigned int marker;
+                const unsigned int val = token_decode(src + i, 4, marker);
+                *d++ = static_cast<unsigned char>((val >> 16) & 0xff);
+                if (marker < 2)
+                    *d++ = static_cast<unsigned char>((val >> 8) & 0xff);
+                if (marker < 1)
+                    *d++ = static_cast<unsigned char>(val & 0xff);
+                continue;
+            }
+            const unsigned int val = (a << 18) | (b << 12) | (c << 6) | e;
+            d[0] = static_cast<unsigned char>(val >> 16);
+            d[1] = static_cast<unsigned char>(val >> 8);
+            d[2] = static_cast<unsigned char>(val);
+            d += 3;
+        }
+        return d - dest;
+    }
+
     unsigned int token_decode(const char *token, const ptrdiff_t len, unsigned int &marker) const
     {
         size_t i;
@@ -290,7 +343,7 @@ class Base64
     }
 
     unsigned char enc[64];
-    unsigned char dec[128];
+    unsigned char dec[256]; // 0xFF for characters outside the alphabet
     unsigned char equal;
 };
 
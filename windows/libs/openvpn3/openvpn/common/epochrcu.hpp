@@ -0,0 +1,194 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Epoch-based reclamation for read-mostly structures that are updated
+// by copying (read-copy-update)
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+namespace openvpn {
+
+/**
+ * Readers enter a read-side section, follow pointers published by a
+ * writer and leave again.  Entering and leaving only writes the
+ * reader's own cache line, so readers never block each other or the
+ * writer.
+ *
+ * A writer publishes a new version of the structure, then retires the
+ * objects that were only reachable from the old version.  Retired
+ * objects are freed by reclaim() once every reader that could still
+ * see them has left its section.
+ *
+ * The writer side (retire, reclaim) must be serialized by the caller.
+ */
+class EpochRCU
+{
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> epoch{0}; // 0 while quiescent
+    };
+
+  public:
+    EpochRCU() = default;
+
+    ~EpochRCU()
+    {
+        // there must be no readers left
+        for (auto &r : retired_)
+            r.del(r.ptr);
+    }
+
+    // Read-side handle, one per reader thread.  Sections do not nest.
+    class Reader
+    {
+      public:
+        explicit Reader(EpochRCU &domain)
+            : domain_(domain),
+              slot_(domain.add_reader())
+        {
+        }
+
+        ~Reader()
+        {
+            domain_.remove_reader(slot_);
+        }
+
+        void enter()
+        {
+            slot_->epoch.store(domain_.epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+            // order the epoch store before the loads of published pointers
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        void leave()
+        {
+            slot_->epoch.store(0, std::memory_order_release);
+        }
+
+      private:
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        EpochRCU &domain_;
+        Slot *slot_;
+    };
+
+    class Guard
+    {
+      public:
+        explicit Guard(Reader &reader)
+            : reader_(reader)
+        {
+            reader_.enter();
+        }
+
+        ~Guard()
+        {
+            reader_.leave();
+        }
+
+      private:
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+        Reader &reader_;
+    };
+
+    // Writer: free obj once no reader can reach it any more.  Call
+    // after the version without obj has been published.
+    template <typename T>
+    void retire(T *obj)
+    {
+        retired_.push_back({epoch_.load(std::memory_order_relaxed), obj, [](void *p)
+                            { delete static_cast<T *>(p); }});
+    }
+
+    // Writer: close the current epoch and free what no reader can
+    // still see.  Returns the number of objects freed.
+    size_t reclaim()
+    {
+        // objects retired so far are tagged with an epoch < new epoch
+        const std::uint64_t current = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // oldest epoch a reader may still be in
+        std::uint64_t oldest = current;
+        {
+            std::lock_guard<std::mutex> lock(readers_mutex_);
+            for (const auto &s : readers_)
+            {
+                const std::uint64_t e = s->epoch.load(std::memory_order_acquire);
+                if (e)
+                    oldest = std::min(oldest, e);
+            }
+        }
+
+        size_t j = 0;
+        size_t freed = 0;
+        for (size_t i = 0; i < retired_.size(); ++i)
+        {
+            if (retired_[i].epoch < oldest)
+            {
+                retired_[i].del(retired_[i].ptr);
+                ++freed;
+            }
+            else
+                retired_[j++] = retired_[i];
+        }
+        retired_.resize(j);
+        return freed;
+    }
+
+    // Writer: number of objects waiting to be freed
+    size_t pending() const
+    {
+        return retired_.size();
+    }
+
+  private:
+    struct Retired
+    {
+        std::uint64_t epoch;
+        void *ptr;
+        void (*del)(void *);
+    };
+
+    Slot *add_reader()
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        readers_.emplace_back(new Slot);
+        return readers_.back().get();
+    }
+
+    void remove_reader(Slot *slot)
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        readers_.erase(std::find_if(readers_.begin(), readers_.end(), [slot](const std::unique_ptr<Slot> &s)
+                                    { return s.get() == slot; }));
+    }
+
+    EpochRCU(const EpochRCU &) = delete;
+    EpochRCU &operator=(const EpochRCU &) = delete;
+
+    std::atomic<std::uint64_t> epoch_{1};
+    std::mutex readers_mutex_;
+    std::vector<std::unique_ptr<Slot>> readers_;
+    std::vector<Retired> retired_;
+};
+
+} // namespace openvpn
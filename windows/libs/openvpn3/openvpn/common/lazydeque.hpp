@@ -0,0 +1,194 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// A std::deque that allocates its storage on first insertion and can
+// give it back with compact() once it has drained.  An empty std::deque
+// already holds a node map and one node (over 500 bytes with libstdc++),
+// which adds up for the mostly idle queues of a per-session protocol
+// object.
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <utility>
+
+namespace openvpn {
+
+template <typename T>
+class LazyDeque
+{
+  public:
+    typedef std::deque<T> deque_type;
+    typedef typename deque_type::value_type value_type;
+    typedef typename deque_type::size_type size_type;
+    typedef typename deque_type::iterator iterator;
+    typedef typename deque_type::const_iterator const_iterator;
+
+    LazyDeque() = default;
+
+    LazyDeque(const LazyDeque &other)
+        : q(other.q ? new deque_type(*other.q) : nullptr)
+    {
+    }
+
+    LazyDeque &operator=(const LazyDeque &other)
+    {
+        if (this != &other)
+            q.reset(other.q ? new deque_type(*other.q) : nullptr);
+        return *this;
+    }
+
+    LazyDeque(LazyDeque &&other) noexcept = default;
+    LazyDeque &operator=(LazyDeque &&other) noexcept = default;
+
+    bool empty() const
+    {
+        return !q || q->empty();
+    }
+
+    size_type size() const
+    {
+        return q ? q->size() : 0;
+    }
+
+    // element access requires a non-empty queue, as with std::deque
+
+    T &front()
+    {
+        return q->front();
+    }
+
+    const T &front() const
+    {
+        return q->front();
+    }
+
+    T &back()
+    {
+        return q->back();
+    }
+
+    const T &back() const
+    {
+        return q->back();
+    }
+
+    T &operator[](const size_type i)
+    {
+        return (*q)[i];
+    }
+
+    const T &operator[](const size_type i) const
+    {
+        return (*q)[i];
+    }
+
+    iterator begin()
+    {
+        return q ? q->begin() : iterator();
+    }
+
+    iterator end()
+    {
+        return q ? q->end() : iterator();
+    }
+
+    const_iterator begin() const
+    {
+        return q ? q->cbegin() : const_iterator();
+    }
+
+    const_iterator end() const
+    {
+        return q ? q->cend() : const_iterator();
+    }
+
+    template <typename U>
+    void push_back(U &&value)
+    {
+        get().push_back(std::forward<U>(value));
+    }
+
+    template <typename U>
+    void push_front(U &&value)
+    {
+        get().push_front(std::forward<U>(value));
+    }
+
+    void pop_front()
+    {
+        q->pop_front();
+    }
+
+    void pop_back()
+    {
+        q->pop_back();
+    }
+
+    iterator erase(iterator pos)
+    {
+        return q->erase(pos);
+    }
+
+    void resize(const size_type n)
+    {
+        if (n)
+            get().resize(n);
+        else
+            clear();
+    }
+
+    void clear()
+    {
+        if (q)
+            q->clear();
+    }
+
+    // Free the storage if the queue is empty.  Returns true if the
+    // queue holds no storage afterwards.
+    bool compact()
+    {
+        if (q && q->empty())
+            q.reset();
+        return !q;
+    }
+
+    bool allocated() const
+    {
+        return bool(q);
+    }
+
+    // Estimated heap bytes held, assuming the libstdc++ layout of
+    // 512 byte nodes and a map of at least 8 node pointers.
+    size_t memory_usage() const
+    {
+        if (!q)
+            return 0;
+        constexpr size_t node_bytes = sizeof(T) < 512 ? 512 / sizeof(T) * sizeof(T) : sizeof(T);
+        constexpr size_t per_node = node_bytes / sizeof(T);
+        const size_t nodes = q->size() / per_node + 1;
+        const size_t map = nodes + 2 > 8 ? nodes + 2 : 8;
+        return sizeof(deque_type) + nodes * node_bytes + map * sizeof(T *);
+    }
+
+  private:
+    deque_type &get()
+    {
+        if (!q)
+            q.reset(new deque_type());
+        return *q;
+    }
+
+    std::unique_ptr<deque_type> q;
+};
+
+} // namespace openvpn
@@ -12,10 +12,9 @@
 #ifndef OPENVPN_COMMON_MSGWIN_H
 #define OPENVPN_COMMON_MSGWIN_H
 
-#include <deque>
-
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
+#include <openvpn/common/lazydeque.hpp>
 
 // Fundamental, lowest-level object of OpenVPN protocol reliability layer
 
@@ -75,6 +74,24 @@ class MessageWindow
             throw message_window_ref_by_id();
     }
 
+    // Return a pointer to the M object at id, or nullptr if id is
+    // outside the window or past the last object referenced so far.
+    // Unlike ref_by_id() this doesn't grow the queue, so scanning the
+    // window doesn't allocate placeholder objects.
+    M *find_by_id(const id_t id)
+    {
+        if (in_window(id) && id - head_id_ < q_.size())
+            return &q_[id - head_id_];
+        return nullptr;
+    }
+
+    const M *find_by_id(const id_t id) const
+    {
+        if (in_window(id) && id - head_id_ < q_.size())
+            return &q_[id - head_id_];
+        return nullptr;
+    }
+
     // Remove the M object at id, is a no-op if
     // id not in window.  Do a purge() as a last
     // step to advance the head_id_ if it's now
@@ -131,7 +148,7 @@ class MessageWindow
     }
 
     // Remove the object at head of queue without error checking (other than
-    // that provided by std::deque object).  Don't call this method unless
+    // that provided by the underlying std::deque).  Don't call this method unless
     // head_defined() returns true.
     void rm_head_nocheck()
     {
@@ -140,6 +157,18 @@ class MessageWindow
         ++head_id_;
     }
 
+    // Free the queue storage if the window holds no objects
+    void compact()
+    {
+        q_.compact();
+    }
+
+    // Estimated heap bytes held by the queue
+    size_t memory_usage() const
+    {
+        return q_.memory_usage();
+    }
+
   private:
     // Expand the queue if necessary so that id maps
     // to an object in the queue
@@ -163,7 +192,7 @@ class MessageWindow
 
     id_t head_id_; // id of msgs[0]
     id_t span_;
-    std::deque<M> q_;
+    LazyDeque<M> q_;
 };
 
 } // namespace openvpn
@@ -1569,6 +1569,7 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
     void update_map()
     {
         map_.clear();
+        map_.reserve(size());
         for (size_t i = 0; i < size(); ++i)
         {
             const Option &opt = (*this)[i];
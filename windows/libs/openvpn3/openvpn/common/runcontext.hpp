@@ -38,7 +38,9 @@
 #include <openvpn/common/environ.hpp>
 #include <openvpn/common/number.hpp>
 #include <openvpn/common/signal_name.hpp>
+#include <openvpn/common/strerror.hpp>
 #include <openvpn/common/pthreadcond.hpp>
+#include <openvpn/asio/asiobusypoll.hpp>
 #include <openvpn/asio/asiosignal.hpp>
 #include <openvpn/time/time.hpp>
 #include <openvpn/time/asiotimer.hpp>
@@ -49,6 +51,10 @@
 #include <openvpn/common/scoped_fd.hpp>
 #endif
 
+#ifdef OPENVPN_PLATFORM_LINUX
+#include <openvpn/linux/cpuplace.hpp>
+#endif
+
 namespace openvpn {
 
 struct RunContextLogEntry
@@ -102,13 +108,28 @@ class RunContext : public RunContextBase
             ctx.add_thread();
         }
 
+        // also places the calling worker thread according to
+        // set_placement() and tracks its load as unit
+        ThreadContext(RunContext &ctx_arg, const unsigned int unit_arg)
+            : ctx(ctx_arg),
+              unit(unit_arg),
+              placed(true)
+        {
+            ctx.add_thread();
+            ctx.place_thread(unit);
+        }
+
         ~ThreadContext()
         {
+            if (placed)
+                ctx.unplace_thread(unit);
             ctx.remove_thread();
         }
 
       private:
         RunContext &ctx;
+        unsigned int unit = 0;
+        bool placed = false;
     };
 
     RunContext()
@@ -232,6 +253,83 @@ class RunContext : public RunContextBase
             io_context.run();
     }
 
+    // Spin on the worker event loops before sleeping, see AsioBusyPoll.
+    // Call before the worker threads are started.
+    void set_busy_poll(const AsioBusyPoll::Config &config)
+    {
+        busy_poll_config = config;
+    }
+
+    // called from worker thread, runs its event loop
+    void run_worker(openvpn_io::io_context &io_context, const unsigned int unit)
+    {
+        if (!busy_poll_config.enabled())
+        {
+            io_context.run();
+            return;
+        }
+        AsioBusyPoll busy_poll(io_context, busy_poll_config);
+        busy_poll.run();
+        OPENVPN_LOG(prefix << "Busy poll thread " << unit << ": " << busy_poll.to_string());
+
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        while (busy_poll_stats_.size() <= unit)
+            busy_poll_stats_.emplace_back();
+        busy_poll_stats_[unit] = busy_poll.stats();
+    }
+
+    // busy poll stats of the worker threads that have exited, by unit
+    std::vector<AsioBusyPoll::Stats> busy_poll_stats()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        return busy_poll_stats_;
+    }
+
+#ifdef OPENVPN_PLATFORM_LINUX
+    struct ThreadLoad
+    {
+        unsigned int unit;
+        int cpu;            // CPU the thread is pinned to, or -1
+        int node;           // NUMA node of cpu, or -1
+        double cpu_seconds; // CPU time used so far
+        double load;        // fraction of a CPU used since the previous call
+    };
+
+    // Pin worker threads to CPUs and allocate their state on the local
+    // NUMA node, see CPUPlace.  Call before the worker threads are started.
+    void set_placement(const CPUPlace::Config &config)
+    {
+        placement.reset(new CPUPlace::Placement(config));
+        OPENVPN_LOG(prefix << "Worker threads placed on CPUs " << CPUPlace::cpu_list_to_string(placement->cpu_list()));
+    }
+
+    // per-thread load of the worker threads started with ThreadContext(ctx, unit)
+    std::vector<ThreadLoad> thread_load()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        std::vector<ThreadLoad> ret;
+        const Time now = Time::now();
+        for (size_t unit = 0; unit < thread_info.size(); ++unit)
+        {
+            ThreadInfo &ti = thread_info[unit];
+            if (!ti.tid)
+                continue;
+            const double cpu = CPUPlace::thread_cpu_seconds(ti.tid);
+            if (cpu < 0)
+                continue; // thread is gone
+            const double wall = (now - ti.last_time).to_double();
+            ret.push_back({static_cast<unsigned int>(unit),
+                           ti.cpu,
+                           ti.node,
+                           cpu,
+                           wall > 0 ? (cpu - ti.last_cpu) / wall : 0});
+            ti.last_cpu = cpu;
+            ti.last_time = now;
+        }
+        return ret;
+    }
+#endif
+
     void join()
     {
         for (size_t i = 0; i < threadlist.size(); ++i)
@@ -352,6 +450,47 @@ class RunContext : public RunContextBase
         ++thread_count;
     }
 
+    // called from worker thread
+    void place_thread(const unsigned int unit)
+    {
+#ifdef OPENVPN_PLATFORM_LINUX
+        int cpu = -1;
+        int node = -1;
+        if (placement)
+        {
+            const int status = placement->place_thread(unit);
+            if (status)
+                OPENVPN_LOG(prefix << "thread " << unit << " placement failed: " << strerror_str(status));
+            else
+            {
+                cpu = placement->cpu(unit);
+                node = placement->node(unit);
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        while (thread_info.size() <= unit)
+            thread_info.emplace_back();
+        ThreadInfo &ti = thread_info[unit];
+        ti.tid = CPUPlace::gettid();
+        ti.cpu = cpu;
+        ti.node = node;
+        ti.last_cpu = CPUPlace::thread_cpu_seconds(ti.tid);
+        ti.last_time = Time::now();
+#endif
+    }
+
+    // called from worker thread when it exits, so that thread_load()
+    // does not report on a tid that no longer exists
+    void unplace_thread(const unsigned int unit)
+    {
+#ifdef OPENVPN_PLATFORM_LINUX
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        if (unit < thread_info.size())
+            thread_info[unit] = ThreadInfo();
+#endif
+    }
+
     // called from main or worker thread
     void remove_thread()
     {
@@ -380,6 +519,11 @@ class RunContext : public RunContextBase
             case SIGUSR2:
                 if (stats)
                     OPENVPN_LOG(stats->dump());
+#ifdef OPENVPN_PLATFORM_LINUX
+                for (const auto &tl : thread_load())
+                    OPENVPN_LOG("THREAD " << tl.unit << " cpu=" << tl.cpu << " node=" << tl.node
+                                          << " cpu_sec=" << tl.cpu_seconds << " load=" << tl.load);
+#endif
                 signal_rearm();
                 break;
             case SIGHUP:
@@ -439,6 +583,24 @@ class RunContext : public RunContextBase
     // stop
     Stop *async_stop_ = nullptr;
 
+#ifdef OPENVPN_PLATFORM_LINUX
+    // placement and load of worker threads, thread_info protected by mutex
+    struct ThreadInfo
+    {
+        pid_t tid = 0;
+        int cpu = -1;
+        int node = -1;
+        double last_cpu = 0;
+        Time last_time;
+    };
+    std::unique_ptr<CPUPlace::Placement> placement;
+    std::vector<ThreadInfo> thread_info;
+#endif
+
+    // busy poll
+    AsioBusyPoll::Config busy_poll_config;
+    std::vector<AsioBusyPoll::Stats> busy_poll_stats_; // protected by mutex
+
     // log observers
     std::vector<unsigned int> log_observers; // unit numbers of log observers
     std::unique_ptr<std::vector<RunContextLogEntry>> log_history;
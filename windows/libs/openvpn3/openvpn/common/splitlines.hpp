@@ -14,6 +14,7 @@
 #ifndef OPENVPN_COMMON_SPLITLINES_H
 #define OPENVPN_COMMON_SPLITLINES_H
 
+#include <cstring>
 #include <utility>
 
 #include <openvpn/common/string.hpp>
@@ -57,25 +58,25 @@ class SplitLinesType
         line.clear();
         overflow = false;
         line_valid = true;
-        const size_t overflow_index = index + max_line_len;
-        while (index < size)
+        if (index >= size)
         {
-            if (max_line_len && index >= overflow_index)
-            {
-                overflow = true;
-                return true;
-            }
-            const char c = data[index++];
-            line += c;
-            if (c == '\n' || index >= size)
-            {
-                if (trim)
-                    string::trim_crlf(line);
-                return true;
-            }
+            line_valid = false;
+            return false;
         }
-        line_valid = false;
-        return false;
+
+        // locate end of line (including the \n) and copy it in one step
+        const char *nl = static_cast<const char *>(std::memchr(data + index, '\n', size - index));
+        size_t len = nl ? size_t(nl - (data + index)) + 1 : size - index;
+        if (max_line_len && len > max_line_len)
+        {
+            len = max_line_len;
+            overflow = true;
+        }
+        line.assign(data + index, len);
+        index += len;
+        if (trim && !overflow)
+            string::trim_crlf(line);
+        return true;
     }
 
     /**
@@ -210,6 +210,13 @@ class Crypto : public CryptoDCInstance
     {
     }
 
+    // Derive upcoming epoch keys so that epoch switches in encrypt/decrypt
+    // do not have to
+    void prepare_keys() override
+    {
+        dce.prepare_keys();
+    }
+
     // Force using a new epoch on send. Currently mainly used for unit testing
     void increase_send_epoch()
     {
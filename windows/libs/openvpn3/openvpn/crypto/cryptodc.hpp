@@ -79,6 +79,12 @@ class CryptoDCInstance : public RC<thread_unsafe_refcount>
     {
     }
 
+    // Called periodically, outside of the packet path, to do key setup
+    // work ahead of time that would otherwise be done by encrypt/decrypt
+    virtual void prepare_keys()
+    {
+    }
+
     // Rekeying
 
     enum RekeyType
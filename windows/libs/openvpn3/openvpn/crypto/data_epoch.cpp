@@ -163,6 +163,12 @@ openvpn::EpochKey::EpochKey(openvpn::StaticKey key)
 
 
 void openvpn::DataChannelEpoch::generate_future_receive_keys()
+{
+    retire_future_receive_keys();
+    fill_future_receive_keys(future_keys_count);
+}
+
+void openvpn::DataChannelEpoch::retire_future_receive_keys()
 {
     /* We want the number of receive keys starting with the currently used
      * keys. */
@@ -171,11 +177,6 @@ void openvpn::DataChannelEpoch::generate_future_receive_keys()
     if (current_epoch_recv == 0)
         throw epoch_key_exception("Current receive key not initialised");
 
-    /* Either we have not generated any future keys yet or the last
-     * index is the same as our current epoch key */
-    if (future_keys.size() > 0 && future_keys.back().epoch != receive.epoch)
-        throw epoch_key_exception("Epoch key generation and future keys mismatch detected");
-
     /* free the keys that are not used anymore */
     for (auto it = future_keys.begin(); it != future_keys.end();)
     {
@@ -189,9 +190,17 @@ void openvpn::DataChannelEpoch::generate_future_receive_keys()
             it++;
         }
     }
+}
+
+void openvpn::DataChannelEpoch::fill_future_receive_keys(std::size_t count)
+{
+    /* Either we have not generated any future keys yet or the last
+     * index is the same as our current epoch key */
+    if (future_keys.size() > 0 && future_keys.back().epoch != receive.epoch)
+        throw epoch_key_exception("Epoch key generation and future keys mismatch detected");
 
     /* regenerate the array elements at the end */
-    while (future_keys.size() < future_keys_count)
+    while (future_keys.size() < count)
     {
         receive.iterate();
 
@@ -222,10 +231,39 @@ void openvpn::DataChannelEpoch::iterate_send_key()
     if (send.epoch >= UINT16_MAX)
         throw epoch_key_exception("Send epoch at limit");
 
+    if (use_prepared_encrypt_ctx(send.epoch + 1))
+        return;
+
     send.iterate();
     generate_encrypt_ctx();
 }
 
+bool openvpn::DataChannelEpoch::use_prepared_encrypt_ctx(std::uint16_t epoch)
+{
+    if (next_encrypt_ctx.epoch == 0 || next_encrypt_ctx.epoch != epoch)
+        return false;
+
+    send = next_send;
+    encrypt_ctx = std::move(next_encrypt_ctx);
+    next_encrypt_ctx = {};
+    return true;
+}
+
+void openvpn::DataChannelEpoch::prepare_keys()
+{
+    /* next send key, unless we already have it or reached the epoch limit */
+    if (send.epoch < UINT16_MAX && next_encrypt_ctx.epoch != send.epoch + 1)
+    {
+        next_send = send;
+        next_send.iterate();
+        auto key_ctx = next_send.key_context(libctx, cipher, openvpn::SSLLib::CryptoAPI::CipherContextAEAD::ENCRYPT);
+        next_encrypt_ctx = EpochDataChannelEncryptContext{std::move(key_ctx), PacketIDDataSend{true, next_send.epoch}};
+    }
+
+    /* top up the window of future receive keys */
+    fill_future_receive_keys(future_keys_count);
+}
+
 void openvpn::DataChannelEpoch::generate_encrypt_ctx()
 {
     auto key_ctx = send.key_context(libctx, cipher, openvpn::SSLLib::CryptoAPI::CipherContextAEAD::ENCRYPT);
@@ -246,6 +284,10 @@ void openvpn::DataChannelEpoch::replace_update_recv_key(std::uint16_t new_epoch,
         return ctx.epoch == new_epoch;
     };
 
+    /* Future keys might not have been topped up since the last epoch switch */
+    if (new_epoch > receive.epoch && new_epoch <= decrypt_ctx.epoch + future_keys_count)
+        fill_future_receive_keys(future_keys.size() + (new_epoch - receive.epoch));
+
     /* Find the key of the new epoch in future keys */
     auto fki = std::find_if(future_keys.begin(), future_keys.end(), is_epoch);
 
@@ -257,7 +299,7 @@ void openvpn::DataChannelEpoch::replace_update_recv_key(std::uint16_t new_epoch,
 
     /* Check if the new recv key epoch is higher than the send key epoch. If
      * yes we will replace the send key as well */
-    if (send.epoch < new_epoch)
+    if (send.epoch < new_epoch && !use_prepared_encrypt_ctx(new_epoch))
     {
         /* Update the epoch_key for send to match the current key being used.
          * This is a bit of extra work but since we are a maximum of 16
@@ -277,8 +319,10 @@ void openvpn::DataChannelEpoch::replace_update_recv_key(std::uint16_t new_epoch,
     // Explicitly invalidate the old context
     *fki = {};
 
-    /* Generate new future keys */
-    generate_future_receive_keys();
+    /* Drop the keys we moved past. New future keys are derived by
+     * prepare_keys() outside of the packet path, or on demand by
+     * lookup_decrypt_key() if a packet for them arrives first. */
+    retire_future_receive_keys();
 }
 
 openvpn::EpochDataChannelDecryptContext *
@@ -308,6 +352,8 @@ openvpn::DataChannelEpoch::lookup_decrypt_key(uint16_t epoch)
         {
             /* Key in the range of future keys */
             int index = epoch - (decrypt_ctx.epoch + 1);
+            if (static_cast<std::size_t>(index) >= future_keys.size())
+                fill_future_receive_keys(index + 1);
             return &future_keys.at(index);
         }
     }
@@ -168,16 +168,42 @@ class DataChannelEpoch
     /** The key used to generate the last receive data channel keys */
     EpochKey receive{};
 
+    /** Encryption context for the epoch after \c send, prepared ahead of
+     * time by prepare_keys(). Epoch 0 if nothing has been prepared */
+    EpochDataChannelEncryptContext next_encrypt_ctx{};
+
+    /** The key used to generate next_encrypt_ctx */
+    EpochKey next_send{};
+
     void generate_future_receive_keys();
 
+    /** Drop future receive keys that are not newer than the current receive key */
+    void retire_future_receive_keys();
+
+    /** Derive future receive keys until there are \c count of them */
+    void fill_future_receive_keys(std::size_t count);
+
     void generate_encrypt_ctx();
 
+    /** Switch to the prepared encryption context if it is for \c epoch.
+     * Returns false if no matching context has been prepared. */
+    bool use_prepared_encrypt_ctx(std::uint16_t epoch);
+
   public:
     /**
      * Forces the use of a new epoch key for sending
      */
     void iterate_send_key();
 
+    /**
+     * Derives the keys and initialises the cipher contexts that the next
+     * epoch switches will need: the next send epoch and a full window of
+     * future receive epochs. Intended to be called outside of the packet
+     * path so that an epoch switch only moves a ready context into place.
+     * Anything that has not been prepared is still generated on demand.
+     */
+    void prepare_keys();
+
 
     /**
      * Returns the number of future receive keys that this will consider as validate candidates for decryption
@@ -64,23 +64,28 @@ class DecryptCHM
             // extract IV from head of packet
             buf.read(iv_buf, iv_length);
 
-            // initialize work buffer
-            frame->prepare(Frame::DECRYPT_WORK, work);
-
-            // decrypt from buf -> work
-            const size_t decrypt_bytes = cipher.decrypt(iv_buf, work.data(), work.max_size(), buf.c_data(), buf.size());
+            // decrypt in place if the crypto library allows it and buf has
+            // tailroom for one cipher block, otherwise go through work
+            const bool in_place = CRYPTO_API::CipherContext::SUPPORTS_IN_PLACE
+                                  && buf.max_size() >= cipher.output_size(buf.size());
+            BufferAllocated &out = in_place ? buf : work;
+            if (!in_place)
+                frame->prepare(Frame::DECRYPT_WORK, work);
+
+            // decrypt from buf -> out
+            const size_t decrypt_bytes = cipher.decrypt(iv_buf, out.data(), out.max_size(), buf.c_data(), buf.size());
             if (!decrypt_bytes)
             {
                 buf.reset_size();
                 return Error::DECRYPT_ERROR;
             }
-            work.set_size(decrypt_bytes);
+            out.set_size(decrypt_bytes);
 
             // handle different cipher modes
             const int cipher_mode = cipher.cipher_mode();
             if (cipher_mode == CRYPTO_API::CipherContext::CIPH_CBC_MODE)
             {
-                if (!verify_packet_id(work, now))
+                if (!verify_packet_id(out, now))
                 {
                     buf.reset_size();
                     return Error::REPLAY_ERROR;
@@ -92,7 +97,8 @@ class DecryptCHM
             }
 
             // return cleartext result in buf
-            buf.swap(work);
+            if (!in_place)
+                buf.swap(work);
         }
         else // no encryption
         {
@@ -61,26 +61,36 @@ class EncryptCHM
                 throw chm_unsupported_cipher_mode();
             }
 
-            // initialize work buffer
-            frame->prepare(Frame::ENCRYPT_WORK, work);
-
-            // encrypt from buf -> work
-            const size_t encrypt_bytes = cipher.encrypt(iv_buf, work.data(), work.max_size(), buf.c_data(), buf.size());
+            // Encrypt in place when the crypto library allows it and buf has
+            // headroom for the IV and HMAC and tailroom for the final padding
+            // block, which is the normal case for buffers prepared by Frame.
+            // Otherwise go through work.
+            const size_t hmac_size = hmac.defined() ? hmac.output_size() : 0;
+            const bool in_place = CRYPTO_API::CipherContext::SUPPORTS_IN_PLACE
+                                  && buf.offset() >= iv_length + hmac_size
+                                  && buf.max_size() >= cipher.output_size(buf.size());
+            BufferAllocated &out = in_place ? buf : work;
+            if (!in_place)
+                frame->prepare(Frame::ENCRYPT_WORK, work);
+
+            // encrypt from buf -> out
+            const size_t encrypt_bytes = cipher.encrypt(iv_buf, out.data(), out.max_size(), buf.c_data(), buf.size());
             if (!encrypt_bytes)
             {
                 buf.reset_size();
                 return;
             }
-            work.set_size(encrypt_bytes);
+            out.set_size(encrypt_bytes);
 
             // prepend the IV to the ciphertext
-            work.prepend(iv_buf, iv_length);
+            out.prepend(iv_buf, iv_length);
 
             // HMAC the ciphertext
-            prepend_hmac(work);
+            prepend_hmac(out);
 
             // return ciphertext result in buf
-            buf.swap(work);
+            if (!in_place)
+                buf.swap(work);
         }
         else // no encryption
         {
@@ -0,0 +1,216 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Server-side cache of unwrapped tls-crypt-v2 client keys
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/time/time.hpp>
+#include <openvpn/crypto/static_key.hpp>
+
+namespace openvpn {
+
+/**
+ * Bounded LRU cache mapping a wrapped client key (WKc) to the client key
+ * Kc and metadata obtained by unwrapping it.
+ *
+ * Clients that reconnect often present the same WKc every time, so the
+ * server can skip the AES-256-CTR decryption, the HMAC check and the
+ * metadata verification for a WKc it has already accepted.  Entries are
+ * keyed on the complete WKc bytes (tag, ciphertext, server key ID and
+ * length), so a hit is only possible for a byte-identical WKc.
+ *
+ * Only WKc's whose metadata passed TLSCryptMetadata::verify() are
+ * cached.  Revoked clients must be removed with invalidate(),
+ * invalidate_if() or clear(); otherwise they stay valid until their
+ * entry expires or is evicted.
+ *
+ * The cache is meant to be shared by all server sessions through
+ * ProtoConfig and is safe to use from multiple threads.
+ */
+class TLSCryptV2WKcCache : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<TLSCryptV2WKcCache> Ptr;
+
+    struct Entry
+    {
+        OpenVPNStaticKey client_key;
+        int metadata_type = -1; // -1 if the WKc had no metadata
+        std::string metadata;
+        Time expire;
+    };
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t expired = 0;     // lookups that found a stale entry
+        std::uint64_t evictions = 0;   // entries dropped to honour max_entries
+        std::uint64_t invalidated = 0; // entries dropped by invalidate*() or clear()
+        size_t size = 0;
+    };
+
+    /**
+     * @param max_entries  maximum number of cached client keys
+     * @param ttl          lifetime of an entry after it was inserted
+     */
+    TLSCryptV2WKcCache(const size_t max_entries, const Time::Duration &ttl)
+        : max_entries_(max_entries ? max_entries : 1),
+          ttl_(ttl)
+    {
+        map_.reserve(max_entries_);
+    }
+
+    // Look up a WKc.  On a hit, copy the cached client key into
+    // client_key and return true.
+    bool lookup(const unsigned char *wkc,
+                const size_t wkc_size,
+                const Time &now,
+                OpenVPNStaticKey &client_key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto i = map_.find(key(wkc, wkc_size));
+        if (i == map_.end())
+        {
+            ++stats_.misses;
+            return false;
+        }
+        if (i->second->second.expire <= now)
+        {
+            ++stats_.expired;
+            ++stats_.misses;
+            lru_.erase(i->second);
+            map_.erase(i);
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, i->second);
+        client_key = i->second->second.client_key;
+        ++stats_.hits;
+        return true;
+    }
+
+    // Add or replace the entry for a WKc whose metadata was verified.
+    void insert(const unsigned char *wkc,
+                const size_t wkc_size,
+                const Time &now,
+                const OpenVPNStaticKey &client_key,
+                const int metadata_type,
+                const std::string &metadata)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string k = key(wkc, wkc_size);
+        auto i = map_.find(k);
+        if (i != map_.end())
+        {
+            lru_.erase(i->second);
+            map_.erase(i);
+        }
+        while (map_.size() >= max_entries_)
+        {
+            map_.erase(lru_.back().first);
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+        lru_.emplace_front(k, Entry{client_key, metadata_type, metadata, now + ttl_});
+        map_.emplace(std::move(k), lru_.begin());
+    }
+
+    // Drop the entry for one WKc.  Returns true if it was cached.
+    bool invalidate(const unsigned char *wkc, const size_t wkc_size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto i = map_.find(key(wkc, wkc_size));
+        if (i == map_.end())
+            return false;
+        lru_.erase(i->second);
+        map_.erase(i);
+        ++stats_.invalidated;
+        return true;
+    }
+
+    /**
+     * Drop every entry for which pred returns true, e.g. all clients
+     * whose metadata matches a revoked identity.  Returns the number
+     * of entries removed.
+     */
+    size_t invalidate_if(const std::function<bool(const Entry &)> &pred)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = 0;
+        for (auto i = lru_.begin(); i != lru_.end();)
+        {
+            if (pred(i->second))
+            {
+                map_.erase(i->first);
+                i = lru_.erase(i);
+                ++n;
+            }
+            else
+                ++i;
+        }
+        stats_.invalidated += n;
+        return n;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.invalidated += map_.size();
+        map_.clear();
+        lru_.clear();
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats ret = stats_;
+        ret.size = map_.size();
+        return ret;
+    }
+
+    size_t max_entries() const
+    {
+        return max_entries_;
+    }
+
+    const Time::Duration &ttl() const
+    {
+        return ttl_;
+    }
+
+  private:
+    typedef std::list<std::pair<std::string, Entry>> LRU;
+
+    static std::string key(const unsigned char *wkc, const size_t wkc_size)
+    {
+        return std::string(reinterpret_cast<const char *>(wkc), wkc_size);
+    }
+
+    const size_t max_entries_;
+    const Time::Duration ttl_;
+
+    mutable std::mutex mutex_;
+    LRU lru_; // most recently used first
+    std::unordered_map<std::string, LRU::iterator> map_;
+    Stats stats_;
+};
+
+} // namespace openvpn
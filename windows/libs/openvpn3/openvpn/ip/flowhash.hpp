@@ -0,0 +1,126 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Classify IP packets into flows by hashing their 5-tuple
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/ip/tcp.hpp>
+#include <openvpn/ip/udp.hpp>
+
+namespace openvpn::IPFlow {
+
+namespace detail {
+inline std::uint32_t mix(std::uint32_t h, const std::uint32_t v)
+{
+    h ^= v;
+    h *= 0x9E3779B1u;
+    return h ^ (h >> 15);
+}
+
+inline std::uint32_t mix_bytes(std::uint32_t h, const unsigned char *data, const size_t size)
+{
+    for (size_t i = 0; i + 4 <= size; i += 4)
+    {
+        std::uint32_t v;
+        std::memcpy(&v, data + i, sizeof(v));
+        h = mix(h, v);
+    }
+    return h;
+}
+
+inline std::uint32_t finalize(std::uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    return h ^ (h >> 16);
+}
+
+// source and destination port of a TCP or UDP header, if present
+inline std::uint32_t ports(const unsigned int protocol, const unsigned char *l4, const size_t l4_size)
+{
+    static_assert(offsetof(TCPHeader, source) == offsetof(UDPHeader, source)
+                  && offsetof(TCPHeader, dest) == offsetof(UDPHeader, dest));
+    if ((protocol == IPCommon::TCP || protocol == IPCommon::UDP) && l4_size >= sizeof(UDPHeader))
+    {
+        std::uint32_t p;
+        std::memcpy(&p, l4, sizeof(p)); // source and dest port
+        return p;
+    }
+    return 0;
+}
+} // namespace detail
+
+/**
+ * Return a hash of the source/destination address, the protocol and,
+ * for TCP and UDP, the source/destination port of an IPv4 or IPv6
+ * packet.  Packets of the same transport connection always hash to the
+ * same value.  Non-initial IPv4 fragments carry no ports, so ports are
+ * ignored for all fragments to keep them in the same flow.  IPv6
+ * extension headers are not parsed; such packets are classified by
+ * address and next header only.  Anything that is not a complete IP
+ * header hashes to the seed.
+ *
+ * @param data  packet, starting with the IP header
+ * @param size  size of the packet
+ * @param seed  perturbation, so that flows cannot be steered into
+ *              colliding hash buckets from outside
+ */
+inline std::uint32_t hash(const unsigned char *data, const size_t size, const std::uint32_t seed = 0)
+{
+    std::uint32_t h = seed;
+    if (!size)
+        return h;
+
+    switch (IPCommon::version(data[0]))
+    {
+    case IPCommon::IPv4:
+        {
+            if (size < sizeof(IPv4Header))
+                return h;
+            const auto *ip = reinterpret_cast<const IPv4Header *>(data);
+            const unsigned int hlen = IPv4Header::length(ip->version_len);
+            h = detail::mix(h, ip->saddr);
+            h = detail::mix(h, ip->daddr);
+            h = detail::mix(h, ip->protocol);
+            const bool fragment = ntohs(ip->frag_off) & (IPv4Header::OFFMASK | 0x2000); // offset or MF
+            if (!fragment && hlen >= sizeof(IPv4Header) && hlen <= size)
+                h = detail::mix(h, detail::ports(ip->protocol, data + hlen, size - hlen));
+            break;
+        }
+    case IPCommon::IPv6:
+        {
+            if (size < sizeof(IPv6Header))
+                return h;
+            const auto *ip = reinterpret_cast<const IPv6Header *>(data);
+            h = detail::mix_bytes(h, reinterpret_cast<const unsigned char *>(&ip->saddr), sizeof(ip->saddr));
+            h = detail::mix_bytes(h, reinterpret_cast<const unsigned char *>(&ip->daddr), sizeof(ip->daddr));
+            h = detail::mix(h, ip->nexthdr);
+            h = detail::mix(h, detail::ports(ip->nexthdr, data + sizeof(IPv6Header), size - sizeof(IPv6Header)));
+            break;
+        }
+    default:
+        return h;
+    }
+    return detail::finalize(h);
+}
+
+} // namespace openvpn::IPFlow
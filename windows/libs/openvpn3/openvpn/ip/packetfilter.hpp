@@ -0,0 +1,426 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Match IP packets against tcpdump-style filter expressions
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/addr/route.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+
+namespace openvpn {
+
+/**
+ * A subset of the pcap-filter(7) language, evaluated directly on IPv4
+ * and IPv6 packets:
+ *
+ *   ip | ip6 | tcp | udp | icmp | icmp6
+ *   [src|dst] host ADDR
+ *   [src|dst] net ADDR/LEN
+ *   [tcp|udp] [src|dst] port N
+ *   less N | greater N            (total packet length)
+ *   not EXPR | EXPR and EXPR | EXPR or EXPR | ( EXPR )
+ *
+ * "!", "&&" and "||" may be used instead of not, and and or.  Without a
+ * src or dst qualifier, either direction matches.  Ports match TCP and
+ * UDP packets only; IPv6 extension headers are not parsed.  An empty
+ * expression matches every packet.
+ */
+class PacketFilter
+{
+  public:
+    OPENVPN_EXCEPTION(packet_filter_error);
+
+    PacketFilter() = default;
+
+    explicit PacketFilter(const std::string &expr)
+    {
+        Parser p(expr, nodes_);
+        if (!p.done())
+            root_ = p.parse_or();
+        if (!p.done())
+            throw packet_filter_error("unexpected '" + p.peek() + "' in filter");
+    }
+
+    bool empty() const
+    {
+        return root_ < 0;
+    }
+
+    bool match(const unsigned char *data, const size_t size) const
+    {
+        if (empty())
+            return true;
+        Packet pkt;
+        if (!pkt.parse(data, size))
+            return false;
+        return eval(root_, pkt);
+    }
+
+  private:
+    enum Op
+    {
+        AND,
+        OR,
+        NOT,
+        VERSION, // value: 4 or 6
+        PROTO,   // value: IP protocol number
+        HOST,
+        NET,
+        PORT,
+        LESS,
+        GREATER,
+    };
+
+    enum Dir : unsigned int
+    {
+        SRC = 1,
+        DST = 2,
+        ANY = SRC | DST,
+    };
+
+    struct Node
+    {
+        Op op;
+        int left = -1;
+        int right = -1;
+        unsigned int dir = ANY;
+        unsigned int value = 0;   // version, protocol, port, length or prefix length
+        unsigned int version = 0; // address family of addr
+        unsigned char addr[16] = {};
+    };
+
+    struct Packet
+    {
+        unsigned int version = 0;
+        const unsigned char *src = nullptr;
+        const unsigned char *dst = nullptr;
+        unsigned int proto = 0;
+        bool has_ports = false;
+        std::uint16_t sport = 0;
+        std::uint16_t dport = 0;
+        size_t size = 0;
+
+        bool parse(const unsigned char *data, const size_t len)
+        {
+            if (!len)
+                return false;
+            size = len;
+            version = IPCommon::version(data[0]);
+            size_t l4 = 0;
+            if (version == IPCommon::IPv4 && len >= sizeof(IPv4Header))
+            {
+                const auto *ip = reinterpret_cast<const IPv4Header *>(data);
+                src = reinterpret_cast<const unsigned char *>(&ip->saddr);
+                dst = reinterpret_cast<const unsigned char *>(&ip->daddr);
+                proto = ip->protocol;
+                if (ntohs(ip->frag_off) & IPv4Header::OFFMASK)
+                    return true; // no transport header in non-initial fragments
+                l4 = IPv4Header::length(ip->version_len);
+            }
+            else if (version == IPCommon::IPv6 && len >= sizeof(IPv6Header))
+            {
+                const auto *ip = reinterpret_cast<const IPv6Header *>(data);
+                src = reinterpret_cast<const unsigned char *>(&ip->saddr);
+                dst = reinterpret_cast<const unsigned char *>(&ip->daddr);
+                proto = ip->nexthdr;
+                l4 = sizeof(IPv6Header);
+            }
+            else
+                return false;
+
+            if ((proto == IPCommon::TCP || proto == IPCommon::UDP) && l4 + 4 <= len)
+            {
+                has_ports = true;
+                sport = static_cast<std::uint16_t>((data[l4] << 8) | data[l4 + 1]);
+                dport = static_cast<std::uint16_t>((data[l4 + 2] << 8) | data[l4 + 3]);
+            }
+            return true;
+        }
+    };
+
+    class Parser
+    {
+      public:
+        Parser(const std::string &expr, std::vector<Node> &nodes)
+            : nodes_(nodes)
+        {
+            tokenize(expr);
+        }
+
+        bool done() const
+        {
+            return pos_ >= tokens_.size();
+        }
+
+        const std::string &peek() const
+        {
+            static const std::string end = "end of filter";
+            return done() ? end : tokens_[pos_];
+        }
+
+        int parse_or()
+        {
+            int left = parse_and();
+            while (accept("or") || accept("||"))
+                left = add(OR, left, parse_and());
+            return left;
+        }
+
+      private:
+        int parse_and()
+        {
+            int left = parse_not();
+            while (accept("and") || accept("&&"))
+                left = add(AND, left, parse_not());
+            return left;
+        }
+
+        int parse_not()
+        {
+            if (accept("not") || accept("!"))
+                return add(NOT, parse_not(), -1);
+            if (accept("("))
+            {
+                const int ret = parse_or();
+                expect(")");
+                return ret;
+            }
+            return parse_primitive();
+        }
+
+        int parse_primitive()
+        {
+            Node n;
+            if (accept("ip"))
+                return version_node(IPCommon::IPv4);
+            if (accept("ip6"))
+                return version_node(IPCommon::IPv6);
+            if (accept("tcp"))
+                return qualified_port(proto_node(IPCommon::TCP));
+            if (accept("udp"))
+                return qualified_port(proto_node(IPCommon::UDP));
+            if (accept("icmp"))
+                return proto_node(IPCommon::ICMPv4);
+            if (accept("icmp6"))
+                return proto_node(IPCommon::ICMPv6);
+            if (accept("less"))
+                return length_node(LESS);
+            if (accept("greater"))
+                return length_node(GREATER);
+
+            if (accept("src"))
+                n.dir = SRC;
+            else if (accept("dst"))
+                n.dir = DST;
+
+            if (accept("host"))
+            {
+                n.op = HOST;
+                const IP::Addr a = IP::Addr::from_string(next("address"), "filter host");
+                set_addr(n, a);
+                n.value = a.size_bytes();
+            }
+            else if (accept("net"))
+            {
+                n.op = NET;
+                const IP::Route r = IP::Route::from_string(next("network"), "filter net");
+                set_addr(n, r.addr);
+                n.value = r.prefix_len;
+            }
+            else if (accept("port"))
+            {
+                n.op = PORT;
+                const std::string &s = next("port");
+                if (!parse_number_validate<unsigned int>(s, 5, 0, 65535, &n.value))
+                    throw packet_filter_error("bad port '" + s + "' in filter");
+            }
+            else
+                throw packet_filter_error("unexpected '" + peek() + "' in filter");
+            nodes_.push_back(n);
+            return static_cast<int>(nodes_.size() - 1);
+        }
+
+        static void set_addr(Node &n, const IP::Addr &a)
+        {
+            n.version = a.is_ipv6() ? IPCommon::IPv6 : IPCommon::IPv4;
+            a.to_byte_string_variable(n.addr);
+        }
+
+        int version_node(const unsigned int v)
+        {
+            Node n;
+            n.op = VERSION;
+            n.value = v;
+            nodes_.push_back(n);
+            return static_cast<int>(nodes_.size() - 1);
+        }
+
+        int proto_node(const unsigned int proto)
+        {
+            Node n;
+            n.op = PROTO;
+            n.value = proto;
+            nodes_.push_back(n);
+            return static_cast<int>(nodes_.size() - 1);
+        }
+
+        // "tcp port 80" is short for "tcp and port 80"
+        int qualified_port(const int proto)
+        {
+            if (done())
+                return proto;
+            const std::string &tok = tokens_[pos_];
+            if (tok == "port"
+                || ((tok == "src" || tok == "dst") && pos_ + 1 < tokens_.size() && tokens_[pos_ + 1] == "port"))
+                return add(AND, proto, parse_primitive());
+            return proto;
+        }
+
+        int length_node(const Op op)
+        {
+            Node n;
+            n.op = op;
+            const std::string &s = next("length");
+            if (!parse_number_validate<unsigned int>(s, 6, 0, 65535, &n.value))
+                throw packet_filter_error("bad length '" + s + "' in filter");
+            nodes_.push_back(n);
+            return static_cast<int>(nodes_.size() - 1);
+        }
+
+        int add(const Op op, const int left, const int right)
+        {
+            Node n;
+            n.op = op;
+            n.left = left;
+            n.right = right;
+            nodes_.push_back(n);
+            return static_cast<int>(nodes_.size() - 1);
+        }
+
+        bool accept(const char *tok)
+        {
+            if (!done() && tokens_[pos_] == tok)
+            {
+                ++pos_;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(const char *tok)
+        {
+            if (!accept(tok))
+                throw packet_filter_error(std::string("expected '") + tok + "' in filter");
+        }
+
+        const std::string &next(const char *what)
+        {
+            if (done())
+                throw packet_filter_error(std::string("missing ") + what + " in filter");
+            return tokens_[pos_++];
+        }
+
+        void tokenize(const std::string &expr)
+        {
+            std::string cur;
+            auto flush = [&]()
+            {
+                if (!cur.empty())
+                    tokens_.push_back(std::move(cur));
+                cur.clear();
+            };
+            for (size_t i = 0; i < expr.size(); ++i)
+            {
+                const char c = expr[i];
+                if (c == ' ' || c == '\t' || c == '\n')
+                    flush();
+                else if (c == '(' || c == ')')
+                {
+                    flush();
+                    tokens_.emplace_back(1, c);
+                }
+                else if (c == '!' && cur.empty())
+                    tokens_.emplace_back(1, c);
+                else
+                    cur += c;
+            }
+            flush();
+        }
+
+        std::vector<Node> &nodes_;
+        std::vector<std::string> tokens_;
+        size_t pos_ = 0;
+    };
+
+    bool eval(const int i, const Packet &pkt) const
+    {
+        const Node &n = nodes_[i];
+        switch (n.op)
+        {
+        case AND:
+            return eval(n.left, pkt) && eval(n.right, pkt);
+        case OR:
+            return eval(n.left, pkt) || eval(n.right, pkt);
+        case NOT:
+            return !eval(n.left, pkt);
+        case VERSION:
+            return pkt.version == n.value;
+        case PROTO:
+            return pkt.proto == n.value;
+        case HOST:
+            return pkt.version == n.version
+                   && (((n.dir & SRC) && !std::memcmp(pkt.src, n.addr, n.value))
+                       || ((n.dir & DST) && !std::memcmp(pkt.dst, n.addr, n.value)));
+        case NET:
+            return pkt.version == n.version
+                   && (((n.dir & SRC) && prefix_match(pkt.src, n.addr, n.value))
+                       || ((n.dir & DST) && prefix_match(pkt.dst, n.addr, n.value)));
+        case PORT:
+            return pkt.has_ports
+                   && (((n.dir & SRC) && pkt.sport == n.value)
+                       || ((n.dir & DST) && pkt.dport == n.value));
+        case LESS:
+            return pkt.size <= n.value;
+        case GREATER:
+            return pkt.size >= n.value;
+        }
+        return false;
+    }
+
+    static bool prefix_match(const unsigned char *a, const unsigned char *net, const unsigned int prefix_len)
+    {
+        const unsigned int bytes = prefix_len / 8;
+        if (std::memcmp(a, net, bytes))
+            return false;
+        const unsigned int bits = prefix_len % 8;
+        if (!bits)
+            return true;
+        const unsigned char mask = static_cast<unsigned char>(0xFF << (8 - bits));
+        return (a[bytes] & mask) == (net[bytes] & mask);
+    }
+
+    std::vector<Node> nodes_;
+    int root_ = -1;
+};
+
+} // namespace openvpn
@@ -0,0 +1,331 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Placement of worker threads on CPUs and NUMA nodes.  The CPU list
+// is either given explicitly or taken from the IRQ affinity of a NIC,
+// so that each worker runs on a core that receives packets from the
+// NIC.  A placed thread also switches to node local memory allocation,
+// which keeps the pools and session state it creates on its own node.
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/lex.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/common/split.hpp>
+#include <openvpn/common/string.hpp>
+
+namespace openvpn::CPUPlace {
+
+OPENVPN_EXCEPTION(cpu_place_error);
+
+typedef std::vector<unsigned int> CPUList;
+
+namespace detail {
+inline std::string read_line(const std::string &fn)
+{
+    std::ifstream ifs(fn);
+    std::string line;
+    std::getline(ifs, line);
+    return string::trim_copy(line);
+}
+} // namespace detail
+
+// Parse a Linux cpulist such as "0-3,8,10-11" into a sorted list
+// without duplicates.
+inline CPUList parse_cpu_list(const std::string &str)
+{
+    CPUList ret;
+    for (const auto &term : Split::by_char<std::vector<std::string>, NullLex, Split::NullLimit>(string::trim_copy(str), ','))
+    {
+        const std::string t = string::trim_copy(term);
+        if (t.empty())
+            continue;
+        const size_t dash = t.find('-');
+        unsigned int first, last;
+        if (!parse_number(t.substr(0, dash), first)
+            || (dash != std::string::npos && !parse_number(t.substr(dash + 1), last)))
+            OPENVPN_THROW(cpu_place_error, "bad cpu list '" << str << '\'');
+        if (dash == std::string::npos)
+            last = first;
+        if (last < first || last - first >= 4096)
+            OPENVPN_THROW(cpu_place_error, "bad cpu range '" << t << '\'');
+        for (unsigned int cpu = first; cpu <= last; ++cpu)
+            ret.push_back(cpu);
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+inline std::string cpu_list_to_string(const CPUList &cpus)
+{
+    std::ostringstream os;
+    for (size_t i = 0; i < cpus.size();)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        if (i)
+            os << ',';
+        os << cpus[i];
+        if (j > i)
+            os << '-' << cpus[j];
+        i = j + 1;
+    }
+    return os.str();
+}
+
+// NUMA node of a CPU, or -1 if unknown
+inline int cpu_node(const unsigned int cpu, const std::string &sysfs = "/sys")
+{
+    std::error_code ec;
+    const std::filesystem::path dir = sysfs + "/devices/system/cpu/cpu" + std::to_string(cpu);
+    for (const auto &e : std::filesystem::directory_iterator(dir, ec))
+    {
+        const std::string name = e.path().filename().string();
+        unsigned int node;
+        if (name.starts_with("node") && parse_number(name.substr(4), node))
+            return static_cast<int>(node);
+    }
+    return -1;
+}
+
+// IRQs of a network device: the MSI vectors of a PCI NIC, or else the
+// /proc/interrupts entries named after the device (e.g. "eth0-TxRx-0")
+// or its bus device (e.g. "virtio3-input.0").
+inline std::vector<unsigned int> nic_irqs(const std::string &dev,
+                                          const std::string &sysfs = "/sys",
+                                          const std::string &procfs = "/proc")
+{
+    std::vector<unsigned int> ret;
+    std::error_code ec;
+    const std::filesystem::path device = sysfs + "/class/net/" + dev + "/device";
+    for (const auto &e : std::filesystem::directory_iterator(device / "msi_irqs", ec))
+    {
+        unsigned int irq;
+        if (parse_number(e.path().filename().string(), irq))
+            ret.push_back(irq);
+    }
+
+    if (ret.empty())
+    {
+        std::vector<std::string> prefixes{dev};
+        const std::filesystem::path target = std::filesystem::read_symlink(device, ec);
+        if (!ec)
+            prefixes.push_back(target.filename().string());
+
+        std::ifstream ifs(procfs + "/interrupts");
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            const size_t colon = line.find(':');
+            unsigned int irq;
+            if (colon == std::string::npos || !parse_number(string::trim_copy(line.substr(0, colon)), irq))
+                continue;
+            std::istringstream is(line.substr(colon + 1));
+            std::string name;
+            while (is >> name)
+                ;
+            for (const auto &p : prefixes)
+                if (string::starts_with_delim(name, p, '-') && name.find("config") == std::string::npos)
+                {
+                    ret.push_back(irq);
+                    break;
+                }
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+// CPUs that service the IRQs of a network device
+inline CPUList nic_irq_cpus(const std::string &dev,
+                            const std::string &sysfs = "/sys",
+                            const std::string &procfs = "/proc")
+{
+    CPUList ret;
+    for (const unsigned int irq : nic_irqs(dev, sysfs, procfs))
+    {
+        const std::string dir = procfs + "/irq/" + std::to_string(irq);
+        std::string list = detail::read_line(dir + "/effective_affinity_list");
+        if (list.empty())
+            list = detail::read_line(dir + "/smp_affinity_list");
+        try
+        {
+            const CPUList cpus = parse_cpu_list(list);
+            ret.insert(ret.end(), cpus.begin(), cpus.end());
+        }
+        catch (const cpu_place_error &)
+        {
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+// CPU time in seconds used so far by a thread of this process
+inline double thread_cpu_seconds(const pid_t tid, const std::string &procfs = "/proc")
+{
+    const std::string stat = detail::read_line(procfs + "/self/task/" + std::to_string(tid) + "/stat");
+
+    // the fields after the parenthesized command name start at state (3),
+    // utime and stime are fields 14 and 15
+    const size_t paren = stat.rfind(')');
+    if (paren == std::string::npos)
+        return -1.0;
+    std::istringstream is(stat.substr(paren + 1));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && is >> field; ++i)
+    {
+        if (i == 14)
+            parse_number(field, utime);
+        else if (i == 15)
+            parse_number(field, stime);
+    }
+    return double(utime + stime) / double(::sysconf(_SC_CLK_TCK));
+}
+
+inline pid_t gettid()
+{
+    return static_cast<pid_t>(::syscall(SYS_gettid));
+}
+
+// Bind the calling thread to cpu.  Returns 0 or an errno value.
+inline int bind_thread(const unsigned int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(cpuset), &cpuset);
+}
+
+// Make further allocations of the calling thread prefer its current
+// node.  Returns 0 or an errno value, ENOSYS without NUMA support.
+inline int set_local_mempolicy()
+{
+    if (::syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == 0)
+        return 0;
+    return errno;
+}
+
+// Ask the kernel to deliver packets received on cpu to this socket
+// when it's part of a SO_REUSEPORT group, so that a peer hashed to a
+// NIC queue stays with the worker pinned to that queue's CPU.
+inline bool set_incoming_cpu(const int fd, const unsigned int cpu)
+{
+#ifdef SO_INCOMING_CPU
+    const int value = static_cast<int>(cpu);
+    return ::setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &value, sizeof(value)) == 0;
+#else
+    return false;
+#endif
+}
+
+struct Config
+{
+    // explicit CPU list, takes precedence over nic
+    CPUList cpus;
+
+    // take the CPU list from the IRQ affinity of this network device
+    std::string nic;
+
+    // switch placed threads to node local allocation
+    bool numa_local = true;
+
+    bool enabled() const
+    {
+        return !cpus.empty() || !nic.empty();
+    }
+};
+
+class Placement
+{
+  public:
+    Placement(const Config &config_arg,
+              const std::string &sysfs = "/sys",
+              const std::string &procfs = "/proc")
+        : config(config_arg),
+          cpus(config.cpus)
+    {
+        if (cpus.empty() && !config.nic.empty())
+        {
+            cpus = nic_irq_cpus(config.nic, sysfs, procfs);
+            if (cpus.empty())
+                OPENVPN_THROW(cpu_place_error, "no IRQ affinity found for " << config.nic);
+        }
+        for (const unsigned int cpu : cpus)
+            nodes.push_back(cpu_node(cpu, sysfs));
+    }
+
+    const CPUList &cpu_list() const
+    {
+        return cpus;
+    }
+
+    // CPU for worker unit, or -1 if there are no CPUs to place on
+    int cpu(const unsigned int unit) const
+    {
+        if (cpus.empty())
+            return -1;
+        return static_cast<int>(cpus[unit % cpus.size()]);
+    }
+
+    int node(const unsigned int unit) const
+    {
+        if (cpus.empty())
+            return -1;
+        return nodes[unit % nodes.size()];
+    }
+
+    // Called from the worker thread before it allocates its state.
+    // Returns 0 or an errno value.
+    int place_thread(const unsigned int unit) const
+    {
+        const int c = cpu(unit);
+        if (c < 0)
+            return 0;
+        const int status = bind_thread(static_cast<unsigned int>(c));
+        if (status)
+            return status;
+        if (config.numa_local)
+        {
+            const int mp = set_local_mempolicy();
+            if (mp && mp != ENOSYS)
+                return mp;
+        }
+        return 0;
+    }
+
+  private:
+    Config config;
+    CPUList cpus;
+    std::vector<int> nodes;
+};
+
+} // namespace openvpn::CPUPlace
@@ -0,0 +1,546 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// io_uring for the packet path, on raw system calls.  Completions are
+// signalled through an eventfd the io_context waits on, so that the
+// owner handles them in batches from one handler, and the requests it
+// queues meanwhile reach the kernel with a single io_uring_enter().
+//
+// The owner (UDPLink, TunIO) provides
+//
+//   void uring_event(bool wait);
+//
+// called through the smart pointer given to async_wait() (wait == true)
+// or post_event() (wait == false), which calls process().
+
+#pragma once
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/common/cleanup.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/strerror.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/frame/frame.hpp>
+
+namespace openvpn {
+
+class IOUring
+{
+  public:
+    OPENVPN_EXCEPTION(io_uring_error);
+
+    enum
+    {
+        TAG_INTERNAL = 0, // not passed to the owner
+    };
+
+    // user_data of a request: a tag chosen by the owner and an index
+    static std::uint64_t user_data(const unsigned int tag, const unsigned int index)
+    {
+        return (std::uint64_t(tag) << 32) | index;
+    }
+
+    static unsigned int tag(const io_uring_cqe &cqe)
+    {
+        return static_cast<unsigned int>(cqe.user_data >> 32);
+    }
+
+    static unsigned int index(const io_uring_cqe &cqe)
+    {
+        return static_cast<unsigned int>(cqe.user_data);
+    }
+
+    // ctx is an io_context or an executor
+    template <typename CONTEXT>
+    IOUring(CONTEXT &&ctx, const unsigned int entries)
+        : efd(std::forward<CONTEXT>(ctx))
+    {
+        io_uring_params p = {};
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (ring_fd < 0)
+            throw io_uring_error("io_uring_setup: " + strerror_str(errno));
+        try
+        {
+            if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP))
+                throw io_uring_error("kernel lacks IORING_FEAT_SINGLE_MMAP or IORING_FEAT_NODROP");
+
+            ring_size = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned int),
+                                 p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+            ring = map(ring_size, IORING_OFF_SQ_RING);
+            sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+
+            sq_head = field(p.sq_off.head);
+            sq_tail = field(p.sq_off.tail);
+            sq_flags = field(p.sq_off.flags);
+            sq_mask = *field(p.sq_off.ring_mask);
+            sq_entries = p.sq_entries;
+            cq_head = field(p.cq_off.head);
+            cq_tail = field(p.cq_off.tail);
+            cq_mask = *field(p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(static_cast<std::uint8_t *>(ring) + p.cq_off.cqes);
+
+            // SQ slots map to SQEs one to one
+            unsigned int *array = field(p.sq_off.array);
+            for (unsigned int i = 0; i < sq_entries; ++i)
+                array[i] = i;
+            sq_local_tail = *sq_tail;
+
+            const int fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (fd < 0)
+                throw io_uring_error("eventfd: " + strerror_str(errno));
+            efd.assign(fd);
+            if (register_op(IORING_REGISTER_EVENTFD, &fd, 1) < 0)
+                throw io_uring_error("IORING_REGISTER_EVENTFD: " + strerror_str(errno));
+        }
+        catch (...)
+        {
+            close_ring();
+            throw;
+        }
+    }
+
+    IOUring(const IOUring &) = delete;
+    IOUring &operator=(const IOUring &) = delete;
+
+    ~IOUring()
+    {
+        cancel_all();
+        close_ring();
+    }
+
+    int fd() const
+    {
+        return ring_fd;
+    }
+
+    int register_op(const unsigned int opcode, const void *arg, const unsigned int nr_args)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+    }
+
+    // Return a zeroed SQE, submitting the queued ones first if the SQ
+    // is full.  Returns nullptr if there is still no room.
+    io_uring_sqe *get_sqe()
+    {
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+        {
+            submit();
+            if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+                return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes[sq_local_tail++ & sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        ++inflight;
+        return sqe;
+    }
+
+    // Pass the queued SQEs to the kernel, optionally waiting for
+    // wait_nr completions.  Returns the io_uring_enter() result.
+    int submit(const unsigned int wait_nr = 0)
+    {
+        __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+        const unsigned int to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        unsigned int flags = 0;
+        if (wait_nr || (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+            flags |= IORING_ENTER_GETEVENTS;
+        if (!to_submit && !flags)
+            return 0;
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, nullptr, 0));
+    }
+
+    bool cq_ready() const
+    {
+        return __atomic_load_n(cq_head, __ATOMIC_RELAXED) != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)
+               || (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW);
+    }
+
+    // Pass up to max completions to f(const io_uring_cqe &), which
+    // returns false to stop.  Each CQE is consumed before f sees it, so
+    // f may reenter (e.g. through cancel_all()).  Returns the number of
+    // CQEs consumed.
+    template <typename F>
+    size_t reap(F f, const size_t max)
+    {
+        size_t n = 0;
+        while (n < max)
+        {
+            const unsigned int head = __atomic_load_n(cq_head, __ATOMIC_RELAXED);
+            if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+                break;
+            const io_uring_cqe cqe = cqes[head & cq_mask];
+            __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+            ++n;
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                --inflight;
+            if (tag(cqe) == TAG_INTERNAL)
+            {
+                if (cqe.res < 0 && cqe.res != -ENOENT && cqe.res != -EALREADY)
+                    cancel_failed = true;
+                continue;
+            }
+            if (!f(cqe))
+                break;
+        }
+        return n;
+    }
+
+    // Called from the owner's uring_event(): consume the eventfd, hand
+    // completions to f as in reap(), and submit what f queued.  Gives
+    // up after a few rounds so that a busy ring doesn't starve other
+    // handlers; returns true if completions are left, in which case the
+    // owner should post_event().
+    template <typename F>
+    bool process(F f)
+    {
+        event_posted = false;
+        processing = true;
+        const auto done = Cleanup([this]()
+                                  { processing = false; });
+        std::uint64_t count;
+        if (::read(efd.native_handle(), &count, sizeof(count)) < 0)
+        {
+            // EAGAIN when called for a posted event
+        }
+        bool go = true;
+        for (int round = 0; round < 4 && go; ++round)
+        {
+            const size_t n = reap([&go, &f](const io_uring_cqe &cqe)
+                                  { return go = f(cqe); },
+                                  MAX_BATCH);
+            submit();
+            if (!n && !cq_ready())
+                return false;
+        }
+        return go && cq_ready();
+    }
+
+    // Call owner->uring_event(true) when the eventfd fires.
+    template <typename PTR>
+    void async_wait(PTR owner)
+    {
+        efd.async_wait(openvpn_io::posix::stream_descriptor::wait_read,
+                       [owner = std::move(owner)](const openvpn_io::error_code &error)
+                       {
+                           OPENVPN_ASYNC_HANDLER;
+                           if (!error)
+                               owner->uring_event(true);
+                       });
+    }
+
+    // Call owner->uring_event(false) after the handlers already queued
+    // on the io_context, e.g. to submit requests queued outside of
+    // uring_event().  No-op inside process(), which submits anyway.
+    template <typename PTR>
+    void post_event(PTR owner)
+    {
+        if (!event_posted && !processing)
+        {
+            event_posted = true;
+            openvpn_io::post(efd.get_executor(), [owner = std::move(owner)]()
+                             {
+                                 OPENVPN_ASYNC_HANDLER;
+                                 owner->uring_event(false); });
+        }
+    }
+
+    // Cancel every request and wait until the kernel is done with them,
+    // so that their buffers may be freed.
+    void cancel_all()
+    {
+        if (ring_fd < 0 || !inflight)
+            return;
+        if (io_uring_sqe *sqe = get_sqe())
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe->user_data = user_data(TAG_INTERNAL, 0);
+        }
+        while (inflight && !cancel_failed)
+        {
+            if (submit(1) < 0 && errno != EINTR)
+                break;
+            reap([](const io_uring_cqe &)
+                 { return true; },
+                 SIZE_MAX);
+        }
+        efd.cancel();
+    }
+
+    // Receive buffers lent to the kernel through a provided-buffer ring
+    // (IORING_REGISTER_PBUF_RING), for requests with IOSQE_BUFFER_SELECT.
+    // Each is a BufferAllocated prepared by frame context fc, offered
+    // from prefix bytes before data() so that the payload following a
+    // prefix of that size (e.g. io_uring_recvmsg_out and the source
+    // address) lands at the usual headroom.  count is a power of 2.
+    class RecvBuffers
+    {
+      public:
+        RecvBuffers(IOUring &ring_arg,
+                    const unsigned short group_arg,
+                    const unsigned int count,
+                    const Frame::Context &fc,
+                    const size_t prefix_arg)
+            : ring(ring_arg),
+              frame_context(fc),
+              prefix(prefix_arg),
+              group_(group_arg),
+              bufs(count),
+              mask(count - 1)
+        {
+            if (!count || (count & mask) || count > 32768)
+                throw io_uring_error("receive buffer count must be a power of 2");
+            if (frame_context.headroom() < prefix)
+                throw io_uring_error("frame headroom too small for receive prefix");
+            entries_size = count * sizeof(io_uring_buf);
+            void *m = ::mmap(nullptr, entries_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED)
+                throw io_uring_error("mmap: " + strerror_str(errno));
+            entries = static_cast<io_uring_buf *>(m);
+
+            io_uring_buf_reg reg = {};
+            reg.ring_addr = reinterpret_cast<std::uint64_t>(entries);
+            reg.ring_entries = count;
+            reg.bgid = group_;
+            if (ring.register_op(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            {
+                const int eno = errno;
+                ::munmap(entries, entries_size);
+                throw io_uring_error("IORING_REGISTER_PBUF_RING: " + strerror_str(eno));
+            }
+            for (unsigned int i = 0; i < count; ++i)
+                provide(i);
+            commit();
+        }
+
+        RecvBuffers(const RecvBuffers &) = delete;
+        RecvBuffers &operator=(const RecvBuffers &) = delete;
+
+        // the ring must be idle (see cancel_all())
+        ~RecvBuffers()
+        {
+            io_uring_buf_reg reg = {};
+            reg.bgid = group_;
+            ring.register_op(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            ::munmap(entries, entries_size);
+        }
+
+        unsigned short group() const
+        {
+            return group_;
+        }
+
+        static bool has_buffer(const io_uring_cqe &cqe)
+        {
+            return cqe.flags & IORING_CQE_F_BUFFER;
+        }
+
+        static unsigned int buffer_id(const io_uring_cqe &cqe)
+        {
+            return cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        }
+
+        // Swap the buffer the kernel returned as bid with buf, and lend
+        // what buf held in its place.  The payload starts at buf.data(),
+        // the caller sets the size.  commit() makes the new buffer visible
+        // to the kernel.
+        void exchange(const unsigned int bid, BufferAllocated &buf)
+        {
+            bufs[bid & mask].swap(buf);
+            provide(bid & mask);
+        }
+
+        // lend buffer bid to the kernel again, unused
+        void recycle(const unsigned int bid)
+        {
+            provide(bid & mask);
+        }
+
+        void commit()
+        {
+            __atomic_store_n(tail_ptr(), local_tail, __ATOMIC_RELEASE);
+        }
+
+      private:
+        void provide(const unsigned int bid)
+        {
+            BufferAllocated &b = bufs[bid];
+            frame_context.prepare(b);
+            io_uring_buf &e = entries[local_tail++ & mask];
+            e.addr = reinterpret_cast<std::uint64_t>(b.data() - prefix);
+            e.len = static_cast<std::uint32_t>(prefix + frame_context.payload());
+            e.bid = static_cast<std::uint16_t>(bid);
+        }
+
+        // the tail overlays the reserved field of the first entry
+        std::uint16_t *tail_ptr()
+        {
+            return &entries[0].resv;
+        }
+
+        IOUring &ring;
+        const Frame::Context frame_context;
+        const size_t prefix;
+        const unsigned short group_;
+        std::vector<BufferAllocated> bufs;
+        const unsigned int mask;
+        io_uring_buf *entries = nullptr;
+        size_t entries_size = 0;
+        std::uint16_t local_tail = 0;
+    };
+
+    // Slots for writes.  The caller's buffer is reused as soon as its
+    // send/write call returns, so the data is copied into a slot that
+    // stays put until the write completes.  The slots are registered
+    // (IORING_REGISTER_BUFFERS) when RLIMIT_MEMLOCK allows it, which
+    // saves the kernel from mapping the pages on every write.
+    class SendBuffers
+    {
+      public:
+        SendBuffers(IOUring &ring_arg, const unsigned int count, const size_t slot_size_arg)
+            : ring(ring_arg),
+              slab(count * slot_size_arg, BufAllocFlags::NO_FLAGS),
+              slot_size(slot_size_arg)
+        {
+            free.reserve(count);
+            for (unsigned int i = count; i-- > 0;)
+                free.push_back(i);
+            iovec iov;
+            iov.iov_base = slab.data_raw();
+            iov.iov_len = slab.capacity();
+            fixed = ring.register_op(IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+        }
+
+        SendBuffers(const SendBuffers &) = delete;
+        SendBuffers &operator=(const SendBuffers &) = delete;
+
+        // the ring must be idle (see cancel_all())
+        ~SendBuffers()
+        {
+            if (fixed)
+                ring.register_op(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        }
+
+        // Queue a write of buf to fd, completing with user_data(tag,
+        // slot).  Returns false if buf doesn't fit or no slot is free.
+        bool write(const int fd, const Buffer &buf, const unsigned int tag)
+        {
+            if (free.empty() || buf.size() > slot_size)
+                return false;
+            io_uring_sqe *sqe = ring.get_sqe();
+            if (!sqe)
+                return false;
+            const unsigned int slot = free.back();
+            free.pop_back();
+            std::uint8_t *data = slab.data_raw() + slot * slot_size;
+            std::memcpy(data, buf.c_data(), buf.size());
+            sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(data);
+            sqe->len = static_cast<std::uint32_t>(buf.size());
+            sqe->buf_index = 0;
+            sqe->user_data = user_data(tag, slot);
+            return true;
+        }
+
+        void release(const unsigned int slot)
+        {
+            free.push_back(slot);
+        }
+
+        bool registered() const
+        {
+            return fixed;
+        }
+
+      private:
+        IOUring &ring;
+        BufferAllocated slab;
+        const size_t slot_size;
+        std::vector<unsigned int> free;
+        bool fixed = false;
+    };
+
+  private:
+    static constexpr size_t MAX_BATCH = 256;
+
+    void *map(const size_t size, const off_t offset)
+    {
+        void *m = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (m == MAP_FAILED)
+            throw io_uring_error("mmap: " + strerror_str(errno));
+        return m;
+    }
+
+    unsigned int *field(const unsigned int offset) const
+    {
+        return reinterpret_cast<unsigned int *>(static_cast<std::uint8_t *>(ring) + offset);
+    }
+
+    void close_ring()
+    {
+        efd.close();
+        if (sqes)
+            ::munmap(sqes, sqes_size);
+        if (ring)
+            ::munmap(ring, ring_size);
+        sqes = nullptr;
+        ring = nullptr;
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+        ring_fd = -1;
+    }
+
+    int ring_fd = -1;
+    openvpn_io::posix::stream_descriptor efd;
+
+    void *ring = nullptr;
+    size_t ring_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned int *sq_head = nullptr;
+    unsigned int *sq_tail = nullptr;
+    unsigned int *sq_flags = nullptr;
+    unsigned int sq_mask = 0;
+    unsigned int sq_entries = 0;
+    unsigned int sq_local_tail = 0;
+
+    unsigned int *cq_head = nullptr;
+    unsigned int *cq_tail = nullptr;
+    unsigned int cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    size_t inflight = 0; // requests without their final CQE
+    bool cancel_failed = false;
+    bool event_posted = false;
+    bool processing = false;
+};
+
+} // namespace openvpn
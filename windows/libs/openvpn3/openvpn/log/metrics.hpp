@@ -0,0 +1,403 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Scrapeable per-session and aggregated counters, rendered in the
+// Prometheus text exposition format or as JSON
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <openvpn/common/count.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/to_string.hpp>
+#include <openvpn/common/string.hpp>
+#include <openvpn/error/error.hpp>
+#include <openvpn/log/sessionstats.hpp>
+
+namespace openvpn {
+
+/**
+ * Registry of per-session metric slots.
+ *
+ * Each session owns a Slot and publishes a Snapshot of its counters
+ * into it from its own event-loop thread.  Publishing never takes a
+ * lock and never waits for a reader: the slot is a seqlock, so a
+ * scrape that overlaps a publish simply reads the slot again.  The
+ * registry mutex is only taken when slots are added and by scrapes,
+ * so scraping never stalls an I/O thread.
+ *
+ * Counters of closed slots are folded into the aggregate, so the
+ * totals stay monotonic as sessions come and go.
+ */
+class Metrics : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<Metrics> Ptr;
+
+    enum Index : size_t
+    {
+        STATS_BASE = 0,                                // SessionStats::Stats
+        ERRORS_BASE = STATS_BASE + SessionStats::N_STATS, // Error::Type
+        CONNECTED = ERRORS_BASE + Error::N_ERRORS,       // 1 while connected
+        N_VALUES,
+    };
+
+    struct Snapshot
+    {
+        count_t v[N_VALUES] = {};
+
+        count_t &stat(const size_t type)
+        {
+            return v[STATS_BASE + type];
+        }
+
+        count_t stat(const size_t type) const
+        {
+            return v[STATS_BASE + type];
+        }
+
+        count_t &error(const size_t type)
+        {
+            return v[ERRORS_BASE + type];
+        }
+
+        count_t error(const size_t type) const
+        {
+            return v[ERRORS_BASE + type];
+        }
+
+        bool connected() const
+        {
+            return v[CONNECTED] != 0;
+        }
+
+        void set_connected(const bool connected)
+        {
+            v[CONNECTED] = connected;
+        }
+
+        Snapshot &operator+=(const Snapshot &rhs)
+        {
+            for (size_t i = 0; i < N_VALUES; ++i)
+                v[i] += rhs.v[i];
+            return *this;
+        }
+    };
+
+    class Slot : public RC<thread_safe_refcount>
+    {
+      public:
+        typedef RCPtr<Slot> Ptr;
+
+        const std::string &name() const
+        {
+            return name_;
+        }
+
+        // Called by the single thread that owns the session.
+        void publish(const Snapshot &s)
+        {
+            const std::uint32_t seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < N_VALUES; ++i)
+                values_[i].store(s.v[i], std::memory_order_relaxed);
+            seq_.store(seq + 2, std::memory_order_release);
+        }
+
+        // Called from any thread.
+        Snapshot read() const
+        {
+            Snapshot s;
+            while (true)
+            {
+                const std::uint32_t seq = seq_.load(std::memory_order_acquire);
+                if (seq & 1)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < N_VALUES; ++i)
+                    s.v[i] = values_[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq_.load(std::memory_order_relaxed) == seq)
+                    return s;
+            }
+        }
+
+        // The session has ended and published its final counters.
+        void close()
+        {
+            closed_.store(true, std::memory_order_release);
+        }
+
+        bool closed() const
+        {
+            return closed_.load(std::memory_order_acquire);
+        }
+
+      private:
+        friend Metrics;
+
+        explicit Slot(std::string name)
+            : name_(std::move(name))
+        {
+            for (auto &v : values_)
+                v.store(0, std::memory_order_relaxed);
+        }
+
+        const std::string name_;
+        std::atomic<std::uint32_t> seq_{0};
+        std::atomic<count_t> values_[N_VALUES];
+        std::atomic<bool> closed_{false};
+    };
+
+    struct Report
+    {
+        std::vector<std::pair<std::string, Snapshot>> sessions;
+        Snapshot total;
+    };
+
+    // Thread-safe.
+    Slot::Ptr add(std::string name)
+    {
+        Slot::Ptr slot(new Slot(std::move(name)));
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_.push_back(slot);
+        return slot;
+    }
+
+    // Read all slots, dropping the closed ones.  Thread-safe.
+    Report collect()
+    {
+        Report r;
+        std::lock_guard<std::mutex> lock(mutex_);
+        r.sessions.reserve(slots_.size());
+        size_t j = 0;
+        for (size_t i = 0; i < slots_.size(); ++i)
+        {
+            const Slot::Ptr &slot = slots_[i];
+            if (slot->closed())
+            {
+                Snapshot s = slot->read();
+                s.set_connected(false);
+                retired_ += s;
+                continue;
+            }
+            r.sessions.emplace_back(slot->name(), slot->read());
+            r.total += r.sessions.back().second;
+            if (j != i)
+                slots_[j] = std::move(slots_[i]);
+            ++j;
+        }
+        slots_.resize(j);
+        r.total += retired_;
+        return r;
+    }
+
+    std::string prometheus()
+    {
+        return render_prometheus(collect());
+    }
+
+    std::string json()
+    {
+        return render_json(collect());
+    }
+
+    static std::string render_prometheus(const Report &r)
+    {
+        std::string out;
+        out.reserve(4096 + r.sessions.size() * 512);
+
+        family(out, "openvpn_sessions", "gauge", "Sessions registered for metrics.");
+        out += "openvpn_sessions " + openvpn::to_string(r.sessions.size()) + '\n';
+        family(out, "openvpn_sessions_connected", "gauge", "Sessions currently connected.");
+        out += "openvpn_sessions_connected " + openvpn::to_string(r.total.v[CONNECTED]) + '\n';
+        family(out, "openvpn_session_connected", "gauge", "1 if the session is connected.");
+        for (const auto &s : r.sessions)
+            sample(out, "openvpn_session_connected", s.first, nullptr, s.second.v[CONNECTED]);
+
+        for (size_t i = 0; i < SessionStats::N_STATS; ++i)
+        {
+            const std::string name = "openvpn_" + stat_metric_name(i) + "_total";
+            const std::string help = std::string("Sum of ") + SessionStats::stat_name(i) + " over all sessions.";
+            family(out, name, "counter", help);
+            out += name + ' ' + openvpn::to_string(r.total.stat(i)) + '\n';
+
+            const std::string sname = "openvpn_session_" + stat_metric_name(i) + "_total";
+            family(out, sname, "counter", std::string(SessionStats::stat_name(i)) + " per session.");
+            for (const auto &s : r.sessions)
+                sample(out, sname, s.first, nullptr, s.second.stat(i));
+        }
+
+        // errors that never happened are omitted
+        family(out, "openvpn_errors_total", "counter", "Errors by type over all sessions.");
+        for (size_t i = 1; i < Error::N_ERRORS; ++i)
+            if (r.total.error(i))
+                sample(out, "openvpn_errors_total", "", Error::name(i), r.total.error(i));
+        family(out, "openvpn_session_errors_total", "counter", "Errors by type per session.");
+        for (const auto &s : r.sessions)
+            for (size_t i = 1; i < Error::N_ERRORS; ++i)
+                if (s.second.error(i))
+                    sample(out, "openvpn_session_errors_total", s.first, Error::name(i), s.second.error(i));
+        return out;
+    }
+
+    static std::string render_json(const Report &r)
+    {
+        std::string out;
+        out.reserve(1024 + r.sessions.size() * 512);
+        out += "{\"total\":";
+        out += "{\"sessions\":" + openvpn::to_string(r.sessions.size()) + ',';
+        json_snapshot(out, r.total);
+        out += '}';
+        out += ",\"sessions\":[";
+        for (size_t i = 0; i < r.sessions.size(); ++i)
+        {
+            if (i)
+                out += ',';
+            out += "{\"name\":";
+            json_string(out, r.sessions[i].first);
+            out += ",\"counters\":";
+            out += '{';
+            json_snapshot(out, r.sessions[i].second);
+            out += '}';
+            out += '}';
+        }
+        out += "]}\n";
+        return out;
+    }
+
+  private:
+    // BYTES_IN -> transport_bytes_in, TUN_BYTES_IN -> tun_bytes_in,
+    // TLS_CRYPT_V2_WKC_CACHE_HITS -> tls_crypt_v2_wkc_cache_hits
+    static std::string stat_metric_name(const size_t type)
+    {
+        std::string name = string::to_lower_copy(SessionStats::stat_name(type));
+        if (type <= SessionStats::PACKETS_OUT)
+            name = "transport_" + name;
+        return name;
+    }
+
+    static void family(std::string &out, const std::string &name, const char *type, const std::string &help)
+    {
+        out += "# HELP " + name + ' ' + help + '\n';
+        out += "# TYPE " + name + ' ' + type + '\n';
+    }
+
+    static void sample(std::string &out,
+                       const std::string &name,
+                       const std::string &session,
+                       const char *type,
+                       const count_t value)
+    {
+        out += name;
+        if (!session.empty() || type)
+        {
+            out += '{';
+            if (!session.empty())
+            {
+                out += "session=\"";
+                label_value(out, session);
+                out += '"';
+            }
+            if (type)
+            {
+                if (!session.empty())
+                    out += ',';
+                out += "type=\"";
+                out += string::to_lower_copy(type);
+                out += '"';
+            }
+            out += '}';
+        }
+        out += ' ' + openvpn::to_string(value) + '\n';
+    }
+
+    static void label_value(std::string &out, const std::string &v)
+    {
+        for (const char c : v)
+        {
+            if (c == '\\' || c == '"')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+                out += "\\n";
+            else
+                out += c;
+        }
+    }
+
+    static void json_string(std::string &out, const std::string &v)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for (const char c : v)
+        {
+            const auto u = static_cast<unsigned char>(c);
+            if (c == '\\' || c == '"')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (u < 0x20)
+            {
+                out += "\\u00";
+                out += hex[u >> 4];
+                out += hex[u & 15];
+            }
+            else
+                out += c;
+        }
+        out += '"';
+    }
+
+    // object members, without the enclosing braces
+    static void json_snapshot(std::string &out, const Snapshot &s)
+    {
+        out += "\"connected\":" + openvpn::to_string(s.v[CONNECTED]);
+        out += ",\"stats\":{";
+        for (size_t i = 0; i < SessionStats::N_STATS; ++i)
+        {
+            if (i)
+                out += ',';
+            out += '"' + stat_metric_name(i) + "\":" + openvpn::to_string(s.stat(i));
+        }
+        out += "},\"errors\":{";
+        bool first = true;
+        for (size_t i = 1; i < Error::N_ERRORS; ++i)
+        {
+            if (!s.error(i))
+                continue;
+            if (!first)
+                out += ',';
+            first = false;
+            out += '"' + string::to_lower_copy(Error::name(i)) + "\":" + openvpn::to_string(s.error(i));
+        }
+        out += '}';
+    }
+
+    std::mutex mutex_;
+    std::vector<Slot::Ptr> slots_;
+    Snapshot retired_;
+};
+
+} // namespace openvpn
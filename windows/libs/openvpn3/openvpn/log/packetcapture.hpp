@@ -0,0 +1,355 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Runtime packet capture of tunnel traffic into a pcapng file
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/ip/packetfilter.hpp>
+#include <openvpn/log/pcapng.hpp>
+
+namespace openvpn {
+
+/**
+ * Records packets into a fixed-size, lock-free ring buffer that a
+ * background thread flushes to a pcapng file.
+ *
+ * Interface 0 of the file carries the decrypted tunnel packets
+ * (LINKTYPE_RAW), interface 1 optionally the OpenVPN packets as sent
+ * and received on the transport (LINKTYPE_USER0).  The filter only
+ * applies to tunnel packets.
+ *
+ * Capture can be started and stopped at any time from any thread.  The
+ * packet hooks must all be called from one thread, the event loop of
+ * the session, which is the single producer of the ring.  When capture
+ * is off, a hook costs one relaxed atomic load.  When the ring is full,
+ * packets are dropped and counted rather than blocking the session.
+ */
+class PacketCapture : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<PacketCapture> Ptr;
+
+    OPENVPN_EXCEPTION(packet_capture_error);
+
+    enum Direction
+    {
+        IN,  // from the server
+        OUT, // to the server
+    };
+
+    struct Config
+    {
+        std::string path;                 // pcapng output file
+        std::string filter;               // PacketFilter expression for tunnel packets
+        size_t snaplen = 65535;           // bytes captured per packet
+        size_t ring_bytes = 4 * 1024 * 1024;
+        bool transport = false;           // also capture transport packets
+        std::chrono::milliseconds flush_interval{100};
+    };
+
+    struct Stats
+    {
+        bool running = false;
+        std::uint64_t captured = 0;      // packets added to the ring
+        std::uint64_t filtered = 0;      // tunnel packets rejected by the filter
+        std::uint64_t dropped = 0;       // packets lost because the ring was full
+        std::uint64_t bytes_written = 0; // size of the pcapng file
+    };
+
+    PacketCapture() = default;
+
+    ~PacketCapture()
+    {
+        stop();
+    }
+
+    // Start capturing into a new file, stopping a running capture first.
+    // Throws on a bad filter expression or if the file cannot be created.
+    void start(const Config &config)
+    {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        stop_locked();
+
+        filter_ = PacketFilter(config.filter);
+        transport_ = config.transport;
+
+        size_t cap = 4096;
+        while (cap < config.ring_bytes && cap < (size_t(1) << 30))
+            cap <<= 1;
+        ring_.reset(new unsigned char[cap]);
+        mask_ = cap - 1;
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+
+        // a record must fit into half the ring
+        snaplen_ = std::min(std::max(config.snaplen, size_t(1)), cap / 2 - sizeof(Record));
+
+        bytes_written_.store(0, std::memory_order_relaxed);
+        file_.open(config.path, std::ios::binary | std::ios::trunc);
+        if (!file_)
+            throw packet_capture_error("cannot open " + config.path);
+        std::string hdr;
+        PcapNG::section_header(hdr);
+        PcapNG::interface_description(hdr, PcapNG::LINKTYPE_RAW, static_cast<std::uint32_t>(snaplen_), "tun");
+        PcapNG::interface_description(hdr, PcapNG::LINKTYPE_USER0, static_cast<std::uint32_t>(snaplen_), "transport");
+        write_file(hdr);
+
+        captured_.store(0, std::memory_order_relaxed);
+        filtered_.store(0, std::memory_order_relaxed);
+        dropped_.store(0, std::memory_order_relaxed);
+
+        stopping_ = false;
+        thread_ = std::thread([this, interval = config.flush_interval]()
+                              { writer(interval); });
+        enabled_.store(true, std::memory_order_seq_cst);
+    }
+
+    // Stop capturing, write out what is left in the ring and close the file.
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        stop_locked();
+    }
+
+    bool enabled() const
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // decrypted packet read from or written to the tun device
+    void tun_packet(const Buffer &buf, const Direction dir)
+    {
+        if (enabled())
+            record(TUN, buf, dir);
+    }
+
+    // OpenVPN packet as sent or received on the transport
+    void transport_packet(const Buffer &buf, const Direction dir)
+    {
+        if (enabled())
+            record(TRANSPORT, buf, dir);
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.running = enabled();
+        s.captured = captured_.load(std::memory_order_relaxed);
+        s.filtered = filtered_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        s.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+  private:
+    enum Interface : std::uint16_t
+    {
+        TUN = 0,
+        TRANSPORT = 1,
+        PAD = 0xFFFF, // skip to the start of the ring
+    };
+
+    struct Record
+    {
+        std::uint32_t size; // of the record including this header, multiple of 8
+        std::uint32_t orig_len;
+        std::uint64_t timestamp_us;
+        std::uint32_t cap_len;
+        std::uint16_t iface;
+        std::uint16_t dir;
+    };
+    static_assert(sizeof(Record) % 8 == 0, "ring records must stay 8-byte aligned");
+
+    static size_t align8(const size_t n)
+    {
+        return (n + 7) & ~size_t(7);
+    }
+
+    void record(const Interface iface, const Buffer &buf, const Direction dir)
+    {
+        // announce the write, so that stop() waits for it before
+        // releasing the ring
+        writers_.fetch_add(1, std::memory_order_seq_cst);
+        if (enabled_.load(std::memory_order_seq_cst) && buf.size() && (iface == TUN || transport_))
+        {
+            if (iface == TUN && !filter_.match(buf.c_data(), buf.size()))
+                filtered_.fetch_add(1, std::memory_order_relaxed);
+            else
+                push(iface, buf, dir);
+        }
+        writers_.fetch_sub(1, std::memory_order_release);
+    }
+
+    void push(const Interface iface, const Buffer &buf, const Direction dir)
+    {
+        const size_t cap_len = std::min(buf.size(), snaplen_);
+        const size_t size = align8(sizeof(Record) + cap_len);
+        const size_t cap = mask_ + 1;
+
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        const std::uint64_t tail = tail_.load(std::memory_order_acquire);
+        size_t pos = head & mask_;
+        const size_t contiguous = cap - pos;
+        const size_t needed = contiguous < size ? contiguous + size : size;
+        if (head + needed - tail > cap)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (contiguous < size)
+        {
+            // the reader skips ends of the ring too short for a header
+            if (contiguous >= sizeof(Record))
+            {
+                Record pad{};
+                pad.size = static_cast<std::uint32_t>(contiguous);
+                pad.iface = PAD;
+                std::memcpy(&ring_[pos], &pad, sizeof(pad));
+            }
+            head += contiguous;
+            pos = 0;
+        }
+
+        Record r;
+        r.size = static_cast<std::uint32_t>(size);
+        r.orig_len = static_cast<std::uint32_t>(buf.size());
+        r.timestamp_us = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                        std::chrono::system_clock::now().time_since_epoch())
+                                                        .count());
+        r.cap_len = static_cast<std::uint32_t>(cap_len);
+        r.iface = iface;
+        r.dir = static_cast<std::uint16_t>(dir);
+        std::memcpy(&ring_[pos], &r, sizeof(r));
+        std::memcpy(&ring_[pos + sizeof(r)], buf.c_data(), cap_len);
+
+        head_.store(head + size, std::memory_order_release);
+        captured_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Move all complete records from the ring to the file.  Only called
+    // by the writer thread, or by stop() after it was joined.
+    void drain()
+    {
+        const size_t cap = mask_ + 1;
+        std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+        const std::uint64_t head = head_.load(std::memory_order_acquire);
+        if (tail == head)
+            return;
+
+        std::string out;
+        out.reserve(static_cast<size_t>(head - tail) + 64);
+        while (tail < head)
+        {
+            const size_t pos = tail & mask_;
+            if (cap - pos < sizeof(Record))
+            {
+                tail += cap - pos;
+                continue;
+            }
+            Record r;
+            std::memcpy(&r, &ring_[pos], sizeof(r));
+            if (r.iface != PAD)
+                PcapNG::enhanced_packet(out,
+                                        r.iface,
+                                        r.timestamp_us,
+                                        &ring_[pos + sizeof(r)],
+                                        r.cap_len,
+                                        r.orig_len,
+                                        r.dir == IN ? PcapNG::EPB_FLAGS_INBOUND : PcapNG::EPB_FLAGS_OUTBOUND);
+            tail += r.size;
+        }
+        tail_.store(tail, std::memory_order_release);
+        write_file(out);
+    }
+
+    void write_file(const std::string &data)
+    {
+        file_.write(data.data(), data.size());
+        file_.flush();
+        bytes_written_.fetch_add(data.size(), std::memory_order_relaxed);
+    }
+
+    void writer(const std::chrono::milliseconds interval)
+    {
+        std::unique_lock<std::mutex> lock(thread_mutex_);
+        while (!stopping_)
+        {
+            thread_cv_.wait_for(lock, interval, [this]()
+                                { return stopping_; });
+            drain();
+        }
+    }
+
+    void stop_locked()
+    {
+        if (!thread_.joinable())
+            return;
+
+        // wait for a producer that already saw enabled_ == true
+        enabled_.store(false, std::memory_order_seq_cst);
+        while (writers_.load(std::memory_order_seq_cst))
+            std::this_thread::yield();
+
+        {
+            std::lock_guard<std::mutex> lock(thread_mutex_);
+            stopping_ = true;
+        }
+        thread_cv_.notify_all();
+        thread_.join();
+        drain();
+        file_.close();
+        ring_.reset();
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<unsigned int> writers_{0};
+
+    // ring, written by the session thread and read by the writer thread
+    std::unique_ptr<unsigned char[]> ring_;
+    size_t mask_ = 0;
+    size_t snaplen_ = 0;
+    std::atomic<std::uint64_t> head_{0};
+    std::atomic<std::uint64_t> tail_{0};
+
+    PacketFilter filter_;
+    bool transport_ = false;
+
+    std::atomic<std::uint64_t> captured_{0};
+    std::atomic<std::uint64_t> filtered_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> bytes_written_{0};
+
+    std::mutex control_mutex_; // serializes start() and stop()
+    std::mutex thread_mutex_;
+    std::condition_variable thread_cv_;
+    bool stopping_ = false;
+    std::thread thread_;
+    std::ofstream file_;
+};
+
+} // namespace openvpn
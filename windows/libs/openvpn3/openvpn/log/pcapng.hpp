@@ -0,0 +1,151 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Encode pcapng blocks (draft-ietf-opsawg-pcapng) in host byte order
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+namespace openvpn::PcapNG {
+
+enum : std::uint16_t
+{
+    LINKTYPE_RAW = 101,   // raw IPv4/IPv6 packets
+    LINKTYPE_USER0 = 147, // private use, here: OpenVPN transport payload
+};
+
+enum : std::uint32_t
+{
+    EPB_FLAGS_INBOUND = 1,
+    EPB_FLAGS_OUTBOUND = 2,
+};
+
+namespace detail {
+enum : std::uint32_t
+{
+    BT_SHB = 0x0A0D0D0A,
+    BT_IDB = 0x00000001,
+    BT_EPB = 0x00000006,
+};
+
+enum : std::uint16_t
+{
+    OPT_ENDOFOPT = 0,
+    OPT_IF_NAME = 2,
+    OPT_IF_TSRESOL = 9,
+    OPT_EPB_FLAGS = 2,
+};
+
+inline size_t pad4(const size_t len)
+{
+    return (len + 3) & ~size_t(3);
+}
+
+template <typename T>
+inline void put(std::string &out, const T v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline void put_padded(std::string &out, const void *data, const size_t len)
+{
+    if (len)
+        out.append(static_cast<const char *>(data), len);
+    out.append(pad4(len) - len, '\0');
+}
+
+inline void put_option(std::string &out, const std::uint16_t code, const void *data, const std::uint16_t len)
+{
+    put(out, code);
+    put(out, len);
+    put_padded(out, data, len);
+}
+
+// begin a block, returning the offset of its length field
+inline size_t begin_block(std::string &out, const std::uint32_t type)
+{
+    put(out, type);
+    const size_t off = out.size();
+    put(out, std::uint32_t(0));
+    return off;
+}
+
+// finish a block started at begin_block() - 4
+inline void end_block(std::string &out, const size_t len_off)
+{
+    const auto len = static_cast<std::uint32_t>(out.size() - (len_off - 4) + 4);
+    std::memcpy(&out[len_off], &len, sizeof(len));
+    put(out, len);
+}
+} // namespace detail
+
+// Section Header Block, starts a file
+inline void section_header(std::string &out)
+{
+    using namespace detail;
+    const size_t off = begin_block(out, BT_SHB);
+    put(out, std::uint32_t(0x1A2B3C4D)); // byte-order magic
+    put(out, std::uint16_t(1));          // major version
+    put(out, std::uint16_t(0));          // minor version
+    put(out, std::int64_t(-1));          // section length not specified
+    end_block(out, off);
+}
+
+// Interface Description Block.  Interfaces are numbered from 0 in the
+// order of their description blocks.  Timestamps are in microseconds.
+inline void interface_description(std::string &out,
+                                  const std::uint16_t linktype,
+                                  const std::uint32_t snaplen,
+                                  const std::string &name)
+{
+    using namespace detail;
+    const size_t off = begin_block(out, BT_IDB);
+    put(out, linktype);
+    put(out, std::uint16_t(0));
+    put(out, snaplen);
+    if (!name.empty())
+        put_option(out, OPT_IF_NAME, name.c_str(), static_cast<std::uint16_t>(std::min(name.size(), size_t(0xFFFF))));
+    const std::uint8_t tsresol = 6;
+    put_option(out, OPT_IF_TSRESOL, &tsresol, 1);
+    put_option(out, OPT_ENDOFOPT, nullptr, 0);
+    end_block(out, off);
+}
+
+// Enhanced Packet Block
+inline void enhanced_packet(std::string &out,
+                            const std::uint32_t interface_id,
+                            const std::uint64_t timestamp_us,
+                            const void *data,
+                            const std::uint32_t captured_len,
+                            const std::uint32_t original_len,
+                            const std::uint32_t flags)
+{
+    using namespace detail;
+    const size_t off = begin_block(out, BT_EPB);
+    put(out, interface_id);
+    put(out, static_cast<std::uint32_t>(timestamp_us >> 32));
+    put(out, static_cast<std::uint32_t>(timestamp_us));
+    put(out, captured_len);
+    put(out, original_len);
+    put_padded(out, data, captured_len);
+    if (flags)
+    {
+        put_option(out, OPT_EPB_FLAGS, &flags, sizeof(flags));
+        put_option(out, OPT_ENDOFOPT, nullptr, 0);
+    }
+    end_block(out, off);
+}
+
+} // namespace openvpn::PcapNG
@@ -41,6 +41,17 @@ class SessionStats : public RC<thread_safe_refcount>
         TUN_BYTES_OUT,   // tun/tap bytes out
         TUN_PACKETS_IN,  // tun/tap packets in
         TUN_PACKETS_OUT, // tun/tap packets out
+
+        // tls-crypt-v2 server WKc cache stats
+        TLS_CRYPT_V2_WKC_CACHE_HITS,   // client key taken from the cache
+        TLS_CRYPT_V2_WKC_CACHE_MISSES, // client key unwrapped from the WKc
+
+        // DNS stub stats
+        DNS_CACHE_QUERIES,       // queries to pushed DNS servers seen
+        DNS_CACHE_HITS,          // answered from the cache
+        DNS_CACHE_NEGATIVE_HITS, // answered from cached NXDOMAIN/NODATA
+        DNS_CACHE_COALESCED,     // answered with the response to an earlier query
+        DNS_CACHE_FORWARDED,     // sent on to the server
         N_STATS,
     };
 
@@ -99,6 +110,13 @@ class SessionStats : public RC<thread_safe_refcount>
             "TUN_BYTES_OUT",
             "TUN_PACKETS_IN",
             "TUN_PACKETS_OUT",
+            "TLS_CRYPT_V2_WKC_CACHE_HITS",
+            "TLS_CRYPT_V2_WKC_CACHE_MISSES",
+            "DNS_CACHE_QUERIES",
+            "DNS_CACHE_HITS",
+            "DNS_CACHE_NEGATIVE_HITS",
+            "DNS_CACHE_COALESCED",
+            "DNS_CACHE_FORWARDED",
         };
 
         static_assert(N_STATS == array_size(names), "stats names array inconsistency");
@@ -128,6 +128,9 @@ class CipherContext
         CIPH_CBC_MODE = MBEDTLS_MODE_CBC
     };
 
+    // mbedtls_cipher_update() needs distinct input and output buffers in CBC mode
+    static constexpr bool SUPPORTS_IN_PLACE = false;
+
     CipherContext() = default;
 
     ~CipherContext()
@@ -787,6 +787,17 @@ class MbedTLSContext : public SSLFactoryAPI
             return ct_out.read_buf();
         }
 
+        void compact() override
+        {
+            ct_in.compact();
+            ct_out.compact();
+        }
+
+        size_t memory_usage() const override
+        {
+            return ct_in.memory_usage() + ct_out.memory_usage();
+        }
+
         std::string ssl_handshake_details() const override
         {
             if (ssl)
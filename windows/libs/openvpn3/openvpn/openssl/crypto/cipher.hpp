@@ -64,6 +64,9 @@ class CipherContext
         CIPH_CBC_MODE = EVP_CIPH_CBC_MODE
     };
 
+    // EVP_CipherUpdate() may write its output over its input
+    static constexpr bool SUPPORTS_IN_PLACE = true;
+
     CipherContext() = default;
 
     ~CipherContext()
@@ -0,0 +1,404 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Revocation index built from X509 CRLs.  Meant for large CRLs that
+// are reloaded often: the index is looked up from the verify callback
+// instead of adding the CRLs to the X509_STORE of an SSL context, and
+// CRLStore rebuilds it off the I/O threads and swaps it in atomically.
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/evp.h>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/pki/cclist.hpp>
+#include <openvpn/openssl/util/error.hpp>
+#include <openvpn/openssl/pki/x509.hpp>
+#include <openvpn/openssl/pki/crl.hpp>
+
+namespace openvpn::OpenSSLPKI {
+
+class CRLIndex : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<CRLIndex> Ptr;
+    typedef CertCRLListTemplate<X509List, CRLList> CertCRLList;
+
+    OPENVPN_EXCEPTION(crl_index_error);
+
+    enum Status
+    {
+        GOOD,
+        REVOKED,
+        NO_CRL,
+        CRL_NOT_YET_VALID,
+        CRL_EXPIRED,
+    };
+
+    // Verify each CRL against its issuer in ca and index its entries.
+    // Tables for CRLs that are unchanged since prev are shared with it
+    // rather than verified and sorted again.  If several CRLs have the
+    // same issuer, the most recent one is used.
+    static Ptr build(const CRLList &crls, const X509List &ca, const CRLIndex *prev = nullptr)
+    {
+        Ptr ret(new CRLIndex());
+        for (const auto &crl : crls)
+        {
+            Table::Ptr t;
+            unsigned char digest[EVP_MAX_MD_SIZE];
+            unsigned int digest_len = 0;
+            if (!::X509_CRL_digest(crl.obj(), ::EVP_sha256(), digest, &digest_len) || digest_len != Table::DIGEST_SIZE)
+                throw OpenSSLException("CRLIndex: X509_CRL_digest");
+            if (prev)
+                t = prev->find_digest(digest);
+            if (!t)
+                t = new_table(crl.obj(), ca, digest);
+
+            auto i = std::find_if(ret->tables.begin(), ret->tables.end(), [&t](const Table::Ptr &e)
+                                  { return ::X509_NAME_cmp(e->issuer, t->issuer) == 0; });
+            if (i == ret->tables.end())
+                ret->tables.push_back(std::move(t));
+            else if (t->this_update > (*i)->this_update)
+                *i = std::move(t);
+        }
+        return ret;
+    }
+
+    // Parse and index PEM CRLs (certificates in crl_txt are ignored)
+    static Ptr build(const std::string &crl_txt, const X509List &ca, const CRLIndex *prev = nullptr)
+    {
+        X509List certs;
+        CRLList crls;
+        CertCRLList::from_string(crl_txt, "crl", &certs, &crls);
+        return build(crls, ca, prev);
+    }
+
+    // Revocation status of cert.  Self-signed certs are always GOOD,
+    // anything else needs a current CRL from its issuer.
+    Status check(::X509 *cert, const std::time_t now) const
+    {
+        if (::X509_get_extension_flags(cert) & EXFLAG_SS)
+            return GOOD;
+        const Table *t = find_issuer(::X509_get_issuer_name(cert));
+        if (!t)
+            return NO_CRL;
+        if (now < t->this_update)
+            return CRL_NOT_YET_VALID;
+        if (t->next_update && now >= t->next_update)
+            return CRL_EXPIRED;
+        Serial s;
+        if (!make_serial(::X509_get0_serialNumber(cert), s))
+            return GOOD; // longer than any serial in the index
+        return std::binary_search(t->serials.begin(), t->serials.end(), s) ? REVOKED : GOOD;
+    }
+
+    // the X509_V_ERR_x code that OpenSSL itself would use for status
+    static int x509_error(const Status status)
+    {
+        switch (status)
+        {
+        case GOOD:
+            return X509_V_OK;
+        case REVOKED:
+            return X509_V_ERR_CERT_REVOKED;
+        case NO_CRL:
+            return X509_V_ERR_UNABLE_TO_GET_CRL;
+        case CRL_NOT_YET_VALID:
+            return X509_V_ERR_CRL_NOT_YET_VALID;
+        default:
+            return X509_V_ERR_CRL_HAS_EXPIRED;
+        }
+    }
+
+    // number of indexed CRLs
+    size_t n_crls() const
+    {
+        return tables.size();
+    }
+
+    // number of revoked serials
+    size_t size() const
+    {
+        size_t ret = 0;
+        for (const auto &t : tables)
+            ret += t->serials.size();
+        return ret;
+    }
+
+    // true if both indexes use the same table for the CRL of issuer
+    bool shares_table(const CRLIndex &other, const ::X509_NAME *issuer) const
+    {
+        const Table *t = find_issuer(issuer);
+        return t && t == other.find_issuer(issuer);
+    }
+
+  private:
+    // ASN1 INTEGER serial: sign bit and length in the first byte,
+    // followed by the magnitude, zero-padded.  Sorts by length, then
+    // value, which is all binary_search needs.
+    typedef std::array<unsigned char, 32> Serial;
+
+    struct Table : public RC<thread_safe_refcount>
+    {
+        typedef RCPtr<Table> Ptr;
+
+        static constexpr unsigned int DIGEST_SIZE = 32;
+
+        Table() = default;
+        Table(const Table &) = delete;
+        Table &operator=(const Table &) = delete;
+
+        ~Table()
+        {
+            ::X509_NAME_free(issuer);
+        }
+
+        ::X509_NAME *issuer = nullptr;
+        unsigned char digest[DIGEST_SIZE];
+        std::time_t this_update = 0;
+        std::time_t next_update = 0; // 0 if the CRL has none
+        std::vector<Serial> serials; // sorted
+    };
+
+    CRLIndex() = default;
+
+    static Table::Ptr new_table(::X509_CRL *crl, const X509List &ca, const unsigned char *digest)
+    {
+        const ::X509_NAME *issuer = ::X509_CRL_get_issuer(crl);
+
+        // same check X509_verify_cert() does for each CRL it uses
+        bool verified = false;
+        for (const auto &c : ca)
+        {
+            if (::X509_NAME_cmp(::X509_get_subject_name(c.obj()), issuer) == 0
+                && ::X509_CRL_verify(crl, ::X509_get0_pubkey(c.obj())) == 1)
+            {
+                verified = true;
+                break;
+            }
+        }
+        if (!verified)
+            throw crl_index_error("CRL signature does not verify against any CA");
+
+        Table::Ptr t(new Table());
+        t->issuer = ::X509_NAME_dup(issuer);
+        if (!t->issuer)
+            throw OpenSSLException("CRLIndex: X509_NAME_dup");
+        std::memcpy(t->digest, digest, Table::DIGEST_SIZE);
+        t->this_update = asn1_time(::X509_CRL_get0_lastUpdate(crl));
+        if (const ::ASN1_TIME *next = ::X509_CRL_get0_nextUpdate(crl))
+            t->next_update = asn1_time(next);
+
+        STACK_OF(X509_REVOKED) *revoked = ::X509_CRL_get_REVOKED(crl);
+        const int n = revoked ? sk_X509_REVOKED_num(revoked) : 0;
+        t->serials.resize(size_t(n));
+        for (int i = 0; i < n; ++i)
+        {
+            const ::ASN1_INTEGER *serial = ::X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i));
+            if (!make_serial(serial, t->serials[size_t(i)]))
+                throw crl_index_error("CRL entry serial number too long");
+        }
+        std::sort(t->serials.begin(), t->serials.end());
+        t->serials.erase(std::unique(t->serials.begin(), t->serials.end()), t->serials.end());
+        t->serials.shrink_to_fit();
+        return t;
+    }
+
+    static bool make_serial(const ::ASN1_INTEGER *ai, Serial &s)
+    {
+        const int len = ::ASN1_STRING_length(ai);
+        if (len < 0 || size_t(len) >= s.size())
+            return false;
+        s.fill(0);
+        s[0] = static_cast<unsigned char>(len | (::ASN1_STRING_type(ai) == V_ASN1_NEG_INTEGER ? 0x80 : 0));
+        std::memcpy(s.data() + 1, ::ASN1_STRING_get0_data(ai), size_t(len));
+        return true;
+    }
+
+    static std::time_t asn1_time(const ::ASN1_TIME *t)
+    {
+        int days = 0;
+        int secs = 0;
+        if (!t || !::ASN1_TIME_diff(&days, &secs, nullptr, t))
+            throw crl_index_error("bad CRL update time");
+        return std::time(nullptr) + std::time_t(days) * 86400 + secs;
+    }
+
+    const Table *find_issuer(const ::X509_NAME *issuer) const
+    {
+        for (const auto &t : tables)
+        {
+            if (::X509_NAME_cmp(t->issuer, issuer) == 0)
+                return t.get();
+        }
+        return nullptr;
+    }
+
+    Table::Ptr find_digest(const unsigned char *digest) const
+    {
+        for (const auto &t : tables)
+        {
+            if (std::memcmp(t->digest, digest, Table::DIGEST_SIZE) == 0)
+                return t;
+        }
+        return Table::Ptr();
+    }
+
+    std::vector<Table::Ptr> tables;
+};
+
+// Holds the current CRLIndex.  Lookups take a snapshot of it; reloads
+// build a new index, by default on a background thread, and swap it in
+// without touching any SSL context.  A failed reload keeps the
+// previous index.
+class CRLStore : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<CRLStore> Ptr;
+
+    struct Stats
+    {
+        unsigned int reloads = 0;  // successful
+        unsigned int failures = 0; // index kept
+        std::string last_error;
+    };
+
+    // ca must contain the issuers of all CRLs that will be loaded
+    explicit CRLStore(X509List ca_arg)
+        : ca(std::move(ca_arg))
+    {
+    }
+
+    ~CRLStore()
+    {
+        wait();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    CRLStore(const CRLStore &) = delete;
+    CRLStore &operator=(const CRLStore &) = delete;
+
+    CRLIndex::Ptr index() const
+    {
+        std::lock_guard lock(index_mutex);
+        return index_;
+    }
+
+    CRLIndex::Status check(::X509 *cert, const std::time_t now) const
+    {
+        const CRLIndex::Ptr idx = index();
+        return idx ? idx->check(cert, now) : CRLIndex::NO_CRL;
+    }
+
+    // build and install a new index on the calling thread
+    void reload(const std::string &crl_txt)
+    {
+        try
+        {
+            CRLIndex::Ptr idx = CRLIndex::build(crl_txt, ca, index().get());
+            std::lock_guard lock(index_mutex);
+            index_.swap(idx);
+            ++stats_.reloads;
+        }
+        catch (const std::exception &e)
+        {
+            std::lock_guard lock(index_mutex);
+            ++stats_.failures;
+            stats_.last_error = e.what();
+            throw;
+        }
+    }
+
+    // Like reload(), on a background thread.  If a reload is already
+    // running, crl_txt replaces any reload still waiting behind it.
+    void reload_background(std::string crl_txt)
+    {
+        std::lock_guard lock(work_mutex);
+        pending = std::move(crl_txt);
+        has_pending = true;
+        if (!running)
+        {
+            if (worker.joinable())
+                worker.join(); // finished, see work()
+            running = true;
+            worker = std::thread([this]()
+                                 { work(); });
+        }
+    }
+
+    // block until no background reload is running
+    void wait() const
+    {
+        std::unique_lock lock(work_mutex);
+        idle.wait(lock, [this]()
+                  { return !running; });
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard lock(index_mutex);
+        return stats_;
+    }
+
+  private:
+    void work()
+    {
+        std::unique_lock lock(work_mutex);
+        while (has_pending)
+        {
+            const std::string crl_txt = std::move(pending);
+            pending.clear();
+            has_pending = false;
+            lock.unlock();
+            try
+            {
+                reload(crl_txt);
+            }
+            catch (const std::exception &)
+            {
+                // recorded in stats
+            }
+            lock.lock();
+        }
+        running = false;
+        idle.notify_all();
+    }
+
+    const X509List ca;
+
+    mutable std::mutex index_mutex;
+    CRLIndex::Ptr index_;
+    Stats stats_;
+
+    mutable std::mutex work_mutex;
+    mutable std::condition_variable idle;
+    std::thread worker;
+    std::string pending;
+    bool has_pending = false;
+    bool running = false;
+};
+
+} // namespace openvpn::OpenSSLPKI
@@ -15,8 +15,12 @@
 #include <map>
 #include <set>
 #include <tuple>
+#include <cstdint>
 #include <memory>
 #include <utility>
+#include <mutex>
+#include <atomic>
+#include <functional>
 
 #include <openssl/ssl.h>
 
@@ -28,7 +32,9 @@ namespace openvpn {
 // Client-side session cache.
 // (We don't cache server-side sessions because we use TLS
 // session resumption tickets which are stateless on the server).
-class OpenSSLSessionCache : public RC<thread_unsafe_refcount>
+// Thread-safe, so that contexts on different threads can share one
+// cache (see OpenSSLContext::Config::set_client_session_cache).
+class OpenSSLSessionCache : public RC<thread_safe_refcount>
 {
   public:
     typedef RCPtr<OpenSSLSessionCache> Ptr;
@@ -106,7 +112,9 @@ class OpenSSLSessionCache : public RC<thread_unsafe_refcount>
         {
             if (!sess)
                 return;
-            auto mi = MSF::find(cache->map, key);
+            Shard &shard = cache->shard(key);
+            std::lock_guard lock(shard.mutex);
+            auto mi = MSF::find(shard.map, key);
             if (mi)
             {
                 /* auto ins = */ mi->second.emplace(sess);
@@ -115,9 +123,9 @@ class OpenSSLSessionCache : public RC<thread_unsafe_refcount>
             else
             {
                 // OPENVPN_LOG("OpenSSLSessionCache::Key::commit CREATE key=" << key);
-                auto ins = cache->map.emplace(std::piecewise_construct,
-                                              std::forward_as_tuple(key),
-                                              std::forward_as_tuple());
+                auto ins = shard.map.emplace(std::piecewise_construct,
+                                             std::forward_as_tuple(key),
+                                             std::forward_as_tuple());
                 ins.first->second.emplace(sess);
             }
         }
@@ -127,14 +135,31 @@ class OpenSSLSessionCache : public RC<thread_unsafe_refcount>
         OpenSSLSessionCache::Ptr cache;
     };
 
+    struct Stats
+    {
+        std::uint64_t hits = 0;   // lookups that found a session to resume
+        std::uint64_t misses = 0; // lookups that found none
+
+        double hit_rate() const
+        {
+            return hits + misses ? double(hits) / double(hits + misses) : 0.0;
+        }
+    };
+
     // Remove a session from the map after calling func() on it.
+    // func() is called with the shard locked, so it must not call
+    // back into the cache.
     // This would be a lot cleaner if we had C++17 std::set::extract().
     template <typename FUNC>
     void extract(const std::string &key, FUNC func)
     {
+        Shard &sh = shard(key);
+        std::lock_guard lock(sh.mutex);
+        Map &map = sh.map;
         auto mi = MSF::find(map, key);
         if (mi)
         {
+            ++hits;
             // OPENVPN_LOG("OpenSSLSessionCache::Key::lookup EXISTS key=" << key);
             SessionSet &ss = mi->second;
             if (ss.empty())
@@ -146,29 +171,66 @@ class OpenSSLSessionCache : public RC<thread_unsafe_refcount>
             }
             catch (...)
             {
-                remove_session(mi, ss, ssi);
+                remove_session(map, mi, ss, ssi);
                 throw;
             }
-            remove_session(mi, ss, ssi);
+            remove_session(map, mi, ss, ssi);
         }
         else
         {
+            ++misses;
             // OPENVPN_LOG("OpenSSLSessionCache::Key::lookup NOT_FOUND key=" << key);
         }
     }
 
+    Stats stats() const
+    {
+        Stats s;
+        s.hits = hits.load(std::memory_order_relaxed);
+        s.misses = misses.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // number of cached sessions
+    size_t size() const
+    {
+        size_t ret = 0;
+        for (auto &sh : shards)
+        {
+            std::lock_guard lock(sh.mutex);
+            for (auto &e : sh.map)
+                ret += e.second.size();
+        }
+        return ret;
+    }
+
   private:
     using SessionSet = std::set<Session>;
     using Map = std::map<std::string, SessionSet>;
 
-    void remove_session(Map::iterator mi, SessionSet &ss, SessionSet::iterator ssi)
+    static constexpr size_t N_SHARDS = 16;
+
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        Map map;
+    };
+
+    Shard &shard(const std::string &key)
+    {
+        return shards[std::hash<std::string>()(key) % N_SHARDS];
+    }
+
+    void remove_session(Map &map, Map::iterator mi, SessionSet &ss, SessionSet::iterator ssi)
     {
         ss.erase(ssi);
         if (ss.empty())
             map.erase(mi);
     }
 
-    Map map;
+    Shard shards[N_SHARDS];
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
 };
 
 } // namespace openvpn
@@ -71,6 +71,7 @@
 #endif
 #include <openvpn/openssl/pki/x509.hpp>
 #include <openvpn/openssl/pki/crl.hpp>
+#include <openvpn/openssl/pki/crlindex.hpp>
 #include <openvpn/openssl/pki/pkey.hpp>
 #include <openvpn/openssl/pki/dh.hpp>
 #include <openvpn/openssl/pki/x509store.hpp>
@@ -240,6 +241,20 @@ class OpenSSLContext : public SSLFactoryAPI
             client_session_tickets = v;
         }
 
+        // client side, share one session cache between contexts,
+        // requires client session tickets
+        void set_client_session_cache(OpenSSLSessionCache::Ptr cache)
+        {
+            client_session_cache = std::move(cache);
+        }
+
+        // Check peer certs against a CRL index instead of CRLs in the
+        // cert store.  The store can be reloaded while contexts use it.
+        void set_crl_store(OpenSSLPKI::CRLStore::Ptr store)
+        {
+            crl_store = std::move(store);
+        }
+
         void enable_legacy_algorithms(const bool v) override
         {
             if (v)
@@ -778,6 +793,8 @@ class OpenSSLContext : public SSLFactoryAPI
         X509Track::ConfigSet x509_track_config;
         bool local_cert_enabled = true;
         bool client_session_tickets = false;
+        OpenSSLSessionCache::Ptr client_session_cache; // client side only, shared between contexts if set
+        OpenSSLPKI::CRLStore::Ptr crl_store;
     };
 
     // Represents an actual SSL session.
@@ -866,6 +883,24 @@ class OpenSSLContext : public SSLFactoryAPI
             return bmq_stream::memq_from_bio(ct_out)->read_buf();
         }
 
+        void compact() override
+        {
+            if (ct_in)
+                bmq_stream::memq_from_bio(ct_in)->compact();
+            if (ct_out)
+                bmq_stream::memq_from_bio(ct_out)->compact();
+        }
+
+        size_t memory_usage() const override
+        {
+            size_t ret = 0;
+            if (ct_in)
+                ret += bmq_stream::const_memq_from_bio(ct_in)->memory_usage();
+            if (ct_out)
+                ret += bmq_stream::const_memq_from_bio(ct_out)->memory_usage();
+            return ret;
+        }
+
         std::string ssl_handshake_details() const override
         {
             return ssl_handshake_details(ssl);
@@ -1330,8 +1365,13 @@ class OpenSSLContext : public SSLFactoryAPI
         {
             if (config->client_session_tickets)
             {
-                SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT);
-                sess_cache.reset(new OpenSSLSessionCache);
+                // Sessions live only in sess_cache: SSL_CTX_free() flushes the
+                // internal store and marks its sessions non-resumable, which
+                // would break a cache shared with other contexts.
+                SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+                sess_cache = config->client_session_cache;
+                if (!sess_cache)
+                    sess_cache.reset(new OpenSSLSessionCache);
             }
             else
             {
@@ -1892,6 +1932,15 @@ class OpenSSLContext : public SSLFactoryAPI
         }
     }
 
+    static bool verify_crl_store(const OpenSSLPKI::CRLStore &crl_store, X509_STORE_CTX *ctx)
+    {
+        const OpenSSLPKI::CRLIndex::Status status = crl_store.check(X509_STORE_CTX_get_current_cert(ctx), std::time(nullptr));
+        if (status == OpenSSLPKI::CRLIndex::GOOD)
+            return true;
+        X509_STORE_CTX_set_error(ctx, OpenSSLPKI::CRLIndex::x509_error(status));
+        return false;
+    }
+
     static int verify_callback_client(int preverify_ok, X509_STORE_CTX *ctx)
     {
         // get the OpenSSL SSL object
@@ -1903,6 +1952,10 @@ class OpenSSLContext : public SSLFactoryAPI
         // get OpenSSLContext::SSL
         SSL *self_ssl = (SSL *)SSL_get_ex_data(ssl, SSL::ssl_data_index);
 
+        // revocation check, if CRLs are not in the cert store
+        if (preverify_ok && self->config->crl_store)
+            preverify_ok = verify_crl_store(*self->config->crl_store, ctx);
+
         // get depth
         const int depth = X509_STORE_CTX_get_error_depth(ctx);
 
@@ -2013,6 +2066,10 @@ class OpenSSLContext : public SSLFactoryAPI
         // get OpenSSLContext::SSL
         SSL *self_ssl = (SSL *)SSL_get_ex_data(ssl, SSL::ssl_data_index);
 
+        // revocation check, if CRLs are not in the cert store
+        if (preverify_ok && self->config->crl_store)
+            preverify_ok = verify_crl_store(*self->config->crl_store, ctx);
+
         // get error code
         const int err = X509_STORE_CTX_get_error(ctx);
 
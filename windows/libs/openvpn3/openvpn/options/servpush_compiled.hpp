@@ -0,0 +1,167 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Server-side PUSH_REPLY/PUSH_UPDATE messages that are escaped and
+// fragmented once and shared by all sessions.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/bufstr.hpp>
+#include <openvpn/options/servpush.hpp>
+#include <openvpn/options/continuation_fragment.hpp>
+
+namespace openvpn {
+
+/**
+ * A push list compiled into push messages.
+ *
+ * Most options pushed by a server are the same for every client.  This
+ * class escapes those options once and splits them into
+ * PushContinuationFragment sized messages.  Per-client options such as
+ * ifconfig, peer-id or auth-token are appended as a tail by render().
+ *
+ * render() produces the same messages as building the whole push list
+ * as CSV and passing it to PushContinuationFragment.  Full fragments
+ * are copied with a single memcpy each, so only the tail has to be
+ * escaped and fragmented per client.  The copies are needed because the
+ * control channel takes ownership of the buffers passed to
+ * ServerSession::push_reply() and modifies them.
+ *
+ * Instances are immutable after construction and may be shared between
+ * threads.  A server keeps one per push configuration and sends it to
+ * each session with ManClientInstance::Recv::push_reply_compiled().
+ */
+class CompiledPushList : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<CompiledPushList> Ptr;
+
+    // prefix should be PUSH_REPLY or PUSH_UPDATE
+    CompiledPushList(const std::vector<std::string> &common, std::string prefix)
+        : prefix_(std::move(prefix))
+    {
+        std::string open;
+        for (const auto &opt : common)
+        {
+            const std::string escaped = escape(opt);
+            if (open.empty())
+                open = prefix_;
+            if (would_overflow(open.size(), escaped))
+            {
+                open += ",push-continuation 2";
+                full_.push_back(to_buffer(open));
+                open = prefix_;
+            }
+            open += ',';
+            open += escaped;
+        }
+        if (!open.empty())
+            open_ = to_buffer(open);
+    }
+
+    // Return the push messages for a client, with the options in tail
+    // appended to the common options.
+    std::vector<BufferPtr> render(const std::vector<std::string> &tail = {}) const
+    {
+        std::vector<BufferPtr> ret;
+        ret.reserve(full_.size() + 2);
+        for (const auto &bp : full_)
+            ret.push_back(copy(*bp));
+
+        BufferPtr cur;
+        if (open_)
+            cur = copy(*open_);
+        for (const auto &opt : tail)
+        {
+            const std::string escaped = escape(opt);
+            if (!cur)
+                cur = new_buffer();
+            if (would_overflow(cur->size(), escaped))
+            {
+                buf_append_string(*cur, ",push-continuation 2");
+                ret.push_back(std::move(cur));
+                cur = new_buffer();
+            }
+            cur->push_back(',');
+            buf_append_string(*cur, escaped);
+        }
+
+        if (cur)
+        {
+            if (!ret.empty())
+                buf_append_string(*cur, ",push-continuation 1");
+            ret.push_back(std::move(cur));
+        }
+        return ret;
+    }
+
+    const std::string &prefix() const
+    {
+        return prefix_;
+    }
+
+    // number of messages produced for an empty tail
+    size_t n_messages() const
+    {
+        return full_.size() + (open_ ? 1 : 0);
+    }
+
+  private:
+    // same limit as PushContinuationFragment, including room for
+    // ",push-continuation n" and the comma in front of the option
+    static bool would_overflow(const size_t size, const std::string &escaped)
+    {
+        return size + escaped.size() + 20 + 1 > PushContinuationFragment::FRAGMENT_SIZE;
+    }
+
+    static std::string escape(const std::string &opt)
+    {
+        std::ostringstream os;
+        ServerPushList::output_arg(opt, os);
+        return os.str();
+    }
+
+    // include extra byte for null termination by push_reply()
+    BufferPtr new_buffer() const
+    {
+        auto bp = BufferAllocatedRc::Create(PushContinuationFragment::FRAGMENT_SIZE + 1);
+        buf_append_string(*bp, prefix_);
+        return bp;
+    }
+
+    static BufferPtr copy(const Buffer &buf)
+    {
+        auto bp = BufferAllocatedRc::Create(std::max(buf.size(), PushContinuationFragment::FRAGMENT_SIZE) + 1);
+        bp->write(buf.c_data(), buf.size());
+        return bp;
+    }
+
+    static BufferPtr to_buffer(const std::string &str)
+    {
+        auto bp = BufferAllocatedRc::Create(str.size());
+        buf_append_string(*bp, str);
+        return bp;
+    }
+
+    const std::string prefix_;
+    std::vector<BufferPtr> full_; // complete fragments, ending in push-continuation 2
+    BufferPtr open_;              // last fragment of the common options, without push-continuation
+};
+
+} // namespace openvpn
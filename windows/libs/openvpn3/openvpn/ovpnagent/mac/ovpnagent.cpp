@@ -607,7 +607,7 @@ void work(openvpn_io::io_context &io_context,
         // privilege has now been downgraded
 
         // run i/o reactor
-        io_context.run();
+        runctx.run_worker(io_context, unit);
         runctx.clear_server(unit);
         serv->stop();
     }
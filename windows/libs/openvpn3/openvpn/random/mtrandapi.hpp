@@ -70,14 +70,6 @@ class MTRand : public WeakRandomAPI
         return rng();
     }
 
-  private:
-    bool rndbytes(unsigned char *buf, size_t size)
-    {
-        while (size--)
-            *buf++ = rbs.get_byte(rng);
-        return true;
-    }
-
     static rand_type::result_type gen_seed(RandomAPI &seed)
     {
         return seed.rand_get<rand_type::result_type>();
@@ -92,6 +84,14 @@ class MTRand : public WeakRandomAPI
         return ret;
     }
 
+  private:
+    bool rndbytes(unsigned char *buf, size_t size)
+    {
+        while (size--)
+            *buf++ = rbs.get_byte(rng);
+        return true;
+    }
+
     rand_type rng;
     RandomByteStore<rand_type> rbs;
 };
@@ -14,12 +14,14 @@
 #pragma once
 
 
-#include <deque>
 #include <algorithm>
 #include <limits>
+#include <vector>
 
 #include <openvpn/common/socktypes.hpp>
+#include <openvpn/common/lazydeque.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/time/time.hpp>
 #include <openvpn/crypto/packet_id_control.hpp>
 #include <openvpn/reliable/relcommon.hpp>
 
@@ -65,6 +67,21 @@ class ReliableAck
         return len;
     }
 
+    // Like ack() above, but pass the arrival time to rel_send so it can
+    // maintain its RTT estimate and detect overtaken messages.
+    template <typename REL_SEND>
+    static size_t ack(REL_SEND &rel_send, Buffer &buf, const bool live, const Time &now)
+    {
+        const size_t len = buf.pop_front();
+        for (size_t i = 0; i < len; ++i)
+        {
+            const id_t id = read_id(buf);
+            if (live)
+                rel_send.ack(id, now);
+        }
+        return len;
+    }
+
     static size_t ack_skip(Buffer &buf)
     {
         const size_t len = buf.pop_front();
@@ -131,11 +148,22 @@ class ReliableAck
 
     size_t resend_size();
 
+    // Free the storage of the outstanding ACK queue if it's empty
+    void compact()
+    {
+        data.compact();
+    }
+
+    size_t memory_usage() const
+    {
+        return data.memory_usage() + re_acks.capacity() * sizeof(id_t);
+    }
+
   private:
     void add_ack_to_reack(id_t ack);
 
-    std::deque<id_t> data;
-    std::deque<id_t> re_acks;
+    LazyDeque<id_t> data;
+    std::vector<id_t> re_acks; // most recent first, at most maximum_acks_ack_v1 + 1 entries
 };
 
 /**
@@ -180,7 +208,7 @@ inline void ReliableAck::add_ack_to_reack(id_t ack)
         }
     }
 
-    re_acks.push_front(ack);
+    re_acks.insert(re_acks.begin(), ack);
     if (re_acks.size() > maximum_acks_ack_v1)
     {
         re_acks.pop_back();
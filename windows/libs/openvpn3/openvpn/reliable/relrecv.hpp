@@ -89,6 +89,17 @@ class ReliableRecvTemplate
         window_.rm_head_nocheck();
     }
 
+    // Free the window storage when no message is waiting for delivery
+    void compact()
+    {
+        window_.compact();
+    }
+
+    size_t memory_usage() const
+    {
+        return window_.memory_usage();
+    }
+
   private:
     MessageWindow<Message, id_t> window_;
 };
@@ -0,0 +1,120 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Round-trip time estimation for the reliability layer
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+
+/**
+ * SRTT/RTTVAR estimator and retransmission timeout computation as
+ * described in RFC 6298.
+ *
+ * All arithmetic is done on the raw Time::Duration representation
+ * (1/1024 of a second), which also serves as the clock granularity G.
+ */
+class ReliableRTT
+{
+  public:
+    typedef Time::type T;
+
+    ReliableRTT() = default;
+
+    ReliableRTT(const Time::Duration &initial_rto,
+                const Time::Duration &min_rto,
+                const Time::Duration &max_rto)
+    {
+        init(initial_rto, min_rto, max_rto);
+    }
+
+    void init(const Time::Duration &initial_rto,
+              const Time::Duration &min_rto,
+              const Time::Duration &max_rto)
+    {
+        min_rto_ = min_rto.raw();
+        max_rto_ = std::max(max_rto.raw(), min_rto_);
+        rto_ = clamp(initial_rto.raw());
+        srtt_ = rttvar_ = 0;
+        n_samples_ = 0;
+    }
+
+    // Feed a round-trip measurement.  Per Karn's algorithm, callers must
+    // not sample packets that were retransmitted.
+    void sample(const Time::Duration &rtt)
+    {
+        const T r = std::max(rtt.raw(), T(1));
+        if (!n_samples_)
+        {
+            srtt_ = r;
+            rttvar_ = r / 2;
+        }
+        else
+        {
+            const T delta = srtt_ > r ? srtt_ - r : r - srtt_;
+            rttvar_ = (3 * rttvar_ + delta) / 4;
+            srtt_ = (7 * srtt_ + r) / 8;
+        }
+        ++n_samples_;
+        rto_ = clamp(srtt_ + std::max(T(1), 4 * rttvar_));
+    }
+
+    // Current retransmission timeout
+    Time::Duration rto() const
+    {
+        return Time::Duration::binary_ms(rto_);
+    }
+
+    // Retransmission timeout after n consecutive timeouts of the same
+    // packet (exponential backoff, bounded by the maximum RTO)
+    Time::Duration backoff(const unsigned int n) const
+    {
+        T ret = rto_;
+        for (unsigned int i = 0; i < n && ret < max_rto_; ++i)
+            ret *= 2;
+        return Time::Duration::binary_ms(std::min(ret, max_rto_));
+    }
+
+    Time::Duration srtt() const
+    {
+        return Time::Duration::binary_ms(srtt_);
+    }
+
+    Time::Duration rttvar() const
+    {
+        return Time::Duration::binary_ms(rttvar_);
+    }
+
+    unsigned int n_samples() const
+    {
+        return n_samples_;
+    }
+
+  private:
+    T clamp(const T rto) const
+    {
+        return std::clamp(rto, min_rto_, max_rto_);
+    }
+
+    T srtt_ = 0;
+    T rttvar_ = 0;
+    T rto_ = Time::prec;
+    T min_rto_ = 0;
+    T max_rto_ = std::numeric_limits<T>::max();
+    unsigned int n_samples_ = 0;
+};
+
+} // namespace openvpn
@@ -19,6 +19,7 @@
 #include <openvpn/common/msgwin.hpp>
 #include <openvpn/time/time.hpp>
 #include <openvpn/reliable/relcommon.hpp>
+#include <openvpn/reliable/relrtt.hpp>
 
 namespace openvpn {
 
@@ -52,10 +53,24 @@ class ReliableSendTemplate
             retransmit_at_ = now + tls_timeout;
         }
 
+        // Number of times this message has been put on the wire
+        unsigned int n_sent() const
+        {
+            return n_sent_;
+        }
+
       private:
         Time retransmit_at_;
+        Time sent_at_;                  // time of most recent transmission
+        unsigned int n_sent_ = 0;       // number of transmissions
+        unsigned int n_timeouts_ = 0;   // consecutive retransmission timeouts
+        unsigned int n_skipped_ = 0;    // later-sent messages ACKed while this one was outstanding
+        bool fast_retransmit_ = false;  // scheduled for retransmission by ACKs, not by timeout
     };
 
+    // Fast retransmit after this many ACKs for later-sent messages
+    static constexpr unsigned int default_fast_retransmit_threshold = 2;
+
     ReliableSendTemplate()
         : next(0)
     {
@@ -71,6 +86,32 @@ class ReliableSendTemplate
         window_.init(next, span);
     }
 
+    /**
+     * Derive retransmission timeouts from measured round-trip times
+     * (RFC 6298) instead of using the fixed timeout passed to send().
+     * Also enables fast retransmit of messages that were overtaken by
+     * fast_retransmit_threshold ACKs for later-sent messages.
+     */
+    void enable_adaptive_timeout(const Time::Duration &initial_rto,
+                                 const Time::Duration &min_rto,
+                                 const Time::Duration &max_rto,
+                                 const unsigned int fast_retransmit_threshold = default_fast_retransmit_threshold)
+    {
+        rtt_.init(initial_rto, min_rto, max_rto);
+        fast_retransmit_threshold_ = fast_retransmit_threshold;
+        adaptive_ = true;
+    }
+
+    bool adaptive_timeout() const
+    {
+        return adaptive_;
+    }
+
+    const ReliableRTT &rtt() const
+    {
+        return rtt_;
+    }
+
     // Return the id that the object at the head of the queue
     // would have (even if it isn't defined yet).
     id_t head_id() const
@@ -97,16 +138,25 @@ class ReliableSendTemplate
         return window_.ref_by_id(id);
     }
 
+    // Return a pointer to the M object at id, or nullptr if id is not
+    // in the current window or hasn't been sent yet
+    Message *find_by_id(const id_t id)
+    {
+        return window_.find_by_id(id);
+    }
+
     // Return the shortest duration for any pending retransmissions
     Time::Duration until_retransmit(const Time &now)
     {
         Time::Duration ret = Time::Duration::infinite();
         for (id_t i = head_id(); i < tail_id(); ++i)
         {
-            const Message &msg = ref_by_id(i);
-            if (msg.defined())
+            const Message *msg = find_by_id(i);
+            if (!msg)
+                break;
+            if (msg->defined())
             {
-                Time::Duration ut = msg.until_retransmit(now);
+                Time::Duration ut = msg->until_retransmit(now);
                 if (ut < ret)
                     ret = ut;
             }
@@ -120,7 +170,10 @@ class ReliableSendTemplate
         unsigned int ret = 0;
         for (id_t i = head_id(); i < tail_id(); ++i)
         {
-            if (ref_by_id(i).defined())
+            const Message *msg = find_by_id(i);
+            if (!msg)
+                break;
+            if (msg->defined())
                 ++ret;
         }
         return ret;
@@ -133,10 +186,55 @@ class ReliableSendTemplate
     {
         Message &msg = window_.ref_by_id(next);
         msg.id_ = next++;
-        msg.reset_retransmit(now, tls_timeout);
+        msg.sent_at_ = now;
+        msg.n_sent_ = 1;
+        msg.n_timeouts_ = 0;
+        msg.n_skipped_ = 0;
+        msg.fast_retransmit_ = false;
+        msg.reset_retransmit(now, adaptive_ ? rtt_.rto() : tls_timeout);
         return msg;
     }
 
+    // Call after msg has been retransmitted to schedule the next
+    // retransmission.  Timeout-driven retransmissions back off
+    // exponentially in adaptive mode.
+    void retransmitted(Message &msg, const Time &now, const Time::Duration &tls_timeout)
+    {
+        ++msg.n_sent_;
+        msg.sent_at_ = now;
+        msg.n_skipped_ = 0;
+        if (adaptive_)
+        {
+            if (msg.fast_retransmit_)
+                msg.fast_retransmit_ = false;
+            else
+                ++msg.n_timeouts_;
+            msg.reset_retransmit(now, rtt_.backoff(msg.n_timeouts_));
+        }
+        else
+            msg.reset_retransmit(now, tls_timeout);
+    }
+
+    // Return true (and clear the flag) if an ACK has made a message
+    // eligible for fast retransmission since the last call.
+    bool fast_retransmit_pending()
+    {
+        const bool ret = fast_pending_;
+        fast_pending_ = false;
+        return ret;
+    }
+
+    // Free the window storage when nothing is awaiting an ACK
+    void compact()
+    {
+        window_.compact();
+    }
+
+    size_t memory_usage() const
+    {
+        return window_.memory_usage();
+    }
+
     // Return true if send queue is ready to receive another packet
     bool ready() const
     {
@@ -149,9 +247,45 @@ class ReliableSendTemplate
         window_.rm_by_id(id);
     }
 
+    // Like ack(id), but in adaptive mode also take an RTT sample and
+    // account for messages that the acknowledged one has overtaken.
+    void ack(const id_t id, const Time &now)
+    {
+        if (adaptive_ && window_.in_window(id))
+        {
+            const Message &m = window_.ref_by_id(id);
+            if (m.defined())
+            {
+                // Karn's algorithm: ambiguous samples from retransmitted messages are ignored
+                if (m.n_sent_ == 1)
+                    rtt_.sample(now - m.sent_at_);
+
+                // The ACK IDs on the wire are selective, so an ACK for id tells us that
+                // every older message still outstanding and sent no later than id has
+                // been overtaken and is probably lost.
+                for (id_t i = head_id(); i < id; ++i)
+                {
+                    Message &o = *window_.find_by_id(i);
+                    if (o.defined() && !o.fast_retransmit_ && o.sent_at_ <= m.sent_at_
+                        && ++o.n_skipped_ >= fast_retransmit_threshold_)
+                    {
+                        o.fast_retransmit_ = true;
+                        o.retransmit_at_ = now;
+                        fast_pending_ = true;
+                    }
+                }
+            }
+        }
+        window_.rm_by_id(id);
+    }
+
   private:
     id_t next;
     MessageWindow<Message, id_t> window_;
+    ReliableRTT rtt_;
+    unsigned int fast_retransmit_threshold_ = default_fast_retransmit_threshold;
+    bool adaptive_ = false;
+    bool fast_pending_ = false;
 };
 
 } // namespace openvpn
@@ -0,0 +1,510 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Longest-prefix-match forwarding table mapping VPN IPs and iroutes
+// to the session that owns them, for packets arriving from the tun
+// device on the server side
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/epochrcu.hpp>
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/addr/route.hpp>
+
+namespace openvpn {
+
+/**
+ * Routes are kept in two multibit tries (IPv4 and IPv6) with a stride
+ * of one address byte, so a lookup follows at most 4 or 16 nodes.
+ * Prefixes are expanded within their node: each of the 256 slots
+ * holds the longest route of that node covering the slot, next to
+ * the pointer to the child node.  A lookup just remembers the last
+ * route seen on the way down.
+ *
+ * Lookups take no lock.  Published nodes are never modified: a
+ * Transaction copies the nodes on the path to every change, and commit
+ * publishes the new roots and retires the replaced nodes through
+ * EpochRCU.  Nodes already copied in the same transaction are modified
+ * in place, so a batch of changes, e.g. the VPN IPs and iroutes of a
+ * connecting session, copies each node at most once.
+ *
+ * VALUE is typically a pointer to the session.
+ */
+template <typename VALUE>
+class ForwardTable
+{
+    struct Leaf
+    {
+        Leaf(const VALUE &value_arg, const unsigned int prefix_len_arg)
+            : value(value_arg),
+              prefix_len(prefix_len_arg)
+        {
+        }
+
+        const VALUE value;
+        const unsigned int prefix_len;
+    };
+
+    // a route stored in a node, covering the slots
+    // [base, base + (256 >> bits))
+    struct Entry
+    {
+        std::uint8_t base;
+        std::uint8_t bits; // 0..8
+        const Leaf *leaf;
+    };
+
+    struct Node
+    {
+        Node *child[256] = {};
+        const Leaf *leaf[256] = {};
+        std::vector<Entry> entries;
+        unsigned int n_children = 0;
+        std::uint64_t gen = 0; // transaction that created this copy
+    };
+
+  public:
+    OPENVPN_EXCEPTION(forward_table_error);
+
+    ForwardTable() = default;
+
+    // There must be no transaction or reader left.
+    ~ForwardTable()
+    {
+        for (auto &r : root_)
+            destroy(r.load(std::memory_order_relaxed));
+    }
+
+    class Batch;
+
+    // Read-side handle, one per I/O thread.
+    class Reader
+    {
+      public:
+        explicit Reader(ForwardTable &table)
+            : table_(table),
+              reader_(table.rcu_)
+        {
+        }
+
+        // Longest-prefix match of addr, copying the value of the
+        // route into value.  Returns false if no route matches.
+        bool lookup(const IP::Addr &addr, VALUE &value)
+        {
+            Batch b(*this);
+            const VALUE *v = b.lookup(addr);
+            if (v)
+                value = *v;
+            return bool(v);
+        }
+
+        // Same for the destination address of an IPv4/IPv6 packet.
+        bool lookup_packet(const unsigned char *data, const size_t size, VALUE &value)
+        {
+            Batch b(*this);
+            const VALUE *v = b.lookup_packet(data, size);
+            if (v)
+                value = *v;
+            return bool(v);
+        }
+
+      private:
+        friend Batch;
+
+        ForwardTable &table_;
+        EpochRCU::Reader reader_;
+    };
+
+    // One read-side section for a batch of lookups, e.g. all packets
+    // of one tun read.  The returned pointers stay valid until the
+    // Batch is destroyed.
+    class Batch
+    {
+      public:
+        explicit Batch(Reader &reader)
+            : table_(reader.table_),
+              guard_(reader.reader_)
+        {
+        }
+
+        const VALUE *lookup(const IP::Addr &addr) const
+        {
+            unsigned char key[16];
+            switch (addr.version())
+            {
+            case IP::Addr::V4:
+                addr.to_byte_string_variable(key);
+                return table_.find(V4, key, 4);
+            case IP::Addr::V6:
+                addr.to_byte_string_variable(key);
+                return table_.find(V6, key, 16);
+            default:
+                return nullptr;
+            }
+        }
+
+        const VALUE *lookup_packet(const unsigned char *data, const size_t size) const
+        {
+            if (size >= 20 && (data[0] >> 4) == 4)
+                return table_.find(V4, data + 16, 4);
+            if (size >= 40 && (data[0] >> 4) == 6)
+                return table_.find(V6, data + 24, 16);
+            return nullptr;
+        }
+
+      private:
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        const ForwardTable &table_;
+        EpochRCU::Guard guard_;
+    };
+
+    // A set of changes that readers see all at once on commit().
+    // Holds the writer lock of the table.
+    class Transaction
+    {
+      public:
+        explicit Transaction(ForwardTable &table)
+            : table_(table),
+              lock_(table.writer_mutex_)
+        {
+            table_.begin();
+        }
+
+        ~Transaction()
+        {
+            commit();
+        }
+
+        // Add a route, or replace the value of an existing one.
+        // Host bits of the route are ignored.  Returns false if the
+        // route existed.
+        bool add(const IP::Route &route, const VALUE &value)
+        {
+            return table_.add_route(route, value);
+        }
+
+        // Returns false if the route did not exist.
+        bool remove(const IP::Route &route)
+        {
+            return table_.remove_route(route);
+        }
+
+        // publish the changes, can be called more than once
+        void commit()
+        {
+            table_.commit();
+        }
+
+      private:
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+
+        ForwardTable &table_;
+        std::lock_guard<std::mutex> lock_;
+    };
+
+    // single-change transactions
+    bool add(const IP::Route &route, const VALUE &value)
+    {
+        Transaction t(*this);
+        return t.add(route, value);
+    }
+
+    bool remove(const IP::Route &route)
+    {
+        Transaction t(*this);
+        return t.remove(route);
+    }
+
+    // Thread-safe.
+    size_t size() const
+    {
+        return n_routes_.load(std::memory_order_relaxed);
+    }
+
+    // nodes of the current version, thread-safe
+    size_t node_count() const
+    {
+        return n_nodes_.load(std::memory_order_relaxed);
+    }
+
+    // Free what no reader can still see.  Normally done by commit(),
+    // call this to free memory of a table that has stopped changing.
+    size_t reclaim()
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        return rcu_.reclaim();
+    }
+
+  private:
+    enum Family
+    {
+        V4,
+        V6,
+    };
+
+    static unsigned int mask_bits(const unsigned int bits)
+    {
+        return (0xFF00u >> bits) & 0xFFu;
+    }
+
+    // read side
+
+    const VALUE *find(const Family f, const unsigned char *key, const size_t len) const
+    {
+        const Node *node = root_[f].load(std::memory_order_acquire);
+        const Leaf *best = nullptr;
+        for (size_t i = 0; node && i < len; ++i)
+        {
+            const unsigned char b = key[i];
+            if (const Leaf *l = node->leaf[b])
+                best = l;
+            node = node->child[b];
+        }
+        return best ? &best->value : nullptr;
+    }
+
+    // write side, called with writer_mutex_ held
+
+    struct Key
+    {
+        Family family;
+        unsigned char bytes[16];
+        size_t level;      // node depth holding the route
+        std::uint8_t base; // first slot
+        std::uint8_t bits; // prefix bits within the node
+    };
+
+    static Key make_key(const IP::Route &route)
+    {
+        Key k;
+        const IP::Addr &addr = route.addr;
+        if (addr.version() == IP::Addr::V4)
+            k.family = V4;
+        else if (addr.version() == IP::Addr::V6)
+            k.family = V6;
+        else
+            throw forward_table_error("route address undefined");
+        const unsigned int plen = route.prefix_len;
+        if (plen > addr.size())
+            throw forward_table_error("bad prefix length: " + route.to_string());
+        addr.to_byte_string_variable(k.bytes);
+        k.level = plen ? (plen - 1) / 8 : 0;
+        k.bits = static_cast<std::uint8_t>(plen - 8 * k.level);
+        k.base = static_cast<std::uint8_t>(k.bytes[k.level] & mask_bits(k.bits));
+        return k;
+    }
+
+    void begin()
+    {
+        ++gen_;
+    }
+
+    Node *new_node()
+    {
+        Node *n = new Node;
+        n->gen = gen_;
+        n_nodes_.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    // make *ref a node owned by this transaction, copying it if it is
+    // published
+    Node *writable(Node *&ref)
+    {
+        Node *n = ref;
+        if (!n)
+            n = ref = new_node();
+        else if (n->gen != gen_)
+        {
+            Node *c = new Node(*n);
+            c->gen = gen_;
+            n_nodes_.fetch_add(1, std::memory_order_relaxed);
+            retired_nodes_.push_back(n);
+            ref = c;
+            n = c;
+        }
+        return n;
+    }
+
+    Node *&root_ref(const Family f)
+    {
+        if (!dirty_[f])
+        {
+            work_[f] = root_[f].load(std::memory_order_relaxed);
+            dirty_[f] = true;
+        }
+        return work_[f];
+    }
+
+    bool add_route(const IP::Route &route, const VALUE &value)
+    {
+        const Key k = make_key(route);
+        Node *node = writable(root_ref(k.family));
+        for (size_t i = 0; i < k.level; ++i)
+        {
+            Node *&ref = node->child[k.bytes[i]];
+            if (!ref)
+                ++node->n_children;
+            node = writable(ref);
+        }
+
+        const Leaf *leaf = new Leaf(value, route.prefix_len);
+        bool added = true;
+        auto e = find_entry(*node, k);
+        if (e != node->entries.end())
+        {
+            retired_leaves_.push_back(e->leaf);
+            e->leaf = leaf;
+            added = false;
+        }
+        else
+        {
+            node->entries.push_back({k.base, k.bits, leaf});
+            n_routes_.fetch_add(1, std::memory_order_relaxed);
+        }
+        refill(*node, k.base, k.bits);
+        return added;
+    }
+
+    bool remove_route(const IP::Route &route)
+    {
+        const Key k = make_key(route);
+
+        // look before copying anything
+        {
+            const Node *n = root_ref(k.family);
+            for (size_t i = 0; n && i < k.level; ++i)
+                n = n->child[k.bytes[i]];
+            if (!n || std::none_of(n->entries.begin(), n->entries.end(), [&k](const Entry &e)
+                                   { return e.base == k.base && e.bits == k.bits; }))
+                return false;
+        }
+
+        Node **path[17];
+        path[0] = &root_ref(k.family);
+        Node *node = writable(*path[0]);
+        for (size_t i = 0; i < k.level; ++i)
+        {
+            path[i + 1] = &node->child[k.bytes[i]];
+            node = writable(*path[i + 1]);
+        }
+
+        auto e = find_entry(*node, k);
+        retired_leaves_.push_back(e->leaf);
+        node->entries.erase(e);
+        n_routes_.fetch_sub(1, std::memory_order_relaxed);
+        refill(*node, k.base, k.bits);
+
+        // drop nodes left empty, bottom up; they are all copies owned
+        // by this transaction and were never published
+        for (size_t i = k.level + 1; i-- > 0;)
+        {
+            Node *n = *path[i];
+            if (!n->entries.empty() || n->n_children)
+                break;
+            delete n;
+            n_nodes_.fetch_sub(1, std::memory_order_relaxed);
+            *path[i] = nullptr;
+            if (i)
+                --(*path[i - 1])->n_children;
+        }
+        return true;
+    }
+
+    static typename std::vector<Entry>::iterator find_entry(Node &node, const Key &k)
+    {
+        return std::find_if(node.entries.begin(), node.entries.end(), [&k](const Entry &e)
+                            { return e.base == k.base && e.bits == k.bits; });
+    }
+
+    // recompute the expanded slots [base, base + (256 >> bits))
+    static void refill(Node &node, const unsigned int base, const unsigned int bits)
+    {
+        const unsigned int end = base + (256u >> bits);
+        std::fill(node.leaf + base, node.leaf + end, nullptr);
+        for (const Entry &e : node.entries)
+        {
+            // aligned blocks are either nested or disjoint
+            const unsigned int e_end = e.base + (256u >> e.bits);
+            const unsigned int lo = std::max<unsigned int>(base, e.base);
+            const unsigned int hi = std::min(end, e_end);
+            for (unsigned int s = lo; s < hi; ++s)
+                if (!node.leaf[s] || node.leaf[s]->prefix_len < e.leaf->prefix_len)
+                    node.leaf[s] = e.leaf;
+        }
+    }
+
+    void commit()
+    {
+        for (int f = V4; f <= V6; ++f)
+            if (dirty_[f])
+            {
+                root_[f].store(work_[f], std::memory_order_release);
+                dirty_[f] = false;
+            }
+        for (Node *n : retired_nodes_)
+        {
+            n_nodes_.fetch_sub(1, std::memory_order_relaxed);
+            rcu_.retire(n);
+        }
+        for (const Leaf *l : retired_leaves_)
+            rcu_.retire(const_cast<Leaf *>(l));
+        const bool changed = !retired_nodes_.empty() || !retired_leaves_.empty();
+        retired_nodes_.clear();
+        retired_leaves_.clear();
+        if (changed || rcu_.pending())
+            rcu_.reclaim();
+
+        // later changes must copy the nodes published now
+        ++gen_;
+    }
+
+    // free a whole version, including its routes
+    void destroy(Node *node)
+    {
+        if (!node)
+            return;
+        for (Node *c : node->child)
+            destroy(c);
+        for (const Entry &e : node->entries)
+            delete e.leaf;
+        delete node;
+    }
+
+    ForwardTable(const ForwardTable &) = delete;
+    ForwardTable &operator=(const ForwardTable &) = delete;
+
+    std::atomic<Node *> root_[2] = {};
+    mutable EpochRCU rcu_;
+
+    std::mutex writer_mutex_;
+    std::uint64_t gen_ = 0;
+    Node *work_[2] = {};
+    bool dirty_[2] = {};
+    std::vector<Node *> retired_nodes_;
+    std::vector<const Leaf *> retired_leaves_;
+
+    std::atomic<size_t> n_routes_{0};
+    std::atomic<size_t> n_nodes_{0};
+};
+
+} // namespace openvpn
@@ -29,6 +29,7 @@
 #include <openvpn/server/peerstats.hpp>
 #include <openvpn/server/peeraddr.hpp>
 #include <openvpn/auth/authcert.hpp>
+#include <openvpn/options/servpush_compiled.hpp>
 
 
 namespace openvpn::AuthStatus {
@@ -137,6 +138,15 @@ struct Recv : public virtual RC<thread_unsafe_refcount>
 
     virtual void push_reply(std::vector<BufferPtr> &&push_msgs) = 0;
 
+    // push the options that a server shares between its sessions,
+    // compiled once into a CompiledPushList with the PUSH_REPLY prefix,
+    // followed by the options specific to this client
+    void push_reply_compiled(const CompiledPushList &push_list,
+                             const std::vector<std::string> &client_opts)
+    {
+        push_reply(push_list.render(client_opts));
+    }
+
     // push a halt or restart message to client
     virtual void push_halt_restart_msg(const HaltRestart::Type type,
                                        const std::string &reason,
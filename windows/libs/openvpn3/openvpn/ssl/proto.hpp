@@ -36,6 +36,7 @@
 #include <openvpn/common/socktypes.hpp>
 #include <openvpn/common/number.hpp>
 #include <openvpn/common/likely.hpp>
+#include <openvpn/common/lazydeque.hpp>
 #include <openvpn/common/string.hpp>
 #include <openvpn/common/to_string.hpp>
 #include <openvpn/common/numeric_cast.hpp>
@@ -56,6 +57,7 @@
 #include <openvpn/crypto/ovpnhmac.hpp>
 #include <openvpn/crypto/tls_crypt.hpp>
 #include <openvpn/crypto/tls_crypt_v2.hpp>
+#include <openvpn/crypto/tls_crypt_v2_cache.hpp>
 #include <openvpn/crypto/packet_id_control.hpp>
 #include <openvpn/crypto/static_key.hpp>
 #include <openvpn/crypto/bs64_data_limit.hpp>
@@ -66,6 +68,7 @@
 #include <openvpn/ssl/datalimit.hpp>
 #include <openvpn/ssl/mssparms.hpp>
 #include <openvpn/transport/mssfix.hpp>
+#include <openvpn/transport/dplpmtud.hpp>
 #include <openvpn/transport/protocol.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/tun/layer.hpp>
@@ -200,6 +203,17 @@ class ProtoContextCallbackInterface
 
     //! Called when KeyContext transitions to ACTIVE state
     virtual void active(bool primary) = 0;
+
+    /**
+     * Called when the peer acknowledged a path MTU probe sent with
+     * ProtoContext::send_pmtu_probe().
+     *
+     * @param seq   sequence number of the probe
+     * @param size  data channel payload size of the probe as received
+     */
+    virtual void pmtu_probe_acked(std::uint32_t seq, size_t size)
+    {
+    }
 };
 
 class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
@@ -377,6 +391,15 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         // send client exit notifications via control channel
         bool cc_exit_notify = false;
 
+        // peer answers data channel path MTU probes
+        bool pmtu_probe = false;
+
+        // announce IV_PMTU_PROBE=1 in the peer info, i.e. that we answer
+        // and use data channel path MTU probes.  This is an OpenVPN 3
+        // extension with its own key rather than an IV_PROTO bit, since
+        // the IV_PROTO bits are allocated by OpenVPN 2.
+        bool pmtu_probe_advertise = false;
+
         // Transport protocol, i.e. UDPv4, etc.
         Protocol protocol; // set with set_protocol()
 
@@ -425,6 +448,9 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
         TLSCryptMetadataFactory::Ptr tls_crypt_metadata_factory;
 
+        //! server only: if defined, cache of already unwrapped tls-crypt-v2 client keys
+        TLSCryptV2WKcCache::Ptr tls_crypt_v2_wkc_cache;
+
         // timeout parameters, relative to construction of KeyContext object
         Time::Duration handshake_window; // SSL/TLS negotiation must complete by this time
         Time::Duration become_primary;   // KeyContext (that is ACTIVE) becomes primary at this time
@@ -432,6 +458,22 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         Time::Duration expire;           // KeyContext expires at this time
         Time::Duration tls_timeout;      // Packet retransmit timeout on TLS control channel
 
+        // When enabled (tls-timeout-adaptive 1), tls_timeout is only the
+        // initial retransmit timeout and later timeouts are derived from
+        // measured control channel RTT, bounded by
+        // [tls_timeout_min, max(tls_timeout, tls_timeout_max)].  The
+        // default minimum is the 1 second of RFC 6298.
+        bool tls_timeout_adaptive = false;
+        Time::Duration tls_timeout_min = Time::Duration::seconds(1);
+        Time::Duration tls_timeout_max = Time::Duration::seconds(16);
+
+        // Control channel packets sent ahead of the oldest unacknowledged
+        // one (tls-send-window).  Packets beyond the receive window of the
+        // peer would be dropped by it and resent later, so the window is
+        // capped at that size.  Only taken from the local configuration.
+        size_t tls_send_window = 6;
+        static constexpr size_t tls_send_window_max = ReliableAck::maximum_acks_ack_v1;
+
         // keepalive parameters
         Time::Duration keepalive_ping;          // ping xmit period
         Time::Duration keepalive_timeout;       // timeout period after primary KeyContext reaches ACTIVE state
@@ -866,6 +908,10 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                         {
                             dc.set_use_epoch_keys(true);
                         }
+                        else if (flag == "pmtu-probe")
+                        {
+                            pmtu_probe = true;
+                        }
                         else
                         {
                             OPENVPN_THROW(process_server_push_error, "unknown flag '" << flag << "'");
@@ -1140,6 +1186,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             out << "IV_NCP=2\n";   // negotiable crypto parameters V2
             out << "IV_TCPNL=1\n"; // supports TCP non-linear packet ID
             out << "IV_PROTO=" << iv_proto << '\n';
+            if (pmtu_probe_advertise)
+                out << "IV_PMTU_PROBE=1\n"; // answers data channel path MTU probes
             out << "IV_MTU=" << tun_mtu_max << "\n";
             /*
              * OpenVPN3 allows to be pushed any cipher that it supports as it
@@ -1237,6 +1285,11 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                                                                   renegotiate.to_seconds() / 2));
             load_duration_parm(become_primary, "become-primary", opt, 0, false, false);
             load_duration_parm(tls_timeout, "tls-timeout", opt, 100, false, true);
+            tls_timeout_adaptive = opt.get_num<unsigned int>("tls-timeout-adaptive", 1, tls_timeout_adaptive, 0, 1);
+            load_duration_parm(tls_timeout_min, "tls-timeout-min", opt, 100, false, true);
+            load_duration_parm(tls_timeout_max, "tls-timeout-max", opt, 100, false, true);
+            if (type != LOAD_COMMON_CLIENT_PUSHED)
+                tls_send_window = opt.get_num<size_t>("tls-send-window", 1, tls_send_window, 1, tls_send_window_max);
 
             if (type == LOAD_COMMON_SERVER)
                 renegotiate += handshake_window; // avoid renegotiation collision with client
@@ -1657,7 +1710,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         {
             return bool(buf);
         }
-        const BufferPtr &buffer_ptr()
+        const BufferPtr &buffer_ptr() const
         {
             return buf;
         }
@@ -1807,7 +1860,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                    p.config->tls_timeout,
                    p.config->frame,
                    p.stats,
-                   psid_cookie_mode),
+                   psid_cookie_mode,
+                   p.config->tls_send_window),
               proto(p),
               state(STATE_UNDEF),
               crypto_flags(0),
@@ -1832,6 +1886,11 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
             // set must-negotiate-by time
             set_event(KEV_NONE, KEV_NEGOTIATE, construct_time + proto.config->handshake_window);
+
+            // RTT-based control channel retransmission
+            if (proto.config->tls_timeout_adaptive)
+                enable_adaptive_timeout(proto.config->tls_timeout_min,
+                                        std::max(proto.config->tls_timeout_max, proto.config->tls_timeout));
         }
 
         void set_protocol(const Protocol &p)
@@ -2073,6 +2132,23 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             return state >= ACTIVE;
         }
 
+        // Release storage that isn't needed while the control channel
+        // is idle.  Queues and buffers are allocated again on demand.
+        void compact()
+        {
+            Base::compact();
+            app_pre_write_queue.compact();
+            work.clear();
+        }
+
+        void memory_usage(ProtoMemoryUsage &mu) const
+        {
+            mu.proto += sizeof(*this);
+            Base::memory_usage(mu);
+            mu.queues += app_pre_write_queue.memory_usage();
+            mu.buffers += work.capacity();
+        }
+
         bool is_dirty() const
         {
             return dirty;
@@ -2113,6 +2189,13 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                                           sizeof(proto_context_private::explicit_exit_notify_message));
         }
 
+        // let the data channel derive upcoming keys outside of the packet path
+        void prepare_data_channel_keys()
+        {
+            if ((crypto_flags & CryptoDCInstance::CRYPTO_DEFINED) && !invalidated())
+                crypto->prepare_keys();
+        }
+
         // general purpose method for sending constant string messages
         // to peer via data channel
         void send_data_channel_message(const unsigned char *data, const size_t size)
@@ -2183,10 +2266,19 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             else
             {
                 // use the TLS PRF construction to exchange session keys for building
-                // the data channel crypto context
+                // the data channel crypto context, its random material is released
+                // below, so this can only be done once
+                if (!tlsprf)
+                    throw proto_error("tls_prf_released");
                 tlsprf->generate_key_expansion(dck->key, proto.psid_self, proto.psid_peer);
             }
-            tlsprf->erase();
+
+            // handshake-only state
+            if (tlsprf)
+            {
+                tlsprf->erase();
+                tlsprf.reset();
+            }
             OVPN_LOG_VERBOSE(proto.debug_prefix()
                              << " KEY " << CryptoAlgs::name(proto.config->dc.key_derivation())
                              << " " << proto.mode().str() << ' ' << dck->key.render());
@@ -2370,12 +2462,19 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
          * @param  tls_crypt_server    Server context used only to process incoming WKc's.
          * @param  tls_crypt_metadata  If not nullptr, the function will also check the validity
          *                             of the WKc metadata.
+         *
+         * @param  stats               If not nullptr, cache hits and misses are counted here.
+         *
+         * If proto_config.tls_crypt_v2_wkc_cache is defined, a WKc that was already unwrapped
+         * and verified is taken from the cache, and a newly verified one is added to it.
+         *
          * @return Error::SUCCESS on success.
          */
         static Error::Type unwrap_tls_crypt_wkc(Buffer &recv,
                                                 ProtoConfig &proto_config,
                                                 TLSCryptInstance &tls_crypt_server,
-                                                TLSCryptMetadata::Ptr tls_crypt_metadata = nullptr)
+                                                TLSCryptMetadata::Ptr tls_crypt_metadata = nullptr,
+                                                SessionStats *stats = nullptr)
         {
             // the ``WKc`` is located at the end of the packet, after the tls-crypt
             // payload.
@@ -2435,6 +2534,21 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             if ((wkc_len - sizeof(uint16_t)) != wkc_raw_size)
                 return Error::CC_ERROR;
 
+            TLSCryptV2WKcCache *wkc_cache = proto_config.tls_crypt_v2_wkc_cache.get();
+            const Time now = proto_config.now ? *proto_config.now : Time::now();
+            if (wkc_cache)
+            {
+                if (wkc_cache->lookup(wkc_raw, wkc_len, now, proto_config.wrapped_tls_crypt_key))
+                {
+                    if (stats)
+                        stats->inc_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_HITS, 1);
+                    recv.set_size(orig_size - wkc_len);
+                    return Error::SUCCESS;
+                }
+                if (stats)
+                    stats->inc_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_MISSES, 1);
+            }
+
             BufferAllocated plaintext(wkc_len, BufAllocFlags::CONSTRUCT_ZERO);
             // plaintext will be used to compute the Auth Tag, therefore start by prepending
             // the WKc length in network order
@@ -2498,7 +2612,15 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             if (!plaintext.empty())
                 metadata_type = plaintext.pop_front();
 
-            if (tls_crypt_metadata && !tls_crypt_metadata->verify(metadata_type, plaintext))
+            // only WKc's with verified metadata may be served from the cache
+            if (wkc_cache && tls_crypt_metadata)
+            {
+                const std::string metadata(reinterpret_cast<const char *>(plaintext.c_data()), plaintext.size());
+                if (!tls_crypt_metadata->verify(metadata_type, plaintext))
+                    return Error::TLS_CRYPT_META_FAIL;
+                wkc_cache->insert(wkc_raw, wkc_len, now, proto_config.wrapped_tls_crypt_key, metadata_type, metadata);
+            }
+            else if (tls_crypt_metadata && !tls_crypt_metadata->verify(metadata_type, plaintext))
                 return Error::TLS_CRYPT_META_FAIL;
 
             // virtually remove the WKc from the packet
@@ -2981,7 +3103,11 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         void net_send(const Packet &net_pkt, const Base::NetSendType nstype) // called by ProtoStackBase
         {
             if (!is_reliable || nstype != Base::NET_SEND_RETRANSMIT) // retransmit packets on UDP only, not TCP
+            {
+                if (nstype == Base::NET_SEND_RETRANSMIT)
+                    ++proto.n_control_retransmits;
                 proto.net_send(key_id_, net_pkt);
+            }
         }
 
         void post_ack_action()
@@ -3096,6 +3222,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             reached_active_time_ = *now;
             proto.slowest_handshake_.max(reached_active_time_ - construct_time);
             active_event();
+            compact();
         }
 
         void prepend_dest_psid_and_acks(Buffer &buf, unsigned int opcode)
@@ -3287,7 +3414,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
             // process ACKs sent by peer (if packet ID check failed,
             // read the ACK IDs, but don't modify the rel_send object).
-            if (ReliableAck::ack(rel_send, recv, pid_ok))
+            if (ReliableAck::ack(rel_send, recv, pid_ok, *now))
             {
                 // make sure that our own PSID is contained in packet received from peer
                 if (!verify_dest_psid(recv))
@@ -3442,7 +3569,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                 return false;
 
             // process ACKs sent by peer
-            if (ReliableAck::ack(rel_send, recv, true))
+            if (ReliableAck::ack(rel_send, recv, true, *now))
             {
                 // make sure that our own PSID is in packet received from peer
                 if (!verify_dest_psid(recv))
@@ -3505,7 +3632,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
                         const Error::Type unwrap_wkc_result = unwrap_tls_crypt_wkc(*pkt.buf,
                                                                                    *proto.config,
                                                                                    *proto.tls_crypt_server,
-                                                                                   proto.tls_crypt_metadata);
+                                                                                   proto.tls_crypt_metadata,
+                                                                                   proto.stats.get());
                         switch (unwrap_wkc_result)
                         {
                         case Error::DECRYPT_ERROR:
@@ -3611,7 +3739,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         Time next_event_time;
         EventType current_event;
         EventType next_event;
-        std::deque<BufferPtr> app_pre_write_queue;
+        LazyDeque<BufferPtr> app_pre_write_queue;
         std::unique_ptr<DataChannelKey> data_channel_key;
         BufferComposed app_recv_buf;
         std::unique_ptr<DataLimit> data_limit;
@@ -3678,7 +3806,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     {
       public:
         IvProtoHelper(const OptionList &peer_info)
-            : proto_field_(peer_info.get_num<unsigned int>("IV_PROTO", 1, 0))
+            : proto_field_(peer_info.get_num<unsigned int>("IV_PROTO", 1, 0)),
+              pmtu_probe_(peer_info.get_num<unsigned int>("IV_PMTU_PROBE", 1, 0) != 0)
         {
         }
 
@@ -3730,8 +3859,15 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             return proto_field_ & iv_proto_flag::IV_PROTO_DNS_OPTION_V2;
         }
 
+        //! Checks if the client answers data channel path MTU probes (IV_PMTU_PROBE=1).
+        bool client_supports_pmtu_probe() const
+        {
+            return pmtu_probe_;
+        }
+
       private:
         unsigned int proto_field_;
+        bool pmtu_probe_;
     };
 
     class TLSWrapPreValidate : public RC<thread_unsafe_refcount>
@@ -4230,8 +4366,37 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         // handle possible events
         flush(false);
 
+        // prepare upcoming data channel keys
+        if (primary)
+            primary->prepare_data_channel_keys();
+
         // handle keepalive/expiration
         keepalive_housekeeping();
+
+        // release control channel storage that has drained since
+        compact();
+    }
+
+    // Release storage of drained control channel queues and windows,
+    // so that an idle session holds little more than its keys.
+    void compact()
+    {
+        if (primary)
+            primary->compact();
+        if (secondary)
+            secondary->compact();
+    }
+
+    // Estimated heap bytes held by this session, see ProtoMemoryUsage
+    ProtoMemoryUsage memory_usage() const
+    {
+        ProtoMemoryUsage mu;
+        mu.proto += sizeof(*this);
+        if (primary)
+            primary->memory_usage(mu);
+        if (secondary)
+            secondary->memory_usage(mu);
+        return mu;
     }
 
     // When should we next call housekeeping?
@@ -4324,10 +4489,43 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         {
             in_out.reset_size();
         }
+        // answer path MTU probes and pass on acknowledgements
+        else if (PathMTUDiscovery::Message::is_message(in_out))
+        {
+            PathMTUDiscovery::Message msg;
+            if (msg.read(in_out))
+            {
+                if (msg.type == PathMTUDiscovery::Message::PROBE)
+                {
+                    if (primary)
+                    {
+                        msg.type = PathMTUDiscovery::Message::ACK;
+                        send_pmtu_message(msg);
+                    }
+                }
+                else
+                    proto_callback->pmtu_probe_acked(msg.seq, msg.size);
+            }
+            in_out.reset_size();
+        }
 
         return ret;
     }
 
+    // Send a path MTU probe with a data channel payload of size bytes.
+    // The peer must have announced support for probes (ProtoConfig::pmtu_probe).
+    // Returns false if there is no active data channel.
+    bool send_pmtu_probe(const std::uint32_t seq, const size_t size)
+    {
+        if (!primary || !primary->data_channel_ready())
+            return false;
+        PathMTUDiscovery::Message msg;
+        msg.seq = seq;
+        msg.size = size;
+        send_pmtu_message(msg);
+        return true;
+    }
+
     // enter disconnected state
     void disconnect(const Error::Type reason)
     {
@@ -4384,6 +4582,12 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         return slowest_handshake_;
     }
 
+    // total number of control channel packets retransmitted by the reliability layer
+    count_t control_retransmits() const
+    {
+        return n_control_retransmits;
+    }
+
     // was primary context invalidated by an exception?
     bool invalidated() const
     {
@@ -4658,6 +4862,13 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
         return *primary;
     }
 
+    void send_pmtu_message(const PathMTUDiscovery::Message &msg)
+    {
+        BufferAllocated buf(std::max(msg.size, PathMTUDiscovery::Message::HEADER_SIZE));
+        msg.write(buf);
+        primary->send_data_channel_message(buf.c_data(), buf.size());
+    }
+
     // Possibly send a keepalive message, and check for expiration
     // of session due to lack of received packets from peer.
     void keepalive_housekeeping()
@@ -4878,6 +5089,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     Time keepalive_expire; // time in future when we must have received a packet from peer or we will timeout session
 
     Time::Duration slowest_handshake_; // longest time to reach a successful handshake
+    count_t n_control_retransmits = 0; // control channel packets retransmitted
 
     OvpnHMACInstance::Ptr ta_hmac_send;
     OvpnHMACInstance::Ptr ta_hmac_recv;
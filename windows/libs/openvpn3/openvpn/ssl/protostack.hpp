@@ -12,12 +12,14 @@
 #ifndef OPENVPN_SSL_PROTOSTACK_H
 #define OPENVPN_SSL_PROTOSTACK_H
 
-#include <deque>
+#include <sstream>
+#include <string>
 #include <utility>
 
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/usecount.hpp>
+#include <openvpn/common/lazydeque.hpp>
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/time/time.hpp>
 #include <openvpn/log/sessionstats.hpp>
@@ -38,6 +40,36 @@
 
 namespace openvpn {
 
+// Estimated heap bytes held by a protocol session, by component.
+// Memory held inside the SSL library (connection state, peer
+// certificate) and the cipher contexts of the crypto library is
+// not included.
+struct ProtoMemoryUsage
+{
+    size_t proto = 0;      // session and key context objects
+    size_t reliable = 0;   // reliability layer windows and ACK queues
+    size_t queues = 0;     // cleartext and raw control channel write queues
+    size_t ssl_queues = 0; // ciphertext queues of the SSL objects
+    size_t buffers = 0;    // packet buffers kept between calls
+
+    size_t total() const
+    {
+        return proto + reliable + queues + ssl_queues + buffers;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        os << "total=" << total()
+           << " proto=" << proto
+           << " reliable=" << reliable
+           << " queues=" << queues
+           << " ssl_queues=" << ssl_queues
+           << " buffers=" << buffers;
+        return os.str();
+    }
+};
+
 // PACKET type must define the following methods:
 //
 // Default constructor:
@@ -91,7 +123,8 @@ class ProtoStackBase
                    const Time::Duration &tls_timeout_arg, // packet retransmit timeout
                    const Frame::Ptr &frame,               // contains info on how to allocate and align buffers
                    const SessionStats::Ptr &stats_arg,    // error statistics
-                   bool psid_cookie_mode)                 // start the reliability layer at packet id 1, not 0
+                   bool psid_cookie_mode,                 // start the reliability layer at packet id 1, not 0
+                   const size_t send_window = ovpn_sending_window) // packets in flight before waiting for an ACK
 
         : tls_timeout(tls_timeout_arg),
           ssl_(ssl_factory.ssl()),
@@ -99,8 +132,47 @@ class ProtoStackBase
           stats(stats_arg),
           now(now_arg),
           rel_recv(ovpn_receiving_window, psid_cookie_mode ? 1 : 0),
-          rel_send(ovpn_sending_window, psid_cookie_mode ? 1 : 0)
+          rel_send(reliable::id_t(send_window), psid_cookie_mode ? 1 : 0)
+    {
+    }
+
+    // Replace the fixed tls_timeout with an RTT-derived retransmission
+    // timeout (tls_timeout becomes the initial RTO) and enable fast
+    // retransmit of packets overtaken by later ACKed packets.
+    void enable_adaptive_timeout(const Time::Duration &min_rto, const Time::Duration &max_rto)
+    {
+        rel_send.enable_adaptive_timeout(tls_timeout, min_rto, max_rto);
+    }
+
+    // Smoothed control channel round-trip time, zero if not measured yet
+    Time::Duration control_srtt() const
     {
+        return rel_send.rtt().srtt();
+    }
+
+    // Release storage that an idle key context doesn't need: empty
+    // write and ciphertext queues, the reliability windows once every
+    // message has been delivered and acknowledged, and the standalone
+    // ACK buffer.  Storage is allocated again on demand.
+    void compact()
+    {
+        app_write_queue.compact();
+        raw_write_queue.compact();
+        rel_recv.compact();
+        rel_send.compact();
+        xmit_acks.compact();
+        ack_send_buf.reset();
+        ssl_->compact();
+    }
+
+    void memory_usage(ProtoMemoryUsage &mu) const
+    {
+        mu.reliable += rel_recv.memory_usage() + rel_send.memory_usage() + xmit_acks.memory_usage();
+        mu.queues += app_write_queue.memory_usage() + raw_write_queue.memory_usage();
+        mu.ssl_queues += ssl_->memory_usage();
+        const BufferPtr &ack_buf = ack_send_buf.buffer_ptr();
+        if (ack_buf)
+            mu.buffers += sizeof(*ack_buf) + ack_buf->capacity();
     }
 
     // Start SSL handshake on underlying SSL connection object.
@@ -156,6 +228,8 @@ class ProtoStackBase
             down_stack_raw();
             down_stack_app();
             update_retransmit();
+            if (rel_send.fast_retransmit_pending())
+                retransmit();
         }
     }
 
@@ -184,7 +258,10 @@ class ProtoStackBase
         {
             for (id_t i = rel_send.head_id(); i < rel_send.tail_id(); ++i)
             {
-                typename ReliableSend::Message &m = rel_send.ref_by_id(i);
+                typename ReliableSend::Message *msg = rel_send.find_by_id(i);
+                if (!msg)
+                    break;
+                typename ReliableSend::Message &m = *msg;
                 if (m.ready_retransmit(*now))
                 {
                     // preserve original packet non-encapsulated
@@ -201,7 +278,7 @@ class ProtoStackBase
                         throw;
                     }
                     parent().net_send(pkt, NET_SEND_RETRANSMIT);
-                    m.reset_retransmit(*now, tls_timeout);
+                    rel_send.retransmitted(m, *now, tls_timeout);
                 }
             }
             update_retransmit();
@@ -530,8 +607,8 @@ class ProtoStackBase
     Time next_retransmit_ = Time::infinite();
     BufferPtr to_app_buf; // cleartext data decrypted by SSL that is to be passed to app via app_recv method
     PACKET ack_send_buf;  // only used for standalone ACKs to be sent to peer
-    std::deque<BufferPtr> app_write_queue;
-    std::deque<PACKET> raw_write_queue;
+    LazyDeque<BufferPtr> app_write_queue;
+    LazyDeque<PACKET> raw_write_queue;
     SessionStats::Ptr stats;
 
   protected:
@@ -0,0 +1,335 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Server-side TLS session ticket key manager with scheduled rotation.
+// A single instance is meant to be shared by the SSL configs of all
+// worker threads, so that a ticket issued on one thread resumes on any
+// other.
+
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <fstream>
+#include <cstdint>
+
+#include <openvpn/common/platform.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/file.hpp>
+#include <openvpn/common/path.hpp>
+#include <openvpn/ssl/sess_ticket.hpp>
+#include <openvpn/random/randapi.hpp>
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+#include <sys/stat.h>
+#include <openvpn/common/fileatomic.hpp>
+#endif
+
+namespace openvpn {
+
+class TLSSessionTicketKeys : public TLSSessionTicketBase, public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<TLSSessionTicketKeys> Ptr;
+
+    struct Config
+    {
+        // must be identical on all servers that share tickets
+        std::string session_id_context;
+
+        // seconds a key is used to issue new tickets
+        unsigned int rotation_period = 12 * 3600;
+
+        // seconds a retired key still decrypts tickets, which are
+        // then renewed with the current key
+        unsigned int overlap = 12 * 3600;
+
+        // if not empty, keys are loaded from here on construction and
+        // saved after every rotation (not supported on Windows).  Only
+        // a failed save from the constructor throws, see persist().
+        std::string persist_file;
+    };
+
+    struct Stats
+    {
+        std::uint64_t issued = 0;  // tickets issued
+        std::uint64_t resumed = 0; // tickets accepted with the current key
+        std::uint64_t renewed = 0; // tickets accepted with a retired key
+        std::uint64_t missed = 0;  // tickets with an unknown or expired key
+
+        double hit_rate() const
+        {
+            const std::uint64_t presented = resumed + renewed + missed;
+            return presented ? double(resumed + renewed) / double(presented) : 0.0;
+        }
+    };
+
+    TLSSessionTicketKeys(Config config_arg,
+                         StrongRandomAPI::Ptr rng_arg,
+                         const std::time_t now = std::time(nullptr))
+        : config(std::move(config_arg)),
+          rng(std::move(rng_arg))
+    {
+        if (!config.rotation_period)
+            throw sess_ticket_error("rotation period must be non-zero");
+        std::unique_lock lock(mutex);
+        if (!config.persist_file.empty() && file_exists(config.persist_file))
+            load_(read_text(config.persist_file, 1 << 16), now);
+        expire_(now);
+        if (keys.empty() || now >= keys.back().created + std::time_t(config.rotation_period))
+            rotate_(now);
+        else
+            next_rotation = keys.back().created + config.rotation_period;
+        if (unsaved && !config.persist_file.empty())
+        {
+            save_(persist_string_());
+            unsaved = false;
+        }
+    }
+
+    Status create_session_ticket_key(Name &name, Key &key) const override
+    {
+        const std::time_t now = std::time(nullptr);
+        maintain(now);
+
+        std::shared_lock lock(mutex);
+        const Entry &e = keys.back();
+        name = e.name;
+        key = e.key;
+        ++issued;
+        return TICKET_AVAILABLE;
+    }
+
+    Status lookup_session_ticket_key(const Name &name, Key &key) const override
+    {
+        const std::time_t now = std::time(nullptr);
+        maintain(now);
+
+        std::shared_lock lock(mutex);
+        for (auto i = keys.rbegin(); i != keys.rend(); ++i)
+        {
+            if (i->name != name)
+                continue;
+            if (i == keys.rbegin())
+            {
+                key = i->key;
+                ++resumed;
+                return TICKET_AVAILABLE;
+            }
+            if (now < i->retired + std::time_t(config.overlap))
+            {
+                key = i->key;
+                ++renewed;
+                return TICKET_EXPIRING;
+            }
+            break;
+        }
+        ++missed;
+        return NO_TICKET;
+    }
+
+    std::string session_id_context() const override
+    {
+        return config.session_id_context;
+    }
+
+    // Rotate if due and drop keys past their overlap window.
+    // Called implicitly by the ticket callbacks; returns true if
+    // a new key was created.
+    bool maintain(const std::time_t now) const
+    {
+        if (now < next_rotation.load(std::memory_order_relaxed))
+            return false;
+        {
+            std::unique_lock lock(mutex);
+            if (now < next_rotation.load(std::memory_order_relaxed))
+                return false;
+            rotate_(now);
+        }
+        persist();
+        return true;
+    }
+
+    // start issuing tickets with a new key now
+    void rotate(const std::time_t now = std::time(nullptr))
+    {
+        {
+            std::unique_lock lock(mutex);
+            rotate_(now);
+        }
+        persist();
+    }
+
+    // Save the keys to persist_file if they changed since the last
+    // save.  This runs from the TLS ticket callbacks, so errors are
+    // logged rather than thrown and the keys stay unsaved; call again,
+    // e.g. from a timer, to retry.  Returns false if the save failed.
+    bool persist() const
+    {
+        if (config.persist_file.empty())
+            return true;
+
+        // saves are serialized so that the newest keys are written last
+        std::lock_guard save_lock(save_mutex);
+        std::string text;
+        {
+            std::unique_lock lock(mutex);
+            if (!unsaved)
+                return true;
+            text = persist_string_();
+            unsaved = false;
+        }
+        try
+        {
+            save_(text);
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            {
+                std::unique_lock lock(mutex);
+                unsaved = true;
+            }
+            OPENVPN_LOG("TLS session ticket keys: cannot save " << config.persist_file << ": " << e.what());
+            return false;
+        }
+    }
+
+    // number of keys that decrypt tickets, including the current one
+    size_t size() const
+    {
+        std::shared_lock lock(mutex);
+        return keys.size();
+    }
+
+    std::time_t next_rotation_time() const
+    {
+        return next_rotation.load(std::memory_order_relaxed);
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.issued = issued.load(std::memory_order_relaxed);
+        s.resumed = resumed.load(std::memory_order_relaxed);
+        s.renewed = renewed.load(std::memory_order_relaxed);
+        s.missed = missed.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Key file contents (secret), one key per line, oldest first:
+    //   <created> <retired or 0> <name> <cipher key> <hmac key>
+    std::string persist_string() const
+    {
+        std::shared_lock lock(mutex);
+        return persist_string_();
+    }
+
+  private:
+    struct Entry
+    {
+        Name name;
+        Key key;
+        std::time_t created;
+        std::time_t retired; // 0 while current
+    };
+
+    void rotate_(const std::time_t now) const
+    {
+        if (!keys.empty())
+            keys.back().retired = now;
+        keys.push_back(Entry{Name(*rng), Key(*rng), now, 0});
+        next_rotation = now + config.rotation_period;
+        expire_(now);
+        unsaved = true;
+    }
+
+    void expire_(const std::time_t now) const
+    {
+        std::erase_if(keys, [this, now](const Entry &e)
+                      { return e.retired && now >= e.retired + std::time_t(config.overlap); });
+    }
+
+    std::string persist_string_() const
+    {
+        std::ostringstream os;
+        for (const auto &e : keys)
+            os << e.created << ' ' << e.retired << ' ' << e.name.b64() << ' ' << e.key.cipher_b64() << ' ' << e.key.hmac_b64() << '\n';
+        return os.str();
+    }
+
+    void load_(const std::string &text, const std::time_t now)
+    {
+        std::istringstream is(text);
+        std::string line;
+        while (std::getline(is, line))
+        {
+            if (line.empty())
+                continue;
+            std::istringstream ls(line);
+            long long created = 0;
+            long long retired = 0;
+            std::string name, cipher, hmac, extra;
+            if (!(ls >> created >> retired >> name >> cipher >> hmac) || (ls >> extra))
+                throw sess_ticket_error("bad line in " + config.persist_file);
+            keys.push_back(Entry{Name(name), Key(cipher, hmac), std::time_t(created), std::time_t(retired)});
+        }
+        // only the newest key may be current
+        for (size_t i = 0; i + 1 < keys.size(); ++i)
+        {
+            if (!keys[i].retired)
+                keys[i].retired = now;
+        }
+        if (!keys.empty() && keys.back().retired)
+            rotate_(now);
+    }
+
+    void save_(const std::string &text) const
+    {
+#if !defined(OPENVPN_PLATFORM_WIN)
+        const ConstBuffer buf(reinterpret_cast<const unsigned char *>(text.data()), text.size(), true);
+        // temporary file next to the target, so that the rename stays on one filesystem
+        write_binary_atomic(config.persist_file, path::dirname(config.persist_file), S_IRUSR | S_IWUSR, 0, buf, *rng);
+#else
+        throw sess_ticket_error("persist_file not supported on this platform");
+#endif
+    }
+
+    static bool file_exists(const std::string &fn)
+    {
+        std::ifstream f(fn);
+        return f.good();
+    }
+
+    const Config config;
+    StrongRandomAPI::Ptr rng;
+
+    // rotation happens lazily from the const ticket callbacks
+    mutable std::shared_mutex mutex;
+    mutable std::vector<Entry> keys; // newest last
+    mutable std::atomic<std::time_t> next_rotation{0};
+    mutable bool unsaved = false; // keys changed since the last save
+
+    // serializes persist(), taken before mutex and held across the write
+    mutable std::mutex save_mutex;
+
+    mutable std::atomic<std::uint64_t> issued{0};
+    mutable std::atomic<std::uint64_t> resumed{0};
+    mutable std::atomic<std::uint64_t> renewed{0};
+    mutable std::atomic<std::uint64_t> missed{0};
+};
+
+} // namespace openvpn
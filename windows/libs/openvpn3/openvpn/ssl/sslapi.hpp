@@ -70,6 +70,19 @@ class SSLAPI : public RC<thread_unsafe_refcount>
     virtual bool did_full_handshake() = 0;
     virtual const AuthCert::Ptr &auth_cert() const = 0;
     virtual void mark_no_cache() = 0; // prevent caching of client-side session (only meaningful when client_session_tickets is enabled)
+
+    // Free ciphertext queue storage while the queues are empty
+    virtual void compact()
+    {
+    }
+
+    // Estimated heap bytes held by the ciphertext queues, not including
+    // the SSL library's own connection state
+    virtual size_t memory_usage() const
+    {
+        return 0;
+    }
+
     uint32_t get_tls_warnings() const
     {
         return tls_warnings;
@@ -18,9 +18,11 @@
 
 #include <openvpn/io/io.hpp>
 
+#include <openvpn/asio/asiobusypoll.hpp>
 #include <openvpn/common/bigmutex.hpp>
 #include <openvpn/common/likely.hpp>
 #include <openvpn/common/platform.hpp>
+#include <openvpn/common/strerror.hpp>
 #include <openvpn/transport/udplink.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/socket_protect.hpp>
@@ -37,6 +39,8 @@ class ClientConfig : public TransportClientFactory
     bool server_addr_float;
     bool synchronous_dns_lookup;
     int n_parallel;
+    bool io_uring; // with OPENVPN_IO_URING, falls back to the reactor if unavailable
+    unsigned int busy_poll; // SO_BUSY_POLL in microseconds, 0 to leave unset
     Frame::Ptr frame;
     SessionStats::Ptr stats;
 
@@ -64,6 +68,8 @@ class ClientConfig : public TransportClientFactory
         : server_addr_float(false),
           synchronous_dns_lookup(false),
           n_parallel(8),
+          io_uring(false),
+          busy_poll(0),
           socket_protect(nullptr)
     {
     }
@@ -292,6 +298,9 @@ class Client : public TransportClient, AsyncResolvableUDP
             }
         }
 
+        if (config->busy_poll && !AsioBusyPoll::set_socket(socket, config->busy_poll))
+            OPENVPN_LOG("UDP: SO_BUSY_POLL not set: " << strerror_str(errno));
+
         socket.async_connect(server_endpoint, [self = Ptr(this)](const openvpn_io::error_code &error)
                              {
                                                 OPENVPN_ASYNC_HANDLER;
@@ -311,6 +320,10 @@ class Client : public TransportClient, AsyncResolvableUDP
                                         config->stats));
 #ifdef OPENVPN_GREMLIN
                 impl->gremlin_config(config->gremlin_config);
+#endif
+#ifdef OPENVPN_IO_URING
+                if (config->io_uring)
+                    impl->use_io_uring();
 #endif
                 impl->start(config->n_parallel);
                 parent->transport_connecting();
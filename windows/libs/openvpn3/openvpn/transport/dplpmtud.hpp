@@ -0,0 +1,421 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Datagram packetization layer path MTU discovery (RFC 8899) for the
+// data channel
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+
+/**
+ * Search for the largest data channel packet that makes it to the peer.
+ *
+ * Sizes are plaintext sizes of data channel packets, i.e. the size of
+ * the largest tunnel IP packet that can be sent without fragmentation
+ * in the underlay.  Probes are padded data channel messages (see
+ * PathMTUDiscovery::Message) which the peer acknowledges with a small
+ * message, so the search works regardless of ICMP filtering.
+ *
+ * The search starts at base_plpmtu, tries max_plpmtu next and then
+ * narrows down the gap between the largest acknowledged and the
+ * smallest failed size.  A size has failed when max_probes probes in a
+ * row were not acknowledged within probe_timeout.  After the search
+ * completes, the current size is confirmed every confirm_interval; if
+ * the confirmation fails, the path has become a black hole for packets
+ * of that size, and the search restarts at base_plpmtu.  A completed
+ * search is repeated after raise_interval to find out if the path MTU
+ * has grown.
+ *
+ * Only one probe is in flight at a time.  The class does no I/O: the
+ * caller sends the probes returned by poll(), passes acknowledgements to
+ * acked() and calls poll() again at next_event().
+ */
+class PathMTUDiscovery
+{
+  public:
+    enum State
+    {
+        DISABLED,
+        BASE,            // confirming base_plpmtu
+        SEARCHING,       // looking for a larger size
+        SEARCH_COMPLETE, // plpmtu() is the largest size found
+        ERROR,           // not even base_plpmtu works
+    };
+
+    struct Config
+    {
+        size_t base_plpmtu = 1200;  // size assumed to work on almost any path
+        size_t min_plpmtu = 576;    // size used when base_plpmtu fails
+        size_t max_plpmtu = 1500;   // upper bound of the search
+        size_t search_granularity = 16; // stop searching when the gap is this small
+        unsigned int max_probes = 3;
+        Time::Duration probe_timeout = Time::Duration::seconds(1);
+        Time::Duration confirm_interval = Time::Duration::seconds(30);
+        Time::Duration raise_interval = Time::Duration::seconds(600);
+    };
+
+    struct Probe
+    {
+        std::uint32_t seq = 0;
+        size_t size = 0;
+    };
+
+    /**
+     * Probe and acknowledgement messages, sent as data channel payload.
+     *
+     *   magic (8 bytes) | type (1) | seq (4, big endian) | size (2, big endian) | padding
+     *
+     * The size field of an acknowledgement echoes the size the probe had
+     * when it was received.
+     */
+    struct Message
+    {
+        enum Type : unsigned char
+        {
+            PROBE = 1,
+            ACK = 2,
+        };
+
+        static constexpr size_t HEADER_SIZE = 8 + 1 + 4 + 2;
+
+        Type type = PROBE;
+        std::uint32_t seq = 0;
+        size_t size = 0;
+
+        // Write a message to buf, padded to size bytes for a probe.
+        // Returns false if the message does not fit into buf.
+        bool write(Buffer &buf) const
+        {
+            const size_t len = type == PROBE ? std::max(size, HEADER_SIZE) : HEADER_SIZE;
+            if (buf.remaining() < len)
+                return false;
+            buf.write(magic, sizeof(magic));
+            buf.push_back(type);
+            for (int shift = 24; shift >= 0; shift -= 8)
+                buf.push_back(static_cast<unsigned char>(seq >> shift));
+            const size_t sz = std::min(size, size_t(0xFFFF));
+            buf.push_back(static_cast<unsigned char>(sz >> 8));
+            buf.push_back(static_cast<unsigned char>(sz));
+            if (len > HEADER_SIZE)
+                std::memset(buf.write_alloc(len - HEADER_SIZE), 0, len - HEADER_SIZE);
+            return true;
+        }
+
+        // Parse a received data channel payload.  Returns false if it is
+        // not a probe or acknowledgement.
+        bool read(const Buffer &buf)
+        {
+            if (!is_message(buf))
+                return false;
+            const unsigned char *p = buf.c_data() + sizeof(magic);
+            if (p[0] != PROBE && p[0] != ACK)
+                return false;
+            type = static_cast<Type>(p[0]);
+            seq = (std::uint32_t(p[1]) << 24) | (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 8) | p[4];
+            size = type == PROBE ? buf.size() : (size_t(p[5]) << 8) | p[6];
+            return true;
+        }
+
+        static bool is_message(const Buffer &buf)
+        {
+            return buf.size() >= HEADER_SIZE
+                   && buf[0] == magic[0]
+                   && !std::memcmp(magic, buf.c_data(), sizeof(magic));
+        }
+
+        // first byte is not a valid IP version, like the keepalive message
+        static constexpr unsigned char magic[8] = {0x2b, 0x93, 0x0e, 0x5a, 0xc1, 0x77, 0x48, 0xd6};
+    };
+
+    PathMTUDiscovery() = default;
+
+    explicit PathMTUDiscovery(const Config &config)
+        : config_(config)
+    {
+    }
+
+    // Start (or restart) the search.  plpmtu() is base_plpmtu until a
+    // probe confirms it.
+    void start(const Time &now)
+    {
+        plpmtu_ = config_.base_plpmtu;
+        enter_base(now);
+    }
+
+    void stop()
+    {
+        state_ = DISABLED;
+        in_flight_ = false;
+        next_event_.reset();
+    }
+
+    /**
+     * Handle timeouts and return the probe to send now, if any.  Returns
+     * false if no probe is due before next_event().
+     */
+    bool poll(const Time &now, Probe &probe)
+    {
+        if (state_ == DISABLED || !next_event_.defined() || now < next_event_)
+            return false;
+
+        if (in_flight_)
+        {
+            // the probe in flight timed out
+            in_flight_ = false;
+            if (++probe_count_ >= config_.max_probes)
+                probe_failed(now);
+            if (now < next_event_)
+                return false;
+        }
+        else if (state_ == SEARCH_COMPLETE)
+        {
+            if (now >= raise_time_ && plpmtu_ < config_.max_plpmtu)
+            {
+                // see if the path MTU has grown
+                enter_searching(now);
+            }
+            else
+            {
+                // confirm the current size
+                confirming_ = true;
+                set_probe_size(plpmtu_);
+            }
+        }
+        else if (state_ == ERROR)
+        {
+            // try base_plpmtu again
+            set_probe_size(config_.base_plpmtu);
+        }
+
+        if (state_ == SEARCH_COMPLETE && !confirming_)
+            return false;
+
+        probe.seq = ++seq_;
+        probe.size = probe_size_;
+        in_flight_ = true;
+        next_event_ = now + config_.probe_timeout;
+        ++stats_.probes_sent;
+        return true;
+    }
+
+    /**
+     * Process an acknowledgement.  Acknowledgements of any probe of the
+     * size currently being probed are accepted, so a late answer to a
+     * retransmitted probe still counts.  Returns true if the
+     * acknowledgement was for the current probe.
+     */
+    bool acked(const std::uint32_t seq, const size_t size, const Time &now)
+    {
+        if (!in_flight_ || size != probe_size_ || seq < first_seq_ || seq > seq_)
+            return false;
+        in_flight_ = false;
+        ++stats_.probes_acked;
+
+        switch (state_)
+        {
+        case BASE:
+        case ERROR:
+            plpmtu_ = probe_size_;
+            enter_searching(now);
+            break;
+        case SEARCHING:
+            plpmtu_ = probe_size_;
+            next_search_probe(now);
+            break;
+        case SEARCH_COMPLETE:
+            confirming_ = false;
+            next_event_ = complete_next_event(now);
+            break;
+        case DISABLED:
+            break;
+        }
+        return true;
+    }
+
+    // largest size known to work, or the assumed size while searching
+    size_t plpmtu() const
+    {
+        return plpmtu_;
+    }
+
+    State state() const
+    {
+        return state_;
+    }
+
+    // true once plpmtu() describes the path: a probe of that size was
+    // acknowledged, or a failed probe lowered it
+    bool plpmtu_known() const
+    {
+        switch (state_)
+        {
+        case SEARCHING:
+        case SEARCH_COMPLETE:
+        case ERROR:
+            return true;
+        case BASE:
+            return stats_.black_holes > 0;
+        case DISABLED:
+            break;
+        }
+        return false;
+    }
+
+    // time at which poll() has to be called again, undefined if disabled
+    const Time &next_event() const
+    {
+        return next_event_;
+    }
+
+    const Config &config() const
+    {
+        return config_;
+    }
+
+    struct Stats
+    {
+        std::uint64_t probes_sent = 0;
+        std::uint64_t probes_acked = 0;
+        std::uint64_t black_holes = 0; // confirmed size stopped working
+    };
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    static const char *state_name(const State state)
+    {
+        switch (state)
+        {
+        case DISABLED:
+            return "disabled";
+        case BASE:
+            return "base";
+        case SEARCHING:
+            return "searching";
+        case SEARCH_COMPLETE:
+            return "search complete";
+        case ERROR:
+            return "error";
+        }
+        return "unknown";
+    }
+
+  private:
+    void enter_base(const Time &now)
+    {
+        state_ = BASE;
+        confirming_ = false;
+        in_flight_ = false;
+        set_probe_size(config_.base_plpmtu);
+        next_event_ = now;
+    }
+
+    void enter_searching(const Time &now)
+    {
+        state_ = SEARCHING;
+        confirming_ = false;
+        search_high_ = config_.max_plpmtu + 1; // smallest size known to fail
+        if (plpmtu_ >= config_.max_plpmtu)
+            enter_complete(now);
+        else
+        {
+            // optimistically try the largest size first
+            set_probe_size(config_.max_plpmtu);
+            next_event_ = now;
+        }
+    }
+
+    void enter_complete(const Time &now)
+    {
+        state_ = SEARCH_COMPLETE;
+        confirming_ = false;
+        raise_time_ = now + config_.raise_interval;
+        next_event_ = complete_next_event(now);
+    }
+
+    // next confirmation probe, or the next attempt to raise the size
+    Time complete_next_event(const Time &now) const
+    {
+        const Time confirm = now + config_.confirm_interval;
+        if (plpmtu_ < config_.max_plpmtu && raise_time_ < confirm)
+            return raise_time_;
+        return confirm;
+    }
+
+    void next_search_probe(const Time &now)
+    {
+        if (search_high_ <= plpmtu_ + config_.search_granularity)
+        {
+            enter_complete(now);
+            return;
+        }
+        set_probe_size(plpmtu_ + (search_high_ - plpmtu_) / 2);
+        next_event_ = now;
+    }
+
+    void probe_failed(const Time &now)
+    {
+        switch (state_)
+        {
+        case BASE:
+        case ERROR:
+            state_ = ERROR;
+            plpmtu_ = config_.min_plpmtu;
+            next_event_ = now + config_.confirm_interval;
+            break;
+        case SEARCHING:
+            search_high_ = probe_size_;
+            next_search_probe(now);
+            break;
+        case SEARCH_COMPLETE:
+            // the confirmed size stopped working
+            ++stats_.black_holes;
+            plpmtu_ = config_.base_plpmtu;
+            enter_base(now);
+            break;
+        case DISABLED:
+            break;
+        }
+    }
+
+    void set_probe_size(const size_t size)
+    {
+        probe_size_ = size;
+        probe_count_ = 0;
+        first_seq_ = seq_ + 1;
+    }
+
+    Config config_;
+    State state_ = DISABLED;
+    size_t plpmtu_ = 0;
+    size_t probe_size_ = 0;
+    size_t search_high_ = 0;
+    unsigned int probe_count_ = 0;
+    bool in_flight_ = false;
+    bool confirming_ = false;
+    std::uint32_t seq_ = 0;
+    std::uint32_t first_seq_ = 0;
+    Time next_event_;
+    Time raise_time_;
+    Stats stats_;
+};
+
+} // namespace openvpn
@@ -0,0 +1,315 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Flow-queueing packet scheduler with CoDel active queue management,
+// after RFC 8290 (FQ-CoDel) and RFC 8289 (CoDel).
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <deque>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+
+/**
+ * Packets are hashed into a fixed number of flow queues, which are
+ * served round-robin with a byte quantum (deficit round robin).  Flows
+ * that just became active are served before flows that have been busy,
+ * so sparse flows (interactive traffic, DNS, VoIP) bypass the backlog of
+ * bulk flows.  Each queue runs CoDel on the time its packets spent in
+ * the scheduler, which keeps the standing queue of a bulk flow near the
+ * target delay instead of the size of the buffer.
+ *
+ * When the total backlog exceeds the byte or packet limit, packets are
+ * dropped from the head of the flow with the largest backlog.
+ *
+ * Time is taken from the caller, so the scheduler can be driven by a
+ * simulated clock.  Note that Time has a granularity of 1/1024 s.
+ */
+class FQCoDel
+{
+  public:
+    struct Config
+    {
+        size_t flows = 1024;                                     // number of flow queues
+        size_t quantum = 1514;                                   // bytes per flow per round
+        size_t byte_limit = 1024 * 1024;                         // max total backlog in bytes
+        size_t packet_limit = 10240;                             // max total backlog in packets
+        Time::Duration target = Time::Duration::milliseconds(5); // acceptable standing queue delay
+        Time::Duration interval = Time::Duration::milliseconds(100);
+    };
+
+    struct Stats
+    {
+        std::uint64_t enqueued = 0;
+        std::uint64_t dequeued = 0;
+        std::uint64_t codel_drops = 0;   // dropped by CoDel for excess sojourn time
+        std::uint64_t overlimit_drops = 0; // dropped because the byte or packet limit was hit
+        std::uint64_t new_flows = 0;     // flows that became active
+        Time::Duration last_sojourn;     // sojourn time of the last dequeued packet
+        Time::Duration max_sojourn;
+        double avg_sojourn_ms = 0.0;     // moving average over dequeued packets
+
+        std::string to_string() const
+        {
+            std::ostringstream os;
+            os << "enq=" << enqueued
+               << " deq=" << dequeued
+               << " codel_drop=" << codel_drops
+               << " overlimit_drop=" << overlimit_drops
+               << " new_flows=" << new_flows
+               << " sojourn_avg=" << avg_sojourn_ms << "ms"
+               << " sojourn_max=" << max_sojourn.to_milliseconds() << "ms";
+            return os.str();
+        }
+    };
+
+    FQCoDel()
+        : FQCoDel(Config())
+    {
+    }
+
+    explicit FQCoDel(const Config &config)
+        : config_(config),
+          flows_(std::max(config.flows, size_t(1)))
+    {
+    }
+
+    // Queue a packet for the flow identified by flow_hash.  Returns the
+    // number of packets dropped to stay within the limits, which may
+    // include the packet just queued.
+    size_t enqueue(BufferPtr pkt, const std::uint32_t flow_hash, const Time &now)
+    {
+        Flow &f = flows_[flow_hash % flows_.size()];
+        const size_t size = pkt->size();
+        f.queue.push_back(Packet{std::move(pkt), now});
+        f.backlog += size;
+        backlog_bytes_ += size;
+        ++backlog_packets_;
+        ++stats_.enqueued;
+
+        if (!f.active)
+        {
+            f.active = true;
+            f.deficit = static_cast<long>(config_.quantum);
+            new_flows_.push_back(&f);
+            ++stats_.new_flows;
+        }
+
+        size_t dropped = 0;
+        while (backlog_bytes_ > config_.byte_limit || backlog_packets_ > config_.packet_limit)
+        {
+            drop_from_fattest_flow();
+            ++dropped;
+        }
+        return dropped;
+    }
+
+    // Return the next packet to send, or an undefined BufferPtr if the
+    // scheduler is empty.
+    BufferPtr dequeue(const Time &now)
+    {
+        while (true)
+        {
+            std::list<Flow *> &list = !new_flows_.empty() ? new_flows_ : old_flows_;
+            if (list.empty())
+                return BufferPtr();
+            Flow *f = list.front();
+
+            if (f->deficit <= 0)
+            {
+                f->deficit += static_cast<long>(config_.quantum);
+                list.pop_front();
+                old_flows_.push_back(f);
+                continue;
+            }
+
+            BufferPtr pkt = codel_dequeue(*f, now);
+            if (!pkt)
+            {
+                list.pop_front();
+                if (&list == &new_flows_ && !old_flows_.empty())
+                    old_flows_.push_back(f); // prevent starvation of old flows
+                else
+                    f->active = false;
+                continue;
+            }
+
+            f->deficit -= static_cast<long>(pkt->size());
+            ++stats_.dequeued;
+            return pkt;
+        }
+    }
+
+    bool empty() const
+    {
+        return backlog_packets_ == 0;
+    }
+
+    size_t backlog_bytes() const
+    {
+        return backlog_bytes_;
+    }
+
+    size_t backlog_packets() const
+    {
+        return backlog_packets_;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    const Config &config() const
+    {
+        return config_;
+    }
+
+  private:
+    struct Packet
+    {
+        BufferPtr buf;
+        Time enqueue_time;
+    };
+
+    struct Flow
+    {
+        std::deque<Packet> queue;
+        size_t backlog = 0;
+        long deficit = 0;
+        bool active = false; // on new_flows_ or old_flows_
+
+        // CoDel state
+        Time first_above_time; // undefined if sojourn time is below target
+        Time drop_next;
+        unsigned int count = 0;
+        unsigned int lastcount = 0;
+        bool dropping = false;
+    };
+
+    BufferPtr pop(Flow &f)
+    {
+        BufferPtr pkt = std::move(f.queue.front().buf);
+        f.queue.pop_front();
+        f.backlog -= pkt->size();
+        backlog_bytes_ -= pkt->size();
+        --backlog_packets_;
+        return pkt;
+    }
+
+    // RFC 8289 dodequeue(): pop the head packet and decide whether its
+    // sojourn time makes it a candidate for dropping
+    BufferPtr codel_pop(Flow &f, const Time &now, bool &ok_to_drop)
+    {
+        ok_to_drop = false;
+        if (f.queue.empty())
+        {
+            f.first_above_time.reset();
+            return BufferPtr();
+        }
+        const Time::Duration sojourn = now - f.queue.front().enqueue_time;
+        BufferPtr pkt = pop(f);
+        record_sojourn(sojourn);
+        if (sojourn < config_.target || f.backlog <= config_.quantum)
+        {
+            // went below target, or too few bytes left to build a queue
+            f.first_above_time.reset();
+        }
+        else if (!f.first_above_time.defined())
+        {
+            f.first_above_time = now + config_.interval;
+        }
+        else if (now >= f.first_above_time)
+        {
+            ok_to_drop = true;
+        }
+        return pkt;
+    }
+
+    BufferPtr codel_dequeue(Flow &f, const Time &now)
+    {
+        bool ok_to_drop;
+        BufferPtr pkt = codel_pop(f, now, ok_to_drop);
+        if (f.dropping)
+        {
+            if (!ok_to_drop)
+                f.dropping = false;
+            while (f.dropping && now >= f.drop_next)
+            {
+                ++stats_.codel_drops;
+                ++f.count;
+                pkt = codel_pop(f, now, ok_to_drop);
+                if (!ok_to_drop)
+                    f.dropping = false;
+                else
+                    f.drop_next = control_law(f.drop_next, f.count);
+            }
+        }
+        else if (ok_to_drop)
+        {
+            ++stats_.codel_drops;
+            pkt = codel_pop(f, now, ok_to_drop);
+            f.dropping = true;
+            const unsigned int delta = f.count - f.lastcount;
+            if (delta > 1 && now - f.drop_next < config_.interval * 16)
+                f.count = delta;
+            else
+                f.count = 1;
+            f.drop_next = control_law(now, f.count);
+            f.lastcount = f.count;
+        }
+        return pkt;
+    }
+
+    Time control_law(const Time &t, const unsigned int count) const
+    {
+        const double d = double(config_.interval.raw()) / std::sqrt(double(count));
+        return t + Time::Duration::binary_ms(static_cast<Time::type>(d));
+    }
+
+    void drop_from_fattest_flow()
+    {
+        Flow *fattest = &flows_[0];
+        for (auto &f : flows_)
+            if (f.backlog > fattest->backlog)
+                fattest = &f;
+        pop(*fattest);
+        ++stats_.overlimit_drops;
+    }
+
+    void record_sojourn(const Time::Duration &sojourn)
+    {
+        stats_.last_sojourn = sojourn;
+        if (sojourn > stats_.max_sojourn)
+            stats_.max_sojourn = sojourn;
+        const double ms = sojourn.to_double() * 1000.0;
+        stats_.avg_sojourn_ms += (ms - stats_.avg_sojourn_ms) / 16.0;
+    }
+
+    const Config config_;
+    std::vector<Flow> flows_;
+    std::list<Flow *> new_flows_;
+    std::list<Flow *> old_flows_;
+    size_t backlog_bytes_ = 0;
+    size_t backlog_packets_ = 0;
+    Stats stats_;
+};
+
+} // namespace openvpn
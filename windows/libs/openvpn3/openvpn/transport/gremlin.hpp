@@ -123,8 +123,8 @@ class Config : public RC<thread_unsafe_refcount>
     Config(const std::string &config_str)
     {
         const std::vector<std::string> parms = string::split(config_str, ',');
-        if (parms.size() < 4)
-            throw gremlin_error("need 4 comma-separated values for send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob");
+        if (parms.size() < 4 || parms.size() > 5)
+            throw gremlin_error("need 4 comma-separated values for send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob, optionally followed by a random seed");
         if (!parse_number(string::trim_copy(parms[0]), send_delay_ms))
             throw gremlin_error("send_delay_ms");
         if (!parse_number(string::trim_copy(parms[1]), recv_delay_ms))
@@ -133,12 +133,17 @@ class Config : public RC<thread_unsafe_refcount>
             throw gremlin_error("send_drop_probability");
         if (!parse_number(string::trim_copy(parms[3]), recv_drop_probability))
             throw gremlin_error("recv_drop_probability");
+        if (parms.size() > 4 && !parse_number(string::trim_copy(parms[4]), seed))
+            throw gremlin_error("seed");
     }
 
     std::string to_string() const
     {
         std::ostringstream os;
-        os << '[' << send_delay_ms << ',' << recv_delay_ms << ',' << send_drop_probability << ',' << recv_drop_probability << ']';
+        os << '[' << send_delay_ms << ',' << recv_delay_ms << ',' << send_drop_probability << ',' << recv_drop_probability;
+        if (seed)
+            os << ',' << seed;
+        os << ']';
         return os.str();
     }
 
@@ -146,6 +151,9 @@ class Config : public RC<thread_unsafe_refcount>
     unsigned int recv_delay_ms = 0;
     unsigned int send_drop_probability = 0;
     unsigned int recv_drop_probability = 0;
+
+    // If non-zero, drop decisions are reproducible across runs
+    std::uint64_t seed = 0;
 };
 
 class SendRecvQueue
@@ -155,6 +163,7 @@ class SendRecvQueue
                   const Config::Ptr &conf_arg,
                   const bool tcp_arg)
         : conf(conf_arg),
+          ri(conf->seed ? MTRand::rand_type::result_type(conf->seed) : MTRand::gen_seed()),
           send(new DelayedQueue(io_context, conf->send_delay_ms)),
           recv(new DelayedQueue(io_context, conf->recv_delay_ms)),
           tcp(tcp_arg)
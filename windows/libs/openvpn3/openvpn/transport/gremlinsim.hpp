@@ -0,0 +1,381 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Deterministic, virtual-time network impairment model.
+//
+// This is the in-process counterpart of the asio-driven Gremlin in
+// gremlin.hpp.  Instead of arming timers on an io_context, a SimLink
+// computes a delivery time for every packet and hands the packet back
+// once the caller's (simulated) clock has reached it.  All impairment
+// decisions are drawn from a seeded MTRand, so the same seed and the
+// same packet sequence always produce the same loss/reorder pattern.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <queue>
+#include <sstream>
+#include <algorithm>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/common/string.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/time/time.hpp>
+#include <openvpn/random/mtrandapi.hpp>
+
+namespace openvpn::Gremlin {
+
+OPENVPN_EXCEPTION(gremlin_profile_error);
+
+/**
+ * Impairment profile for one direction of a simulated link,
+ * loosely modelled on the parameters of Linux netem/tbf.
+ */
+struct Profile
+{
+    std::string name;
+    unsigned int delay_ms = 0;       // one-way base latency
+    unsigned int jitter_ms = 0;      // uniformly distributed extra latency in [0, jitter_ms]
+    double loss_percent = 0.0;       // random loss probability
+    double reorder_percent = 0.0;    // probability that a packet is held back by reorder_gap_ms
+    unsigned int reorder_gap_ms = 0; // extra hold-back latency for reordered packets
+    unsigned int rate_kbps = 0;      // bottleneck bandwidth, 0 for unlimited
+    size_t queue_bytes = 0;          // bottleneck queue size (tail drop), 0 for unlimited
+
+    /**
+     * Parse a profile from a comma-separated list of key=value pairs, e.g.
+     * "delay=40,jitter=10,loss=1.5,reorder=2,gap=20,rate=8000,queue=64000".
+     * A bare preset name (see preset()) may be used as the first element and
+     * further keys override its values.
+     */
+    static Profile parse(const std::string &spec)
+    {
+        Profile p;
+        const std::vector<std::string> parms = string::split(spec, ',');
+        for (size_t i = 0; i < parms.size(); ++i)
+        {
+            const std::string parm = string::trim_copy(parms[i]);
+            const size_t eq = parm.find('=');
+            if (eq == std::string::npos)
+            {
+                if (i == 0)
+                {
+                    p = preset(parm);
+                    continue;
+                }
+                throw gremlin_profile_error("expected key=value: " + parm);
+            }
+            const std::string key = parm.substr(0, eq);
+            const std::string value = parm.substr(eq + 1);
+            if (key == "name")
+                p.name = value;
+            else if (key == "delay")
+                parse_uint(key, value, p.delay_ms);
+            else if (key == "jitter")
+                parse_uint(key, value, p.jitter_ms);
+            else if (key == "loss")
+                p.loss_percent = parse_percent(key, value);
+            else if (key == "reorder")
+                p.reorder_percent = parse_percent(key, value);
+            else if (key == "gap")
+                parse_uint(key, value, p.reorder_gap_ms);
+            else if (key == "rate")
+                parse_uint(key, value, p.rate_kbps);
+            else if (key == "queue")
+                parse_uint(key, value, p.queue_bytes);
+            else
+                throw gremlin_profile_error("unknown key: " + key);
+        }
+        if (p.name.empty())
+            p.name = spec;
+        return p;
+    }
+
+    /**
+     * Named profiles approximating common access networks.
+     * Values are one-way and intended to be applied to both directions.
+     */
+    static Profile preset(const std::string &name)
+    {
+        Profile p;
+        p.name = name;
+        if (name == "ideal")
+            ;
+        else if (name == "lan")
+        {
+            p.delay_ms = 1;
+            p.rate_kbps = 100000;
+        }
+        else if (name == "wifi")
+        {
+            p.delay_ms = 5;
+            p.jitter_ms = 10;
+            p.loss_percent = 0.5;
+            p.rate_kbps = 30000;
+        }
+        else if (name == "lte")
+        {
+            p.delay_ms = 35;
+            p.jitter_ms = 15;
+            p.loss_percent = 1.0;
+            p.reorder_percent = 0.5;
+            p.reorder_gap_ms = 20;
+            p.rate_kbps = 10000;
+            p.queue_bytes = 128 * 1024;
+        }
+        else if (name == "3g")
+        {
+            p.delay_ms = 100;
+            p.jitter_ms = 40;
+            p.loss_percent = 3.0;
+            p.reorder_percent = 1.0;
+            p.reorder_gap_ms = 50;
+            p.rate_kbps = 1500;
+            p.queue_bytes = 64 * 1024;
+        }
+        else if (name == "lossy")
+        {
+            p.delay_ms = 50;
+            p.jitter_ms = 20;
+            p.loss_percent = 10.0;
+            p.reorder_percent = 2.0;
+            p.reorder_gap_ms = 30;
+            p.rate_kbps = 5000;
+        }
+        else if (name == "satellite")
+        {
+            p.delay_ms = 300;
+            p.jitter_ms = 20;
+            p.loss_percent = 0.5;
+            p.rate_kbps = 2000;
+            p.queue_bytes = 256 * 1024;
+        }
+        else
+            throw gremlin_profile_error("unknown preset: " + name);
+        return p;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        os << name << "[delay=" << delay_ms
+           << " jitter=" << jitter_ms
+           << " loss=" << loss_percent
+           << " reorder=" << reorder_percent
+           << " gap=" << reorder_gap_ms
+           << " rate=" << rate_kbps
+           << " queue=" << queue_bytes << ']';
+        return os.str();
+    }
+
+  private:
+    template <typename T>
+    static void parse_uint(const std::string &key, const std::string &value, T &out)
+    {
+        if (!parse_number(value, out))
+            throw gremlin_profile_error("bad value for " + key + ": " + value);
+    }
+
+    static double parse_percent(const std::string &key, const std::string &value)
+    {
+        try
+        {
+            size_t pos = 0;
+            const double d = std::stod(value, &pos);
+            if (pos == value.length() && d >= 0.0 && d <= 100.0)
+                return d;
+        }
+        catch (const std::exception &)
+        {
+        }
+        throw gremlin_profile_error("bad percentage for " + key + ": " + value);
+    }
+};
+
+/**
+ * One direction of a simulated link.  Packets passed to send() are
+ * either dropped or scheduled for delivery, and are returned by
+ * recv() once the caller's clock has reached their delivery time.
+ */
+class SimLink
+{
+  public:
+    struct Stats
+    {
+        std::uint64_t sent = 0;         // packets offered to the link
+        std::uint64_t sent_bytes = 0;   // bytes offered to the link
+        std::uint64_t dropped = 0;      // random loss
+        std::uint64_t queue_drops = 0;  // bottleneck queue overflow
+        std::uint64_t delivered = 0;    // packets handed to the receiver
+        std::uint64_t delivered_bytes = 0;
+        std::uint64_t reordered = 0;    // packets delivered after a later-sent packet
+
+        std::string to_string() const
+        {
+            std::ostringstream os;
+            os << "sent=" << sent
+               << " dropped=" << dropped
+               << " qdrop=" << queue_drops
+               << " delivered=" << delivered
+               << " reordered=" << reordered;
+            return os.str();
+        }
+    };
+
+    SimLink(const Profile &prof, const std::uint64_t seed)
+        : prof_(prof),
+          rng_(seed),
+          loss_ppm_(to_ppm(prof.loss_percent)),
+          reorder_ppm_(to_ppm(prof.reorder_percent))
+    {
+    }
+
+    // Offer a packet to the link at time now.  Returns false if the
+    // packet was dropped.
+    bool send(BufferPtr pkt, const Time &now)
+    {
+        ++stats_.sent;
+        stats_.sent_bytes += pkt->size();
+
+        // Draw every random decision up front, so that the random sequence
+        // only depends on the number of packets sent and not on which of
+        // them were dropped.
+        const bool lose = chance(loss_ppm_);
+        const bool reorder = chance(reorder_ppm_);
+        const unsigned int jitter = prof_.jitter_ms ? rng_.randrange32(prof_.jitter_ms + 1) : 0;
+
+        // bottleneck: serialization delay and finite queue
+        Time depart = now;
+        if (prof_.rate_kbps)
+        {
+            if (tx_free_ < now)
+                tx_free_ = now;
+            if (prof_.queue_bytes && backlog_bytes(now) + pkt->size() > prof_.queue_bytes)
+            {
+                ++stats_.queue_drops;
+                return false;
+            }
+            tx_carry_ += double(pkt->size()) * 8.0 * double(Time::prec) / (double(prof_.rate_kbps) * 1000.0);
+            const auto units = static_cast<Time::type>(tx_carry_);
+            tx_carry_ -= double(units);
+            tx_free_ += Time::Duration::binary_ms(units);
+            depart = tx_free_;
+        }
+
+        if (lose)
+        {
+            ++stats_.dropped;
+            return false;
+        }
+
+        unsigned int latency_ms = prof_.delay_ms + jitter;
+        if (reorder)
+            latency_ms += prof_.reorder_gap_ms;
+
+        in_flight_.push(Entry{depart + Time::Duration::milliseconds(latency_ms), seq_++, std::move(pkt)});
+        return true;
+    }
+
+    // Return the next packet whose delivery time is <= now, or an
+    // undefined BufferPtr if none is ready.
+    BufferPtr recv(const Time &now)
+    {
+        if (in_flight_.empty() || in_flight_.top().deliver_at > now)
+            return BufferPtr();
+        Entry e = in_flight_.top();
+        in_flight_.pop();
+        if (delivered_any_ && e.seq < max_delivered_seq_)
+            ++stats_.reordered;
+        else
+            max_delivered_seq_ = e.seq;
+        delivered_any_ = true;
+        ++stats_.delivered;
+        stats_.delivered_bytes += e.pkt->size();
+        return std::move(e.pkt);
+    }
+
+    // Time at which the next in-flight packet becomes deliverable
+    Time next_delivery() const
+    {
+        if (in_flight_.empty())
+            return Time::infinite();
+        return in_flight_.top().deliver_at;
+    }
+
+    size_t in_flight() const
+    {
+        return in_flight_.size();
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    const Profile &profile() const
+    {
+        return prof_;
+    }
+
+  private:
+    struct Entry
+    {
+        Time deliver_at;
+        std::uint64_t seq;
+        BufferPtr pkt;
+
+        // priority_queue is a max-heap, so invert to get the earliest delivery first;
+        // ties are broken by send order.
+        bool operator<(const Entry &rhs) const
+        {
+            if (deliver_at != rhs.deliver_at)
+                return deliver_at > rhs.deliver_at;
+            return seq > rhs.seq;
+        }
+    };
+
+    static std::uint32_t to_ppm(const double percent)
+    {
+        return static_cast<std::uint32_t>(percent * 10000.0);
+    }
+
+    bool chance(const std::uint32_t ppm)
+    {
+        const std::uint32_t r = rng_.randrange32(1000000);
+        return r < ppm;
+    }
+
+    // Approximate number of bytes still queued at the bottleneck
+    size_t backlog_bytes(const Time &now) const
+    {
+        if (tx_free_ <= now)
+            return 0;
+        const double secs = (tx_free_ - now).to_double();
+        return static_cast<size_t>(secs * double(prof_.rate_kbps) * 1000.0 / 8.0);
+    }
+
+    Profile prof_;
+    MTRand rng_;
+    std::uint32_t loss_ppm_;
+    std::uint32_t reorder_ppm_;
+    Time tx_free_;
+    double tx_carry_ = 0.0;
+    std::uint64_t seq_ = 0;
+    std::uint64_t max_delivered_seq_ = 0;
+    bool delivered_any_ = false;
+    std::priority_queue<Entry> in_flight_;
+    Stats stats_;
+};
+
+} // namespace openvpn::Gremlin
@@ -27,6 +27,10 @@
 #include <openvpn/transport/gremlin.hpp>
 #endif
 
+#ifdef OPENVPN_IO_URING
+#include <openvpn/linux/uring.hpp>
+#endif
+
 #if defined(OPENVPN_DEBUG_UDPLINK) && OPENVPN_DEBUG_UDPLINK >= 1
 #define OPENVPN_LOG_UDPLINK_ERROR(x) OPENVPN_LOG(x)
 #else
@@ -97,10 +101,63 @@ class UDPLink : public RC<thread_unsafe_refcount>
             return do_send(buf, endpoint);
     }
 
+#ifdef OPENVPN_IO_URING
+    // Receive with a multishot recvmsg into a ring of n_recv buffers
+    // (a power of 2), and send through n_send registered slots.  Call
+    // before start().  Returns false, leaving the link on the reactor,
+    // if the kernel lacks the required io_uring features.
+    bool use_io_uring(const unsigned int n_recv = 256, const unsigned int n_send = 256)
+    {
+        try
+        {
+            uring.reset(new IOUring(socket.get_executor(), 256));
+            uring_recv.reset(new IOUring::RecvBuffers(*uring, 0, n_recv, frame_context, URING_RECV_PREFIX));
+            uring_send.reset(new IOUring::SendBuffers(*uring, n_send, frame_context.payload()));
+            uring_msg = {};
+            uring_msg.msg_namelen = sizeof(sockaddr_in6);
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG("UDPLink: io_uring not used: " << e.what());
+            uring_send.reset();
+            uring_recv.reset();
+            uring.reset();
+            return false;
+        }
+    }
+
+    // called by IOUring
+    void uring_event(const bool wait)
+    {
+        if (halt)
+            return;
+        const bool more = uring->process([this](const io_uring_cqe &cqe)
+                                         {
+                                             uring_complete(cqe);
+                                             return !halt; });
+        if (halt)
+            return;
+        if (more)
+            uring->post_event(Ptr(this));
+        if (wait)
+            uring->async_wait(Ptr(this));
+    }
+#endif
+
     void start(const int n_parallel)
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            if (uring)
+            {
+                uring_queue_recv();
+                uring->submit();
+                uring->async_wait(Ptr(this));
+                return;
+            }
+#endif
             for (int i = 0; i < n_parallel; i++)
                 queue_read(nullptr);
         }
@@ -112,6 +169,10 @@ class UDPLink : public RC<thread_unsafe_refcount>
 #ifdef OPENVPN_GREMLIN
         if (gremlin)
             gremlin->stop();
+#endif
+#ifdef OPENVPN_IO_URING
+        if (uring)
+            uring->cancel_all();
 #endif
     }
 
@@ -149,18 +210,7 @@ class UDPLink : public RC<thread_unsafe_refcount>
             if (bytes_recvd)
             {
                 if (!error)
-                {
-                    OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << bytes_recvd << "] from " << pfp->sender_endpoint);
-                    pfp->buf.set_size(bytes_recvd);
-                    stats->inc_stat(SessionStats::BYTES_IN, bytes_recvd);
-                    stats->inc_stat(SessionStats::PACKETS_IN, 1);
-#ifdef OPENVPN_GREMLIN
-                    if (gremlin)
-                        gremlin_recv(pfp);
-                    else
-#endif
-                        read_handler->udp_read_handler(pfp);
-                }
+                    read_packet(pfp, bytes_recvd);
                 else
                 {
                     OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: " << error.message());
@@ -172,10 +222,124 @@ class UDPLink : public RC<thread_unsafe_refcount>
         }
     }
 
+    void read_packet(PacketFrom::SPtr &pfp, const size_t bytes_recvd)
+    {
+        OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << bytes_recvd << "] from " << pfp->sender_endpoint);
+        pfp->buf.set_size(bytes_recvd);
+        stats->inc_stat(SessionStats::BYTES_IN, bytes_recvd);
+        stats->inc_stat(SessionStats::PACKETS_IN, 1);
+#ifdef OPENVPN_GREMLIN
+        if (gremlin)
+            gremlin_recv(pfp);
+        else
+#endif
+            read_handler->udp_read_handler(pfp);
+    }
+
+#ifdef OPENVPN_IO_URING
+    enum
+    {
+        URING_RECV = 1,
+        URING_SEND,
+    };
+
+    // the recvmsg header and the source address precede the payload
+    static constexpr size_t URING_RECV_PREFIX = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in6);
+
+    void uring_queue_recv()
+    {
+        io_uring_sqe *sqe = uring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = socket.native_handle();
+        sqe->addr = reinterpret_cast<std::uint64_t>(&uring_msg);
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = uring_recv->group();
+        sqe->user_data = IOUring::user_data(URING_RECV, 0);
+    }
+
+    void uring_complete(const io_uring_cqe &cqe)
+    {
+        switch (IOUring::tag(cqe))
+        {
+        case URING_RECV:
+            uring_recv_complete(cqe);
+            break;
+        case URING_SEND:
+            uring_send->release(IOUring::index(cqe));
+            if (cqe.res < 0)
+            {
+                OPENVPN_LOG_UDPLINK_ERROR("UDP send error: " << strerror_str(-cqe.res));
+                stats->error(Error::NETWORK_SEND_ERROR);
+            }
+            break;
+        }
+    }
+
+    void uring_recv_complete(const io_uring_cqe &cqe)
+    {
+        if (cqe.res >= 0 && IOUring::RecvBuffers::has_buffer(cqe))
+        {
+            if (!uring_pfp)
+                uring_pfp.reset(new PacketFrom());
+            uring_recv->exchange(IOUring::RecvBuffers::buffer_id(cqe), uring_pfp->buf);
+            uring_recv->commit();
+
+            const std::uint8_t *prefix = uring_pfp->buf.c_data() - URING_RECV_PREFIX;
+            io_uring_recvmsg_out out;
+            std::memcpy(&out, prefix, sizeof(out));
+            const size_t namelen = std::min(size_t(out.namelen), sizeof(sockaddr_in6));
+            std::memcpy(uring_pfp->sender_endpoint.data(), prefix + sizeof(out), namelen);
+            uring_pfp->sender_endpoint.resize(namelen);
+            const size_t size = std::min(size_t(out.payloadlen), size_t(cqe.res) - URING_RECV_PREFIX);
+            if (out.flags & MSG_TRUNC)
+            {
+                OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: truncated");
+                stats->error(Error::NETWORK_RECV_ERROR);
+            }
+            else if (size)
+                read_packet(uring_pfp, size);
+        }
+        else if (cqe.res < 0 && cqe.res != -ENOBUFS)
+        {
+            if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+            {
+                // no multishot recvmsg (Linux < 6.0), receive on the reactor
+                OPENVPN_LOG("UDPLink: io_uring recvmsg not supported, receiving on the reactor");
+                for (int i = 0; i < 8; i++)
+                    queue_read(nullptr);
+                return;
+            }
+            OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: " << strerror_str(-cqe.res));
+            stats->error(Error::NETWORK_RECV_ERROR);
+        }
+        // rearm once the kernel ends the multishot request
+        if (!halt && !(cqe.flags & IORING_CQE_F_MORE))
+            uring_queue_recv();
+    }
+#endif
+
     int do_send(const Buffer &buf, const AsioEndpoint *endpoint)
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            // the socket is connected when there's no endpoint
+            if (uring && !endpoint)
+            {
+                if (uring_send->write(socket.native_handle(), buf, URING_SEND))
+                {
+                    stats->inc_stat(SessionStats::BYTES_OUT, buf.size());
+                    stats->inc_stat(SessionStats::PACKETS_OUT, 1);
+                    uring->post_event(Ptr(this));
+                    return 0;
+                }
+                // out of slots, send synchronously
+                uring->submit();
+            }
+#endif
             try
             {
                 const size_t wrote = endpoint
@@ -233,6 +397,14 @@ class UDPLink : public RC<thread_unsafe_refcount>
 #ifdef OPENVPN_GREMLIN
     std::unique_ptr<Gremlin::SendRecvQueue> gremlin;
 #endif
+
+#ifdef OPENVPN_IO_URING
+    std::unique_ptr<IOUring> uring;
+    std::unique_ptr<IOUring::RecvBuffers> uring_recv;
+    std::unique_ptr<IOUring::SendBuffers> uring_send;
+    PacketFrom::SPtr uring_pfp;
+    msghdr uring_msg;
+#endif
 };
 } // namespace openvpn::UDPTransport
 
@@ -0,0 +1,713 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Compact binary form of TunBuilderCapture, for handing tun settings
+// to another process without a JSON round trip.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/tun/builder/capture.hpp>
+
+namespace openvpn {
+
+/**
+ * @brief Binary serialization of TunBuilderCapture.
+ * @details Layout (all integers little-endian):
+ *
+ *     header:  magic "OVTB" | u16 version | u16 reserved (0) | u32 body size
+ *     body:    sections, each a u8 tag followed by its fields, in tag order
+ *     string:  u32 length | bytes
+ *     list:    u32 count | elements
+ *     route:   string address | u8 prefix_length | i32 metric | string gateway | u8 flags
+ *
+ * Every section of the current version is required.  Readers reject
+ * unknown versions, out-of-order or missing sections, out-of-range
+ * values and trailing bytes.  Carries the same data as
+ * TunBuilderCapture::to_json(), plus block_ipv4.
+ */
+class TunBuilderCaptureBinary
+{
+  public:
+    OPENVPN_EXCEPTION(tun_builder_capture_binary_error);
+
+    static constexpr std::uint32_t magic = 0x4254564f; // "OVTB"
+    static constexpr std::uint16_t version = 1;
+    static constexpr size_t header_size = 12;
+
+    enum Tag : std::uint8_t
+    {
+        SESSION_NAME = 1,
+        MTU,
+        LAYER,
+        REMOTE_ADDRESS,
+        TUNNEL_ADDRESSES,
+        TUNNEL_ADDRESS_INDEX,
+        REROUTE_GW,
+        BLOCK,
+        ROUTE_METRIC_DEFAULT,
+        ADD_ROUTES,
+        EXCLUDE_ROUTES,
+        DNS_OPTIONS,
+        WINS_SERVERS,
+        PROXY_BYPASS,
+        PROXY_AUTO_CONFIG_URL,
+        HTTP_PROXY,
+        HTTPS_PROXY,
+        N_TAGS
+    };
+
+    enum RouteFlags : std::uint8_t
+    {
+        ROUTE_IPV6 = (1 << 0),
+        ROUTE_NET30 = (1 << 1),
+    };
+
+    /**
+     * @brief Bounds-checked little-endian reader over a byte range.
+     */
+    class Cursor
+    {
+      public:
+        Cursor() = default;
+
+        Cursor(const unsigned char *data, const size_t size)
+            : p_(data),
+              end_(data + size)
+        {
+        }
+
+        std::uint8_t u8()
+        {
+            need(1);
+            return *p_++;
+        }
+
+        bool boolean()
+        {
+            const std::uint8_t v = u8();
+            if (v > 1)
+                throw tun_builder_capture_binary_error("bad bool");
+            return v != 0;
+        }
+
+        std::uint16_t u16()
+        {
+            need(2);
+            const std::uint16_t v = std::uint16_t(p_[0] | (p_[1] << 8));
+            p_ += 2;
+            return v;
+        }
+
+        std::uint32_t u32()
+        {
+            need(4);
+            const std::uint32_t v = std::uint32_t(p_[0])
+                                    | (std::uint32_t(p_[1]) << 8)
+                                    | (std::uint32_t(p_[2]) << 16)
+                                    | (std::uint32_t(p_[3]) << 24);
+            p_ += 4;
+            return v;
+        }
+
+        int i32()
+        {
+            return static_cast<std::int32_t>(u32());
+        }
+
+        std::string_view str()
+        {
+            const std::uint32_t len = u32();
+            need(len);
+            const std::string_view ret(reinterpret_cast<const char *>(p_), len);
+            p_ += len;
+            return ret;
+        }
+
+        void tag(const Tag t)
+        {
+            if (u8() != t)
+                throw tun_builder_capture_binary_error("expected section " + std::to_string(t));
+        }
+
+        const unsigned char *pos() const
+        {
+            return p_;
+        }
+
+        size_t remaining() const
+        {
+            return end_ - p_;
+        }
+
+      private:
+        void need(const size_t n) const
+        {
+            if (n > size_t(end_ - p_))
+                throw tun_builder_capture_binary_error("truncated");
+        }
+
+        const unsigned char *p_ = nullptr;
+        const unsigned char *end_ = nullptr;
+    };
+
+    // element views, valid while the underlying buffer is
+
+    struct RouteView
+    {
+        std::string_view address;
+        unsigned char prefix_length = 0;
+        int metric = -1;
+        std::string_view gateway;
+        bool ipv6 = false;
+        bool net30 = false;
+
+        static RouteView read(Cursor &c)
+        {
+            RouteView r;
+            r.address = c.str();
+            r.prefix_length = c.u8();
+            r.metric = c.i32();
+            r.gateway = c.str();
+            const std::uint8_t flags = c.u8();
+            if (flags & ~(ROUTE_IPV6 | ROUTE_NET30))
+                throw tun_builder_capture_binary_error("bad route flags");
+            r.ipv6 = (flags & ROUTE_IPV6) != 0;
+            r.net30 = (flags & ROUTE_NET30) != 0;
+            return r;
+        }
+    };
+
+    struct StringView : public std::string_view
+    {
+        static StringView read(Cursor &c)
+        {
+            return StringView{c.str()};
+        }
+    };
+
+    struct DnsAddressView
+    {
+        std::string_view address;
+        unsigned int port = 0;
+
+        static DnsAddressView read(Cursor &c)
+        {
+            DnsAddressView a;
+            a.address = c.str();
+            a.port = c.u32();
+            return a;
+        }
+    };
+
+    /**
+     * @brief Forward range of elements decoded on the fly.
+     * @tparam T view type with a static read(Cursor &) method
+     */
+    template <typename T>
+    class List
+    {
+      public:
+        class Iterator
+        {
+          public:
+            const T &operator*() const
+            {
+                return value_;
+            }
+
+            const T *operator->() const
+            {
+                return &value_;
+            }
+
+            Iterator &operator++()
+            {
+                if (--remaining_)
+                    value_ = T::read(cur_);
+                return *this;
+            }
+
+            bool operator==(const Iterator &other) const
+            {
+                return remaining_ == other.remaining_;
+            }
+
+            bool operator!=(const Iterator &other) const
+            {
+                return remaining_ != other.remaining_;
+            }
+
+          private:
+            friend List;
+
+            Iterator(Cursor cur, const size_t remaining)
+                : cur_(cur),
+                  remaining_(remaining)
+            {
+                if (remaining_)
+                    value_ = T::read(cur_);
+            }
+
+            Cursor cur_;
+            size_t remaining_;
+            T value_;
+        };
+
+        List() = default;
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return !size_;
+        }
+
+        Iterator begin() const
+        {
+            return Iterator(start_, size_);
+        }
+
+        Iterator end() const
+        {
+            return Iterator(start_, 0);
+        }
+
+        // read a list and leave c after its last element
+        static List read(Cursor &c)
+        {
+            List l;
+            l.size_ = c.u32();
+            l.start_ = c;
+            for (size_t i = 0; i < l.size_; ++i)
+                T::read(c);
+            return l;
+        }
+
+      private:
+        Cursor start_;
+        size_t size_ = 0;
+    };
+
+    struct DnsServerView
+    {
+        int priority = 0;
+        List<DnsAddressView> addresses;
+        List<StringView> domains;
+        DnsServer::Security dnssec = DnsServer::Security::Unset;
+        DnsServer::Transport transport = DnsServer::Transport::Unset;
+        std::string_view sni;
+
+        static DnsServerView read(Cursor &c)
+        {
+            DnsServerView s;
+            s.priority = c.i32();
+            s.addresses = List<DnsAddressView>::read(c);
+            s.domains = List<StringView>::read(c);
+            const std::uint8_t dnssec = c.u8();
+            if (dnssec > std::uint8_t(DnsServer::Security::Optional))
+                throw tun_builder_capture_binary_error("bad dnssec");
+            s.dnssec = DnsServer::Security(dnssec);
+            const std::uint8_t transport = c.u8();
+            if (transport > std::uint8_t(DnsServer::Transport::TLS))
+                throw tun_builder_capture_binary_error("bad dns transport");
+            s.transport = DnsServer::Transport(transport);
+            s.sni = c.str();
+            return s;
+        }
+    };
+
+    struct ProxyView
+    {
+        std::string_view host;
+        int port = 0;
+    };
+
+    /**
+     * @brief Validating view of a serialized capture.
+     * @details The constructor checks the whole buffer against the
+     *          schema and throws tun_builder_capture_binary_error if it
+     *          does not conform.  Accessors then return views into the
+     *          buffer without copying, so the buffer must outlive the
+     *          Reader and everything obtained from it.
+     */
+    class Reader
+    {
+      public:
+        explicit Reader(const Buffer &buf)
+            : Reader(buf.c_data(), buf.size())
+        {
+        }
+
+        Reader(const unsigned char *data, const size_t size)
+        {
+            Cursor c(data, size);
+            if (c.u32() != magic)
+                throw tun_builder_capture_binary_error("bad magic");
+            const std::uint16_t ver = c.u16();
+            if (ver != version)
+                throw tun_builder_capture_binary_error("unsupported version " + std::to_string(ver));
+            if (c.u16() != 0)
+                throw tun_builder_capture_binary_error("bad header");
+            if (c.u32() != c.remaining())
+                throw tun_builder_capture_binary_error("bad body size");
+
+            c.tag(SESSION_NAME);
+            session_name_ = c.str();
+            c.tag(MTU);
+            mtu_ = c.i32();
+            c.tag(LAYER);
+            layer_ = Layer::from_value(c.i32());
+            c.tag(REMOTE_ADDRESS);
+            remote_address_ = c.str();
+            remote_address_ipv6_ = c.boolean();
+            c.tag(TUNNEL_ADDRESSES);
+            tunnel_addresses_ = List<RouteView>::read(c);
+            c.tag(TUNNEL_ADDRESS_INDEX);
+            tunnel_address_index_ipv4_ = c.i32();
+            tunnel_address_index_ipv6_ = c.i32();
+            c.tag(REROUTE_GW);
+            reroute_gw_.ipv4 = c.boolean();
+            reroute_gw_.ipv6 = c.boolean();
+            reroute_gw_.flags = c.u32();
+            c.tag(BLOCK);
+            block_ipv4_ = c.boolean();
+            block_ipv6_ = c.boolean();
+            block_outside_dns_ = c.boolean();
+            c.tag(ROUTE_METRIC_DEFAULT);
+            route_metric_default_ = c.i32();
+            c.tag(ADD_ROUTES);
+            add_routes_ = List<RouteView>::read(c);
+            c.tag(EXCLUDE_ROUTES);
+            exclude_routes_ = List<RouteView>::read(c);
+            c.tag(DNS_OPTIONS);
+            dns_from_dhcp_options_ = c.boolean();
+            dns_search_domains_ = List<StringView>::read(c);
+            dns_servers_ = List<DnsServerView>::read(c);
+            c.tag(WINS_SERVERS);
+            wins_servers_ = List<StringView>::read(c);
+            c.tag(PROXY_BYPASS);
+            proxy_bypass_ = List<StringView>::read(c);
+            c.tag(PROXY_AUTO_CONFIG_URL);
+            proxy_auto_config_url_ = c.str();
+            c.tag(HTTP_PROXY);
+            http_proxy_.host = c.str();
+            http_proxy_.port = c.i32();
+            c.tag(HTTPS_PROXY);
+            https_proxy_.host = c.str();
+            https_proxy_.port = c.i32();
+            if (c.remaining())
+                throw tun_builder_capture_binary_error("trailing data");
+        }
+
+        // clang-format off
+        std::string_view session_name() const { return session_name_; }
+        int mtu() const { return mtu_; }
+        Layer layer() const { return layer_; }
+        std::string_view remote_address() const { return remote_address_; }
+        bool remote_address_ipv6() const { return remote_address_ipv6_; }
+        const List<RouteView> &tunnel_addresses() const { return tunnel_addresses_; }
+        int tunnel_address_index_ipv4() const { return tunnel_address_index_ipv4_; }
+        int tunnel_address_index_ipv6() const { return tunnel_address_index_ipv6_; }
+        const TunBuilderCapture::RerouteGW &reroute_gw() const { return reroute_gw_; }
+        bool block_ipv4() const { return block_ipv4_; }
+        bool block_ipv6() const { return block_ipv6_; }
+        bool block_outside_dns() const { return block_outside_dns_; }
+        int route_metric_default() const { return route_metric_default_; }
+        const List<RouteView> &add_routes() const { return add_routes_; }
+        const List<RouteView> &exclude_routes() const { return exclude_routes_; }
+        bool dns_from_dhcp_options() const { return dns_from_dhcp_options_; }
+        const List<StringView> &dns_search_domains() const { return dns_search_domains_; }
+        const List<DnsServerView> &dns_servers() const { return dns_servers_; }
+        const List<StringView> &wins_servers() const { return wins_servers_; }
+        const List<StringView> &proxy_bypass() const { return proxy_bypass_; }
+        std::string_view proxy_auto_config_url() const { return proxy_auto_config_url_; }
+        const ProxyView &http_proxy() const { return http_proxy_; }
+        const ProxyView &https_proxy() const { return https_proxy_; }
+        // clang-format on
+
+      private:
+        std::string_view session_name_;
+        int mtu_ = 0;
+        Layer layer_;
+        std::string_view remote_address_;
+        bool remote_address_ipv6_ = false;
+        List<RouteView> tunnel_addresses_;
+        int tunnel_address_index_ipv4_ = -1;
+        int tunnel_address_index_ipv6_ = -1;
+        TunBuilderCapture::RerouteGW reroute_gw_;
+        bool block_ipv4_ = false;
+        bool block_ipv6_ = false;
+        bool block_outside_dns_ = false;
+        int route_metric_default_ = -1;
+        List<RouteView> add_routes_;
+        List<RouteView> exclude_routes_;
+        bool dns_from_dhcp_options_ = false;
+        List<StringView> dns_search_domains_;
+        List<DnsServerView> dns_servers_;
+        List<StringView> wins_servers_;
+        List<StringView> proxy_bypass_;
+        std::string_view proxy_auto_config_url_;
+        ProxyView http_proxy_;
+        ProxyView https_proxy_;
+    };
+
+    /**
+     * @brief Serializes a capture, appending to buf.
+     * @param tbc The capture to serialize.
+     * @param buf Output buffer, grown as needed if allocated with BufAllocFlags::GROW.
+     */
+    static void serialize(const TunBuilderCapture &tbc, Buffer &buf)
+    {
+        put_u32(buf, magic);
+        put_u16(buf, version);
+        put_u16(buf, 0);
+        const size_t size_offset = buf.size();
+        put_u32(buf, 0); // body size, filled in below
+
+        put_tag(buf, SESSION_NAME);
+        put_str(buf, tbc.session_name);
+        put_tag(buf, MTU);
+        put_i32(buf, tbc.mtu);
+        put_tag(buf, LAYER);
+        put_i32(buf, tbc.layer.value());
+        put_tag(buf, REMOTE_ADDRESS);
+        put_str(buf, tbc.remote_address.address);
+        put_bool(buf, tbc.remote_address.ipv6);
+        put_tag(buf, TUNNEL_ADDRESSES);
+        put_routes(buf, tbc.tunnel_addresses);
+        put_tag(buf, TUNNEL_ADDRESS_INDEX);
+        put_i32(buf, tbc.tunnel_address_index_ipv4);
+        put_i32(buf, tbc.tunnel_address_index_ipv6);
+        put_tag(buf, REROUTE_GW);
+        put_bool(buf, tbc.reroute_gw.ipv4);
+        put_bool(buf, tbc.reroute_gw.ipv6);
+        put_u32(buf, tbc.reroute_gw.flags);
+        put_tag(buf, BLOCK);
+        put_bool(buf, tbc.block_ipv4);
+        put_bool(buf, tbc.block_ipv6);
+        put_bool(buf, tbc.block_outside_dns);
+        put_tag(buf, ROUTE_METRIC_DEFAULT);
+        put_i32(buf, tbc.route_metric_default);
+        put_tag(buf, ADD_ROUTES);
+        put_routes(buf, tbc.add_routes);
+        put_tag(buf, EXCLUDE_ROUTES);
+        put_routes(buf, tbc.exclude_routes);
+
+        put_tag(buf, DNS_OPTIONS);
+        put_bool(buf, tbc.dns_options.from_dhcp_options);
+        put_count(buf, tbc.dns_options.search_domains.size());
+        for (const auto &d : tbc.dns_options.search_domains)
+            put_str(buf, d.domain);
+        put_count(buf, tbc.dns_options.servers.size());
+        for (const auto &[prio, server] : tbc.dns_options.servers)
+        {
+            put_i32(buf, prio);
+            put_count(buf, server.addresses.size());
+            for (const auto &a : server.addresses)
+            {
+                put_str(buf, a.address);
+                put_u32(buf, a.port);
+            }
+            put_count(buf, server.domains.size());
+            for (const auto &d : server.domains)
+                put_str(buf, d.domain);
+            buf.push_back(std::uint8_t(server.dnssec));
+            buf.push_back(std::uint8_t(server.transport));
+            put_str(buf, server.sni);
+        }
+
+        put_tag(buf, WINS_SERVERS);
+        put_count(buf, tbc.wins_servers.size());
+        for (const auto &w : tbc.wins_servers)
+            put_str(buf, w.address);
+        put_tag(buf, PROXY_BYPASS);
+        put_count(buf, tbc.proxy_bypass.size());
+        for (const auto &b : tbc.proxy_bypass)
+            put_str(buf, b.bypass_host);
+        put_tag(buf, PROXY_AUTO_CONFIG_URL);
+        put_str(buf, tbc.proxy_auto_config_url.url);
+        put_tag(buf, HTTP_PROXY);
+        put_str(buf, tbc.http_proxy.host);
+        put_i32(buf, tbc.http_proxy.port);
+        put_tag(buf, HTTPS_PROXY);
+        put_str(buf, tbc.https_proxy.host);
+        put_i32(buf, tbc.https_proxy.port);
+
+        const size_t body = buf.size() - size_offset - 4;
+        if (body > std::numeric_limits<std::uint32_t>::max())
+            throw tun_builder_capture_binary_error("capture too large");
+        store_u32(buf.data() + size_offset, static_cast<std::uint32_t>(body));
+    }
+
+    static BufferPtr serialize(const TunBuilderCapture &tbc)
+    {
+        // enough for typical routes, the buffer grows if not
+        const size_t hint = 256 + 32 * (tbc.tunnel_addresses.size() + tbc.add_routes.size() + tbc.exclude_routes.size());
+        auto buf = BufferAllocatedRc::Create(hint, BufAllocFlags::GROW);
+        serialize(tbc, *buf);
+        return buf;
+    }
+
+    /**
+     * @brief Rebuilds a capture from its serialized form.
+     * @throws tun_builder_capture_binary_error if the data does not
+     *         conform to the schema.
+     */
+    static TunBuilderCapture::Ptr deserialize(const unsigned char *data, const size_t size)
+    {
+        const Reader r(data, size);
+        TunBuilderCapture::Ptr tbc(new TunBuilderCapture);
+        tbc->session_name = r.session_name();
+        tbc->mtu = r.mtu();
+        tbc->layer = r.layer();
+        tbc->remote_address.address = r.remote_address();
+        tbc->remote_address.ipv6 = r.remote_address_ipv6();
+        get_routes(tbc->tunnel_addresses, r.tunnel_addresses());
+        tbc->tunnel_address_index_ipv4 = r.tunnel_address_index_ipv4();
+        tbc->tunnel_address_index_ipv6 = r.tunnel_address_index_ipv6();
+        tbc->reroute_gw = r.reroute_gw();
+        tbc->block_ipv4 = r.block_ipv4();
+        tbc->block_ipv6 = r.block_ipv6();
+        tbc->block_outside_dns = r.block_outside_dns();
+        tbc->route_metric_default = r.route_metric_default();
+        get_routes(tbc->add_routes, r.add_routes());
+        get_routes(tbc->exclude_routes, r.exclude_routes());
+
+        DnsOptions &dns = tbc->dns_options;
+        dns.from_dhcp_options = r.dns_from_dhcp_options();
+        dns.search_domains.reserve(r.dns_search_domains().size());
+        for (const auto &d : r.dns_search_domains())
+            dns.search_domains.push_back(DnsDomain{std::string(d)});
+        for (const auto &s : r.dns_servers())
+        {
+            DnsServer &server = dns.servers[s.priority];
+            server.addresses.reserve(s.addresses.size());
+            for (const auto &a : s.addresses)
+                server.addresses.push_back(DnsAddress{std::string(a.address), a.port});
+            server.domains.reserve(s.domains.size());
+            for (const auto &d : s.domains)
+                server.domains.push_back(DnsDomain{std::string(d)});
+            server.dnssec = s.dnssec;
+            server.transport = s.transport;
+            server.sni = s.sni;
+        }
+
+        tbc->wins_servers.reserve(r.wins_servers().size());
+        for (const auto &w : r.wins_servers())
+            tbc->wins_servers.emplace_back().address = w;
+        tbc->proxy_bypass.reserve(r.proxy_bypass().size());
+        for (const auto &b : r.proxy_bypass())
+            tbc->proxy_bypass.emplace_back().bypass_host = b;
+        tbc->proxy_auto_config_url.url = r.proxy_auto_config_url();
+        tbc->http_proxy.host = r.http_proxy().host;
+        tbc->http_proxy.port = r.http_proxy().port;
+        tbc->https_proxy.host = r.https_proxy().host;
+        tbc->https_proxy.port = r.https_proxy().port;
+        return tbc;
+    }
+
+    static TunBuilderCapture::Ptr deserialize(const Buffer &buf)
+    {
+        return deserialize(buf.c_data(), buf.size());
+    }
+
+  private:
+    static void store_u32(unsigned char *p, const std::uint32_t v)
+    {
+        p[0] = static_cast<unsigned char>(v);
+        p[1] = static_cast<unsigned char>(v >> 8);
+        p[2] = static_cast<unsigned char>(v >> 16);
+        p[3] = static_cast<unsigned char>(v >> 24);
+    }
+
+    static void put_u32(Buffer &buf, const std::uint32_t v)
+    {
+        unsigned char b[4];
+        store_u32(b, v);
+        buf.write(b, sizeof(b));
+    }
+
+    static void put_u16(Buffer &buf, const std::uint16_t v)
+    {
+        const unsigned char b[2] = {static_cast<unsigned char>(v), static_cast<unsigned char>(v >> 8)};
+        buf.write(b, sizeof(b));
+    }
+
+    static void put_i32(Buffer &buf, const int v)
+    {
+        put_u32(buf, static_cast<std::uint32_t>(v));
+    }
+
+    static void put_bool(Buffer &buf, const bool v)
+    {
+        buf.push_back(v ? 1 : 0);
+    }
+
+    static void put_tag(Buffer &buf, const Tag t)
+    {
+        buf.push_back(t);
+    }
+
+    static void put_count(Buffer &buf, const size_t n)
+    {
+        if (n > std::numeric_limits<std::uint32_t>::max())
+            throw tun_builder_capture_binary_error("list too long");
+        put_u32(buf, static_cast<std::uint32_t>(n));
+    }
+
+    static void put_str(Buffer &buf, const std::string &s)
+    {
+        put_count(buf, s.size());
+        buf.write(s.data(), s.size());
+    }
+
+    template <typename ROUTE>
+    static void put_routes(Buffer &buf, const std::vector<ROUTE> &routes)
+    {
+        put_count(buf, routes.size());
+        for (const auto &r : routes)
+        {
+            put_str(buf, r.address);
+            buf.push_back(r.prefix_length);
+            put_i32(buf, r.metric);
+            put_str(buf, r.gateway);
+            buf.push_back(std::uint8_t((r.ipv6 ? ROUTE_IPV6 : 0) | (r.net30 ? ROUTE_NET30 : 0)));
+        }
+    }
+
+    template <typename ROUTE>
+    static void get_routes(std::vector<ROUTE> &routes, const List<RouteView> &list)
+    {
+        routes.reserve(list.size());
+        for (const RouteView &v : list)
+        {
+            ROUTE &r = routes.emplace_back();
+            r.address = v.address;
+            r.prefix_length = v.prefix_length;
+            r.metric = v.metric;
+            r.gateway = v.gateway;
+            r.ipv6 = v.ipv6;
+            r.net30 = v.net30;
+        }
+    }
+};
+
+} // namespace openvpn
@@ -0,0 +1,188 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Difference between two captured tun configurations, used to apply a
+// PUSH_UPDATE to a running tun interface without tearing it down.
+// Routes are compared by value, so the diff holds only the routes that
+// have to be added or removed.  A change to anything the interface is
+// built from (addresses, MTU, redirect-gateway, ...) can't be applied
+// incrementally and sets reconfigure instead.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <unordered_set>
+
+#include <openvpn/tun/builder/capture.hpp>
+
+namespace openvpn {
+
+struct TunBuilderCaptureDiff
+{
+    typedef std::vector<TunBuilderCapture::Route> RouteList;
+
+    TunBuilderCaptureDiff() = default;
+
+    TunBuilderCaptureDiff(const TunBuilderCapture &from, const TunBuilderCapture &to)
+    {
+        compute(from, to);
+    }
+
+    void compute(const TunBuilderCapture &from, const TunBuilderCapture &to)
+    {
+        *this = TunBuilderCaptureDiff();
+        reconfigure_reason = settings_changed(from, to);
+        reconfigure = !reconfigure_reason.empty();
+        diff_routes(from.add_routes, to.add_routes, add_routes, remove_routes);
+        diff_routes(from.exclude_routes, to.exclude_routes, add_exclude_routes, remove_exclude_routes);
+        dns_changed = !(from.dns_options == to.dns_options);
+    }
+
+    // true if the configurations are the same
+    bool empty() const
+    {
+        return !reconfigure && !dns_changed && !n_route_ops();
+    }
+
+    size_t n_route_ops() const
+    {
+        return add_routes.size() + remove_routes.size()
+               + add_exclude_routes.size() + remove_exclude_routes.size();
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        if (reconfigure)
+            os << "reconfigure (" << reconfigure_reason << ')';
+        else
+            os << "routes +" << add_routes.size() << " -" << remove_routes.size()
+               << " exclude +" << add_exclude_routes.size() << " -" << remove_exclude_routes.size()
+               << (dns_changed ? " dns" : "");
+        return os.str();
+    }
+
+    RouteList add_routes;
+    RouteList remove_routes;
+    RouteList add_exclude_routes;
+    RouteList remove_exclude_routes;
+    bool dns_changed = false;
+
+    // the interface itself changed, the diff can't be applied in place
+    bool reconfigure = false;
+    std::string reconfigure_reason;
+
+  private:
+    // route identity, the fields rendered by RouteBase::to_string()
+    struct RouteHash
+    {
+        size_t operator()(const TunBuilderCapture::Route *r) const
+        {
+            size_t h = std::hash<std::string>()(r->address);
+            h = h * 31 + std::hash<std::string>()(r->gateway);
+            h = h * 31 + size_t(r->prefix_length);
+            h = h * 31 + size_t(r->metric);
+            return h * 4 + size_t(r->ipv6) * 2 + size_t(r->net30);
+        }
+    };
+
+    struct RouteEqual
+    {
+        bool operator()(const TunBuilderCapture::Route *a, const TunBuilderCapture::Route *b) const
+        {
+            return a->prefix_length == b->prefix_length
+                   && a->metric == b->metric
+                   && a->ipv6 == b->ipv6
+                   && a->net30 == b->net30
+                   && a->address == b->address
+                   && a->gateway == b->gateway;
+        }
+    };
+
+    typedef std::unordered_set<const TunBuilderCapture::Route *, RouteHash, RouteEqual> RouteSet;
+
+    // Routes of to that aren't in from are added, routes of from that
+    // aren't in to are removed.  Linear in the size of both tables and
+    // order preserving; a route listed twice is acted on once.
+    static void diff_routes(const RouteList &from,
+                            const RouteList &to,
+                            RouteList &add,
+                            RouteList &remove)
+    {
+        RouteSet from_set(from.size());
+        for (const auto &r : from)
+            from_set.insert(&r);
+
+        RouteSet to_set(to.size());
+        for (const auto &r : to)
+        {
+            if (to_set.insert(&r).second && !from_set.contains(&r))
+                add.push_back(r);
+        }
+
+        for (const auto &r : from)
+        {
+            // erase so that duplicates in from are removed once
+            if (!to_set.contains(&r) && from_set.erase(&r))
+                remove.push_back(r);
+        }
+    }
+
+    template <typename T>
+    static std::string list_key(const std::vector<T> &list)
+    {
+        std::string ret;
+        for (const auto &e : list)
+        {
+            ret += e.to_string();
+            ret += '\n';
+        }
+        return ret;
+    }
+
+    // name of the first interface setting that differs, or empty
+    static std::string settings_changed(const TunBuilderCapture &from, const TunBuilderCapture &to)
+    {
+        if (from.layer() != to.layer())
+            return "layer";
+        if (from.mtu != to.mtu)
+            return "mtu";
+        if (from.remote_address.to_string() != to.remote_address.to_string())
+            return "remote address";
+        if (from.tunnel_address_index_ipv4 != to.tunnel_address_index_ipv4
+            || from.tunnel_address_index_ipv6 != to.tunnel_address_index_ipv6
+            || list_key(from.tunnel_addresses) != list_key(to.tunnel_addresses))
+            return "tunnel addresses";
+        if (from.reroute_gw.to_string() != to.reroute_gw.to_string())
+            return "redirect-gateway";
+        if (from.block_ipv4 != to.block_ipv4
+            || from.block_ipv6 != to.block_ipv6
+            || from.block_outside_dns != to.block_outside_dns)
+            return "block";
+        if (from.route_metric_default != to.route_metric_default)
+            return "route metric";
+        if (list_key(from.proxy_bypass) != list_key(to.proxy_bypass)
+            || from.proxy_auto_config_url.to_string() != to.proxy_auto_config_url.to_string()
+            || from.http_proxy.to_string() != to.http_proxy.to_string()
+            || from.https_proxy.to_string() != to.https_proxy.to_string())
+            return "proxy";
+        if (list_key(from.wins_servers) != list_key(to.wins_servers))
+            return "wins";
+        if (from.session_name != to.session_name)
+            return "session name";
+        return std::string();
+    }
+};
+
+} // namespace openvpn
@@ -18,6 +18,7 @@
 #include <openvpn/common/destruct.hpp>
 #include <openvpn/common/stop.hpp>
 #include <openvpn/tun/builder/capture.hpp>
+#include <openvpn/tun/builder/capturediff.hpp>
 
 namespace openvpn::TunBuilderSetup {
 struct Config
@@ -34,6 +35,15 @@ struct Base : public DestructorBase
     typedef RCPtr<Base> Ptr;
 
     virtual int establish(const TunBuilderCapture &pull, Config *config, Stop *stop, std::ostream &os) = 0;
+
+    // Apply the route changes of a PUSH_UPDATE to the established
+    // interface.  pull is the new configuration and diff its difference
+    // to the current one.  Returns false if the setup object can't do
+    // that, the caller then has to establish again.
+    virtual bool update(const TunBuilderCapture &pull, const TunBuilderCaptureDiff &diff, std::ostream &os)
+    {
+        return false;
+    }
 };
 
 struct Factory : public RC<thread_unsafe_refcount>
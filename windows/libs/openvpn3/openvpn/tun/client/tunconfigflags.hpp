@@ -19,6 +19,7 @@ struct TunConfigFlags
         ADD_BYPASS_ROUTES = (1 << 0),
         DISABLE_IFACE_UP = (1 << 1),
         DISABLE_REROUTE_GW = (1 << 2),
+        ROUTES_ONLY = (1 << 3), // add/exclude routes only, leave the interface and redirect-gateway alone
     };
 };
 } // namespace openvpn
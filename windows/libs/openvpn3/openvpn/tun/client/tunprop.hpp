@@ -86,6 +86,7 @@ class TunProp
         IP::Addr vpn_ip6_gw;
         int mtu = 0;
         bool tun_prefix = false;
+        bool vnet_hdr = false;
         std::uint32_t vpn_interface_index = INVALID_ADAPTER_INDEX;
     };
 
@@ -43,10 +43,12 @@ class Tun : public TunIO<ReadHandler, PacketFrom, openvpn_io::posix::stream_desc
         const Frame::Ptr &frame_arg,
         const SessionStats::Ptr &stats_arg,
         const int socket,
-        const std::string &name)
+        const std::string &name,
+        const bool vnet_hdr)
         : Base(read_handler_arg, frame_arg, stats_arg)
     {
         Base::name_ = name;
+        Base::vnet_hdr = vnet_hdr;
         Base::retain_stream = true;
         Base::stream = new openvpn_io::posix::stream_descriptor(io_context, socket);
         OPENVPN_LOG_TUN(Base::name_ << " opened");
@@ -67,6 +69,8 @@ class ClientConfig : public TunClientFactory
 
     std::string dev_name;
     int txqueuelen = 200;
+    bool vnet_hdr = false; // TSO/USO offloads through IFF_VNET_HDR
+    bool io_uring = false; // with OPENVPN_IO_URING, falls back to the reactor if unavailable
 
     TunProp::Config tun_prop;
 
@@ -160,6 +164,7 @@ class Client : public TunClient
                     state = tun_persist->state();
                     sd = tun_persist->obj();
                     state = tun_persist->state();
+                    capture.reset();
                     OPENVPN_LOG("TunPersist: reused tun context");
                 }
                 else
@@ -192,6 +197,7 @@ class Client : public TunClient
                     tsconf.layer = config->tun_prop.layer;
                     tsconf.dev_name = config->dev_name;
                     tsconf.txqueuelen = config->txqueuelen;
+                    tsconf.vnet_hdr = config->vnet_hdr;
                     tsconf.add_bypass_routes_on_establish = true;
 
                     // open/config tun
@@ -210,8 +216,12 @@ class Client : public TunClient
                     }
 #endif
 
+                    // remembered for incremental push updates
+                    capture = po;
+
                     // persist tun settings state
                     state->iface_name = tsconf.iface_name;
+                    state->vnet_hdr = tsconf.vnet_hdr;
                     tun_persist->persist_tun_state(sd, state);
 
                     // enable tun_setup destructor
@@ -224,7 +234,12 @@ class Client : public TunClient
                                        config->frame,
                                        config->stats,
                                        sd,
-                                       state->iface_name));
+                                       state->iface_name,
+                                       state->vnet_hdr));
+#ifdef OPENVPN_IO_URING
+                if (config->io_uring)
+                    impl->use_io_uring();
+#endif
                 impl->start(config->n_parallel);
 
                 // signal that we are connected
@@ -306,6 +321,9 @@ class Client : public TunClient
 
     void apply_push_update(const OptionList &opt, TransportClient &transcli) override
     {
+        if (update_routes(opt, transcli))
+            return;
+
         stop_();
         if (impl)
         {
@@ -333,10 +351,55 @@ class Client : public TunClient
     {
     }
 
+    // Apply a push update that changes only routes or DNS settings to
+    // the running interface.  The tun device stays open, so flows over
+    // unchanged routes aren't interrupted.  Returns false if the update
+    // needs the interface to be set up again.
+    bool update_routes(const OptionList &opt, TransportClient &transcli)
+    {
+        if (halt || !impl || !capture || !tun_setup)
+            return false;
+
+        try
+        {
+            TunProp::State::Ptr new_state(new TunProp::State());
+            TunBuilderCapture::Ptr po(new TunBuilderCapture());
+            TunProp::configure_builder(po.get(),
+                                       new_state.get(),
+                                       config->stats.get(),
+                                       transcli.server_endpoint_addr(),
+                                       config->tun_prop,
+                                       opt,
+                                       nullptr,
+                                       false);
+
+            const TunBuilderCaptureDiff diff(*capture, *po);
+            if (diff.reconfigure)
+            {
+                OPENVPN_LOG("PUSH_UPDATE: " << diff.to_string() << ", restarting tun");
+                return false;
+            }
+
+            std::ostringstream os;
+            auto os_print = Cleanup([&os]()
+                                    { OPENVPN_LOG_STRING(os.str()); });
+            if (!tun_setup->update(*po, diff, os))
+                return false;
+            os << "PUSH_UPDATE: " << diff.to_string() << std::endl;
+            capture = po;
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG("PUSH_UPDATE: incremental update failed, restarting tun: " << e.what());
+            return false;
+        }
+    }
+
     bool send(Buffer &buf)
     {
         if (impl)
-            return impl->write(buf);
+            return state->vnet_hdr ? impl->write_vnet(buf) : impl->write(buf);
         else
             return false;
     }
@@ -372,6 +435,7 @@ class Client : public TunClient
     TunImpl::Ptr impl;
     TunProp::State::Ptr state;
     TunBuilderSetup::Base::Ptr tun_setup;
+    TunBuilderCapture::Ptr capture; // configuration in effect
     bool halt;
 };
 
@@ -699,9 +699,12 @@ struct TunMethods
         const TunBuilderCapture::RouteAddress *local6 = pull.vpn_ipv6();
 
         // configure interface
-        if (!(flags & TunConfigFlags::DISABLE_IFACE_UP))
-            iface_up(iface_name, pull.mtu, create, destroy);
-        iface_config(iface_name, -1, pull, rtvec, create, destroy);
+        if (!(flags & TunConfigFlags::ROUTES_ONLY))
+        {
+            if (!(flags & TunConfigFlags::DISABLE_IFACE_UP))
+                iface_up(iface_name, pull.mtu, create, destroy);
+            iface_config(iface_name, -1, pull, rtvec, create, destroy);
+        }
 
         // Process Routes
         {
@@ -768,7 +771,7 @@ struct TunMethods
         }
 
         // Process IPv4 redirect-gateway
-        if (!(flags & TunConfigFlags::DISABLE_REROUTE_GW))
+        if (!(flags & (TunConfigFlags::DISABLE_REROUTE_GW | TunConfigFlags::ROUTES_ONLY)))
         {
             if (pull.reroute_gw.ipv4 && local4)
             {
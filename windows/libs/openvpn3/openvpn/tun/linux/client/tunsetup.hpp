@@ -20,6 +20,9 @@
 #include <net/if.h>
 #include <linux/if_tun.h>
 
+#include <algorithm>
+#include <unordered_set>
+
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/file.hpp>
 #include <openvpn/common/split.hpp>
@@ -31,6 +34,7 @@
 #include <openvpn/addr/route.hpp>
 #include <openvpn/asio/asioerr.hpp>
 #include <openvpn/tun/builder/capture.hpp>
+#include <openvpn/tun/builder/capturediff.hpp>
 #include <openvpn/tun/builder/setup.hpp>
 #include <openvpn/tun/client/tunbase.hpp>
 #include <openvpn/tun/client/tunprop.hpp>
@@ -71,6 +75,7 @@ class Setup : public TunBuilderSetup::Base
         int txqueuelen = 0;
         bool add_bypass_routes_on_establish = false; // required when not using tunbuilder
         bool dco = false;
+        bool vnet_hdr = false; // in: request IFF_VNET_HDR offloads, out: enabled
 
 #ifdef HAVE_JSON
         virtual Json::Value to_json() override
@@ -81,6 +86,7 @@ class Setup : public TunBuilderSetup::Base
             root["dev_name"] = Json::Value(dev_name);
             root["txqueuelen"] = Json::Value(txqueuelen);
             root["dco"] = Json::Value(dco);
+            root["vnet_hdr"] = Json::Value(vnet_hdr);
             return root;
         };
 
@@ -92,6 +98,7 @@ class Setup : public TunBuilderSetup::Base
             json::to_string(root, dev_name, "dev_name", title);
             json::to_int(root, txqueuelen, "txqueuelen", title);
             json::to_bool(root, dco, "dco", title);
+            json::to_bool(root, vnet_hdr, "vnet_hdr", title);
         }
 #endif
     };
@@ -144,6 +151,7 @@ class Setup : public TunBuilderSetup::Base
         {
             // in DCO case device is already opened
             tun_iface_name = conf->iface_name;
+            conf->vnet_hdr = false;
         }
 
         ActionList::Ptr add_cmds = new ActionList();
@@ -169,7 +177,69 @@ class Setup : public TunBuilderSetup::Base
         return fd;
     }
 
+    bool update(const TunBuilderCapture &pull, // defined by TunBuilderSetup::Base
+                const TunBuilderCaptureDiff &diff,
+                std::ostream &os) override
+    {
+        if (diff.reconfigure || tun_iface_name.empty())
+            return false;
+
+        // commands for the new routes, their destroy commands are kept
+        // for teardown
+        ActionList::Ptr add_cmds = new ActionList();
+        ActionList::Ptr remove_cmds_new = new ActionList();
+        {
+            TunBuilderCapture routes;
+            routes_config(routes, pull, diff.add_routes, diff.add_exclude_routes);
+            TUNMETHODS::tun_config(tun_iface_name, routes, nullptr, *add_cmds, *remove_cmds_new, TunConfigFlags::ROUTES_ONLY);
+        }
+
+        // commands for the withdrawn routes, only the destroy part is used
+        ActionList::Ptr del_cmds = new ActionListReversed();
+        {
+            ActionList unused;
+            TunBuilderCapture routes;
+            routes_config(routes, pull, diff.remove_routes, diff.remove_exclude_routes);
+            TUNMETHODS::tun_config(tun_iface_name, routes, nullptr, unused, *del_cmds, TunConfigFlags::ROUTES_ONLY);
+        }
+
+        // make before break, traffic that moves from a withdrawn route
+        // to a new covering route is never without a route
+        add_cmds->execute(os);
+        del_cmds->execute(os);
+
+        // the withdrawn routes are gone, drop their destroy commands
+        if (!del_cmds->empty())
+        {
+            std::unordered_set<std::string> done;
+            for (const auto &a : *del_cmds)
+                done.insert(a->to_string());
+            remove_cmds->erase(std::remove_if(remove_cmds->begin(),
+                                              remove_cmds->end(),
+                                              [&done](const Action::Ptr &a)
+                                              { return done.contains(a->to_string()); }),
+                               remove_cmds->end());
+        }
+        remove_cmds->add(*remove_cmds_new);
+        return true;
+    }
+
   private:
+    // a configuration holding just the given routes and the tunnel
+    // addresses that TUNMETHODS::tun_config takes the gateways from
+    static void routes_config(TunBuilderCapture &routes,
+                              const TunBuilderCapture &pull,
+                              const TunBuilderCaptureDiff::RouteList &add_routes,
+                              const TunBuilderCaptureDiff::RouteList &exclude_routes)
+    {
+        routes.tunnel_addresses = pull.tunnel_addresses;
+        routes.tunnel_address_index_ipv4 = pull.tunnel_address_index_ipv4;
+        routes.tunnel_address_index_ipv6 = pull.tunnel_address_index_ipv6;
+        routes.block_ipv6 = pull.block_ipv6;
+        routes.add_routes = add_routes;
+        routes.exclude_routes = exclude_routes;
+    }
+
     int open_tun(Config *conf)
     {
         static const char node[] = "/dev/net/tun";
@@ -188,8 +258,17 @@ class Setup : public TunBuilderSetup::Base
         else
             throw tun_layer_error("unknown OSI layer");
 
+        // the virtio-net header code handles IP packets only
+        if (conf->layer() != Layer::OSI_LAYER_3)
+            conf->vnet_hdr = false;
+        if (conf->vnet_hdr)
+            ifr.ifr_flags |= IFF_VNET_HDR;
+
         open_unit(conf->dev_name, ifr, fd);
 
+        if (conf->vnet_hdr)
+            set_offload(fd());
+
         if (fcntl(fd(), F_SETFL, O_NONBLOCK) < 0)
             throw tun_fcntl_error(errinfo(errno));
 
@@ -216,6 +295,21 @@ class Setup : public TunBuilderSetup::Base
         return fd.release();
     }
 
+    // Let the kernel hand us TCP/UDP super-packets and partial checksums.
+    // Without offloads the header is still present, just always empty.
+    static void set_offload(const int fd)
+    {
+        const unsigned int tso = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6;
+#if defined(TUN_F_USO4) && defined(TUN_F_USO6)
+        // USO needs Linux 6.2
+        if (ioctl(fd, TUNSETOFFLOAD, tso | TUN_F_USO4 | TUN_F_USO6) == 0)
+            return;
+#endif
+        if (ioctl(fd, TUNSETOFFLOAD, tso) == 0)
+            return;
+        ioctl(fd, TUNSETOFFLOAD, 0);
+    }
+
     void open_unit(const std::string &name, struct ifreq &ifr, ScopedFD &fd)
     {
         if (!name.empty())
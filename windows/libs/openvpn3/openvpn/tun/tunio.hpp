@@ -14,6 +14,7 @@
 #pragma once
 
 #include <utility>
+#include <memory>
 
 #include <openvpn/io/io.hpp>
 
@@ -25,6 +26,13 @@
 #include <openvpn/common/socktypes.hpp>
 #include <openvpn/log/sessionstats.hpp>
 #include <openvpn/tun/tunlog.hpp>
+#include <openvpn/tun/vnethdr.hpp>
+
+#ifdef OPENVPN_IO_URING
+#include <poll.h>
+#include <vector>
+#include <openvpn/linux/uring.hpp>
+#endif
 
 namespace openvpn {
 
@@ -93,6 +101,18 @@ class TunIO : public RC<thread_unsafe_refcount>
                     }
                 }
 
+#ifdef OPENVPN_IO_URING
+                if (uring_write(buf))
+                {
+                    if (stats)
+                    {
+                        stats->inc_stat(SessionStats::TUN_BYTES_OUT, buf.size());
+                        stats->inc_stat(SessionStats::TUN_PACKETS_OUT, 1);
+                    }
+                    return true;
+                }
+#endif
+
                 // write data to tun device
                 const size_t wrote = stream->write_some(buf.const_buffer());
                 if (stats)
@@ -156,10 +176,85 @@ class TunIO : public RC<thread_unsafe_refcount>
             return false;
     }
 
+    // Write with vnet_hdr framing.  TCP segments are held back and
+    // merged; the pending super-packet is written once the handlers
+    // already queued on the io_context have run.
+    bool write_vnet(const Buffer &buf)
+    {
+        if (halt)
+            return false;
+        if (!vnet_coalescer)
+            vnet_coalescer.reset(new VirtioNet::Coalescer());
+        bool ret = true;
+        vnet_coalescer->add(buf, [this, &ret](const Buffer &b, const size_t n_packets)
+                            { ret = write_vnet_packet(b, n_packets) && ret; });
+        if (vnet_coalescer->pending() && !vnet_flush_queued)
+        {
+            vnet_flush_queued = true;
+            openvpn_io::post(stream->get_executor(), [self = Ptr(this)]()
+                             {
+                                 OPENVPN_ASYNC_HANDLER;
+                                 self->vnet_flush(); });
+        }
+        return ret;
+    }
+
+#ifdef OPENVPN_IO_URING
+    // Read and write the tun device through io_uring, writes going
+    // through n_send registered slots.  Call before start().  Returns
+    // false, leaving the device on the reactor, if io_uring is not
+    // available.
+    bool use_io_uring(const unsigned int n_send = 128)
+    {
+        try
+        {
+            uring.reset(new IOUring(stream->get_executor(), 256));
+            // leave room for a packet prefix or virtio-net header
+            uring_send.reset(new IOUring::SendBuffers(*uring, n_send, frame_context.payload() + 16));
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG_TUN_ERROR("TUN: io_uring not used: " << e.what());
+            uring_send.reset();
+            uring.reset();
+            return false;
+        }
+    }
+
+    // called by IOUring
+    void uring_event(const bool wait)
+    {
+        if (halt)
+            return;
+        const bool more = uring->process([this](const io_uring_cqe &cqe)
+                                         {
+                                             uring_complete(cqe);
+                                             return !halt; });
+        if (halt)
+            return;
+        if (more)
+            uring->post_event(Ptr(this));
+        if (wait)
+            uring->async_wait(Ptr(this));
+    }
+#endif
+
     void start(const int n_parallel)
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            if (uring)
+            {
+                uring_reads.resize(static_cast<size_t>(n_parallel));
+                for (int i = 0; i < n_parallel; i++)
+                    uring_queue_read(static_cast<unsigned int>(i), false);
+                uring->submit();
+                uring->async_wait(Ptr(this));
+                return;
+            }
+#endif
             for (int i = 0; i < n_parallel; i++)
                 queue_read(nullptr);
         }
@@ -171,6 +266,10 @@ class TunIO : public RC<thread_unsafe_refcount>
         if (!halt)
         {
             halt = true;
+#ifdef OPENVPN_IO_URING
+            if (uring)
+                uring->cancel_all();
+#endif
             if (stream)
             {
                 stream->cancel();
@@ -197,16 +296,182 @@ class TunIO : public RC<thread_unsafe_refcount>
         buf.prepend((unsigned char *)&net_value, sizeof(net_value));
     }
 
+    void vnet_flush()
+    {
+        vnet_flush_queued = false;
+        if (!halt && vnet_coalescer)
+            vnet_coalescer->flush([this](const Buffer &b, const size_t n_packets)
+                                  { write_vnet_packet(b, n_packets); });
+    }
+
+    bool write_vnet_packet(const Buffer &buf, const size_t n_packets)
+    {
+        try
+        {
+#ifdef OPENVPN_IO_URING
+            if (uring_write(buf))
+            {
+                if (stats)
+                {
+                    stats->inc_stat(SessionStats::TUN_BYTES_OUT, buf.size() - sizeof(VirtioNet::Header));
+                    stats->inc_stat(SessionStats::TUN_PACKETS_OUT, n_packets);
+                }
+                return true;
+            }
+#endif
+            const size_t wrote = stream->write_some(buf.const_buffer());
+            if (stats)
+            {
+                stats->inc_stat(SessionStats::TUN_BYTES_OUT, wrote - sizeof(VirtioNet::Header));
+                stats->inc_stat(SessionStats::TUN_PACKETS_OUT, n_packets);
+            }
+            if (wrote == buf.size())
+                return true;
+            else
+            {
+                OPENVPN_LOG_TUN_ERROR("TUN partial write error");
+                tun_error(Error::TUN_WRITE_ERROR, nullptr);
+                return false;
+            }
+        }
+        catch (openvpn_io::system_error &e)
+        {
+            OPENVPN_LOG_TUN_ERROR("TUN write exception: " << e.what());
+            const openvpn_io::error_code code(e.code());
+            tun_error(Error::TUN_WRITE_ERROR, &code);
+            return false;
+        }
+    }
+
+    // split a read into packets and pass them on one by one
+    void vnet_read(Buffer &buf)
+    {
+        const bool ok = VirtioNet::segment(buf, vnet_scratch, frame_context, [this](BufferAllocated &seg)
+                                           {
+            if (halt)
+                return;
+            if (stats)
+            {
+                stats->inc_stat(SessionStats::TUN_BYTES_IN, seg.size());
+                stats->inc_stat(SessionStats::TUN_PACKETS_IN, 1);
+            }
+            // the handler may keep the packet, so hand over a PacketFrom
+            // it can take, and reuse whatever buffer is left behind
+            if (!vnet_packet)
+                vnet_packet.reset(new PacketFrom());
+            vnet_packet->buf.swap(seg);
+            read_handler->tun_read_handler(vnet_packet); });
+        if (!ok)
+        {
+            OPENVPN_LOG_TUN_ERROR("TUN Read Error: bad virtio-net packet");
+            tun_error(Error::TUN_FRAMING_ERROR, nullptr);
+        }
+    }
+
+#ifdef OPENVPN_IO_URING
+    enum
+    {
+        URING_READ = 1,
+        URING_POLL,
+        URING_WRITE,
+    };
+
+    // Queue a read into the buffer of uring_reads[i].  After a read
+    // came back with EAGAIN (the tun fd is non-blocking), the read is
+    // linked to a poll for input instead.
+    void uring_queue_read(const unsigned int i, const bool poll_first)
+    {
+        typename PacketFrom::SPtr &pfp = uring_reads[i];
+        if (!pfp)
+            pfp.reset(new PacketFrom());
+        const openvpn_io::mutable_buffer mb = prepare_read(pfp->buf);
+        if (poll_first)
+        {
+            io_uring_sqe *sqe = uring->get_sqe();
+            if (!sqe)
+                return;
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = stream->native_handle();
+            sqe->poll32_events = POLLIN;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = IOUring::user_data(URING_POLL, i);
+        }
+        io_uring_sqe *sqe = uring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = stream->native_handle();
+        sqe->addr = reinterpret_cast<std::uint64_t>(mb.data());
+        sqe->len = static_cast<std::uint32_t>(mb.size());
+        sqe->off = std::uint64_t(-1);
+        sqe->user_data = IOUring::user_data(URING_READ, i);
+    }
+
+    void uring_complete(const io_uring_cqe &cqe)
+    {
+        const unsigned int i = IOUring::index(cqe);
+        switch (IOUring::tag(cqe))
+        {
+        case URING_READ:
+            if (cqe.res > 0)
+                read_packet(uring_reads[i], cqe.res);
+            else if (cqe.res == -ECANCELED)
+                return;
+            else if (cqe.res < 0 && cqe.res != -EAGAIN)
+            {
+                const openvpn_io::error_code error(-cqe.res, openvpn_io::error::get_system_category());
+                OPENVPN_LOG_TUN_ERROR("TUN Read Error: " << error.message());
+                tun_error(Error::TUN_READ_ERROR, &error);
+            }
+            if (!halt)
+                uring_queue_read(i, cqe.res <= 0);
+            break;
+        case URING_WRITE:
+            uring_send->release(i);
+            if (cqe.res < 0)
+            {
+                const openvpn_io::error_code error(-cqe.res, openvpn_io::error::get_system_category());
+                OPENVPN_LOG_TUN_ERROR("TUN write error: " << error.message());
+                tun_error(Error::TUN_WRITE_ERROR, &error);
+            }
+            break;
+        }
+    }
+
+    bool uring_write(const Buffer &buf)
+    {
+        if (!uring || !uring_send->write(stream->native_handle(), buf, URING_WRITE))
+        {
+            // out of slots, write synchronously
+            if (uring)
+                uring->submit();
+            return false;
+        }
+        uring->post_event(Ptr(this));
+        return true;
+    }
+#endif
+
   protected:
+    openvpn_io::mutable_buffer prepare_read(BufferAllocated &buf)
+    {
+        if (vnet_hdr)
+        {
+            buf.reset(0, VirtioNet::MAX_READ, BufAllocFlags::NO_FLAGS);
+            return openvpn_io::mutable_buffer(buf.data(), VirtioNet::MAX_READ);
+        }
+        frame_context.prepare(buf);
+        return frame_context.mutable_buffer(buf);
+    }
+
     void queue_read(PacketFrom *tunfrom)
     {
         OPENVPN_LOG_TUN_VERBOSE("TunIO::queue_read");
         if (!tunfrom)
             tunfrom = new PacketFrom();
-        frame_context.prepare(tunfrom->buf);
 
         // queue read on tun device
-        stream->async_read_some(frame_context.mutable_buffer(tunfrom->buf),
+        stream->async_read_some(prepare_read(tunfrom->buf),
                                 [self = Ptr(this), tunfrom = typename PacketFrom::SPtr(tunfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
                                 {
                                     OPENVPN_ASYNC_HANDLER;
@@ -220,29 +485,7 @@ class TunIO : public RC<thread_unsafe_refcount>
         if (!halt)
         {
             if (!error)
-            {
-                pfp->buf.set_size(bytes_recvd);
-                if (stats)
-                {
-                    stats->inc_stat(SessionStats::TUN_BYTES_IN, bytes_recvd);
-                    stats->inc_stat(SessionStats::TUN_PACKETS_IN, 1);
-                }
-                if (!tun_prefix)
-                {
-                    read_handler->tun_read_handler(pfp);
-                }
-                else if (pfp->buf.size() >= 4)
-                {
-                    // handle tun packet prefix, if enabled
-                    pfp->buf.advance(4);
-                    read_handler->tun_read_handler(pfp);
-                }
-                else
-                {
-                    OPENVPN_LOG_TUN_ERROR("TUN Read Error: cannot read prefix");
-                    tun_error(Error::TUN_READ_ERROR, nullptr);
-                }
-            }
+                read_packet(pfp, bytes_recvd);
             else
             {
                 OPENVPN_LOG_TUN_ERROR("TUN Read Error: " << error.message());
@@ -253,6 +496,36 @@ class TunIO : public RC<thread_unsafe_refcount>
         }
     }
 
+    void read_packet(typename PacketFrom::SPtr &pfp, const size_t bytes_recvd)
+    {
+        pfp->buf.set_size(bytes_recvd);
+        if (vnet_hdr)
+        {
+            vnet_read(pfp->buf);
+            return;
+        }
+        if (stats)
+        {
+            stats->inc_stat(SessionStats::TUN_BYTES_IN, bytes_recvd);
+            stats->inc_stat(SessionStats::TUN_PACKETS_IN, 1);
+        }
+        if (!tun_prefix)
+        {
+            read_handler->tun_read_handler(pfp);
+        }
+        else if (pfp->buf.size() >= 4)
+        {
+            // handle tun packet prefix, if enabled
+            pfp->buf.advance(4);
+            read_handler->tun_read_handler(pfp);
+        }
+        else
+        {
+            OPENVPN_LOG_TUN_ERROR("TUN Read Error: cannot read prefix");
+            tun_error(Error::TUN_READ_ERROR, nullptr);
+        }
+    }
+
     void tun_error(const Error::Type errtype, const openvpn_io::error_code *error)
     {
         if (stats)
@@ -265,11 +538,24 @@ class TunIO : public RC<thread_unsafe_refcount>
     STREAM *stream = nullptr;
     bool retain_stream = false; // don't close tun stream
     bool tun_prefix = false;
+    bool vnet_hdr = false; // virtio-net header framing (Linux IFF_VNET_HDR)
 
     ReadHandler read_handler;
     const Frame::Context frame_context;
     SessionStats::Ptr stats;
 
     bool halt = false;
+
+    // vnet_hdr state
+    BufferAllocated vnet_scratch;
+    typename PacketFrom::SPtr vnet_packet;
+    std::unique_ptr<VirtioNet::Coalescer> vnet_coalescer;
+    bool vnet_flush_queued = false;
+
+#ifdef OPENVPN_IO_URING
+    std::unique_ptr<IOUring> uring;
+    std::unique_ptr<IOUring::SendBuffers> uring_send;
+    std::vector<typename PacketFrom::SPtr> uring_reads;
+#endif
 };
 } // namespace openvpn
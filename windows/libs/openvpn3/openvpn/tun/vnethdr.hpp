@@ -0,0 +1,474 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// virtio-net header framing, used by Linux tun devices opened with
+// IFF_VNET_HDR.  With TSO/USO enabled through TUNSETOFFLOAD, a read
+// returns a TCP or UDP super-packet of up to 64 KB, which segment()
+// splits into packets that fit the frame.  In the other direction,
+// Coalescer merges consecutive TCP segments of a flow into a
+// super-packet, so that a burst costs one write instead of one per
+// packet.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <openvpn/common/endian.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/frame/frame.hpp>
+#include <openvpn/ip/csum.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/ip/tcp.hpp>
+#include <openvpn/ip/udp.hpp>
+
+namespace openvpn::VirtioNet {
+
+#pragma pack(push)
+#pragma pack(1)
+
+// struct virtio_net_hdr, host byte order (tun's default
+// without TUNSETVNETLE/TUNSETVNETBE)
+struct Header
+{
+    enum
+    {
+        F_NEEDS_CSUM = 1, // complete the checksum at csum_start + csum_offset
+        F_DATA_VALID = 2,
+    };
+
+    enum
+    {
+        GSO_NONE = 0,
+        GSO_TCPV4 = 1,
+        GSO_UDP = 3, // IP fragmentation (UFO), never enabled by us
+        GSO_TCPV6 = 4,
+        GSO_UDP_L4 = 5,
+        GSO_ECN = 0x80,
+    };
+
+    std::uint8_t flags;
+    std::uint8_t gso_type;
+    std::uint16_t hdr_len; // length of the headers copied into every segment
+    std::uint16_t gso_size;
+    std::uint16_t csum_start;
+    std::uint16_t csum_offset;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == 10, "unexpected virtio_net_hdr size");
+
+// largest read from a tun device with TSO/USO enabled
+constexpr size_t MAX_READ = sizeof(Header) + sizeof(IPv6Header) + 65535;
+
+namespace detail {
+
+enum
+{
+    IP4_MF = 0x2000,
+    TCP_FIN = 0x01,
+    TCP_PSH = 0x08,
+    TCP_ACK = 0x10,
+    TCP_CWR = 0x80,
+    TCP_CHECK_OFFSET = 16,
+};
+
+// IPv4 without options or fragmentation, or IPv6 without extension
+// headers, carrying TCP or UDP
+struct L4Packet
+{
+    bool parse(std::uint8_t *data, const size_t size)
+    {
+        ip = data;
+        if (size < sizeof(IPv4Header))
+            return false;
+        ipv6 = IPCommon::version(data[0]) == IPCommon::IPv6;
+        if (ipv6)
+        {
+            if (size < sizeof(IPv6Header))
+                return false;
+            const IPv6Header *h = reinterpret_cast<const IPv6Header *>(data);
+            ip_len = sizeof(IPv6Header);
+            len = ip_len + ntohs(h->payload_len);
+            proto = h->nexthdr;
+        }
+        else
+        {
+            const IPv4Header *h = reinterpret_cast<const IPv4Header *>(data);
+            if (IPCommon::version(data[0]) != IPCommon::IPv4
+                || IPv4Header::length(h->version_len) != sizeof(IPv4Header)
+                || (ntohs(h->frag_off) & (IP4_MF | int(IPv4Header::OFFMASK))))
+                return false;
+            ip_len = sizeof(IPv4Header);
+            len = ntohs(h->tot_len);
+            proto = h->protocol;
+        }
+        if (len > size || len < ip_len)
+            return false;
+        if (proto == IPCommon::TCP)
+        {
+            if (len < ip_len + sizeof(TCPHeader))
+                return false;
+            l4_len = TCPHeader::length(tcp()->doff_res);
+            if (l4_len < sizeof(TCPHeader))
+                return false;
+        }
+        else if (proto == IPCommon::UDP)
+            l4_len = sizeof(UDPHeader);
+        else
+            return false;
+        return len >= hdr_len();
+    }
+
+    size_t hdr_len() const
+    {
+        return ip_len + l4_len;
+    }
+
+    size_t payload_len() const
+    {
+        return len - hdr_len();
+    }
+
+    IPv4Header *ip4() const
+    {
+        return reinterpret_cast<IPv4Header *>(ip);
+    }
+
+    IPv6Header *ip6() const
+    {
+        return reinterpret_cast<IPv6Header *>(ip);
+    }
+
+    TCPHeader *tcp() const
+    {
+        return reinterpret_cast<TCPHeader *>(ip + ip_len);
+    }
+
+    UDPHeader *udp() const
+    {
+        return reinterpret_cast<UDPHeader *>(ip + ip_len);
+    }
+
+    std::uint8_t *ip = nullptr;
+    size_t len = 0; // IP total length
+    size_t ip_len = 0;
+    size_t l4_len = 0;
+    std::uint8_t proto = 0;
+    bool ipv6 = false;
+};
+
+// unfolded sum of the TCP/UDP pseudo-header
+inline std::uint32_t pseudo_header_sum(const L4Packet &p, const size_t l4_size)
+{
+    std::uint32_t sum = p.ipv6
+                            ? IPChecksum::compute(&p.ip6()->saddr, 32)
+                            : IPChecksum::compute(&p.ip4()->saddr, 8);
+    sum += htons(p.proto);
+    sum += htons(static_cast<std::uint16_t>(l4_size));
+    return sum;
+}
+
+// set the IP length fields of a packet of size bytes
+inline void set_ip_len(const L4Packet &p, const size_t size)
+{
+    if (p.ipv6)
+        p.ip6()->payload_len = htons(static_cast<std::uint16_t>(size - p.ip_len));
+    else
+    {
+        IPv4Header *h = p.ip4();
+        h->tot_len = htons(static_cast<std::uint16_t>(size));
+        h->check = 0;
+        h->check = IPChecksum::checksum(h, sizeof(IPv4Header));
+    }
+}
+
+// full L4 checksum of a packet of size bytes
+inline void set_l4_check(const L4Packet &p, std::uint8_t *data, const size_t size)
+{
+    const size_t l4_size = size - p.ip_len;
+    std::uint16_t *check = p.proto == IPCommon::TCP ? &reinterpret_cast<TCPHeader *>(data + p.ip_len)->check
+                                                    : &reinterpret_cast<UDPHeader *>(data + p.ip_len)->check;
+    *check = 0;
+    std::uint16_t c = IPChecksum::cfold(IPChecksum::partial(data + p.ip_len, l4_size, pseudo_header_sum(p, l4_size)));
+    if (c == 0 && p.proto == IPCommon::UDP)
+        c = 0xffff;
+    *check = c;
+}
+
+} // namespace detail
+
+// Split a packet read from tun (virtio-net header first) into packets
+// that fit frame context fc.  Each one is prepared in out and passed to
+// emit(out).  Returns false, without emitting anything, if the packet
+// is malformed or a segment would not fit.
+template <typename EMIT>
+inline bool segment(const Buffer &in, BufferAllocated &out, const Frame::Context &fc, EMIT emit)
+{
+    using namespace detail;
+
+    if (in.size() < sizeof(Header))
+        return false;
+    Header h;
+    std::memcpy(&h, in.c_data(), sizeof(Header));
+    const std::uint8_t *data = in.c_data() + sizeof(Header);
+    const size_t size = in.size() - sizeof(Header);
+    const unsigned int gso_type = h.gso_type & ~Header::GSO_ECN;
+
+    if (gso_type == Header::GSO_NONE)
+    {
+        if (size > fc.payload())
+            return false;
+        fc.prepare(out);
+        out.write(data, size);
+        if (h.flags & Header::F_NEEDS_CSUM)
+        {
+            const size_t field = size_t(h.csum_start) + h.csum_offset;
+            if (field + 2 > size || h.csum_start > size)
+                return false;
+            std::uint8_t *d = out.data();
+            std::uint16_t pseudo;
+            std::memcpy(&pseudo, d + field, 2);
+            // the field holds the folded pseudo-header sum
+            const std::uint16_t zero = 0;
+            std::memcpy(d + field, &zero, 2);
+            const std::uint16_t check = IPChecksum::cfold(IPChecksum::partial(d + h.csum_start, size - h.csum_start, pseudo));
+            std::memcpy(d + field, &check, 2);
+        }
+        emit(out);
+        return true;
+    }
+
+    // GSO super-packet, headers are copied into every segment
+    std::uint8_t hdrs[sizeof(IPv6Header) + 60];
+    L4Packet p;
+    if (!p.parse(const_cast<std::uint8_t *>(data), size))
+        return false;
+    const size_t hdr_len = p.hdr_len();
+    if (hdr_len > sizeof(hdrs))
+        return false;
+    switch (gso_type)
+    {
+    case Header::GSO_TCPV4:
+        if (p.ipv6 || p.proto != IPCommon::TCP)
+            return false;
+        break;
+    case Header::GSO_TCPV6:
+        if (!p.ipv6 || p.proto != IPCommon::TCP)
+            return false;
+        break;
+    case Header::GSO_UDP_L4:
+        if (p.proto != IPCommon::UDP)
+            return false;
+        break;
+    default:
+        return false;
+    }
+    const size_t mss = h.gso_size;
+    const size_t payload = p.payload_len();
+    if (!mss || hdr_len + std::min(mss, payload) > fc.payload())
+        return false;
+    std::memcpy(hdrs, data, hdr_len);
+
+    const std::uint8_t *src = data + hdr_len;
+    const std::uint32_t seq = p.proto == IPCommon::TCP ? ntohl(p.tcp()->seq) : 0;
+    const std::uint16_t id = p.ipv6 ? 0 : ntohs(p.ip4()->id);
+    const std::uint8_t tcp_flags = p.proto == IPCommon::TCP ? p.tcp()->flags : 0;
+    size_t off = 0;
+    unsigned int i = 0;
+    do
+    {
+        const size_t n = std::min(mss, payload - off);
+        const bool last = off + n == payload;
+        fc.prepare(out);
+        out.write(hdrs, hdr_len);
+        out.write(src + off, n);
+
+        L4Packet s = p;
+        s.ip = out.data();
+        if (!p.ipv6)
+            s.ip4()->id = htons(static_cast<std::uint16_t>(id + i));
+        set_ip_len(s, hdr_len + n);
+        if (p.proto == IPCommon::TCP)
+        {
+            TCPHeader *t = s.tcp();
+            t->seq = htonl(seq + static_cast<std::uint32_t>(off));
+            std::uint8_t flags = tcp_flags;
+            if (!last)
+                flags &= ~(TCP_FIN | TCP_PSH);
+            if (i)
+                flags &= ~TCP_CWR;
+            t->flags = flags;
+        }
+        else
+            s.udp()->len = htons(static_cast<std::uint16_t>(sizeof(UDPHeader) + n));
+        set_l4_check(s, out.data(), hdr_len + n);
+
+        emit(out);
+        off += n;
+        ++i;
+    } while (off < payload);
+    return true;
+}
+
+// Merges consecutive in-order TCP segments of one flow (same headers
+// apart from sequence, lengths and checksums, ACK or ACK|PSH only) into
+// a GSO super-packet.  Anything else passes through unchanged.  The
+// packets handed to write() start with a virtio-net header.
+class Coalescer
+{
+  public:
+    Coalescer()
+        : pending_(MAX_READ, BufAllocFlags::NO_FLAGS)
+    {
+    }
+
+    // Add IP packet pkt.  write(const Buffer &, size_t n_packets) is
+    // called for whatever must go out first, and for pkt itself if it
+    // cannot be held back.
+    template <typename WRITE>
+    void add(const Buffer &pkt, WRITE write)
+    {
+        using namespace detail;
+
+        L4Packet p;
+        const bool tcp = p.parse(const_cast<std::uint8_t *>(pkt.c_data()), pkt.size())
+                         && p.proto == IPCommon::TCP
+                         && (p.tcp()->flags & ~TCP_PSH) == TCP_ACK
+                         && p.payload_len();
+        if (!tcp)
+        {
+            flush(write);
+            single(pkt, write);
+            return;
+        }
+        if (n_ && !closed_ && merges(p))
+        {
+            pending_.write(p.ip + p.hdr_len(), p.payload_len());
+            next_seq_ += static_cast<std::uint32_t>(p.payload_len());
+            psh_ = p.tcp()->flags & TCP_PSH;
+            closed_ = p.payload_len() < mss_ || psh_;
+            ++n_;
+            return;
+        }
+        flush(write);
+        start(p);
+    }
+
+    // write out the pending super-packet, if any
+    template <typename WRITE>
+    void flush(WRITE write)
+    {
+        using namespace detail;
+
+        if (!n_)
+            return;
+        L4Packet p = pkt_;
+        p.ip = pending_.data() + sizeof(Header);
+        const size_t size = pending_.size() - sizeof(Header);
+        Header h = {};
+        if (n_ > 1)
+        {
+            set_ip_len(p, size);
+            TCPHeader *t = p.tcp();
+            t->flags = static_cast<std::uint8_t>(psh_ ? (t->flags | TCP_PSH) : (t->flags & ~TCP_PSH));
+            t->check = IPChecksum::fold(pseudo_header_sum(p, size - p.ip_len));
+            h.flags = Header::F_NEEDS_CSUM;
+            h.gso_type = p.ipv6 ? Header::GSO_TCPV6 : Header::GSO_TCPV4;
+            h.hdr_len = static_cast<std::uint16_t>(p.hdr_len());
+            h.gso_size = static_cast<std::uint16_t>(mss_);
+            h.csum_start = static_cast<std::uint16_t>(p.ip_len);
+            h.csum_offset = TCP_CHECK_OFFSET;
+        }
+        std::memcpy(pending_.data(), &h, sizeof(h));
+        const size_t n = n_;
+        n_ = 0;
+        write(static_cast<const Buffer &>(pending_), n);
+    }
+
+    bool pending() const
+    {
+        return n_ != 0;
+    }
+
+  private:
+    template <typename WRITE>
+    void single(const Buffer &pkt, WRITE write)
+    {
+        pending_.reset_content();
+        const Header h = {};
+        pending_.write(&h, sizeof(h));
+        pending_.write(pkt.c_data(), pkt.size());
+        write(static_cast<const Buffer &>(pending_), 1);
+    }
+
+    void start(const detail::L4Packet &p)
+    {
+        pending_.reset_content();
+        const Header h = {};
+        pending_.write(&h, sizeof(h));
+        pending_.write(p.ip, p.len);
+        pkt_ = p;
+        mss_ = p.payload_len();
+        next_seq_ = ntohl(p.tcp()->seq) + static_cast<std::uint32_t>(mss_);
+        psh_ = p.tcp()->flags & detail::TCP_PSH;
+        closed_ = psh_;
+        n_ = 1;
+    }
+
+    bool merges(const detail::L4Packet &p) const
+    {
+        using namespace detail;
+
+        const std::uint8_t *ip = pending_.c_data() + sizeof(Header);
+        if (p.ipv6 != pkt_.ipv6 || p.hdr_len() != pkt_.hdr_len()
+            || p.payload_len() > mss_
+            || pending_.size() - sizeof(Header) + p.payload_len() > 65535 + (p.ipv6 ? sizeof(IPv6Header) : 0)
+            || ntohl(p.tcp()->seq) != next_seq_)
+            return false;
+        if (p.ipv6)
+        {
+            // version/class/flow label, next header and hop limit, addresses
+            if (std::memcmp(p.ip, ip, 4) != 0 || std::memcmp(p.ip + 6, ip + 6, 34) != 0)
+                return false;
+        }
+        else
+        {
+            const IPv4Header *a = p.ip4();
+            const IPv4Header *b = reinterpret_cast<const IPv4Header *>(ip);
+            if (a->tos != b->tos || a->frag_off != b->frag_off || a->ttl != b->ttl
+                || a->saddr != b->saddr || a->daddr != b->daddr)
+                return false;
+        }
+        // ports, ack, offset, flags apart from PSH, window, urgent
+        // pointer and options must match
+        const std::uint8_t *ta = p.ip + p.ip_len;
+        const std::uint8_t *tb = ip + p.ip_len;
+        return std::memcmp(ta, tb, 4) == 0
+               && std::memcmp(ta + 8, tb + 8, 5) == 0
+               && ((ta[13] ^ tb[13]) & ~TCP_PSH) == 0
+               && std::memcmp(ta + 14, tb + 14, 2) == 0
+               && std::memcmp(ta + 18, tb + 18, p.l4_len - 18) == 0;
+    }
+
+    BufferAllocated pending_; // virtio-net header, then the packet
+    detail::L4Packet pkt_;    // layout of the first segment
+    size_t mss_ = 0;
+    size_t n_ = 0; // segments in pending_
+    std::uint32_t next_seq_ = 0;
+    bool psh_ = false;
+    bool closed_ = false; // short or PSH segment seen
+};
+
+} // namespace openvpn::VirtioNet
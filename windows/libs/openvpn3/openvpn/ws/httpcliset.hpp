@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <deque>
 
 #include <openvpn/asio/asiostop.hpp>
 #include <openvpn/common/cleanup.hpp>
@@ -327,6 +328,199 @@ class ClientSet : public RC<thread_unsafe_refcount>
         }
     };
 
+    // Pool of keep-alive connections shared by transaction sets that
+    // talk to the same endpoint with the same Config, so that back-to-back
+    // requests skip the TCP and TLS handshakes.  A connection is checked out
+    // for the whole transaction set and returned when the set completes.
+    // New connections resume TLS sessions if Config::enable_cache is set.
+    // Requests are not pipelined: each connection has at most one request
+    // in flight.  Must be used from the thread that runs io_context.
+    class ConnectionPool : public RC<thread_unsafe_refcount>
+    {
+      public:
+        typedef RCPtr<ConnectionPool> Ptr;
+
+        struct Stats
+        {
+            unsigned int connects = 0; // new connections created
+            unsigned int reuses = 0;   // idle connections handed out
+            unsigned int waits = 0;    // requests queued on max_per_host
+        };
+
+        // connections per endpoint, busy and idle, 0 for no limit
+        unsigned int max_per_host = 0;
+
+        // idle connections kept per endpoint
+        unsigned int max_idle_per_host = 8;
+
+        ConnectionPool(openvpn_io::io_context &io_context_arg)
+            : io_context(io_context_arg)
+        {
+        }
+
+        ~ConnectionPool()
+        {
+            clear();
+        }
+
+        // close all idle connections
+        void clear()
+        {
+            for (auto i = map.begin(); i != map.end();)
+            {
+                for (auto &http : i->second.idle)
+                    http->stop(false);
+                i->second.idle.clear();
+                i = purge(i);
+            }
+        }
+
+        size_t n_idle() const
+        {
+            size_t ret = 0;
+            for (auto &e : map)
+                ret += e.second.idle.size();
+            return ret;
+        }
+
+        size_t n_busy() const
+        {
+            size_t ret = 0;
+            for (auto &e : map)
+                ret += e.second.busy;
+            return ret;
+        }
+
+        const Stats &stats() const
+        {
+            return stats_;
+        }
+
+      private:
+        friend Client;
+
+        typedef std::pair<const WS::Client::Config *, std::string> Key;
+
+        struct Entry
+        {
+            std::vector<HTTPDelegate::Ptr> idle;
+            std::deque<RCPtr<Client>> waiting;
+            unsigned int busy = 0;
+        };
+
+        static Key key(const TransactionSet &ts)
+        {
+            const WS::Client::Host &h = ts.host;
+            std::string k;
+            k.reserve(128);
+            for (const std::string *f : {&h.host, &h.hint, &h.cn, &h.key, &h.head, &h.port, &h.local_addr, &h.local_addr_alt, &h.local_port})
+            {
+                k += *f;
+                k += '\n';
+            }
+            return Key(ts.http_config.get(), std::move(k));
+        }
+
+        // Return a connection, either idle and alive or not yet started,
+        // or null if cli was queued to get one later through pool_ready().
+        // A client retrying after a stale connection always gets a new one.
+        HTTPDelegate::Ptr acquire(const Key &k, Client *cli)
+        {
+            Entry &e = map[k];
+            HTTPDelegate::Ptr http = take(e, *cli);
+            if (!http)
+            {
+                e.waiting.emplace_back(cli);
+                ++stats_.waits;
+            }
+            return http;
+        }
+
+        // give back a connection that has been detached from its client
+        void release(const Key &k, HTTPDelegate::Ptr http, const bool shutdown)
+        {
+            auto i = map.find(k);
+            if (i == map.end())
+                return;
+            Entry &e = i->second;
+            --e.busy;
+            if (http && http->is_alive() && e.idle.size() < max_idle_per_host)
+                e.idle.push_back(std::move(http));
+            else if (http)
+                http->stop(shutdown);
+            dispatch(e);
+            purge(i);
+        }
+
+        void cancel(const Key &k, const Client *cli)
+        {
+            auto i = map.find(k);
+            if (i == map.end())
+                return;
+            auto &w = i->second.waiting;
+            w.erase(std::remove_if(w.begin(), w.end(), [cli](const RCPtr<Client> &c)
+                                   { return c.get() == cli; }),
+                    w.end());
+            purge(i);
+        }
+
+        HTTPDelegate::Ptr take(Entry &e, const Client &cli)
+        {
+            // drop connections that were closed while idle
+            e.idle.erase(std::remove_if(e.idle.begin(), e.idle.end(), [](const HTTPDelegate::Ptr &http)
+                                        { return !http->is_alive(); }),
+                         e.idle.end());
+            HTTPDelegate::Ptr http;
+            if (!e.idle.empty() && !cli.retried)
+            {
+                // most recently used first, it is the least likely to have timed out
+                http = std::move(e.idle.back());
+                e.idle.pop_back();
+                ++stats_.reuses;
+            }
+            else
+            {
+                // make room for the new connection by closing an idle one
+                if (max_per_host && e.busy + e.idle.size() >= max_per_host)
+                {
+                    if (e.idle.empty())
+                        return http;
+                    e.idle.front()->stop(false);
+                    e.idle.erase(e.idle.begin());
+                }
+                http.reset(new HTTPDelegate(io_context, cli.ts->http_config, nullptr));
+                ++stats_.connects;
+            }
+            ++e.busy;
+            return http;
+        }
+
+        void dispatch(Entry &e)
+        {
+            while (!e.waiting.empty())
+            {
+                HTTPDelegate::Ptr http = take(e, *e.waiting.front());
+                if (!http)
+                    break;
+                RCPtr<Client> cli = std::move(e.waiting.front());
+                e.waiting.pop_front();
+                cli->pool_ready(std::move(http));
+            }
+        }
+
+        std::map<Key, Entry>::iterator purge(std::map<Key, Entry>::iterator i)
+        {
+            const Entry &e = i->second;
+            if (!e.busy && e.idle.empty() && e.waiting.empty())
+                return map.erase(i);
+            return ++i;
+        }
+
+        openvpn_io::io_context &io_context;
+        std::map<Key, Entry> map;
+        Stats stats_;
+    };
+
     class TransactionSet : public RC<thread_unsafe_refcount>
     {
       public:
@@ -340,6 +534,11 @@ class ClientSet : public RC<thread_unsafe_refcount>
         bool preserve_http_state = false;
         HTTPStateContainer hsc;
 
+        // Take connections from a pool shared with other
+        // transaction sets.  Ignored if preserve_http_state
+        // is enabled.
+        ConnectionPool::Ptr pool;
+
         // configuration
         WS::Client::Config::Ptr http_config;
         WS::Client::Host host;
@@ -628,6 +827,7 @@ class ClientSet : public RC<thread_unsafe_refcount>
       public:
         typedef RCPtr<Client> Ptr;
         friend HTTPDelegate;
+        friend ConnectionPool;
 
         Client(ClientSet *parent_arg,
                const TransactionSet::Ptr ts_arg,
@@ -639,7 +839,12 @@ class ClientSet : public RC<thread_unsafe_refcount>
               reconnect_timer(parent_arg->io_context),
               client_id(client_id_arg),
               halt(false),
-              started(false)
+              started(false),
+              pool_busy(false),
+              pool_waiting(false),
+              conn_reused(false),
+              retried(false),
+              headers_received(false)
         {
         }
 
@@ -669,6 +874,8 @@ class ClientSet : public RC<thread_unsafe_refcount>
             halt = true;
             reconnect_timer.cancel();
             close_http(keepalive, shutdown);
+            pool_cancel();
+            pool_release(shutdown);
         }
 
         void reset_callbacks()
@@ -679,7 +886,16 @@ class ClientSet : public RC<thread_unsafe_refcount>
 
         void abort(const std::string &message)
         {
-            if (ts)
+            if (pool_waiting)
+            {
+                // no connection yet to abort
+                pool_cancel();
+                Transaction &t = trans();
+                t.status = WS::Client::Status::E_ABORTED;
+                t.description = message;
+                done(false, false);
+            }
+            else if (ts)
                 ts->hsc.abort(message);
         }
 
@@ -761,12 +977,108 @@ class ClientSet : public RC<thread_unsafe_refcount>
             if (ts->debug_level >= 3)
                 OPENVPN_LOG("HTTPStateContainer alive=" << ts->alive() << " error_retry=" << error_retry << " n_clients=" << parent->clients.size());
             if (!ts->alive())
-                ts->hsc.construct(parent->io_context, ts->http_config);
-            ts->hsc.attach(this);
+            {
+                if (pooled())
+                {
+                    if (!pool_acquire())
+                        return; // resumed by pool_ready()
+                }
+                else
+                    ts->hsc.construct(parent->io_context, ts->http_config);
+            }
+            attach_and_start();
+        }
 
+        void attach_and_start()
+        {
+            conn_reused = ts->alive();
+            headers_received = false;
+            ts->hsc.attach(this);
             ts->hsc.start_request();
         }
 
+        bool pooled() const
+        {
+            return ts->pool && !ts->preserve_http_state;
+        }
+
+        bool pool_acquire()
+        {
+            // connection from a previous attempt, possibly to another host
+            pool_release(false);
+
+            pool_key = ConnectionPool::key(*ts);
+            HTTPDelegate::Ptr http = ts->pool->acquire(pool_key, this);
+            if (!http)
+            {
+                pool_waiting = true;
+                if (ts->debug_level >= 3)
+                    OPENVPN_LOG("HTTPClientSet: waiting for connection to " << ts->host.host);
+                return false;
+            }
+            pool_attach(std::move(http));
+            return true;
+        }
+
+        // called by ConnectionPool when a queued request gets a connection
+        void pool_ready(HTTPDelegate::Ptr http)
+        {
+            pool_waiting = false;
+            pool_attach(std::move(http));
+            openvpn_io::post(parent->io_context,
+                             [self = Ptr(this)]()
+                             {
+                                 if (!self->halt)
+                                     self->attach_and_start();
+                             });
+        }
+
+        void pool_attach(HTTPDelegate::Ptr http)
+        {
+            ts->hsc.create_container();
+            ts->hsc.c->http = std::move(http);
+            pool_busy = true;
+        }
+
+        void pool_release(const bool shutdown)
+        {
+            if (!pool_busy)
+                return;
+            pool_busy = false;
+            HTTPDelegate::Ptr http = std::move(ts->hsc.c->http);
+            if (http)
+                http->detach(http->is_alive(), shutdown);
+            ts->pool->release(pool_key, std::move(http), shutdown);
+        }
+
+        void pool_cancel()
+        {
+            if (!pool_waiting)
+                return;
+            pool_waiting = false;
+            ts->pool->cancel(pool_key, this);
+        }
+
+        // A reused connection may have been closed by the server
+        // before our request reached it.  Retry once on a new
+        // connection if nothing came back and the method allows it.
+        bool stale_connection_retry(const Transaction &t) const
+        {
+            if (!pooled() || !conn_reused || retried || headers_received)
+                return false;
+            switch (t.status)
+            {
+            case WS::Client::Status::E_TCP:
+            case WS::Client::Status::E_EOF_TCP:
+            case WS::Client::Status::E_EOF_SSL:
+                break;
+            default:
+                return false;
+            }
+            const std::string &m = t.req.method;
+            return m == "GET" || m == "HEAD" || m == "OPTIONS" || m == "PUT" || m == "DELETE";
+        }
+
         void reconnect_schedule(const bool error_retry)
         {
             if (check_if_done())
@@ -794,6 +1106,8 @@ class ClientSet : public RC<thread_unsafe_refcount>
             WS::Client::ContentInfo ci = t.ci;
             if (!ci.length)
                 ci.length = t.content_out.join_size();
+            if (pooled())
+                ci.keepalive = true;
 #ifdef HAVE_ZLIB
             if (t.accept_gzip_in)
                 ci.extra_headers.emplace_back("Accept-Encoding: gzip");
@@ -819,6 +1133,7 @@ class ClientSet : public RC<thread_unsafe_refcount>
 
             // save reply
             t.reply = hd.reply();
+            headers_received = true;
         }
 
         BufferPtr http_content_out(HTTPDelegate &hd)
@@ -919,12 +1234,19 @@ class ClientSet : public RC<thread_unsafe_refcount>
 
                     // do next request
                     ++ts_iter;
+                    retried = false;
 
                     // Post a call to next_request() under a fresh stack.
                     // Currently we may actually be under tcp_read_handler() and
                     // next_request() can trigger destructors.
                     post_next_request();
                 }
+                else if (stale_connection_retry(t))
+                {
+                    retried = true;
+                    close_http(false, false);
+                    post_next_request();
+                }
                 else
                 {
                     // failed
@@ -992,6 +1314,12 @@ class ClientSet : public RC<thread_unsafe_refcount>
         client_t client_id;
         bool halt;
         bool started;
+        ConnectionPool::Key pool_key;
+        bool pool_busy;
+        bool pool_waiting;
+        bool conn_reused;
+        bool retried; // current request was already retried after a stale connection
+        bool headers_received;
     };
 
     void remove_client_id(const client_t client_id)
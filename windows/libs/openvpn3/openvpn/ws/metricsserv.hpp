@@ -0,0 +1,146 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// HTTP listener that serves a Metrics registry:
+//
+//   GET /metrics       Prometheus text exposition format
+//   GET /metrics.json  JSON snapshot
+
+#pragma once
+
+#include <string>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/buffer/bufstr.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/http/status.hpp>
+#include <openvpn/server/listenlist.hpp>
+#include <openvpn/log/metrics.hpp>
+#include <openvpn/ws/httpserv.hpp>
+
+namespace openvpn::WS {
+
+class MetricsServer : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<MetricsServer> Ptr;
+
+    // Listen on addr/port (TCP).  Must be started and stopped from
+    // the thread that runs io_context.
+    MetricsServer(openvpn_io::io_context &io_context,
+                  const Metrics::Ptr &metrics,
+                  const std::string &addr,
+                  const std::string &port)
+    {
+        Server::Config::Ptr config = new Server::Config();
+        config->http_server_id = "OpenVPN-Metrics";
+        config->frame = frame_init_simple(2048);
+        config->stats.reset(new SessionStats());
+        config->max_content_bytes = 4096;
+        config->general_timeout = 15;
+
+        Listen::Item li;
+        li.directive = "metrics-listen";
+        li.addr = addr;
+        li.port = port;
+        li.proto = Protocol(Protocol::TCP);
+        li.n_threads = 1;
+
+        listener.reset(new Server::Listener(io_context, config, li, new ClientFactory(metrics)));
+    }
+
+    void start()
+    {
+        listener->start();
+    }
+
+    void stop()
+    {
+        listener->stop();
+    }
+
+  private:
+    class ClientInstance : public Server::Listener::Client
+    {
+      public:
+        ClientInstance(Server::Listener::Client::Initializer &ci, const Metrics::Ptr &metrics_arg)
+            : Server::Listener::Client(ci),
+              metrics(metrics_arg)
+        {
+        }
+
+      private:
+        void http_request_received() override
+        {
+            const HTTP::Request &req = request();
+            Server::ContentInfo ci;
+            if (req.method != "GET")
+            {
+                out = buf_from_string("bad request\n");
+                ci.http_status = HTTP::Status::BadRequest;
+                ci.type = "text/plain";
+            }
+            else if (req.uri == "/metrics")
+            {
+                out = buf_from_string(metrics->prometheus());
+                ci.http_status = HTTP::Status::OK;
+                ci.type = "text/plain; version=0.0.4; charset=utf-8";
+            }
+            else if (req.uri == "/metrics.json")
+            {
+                out = buf_from_string(metrics->json());
+                ci.http_status = HTTP::Status::OK;
+                ci.type = "application/json";
+            }
+            else
+            {
+                out = buf_from_string("page not found\n");
+                ci.http_status = HTTP::Status::NotFound;
+                ci.type = "text/plain";
+            }
+            ci.length = out->size();
+            ci.no_cache = true;
+            ci.keepalive = keepalive_request();
+            generate_reply_headers(ci);
+        }
+
+        BufferPtr http_content_out() override
+        {
+            BufferPtr ret;
+            ret.swap(out);
+            return ret;
+        }
+
+        Metrics::Ptr metrics;
+        BufferPtr out;
+    };
+
+    class ClientFactory : public Server::Listener::Client::Factory
+    {
+      public:
+        explicit ClientFactory(const Metrics::Ptr &metrics_arg)
+            : metrics(metrics_arg)
+        {
+        }
+
+        Server::Listener::Client::Ptr new_client(Server::Listener::Client::Initializer &ci) override
+        {
+            return new ClientInstance(ci, metrics);
+        }
+
+      private:
+        Metrics::Ptr metrics;
+    };
+
+    Server::Listener::Ptr listener;
+};
+
+} // namespace openvpn::WS
@@ -0,0 +1,401 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Server load test: runs many client tunnels on a small pool of
+// event-loop threads (ClientAPI::OpenVPNClientHost).  Build with
+// OPENVPN_FORCE_TUN_NULL, since the tunnels don't get tun devices.
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+
+// don't export core symbols
+#define OPENVPN_CORE_API_VISIBILITY_HIDDEN
+
+// should be included before other openvpn includes,
+// with the exception of openvpn/log includes
+#include <client/ovpncli.cpp>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/file.hpp>
+#include <openvpn/common/getopt.hpp>
+#include <openvpn/common/number.hpp>
+#if !defined(OPENVPN_PLATFORM_WIN)
+#include <openvpn/common/signal.hpp>
+#endif
+
+using namespace openvpn;
+
+namespace {
+OPENVPN_SIMPLE_EXCEPTION(usage);
+
+typedef std::chrono::steady_clock Clock;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void handler(int signum)
+{
+    interrupted = 1;
+}
+
+class LoadClient : public ClientAPI::OpenVPNClient
+{
+  public:
+    explicit LoadClient(const int index_arg)
+        : index(index_arg)
+    {
+    }
+
+    void started()
+    {
+        start_time = Clock::now();
+    }
+
+    bool is_connected() const
+    {
+        return connected.load(std::memory_order_acquire);
+    }
+
+    // seconds from start() to the first CONNECTED event, or -1
+    double connect_time() const
+    {
+        return connect_seconds;
+    }
+
+    unsigned int errors() const
+    {
+        return error_count.load(std::memory_order_relaxed);
+    }
+
+    void event(const ClientAPI::Event &ev) override
+    {
+        if (ev.name == "CONNECTED")
+        {
+            if (connect_seconds < 0)
+                connect_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+            connected.store(true, std::memory_order_release);
+        }
+        else if (ev.name == "RECONNECTING" || ev.name == "DISCONNECTED")
+            connected.store(false, std::memory_order_release);
+
+        if (ev.error)
+        {
+            error_count.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(out_mutex);
+            std::cout << "tunnel " << index << ": " << ev.name << ' ' << ev.info << std::endl;
+        }
+    }
+
+    void acc_event(const ClientAPI::AppCustomControlMessageEvent &) override
+    {
+    }
+
+    // core logging goes to the host
+    void log(const ClientAPI::LogInfo &) override
+    {
+    }
+
+    void external_pki_cert_request(ClientAPI::ExternalPKICertRequest &req) override
+    {
+        req.error = true;
+        req.errorText = "external PKI not supported";
+    }
+
+    void external_pki_sign_request(ClientAPI::ExternalPKISignRequest &req) override
+    {
+        req.error = true;
+        req.errorText = "external PKI not supported";
+    }
+
+    bool pause_on_connection_timeout() override
+    {
+        return false;
+    }
+
+    static std::mutex out_mutex;
+
+  private:
+    const int index;
+    Clock::time_point start_time;
+    std::atomic<bool> connected{false};
+    std::atomic<unsigned int> error_count{0};
+    double connect_seconds = -1; // written and read on the pool thread, read after shutdown
+};
+
+std::mutex LoadClient::out_mutex;
+
+class LoadHost : public ClientAPI::OpenVPNClientHost
+{
+  public:
+    LoadHost(const int n_threads, const bool verbose_arg)
+        : ClientAPI::OpenVPNClientHost(n_threads),
+          verbose(verbose_arg)
+    {
+    }
+
+    ~LoadHost()
+    {
+        shutdown();
+    }
+
+    void session_done(ClientAPI::OpenVPNClient *client, const ClientAPI::Status &status) override
+    {
+        done.fetch_add(1, std::memory_order_relaxed);
+        if (status.error)
+        {
+            std::lock_guard<std::mutex> lock(LoadClient::out_mutex);
+            std::cout << "session error: " << status.status << ' ' << status.message << std::endl;
+        }
+    }
+
+    void log(const ClientAPI::LogInfo &log) override
+    {
+        if (verbose)
+        {
+            std::lock_guard<std::mutex> lock(LoadClient::out_mutex);
+            std::cout << log.text << std::flush;
+        }
+    }
+
+    int done_count() const
+    {
+        return done.load(std::memory_order_relaxed);
+    }
+
+  private:
+    const bool verbose;
+    std::atomic<int> done{0};
+};
+
+void report(const double elapsed, const int started, LoadHost &host, const std::vector<std::unique_ptr<LoadClient>> &clients)
+{
+    int connected = 0;
+    unsigned int errors = 0;
+    long long bytes_in = 0, bytes_out = 0;
+    for (auto &c : clients)
+    {
+        if (c->is_connected())
+            ++connected;
+        errors += c->errors();
+        const ClientAPI::TransportStats ts = c->transport_stats();
+        bytes_in += ts.bytesIn;
+        bytes_out += ts.bytesOut;
+    }
+    std::lock_guard<std::mutex> lock(LoadClient::out_mutex);
+    std::cout << std::fixed << std::setprecision(1) << elapsed << "s"
+              << " started=" << started
+              << " connected=" << connected
+              << " done=" << host.done_count()
+              << " errors=" << errors
+              << " in=" << bytes_in
+              << " out=" << bytes_out << std::endl;
+}
+
+void summary(const std::vector<std::unique_ptr<LoadClient>> &clients, const int n_threads)
+{
+    std::vector<double> times;
+    for (auto &c : clients)
+        if (c->connect_time() >= 0)
+            times.push_back(c->connect_time());
+    std::sort(times.begin(), times.end());
+
+    std::cout << "tunnels: " << clients.size() << " on " << n_threads << " threads, "
+              << times.size() << " connected" << std::endl;
+    if (times.empty())
+        return;
+    auto pct = [&times](const double p)
+    { return times[std::min(times.size() - 1, static_cast<size_t>(p * times.size()))]; };
+    std::cout << std::fixed << std::setprecision(3)
+              << "connect time (s): min=" << times.front()
+              << " p50=" << pct(0.5)
+              << " p90=" << pct(0.9)
+              << " p99=" << pct(0.99)
+              << " max=" << times.back() << std::endl;
+}
+
+int load_test(int argc, char *argv[])
+{
+    static const struct option longopts[] = {
+        // clang-format off
+        { "tunnels",  required_argument, nullptr, 'n' },
+        { "threads",  required_argument, nullptr, 't' },
+        { "ramp",     required_argument, nullptr, 'r' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "username", required_argument, nullptr, 'u' },
+        { "password", required_argument, nullptr, 'p' },
+        { "metrics",  required_argument, nullptr, 'm' },
+        { "verbose",  no_argument,       nullptr, 'v' },
+        { nullptr,    0,                 nullptr, 0 }
+        // clang-format on
+    };
+
+    int ret = 0;
+    try
+    {
+        int n_tunnels = 10;
+        int n_threads = 0;
+        int ramp = 50;
+        int duration = 30;
+        std::string username;
+        std::string password;
+        std::string metrics_port;
+        bool verbose = false;
+
+        int ch;
+        optind = 1;
+        while ((ch = getopt_long(argc, argv, "n:t:r:d:u:p:m:v", longopts, nullptr)) != -1)
+        {
+            switch (ch)
+            {
+            case 'n':
+                n_tunnels = parse_number_throw<int>(optarg, "tunnels");
+                break;
+            case 't':
+                n_threads = parse_number_throw<int>(optarg, "threads");
+                break;
+            case 'r':
+                ramp = std::max(1, parse_number_throw<int>(optarg, "ramp"));
+                break;
+            case 'd':
+                duration = parse_number_throw<int>(optarg, "duration");
+                break;
+            case 'u':
+                username = optarg;
+                break;
+            case 'p':
+                password = optarg;
+                break;
+            case 'm':
+                metrics_port = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                throw usage();
+            }
+        }
+        argc -= optind;
+        argv += optind;
+        if (argc != 1)
+            throw usage();
+
+        ClientAPI::Config config;
+        config.content = read_text_utf8(argv[0]);
+        config.connTimeout = 0;
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+        Signal signal(handler, Signal::F_SIGINT | Signal::F_SIGTERM);
+#else
+        std::signal(SIGINT, handler);
+#endif
+
+        LoadHost host(n_threads, verbose);
+        if (!metrics_port.empty())
+        {
+            ClientAPI::MetricsConfig mc;
+            mc.port = metrics_port;
+            const ClientAPI::Status ms = host.start_metrics(mc);
+            if (ms.error)
+                OPENVPN_THROW_EXCEPTION("metrics error: " << ms.message);
+        }
+        std::cout << "starting " << n_tunnels << " tunnels on " << host.thread_count()
+                  << " threads, " << ramp << "/s" << std::endl;
+
+        std::vector<std::unique_ptr<LoadClient>> clients;
+        clients.reserve(n_tunnels);
+        const Clock::time_point begin = Clock::now();
+        Clock::time_point next_report = begin + std::chrono::seconds(1);
+        Clock::time_point end = Clock::time_point::max();
+        int started = 0;
+
+        while (!interrupted && Clock::now() < end)
+        {
+            const Clock::time_point now = Clock::now();
+
+            // start tunnels at the ramp rate
+            const double elapsed = std::chrono::duration<double>(now - begin).count();
+            while (started < n_tunnels && started < static_cast<int>(elapsed * ramp) + 1)
+            {
+                std::unique_ptr<LoadClient> client(new LoadClient(started));
+                const ClientAPI::EvalConfig eval = client->eval_config(config);
+                if (eval.error)
+                    OPENVPN_THROW_EXCEPTION("eval config error: " << eval.message);
+                if (!eval.autologin)
+                {
+                    ClientAPI::ProvideCreds creds;
+                    creds.username = username;
+                    creds.password = password;
+                    const ClientAPI::Status cs = client->provide_creds(creds);
+                    if (cs.error)
+                        OPENVPN_THROW_EXCEPTION("creds error: " << cs.message);
+                }
+                client->started();
+                const ClientAPI::Status status = host.start(client.get());
+                if (status.error)
+                    OPENVPN_THROW_EXCEPTION("start error: " << status.message);
+                clients.push_back(std::move(client));
+                if (++started == n_tunnels)
+                    end = Clock::now() + std::chrono::seconds(duration);
+            }
+
+            if (now >= next_report)
+            {
+                report(elapsed, started, host, clients);
+                next_report += std::chrono::seconds(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        std::cout << "stopping" << std::endl;
+        host.shutdown();
+        summary(clients, host.thread_count());
+    }
+    catch (const usage &)
+    {
+        std::cout << "OpenVPN Server Load Test" << std::endl;
+        std::cout << "Usage: ovpncliload [options] <config-file>" << std::endl;
+        std::cout << "--tunnels, -n  : number of tunnels (default 10)" << std::endl;
+        std::cout << "--threads, -t  : event-loop threads (default: one per CPU)" << std::endl;
+        std::cout << "--ramp, -r     : tunnels started per second (default 50)" << std::endl;
+        std::cout << "--duration, -d : seconds to run after the last tunnel was started (default 30)" << std::endl;
+        std::cout << "--username, -u : username" << std::endl;
+        std::cout << "--password, -p : password" << std::endl;
+        std::cout << "--metrics, -m  : serve metrics on 127.0.0.1:<port>/metrics" << std::endl;
+        std::cout << "--verbose, -v  : show core log" << std::endl;
+        ret = 2;
+    }
+    return ret;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int ret = 0;
+    try
+    {
+        ret = load_test(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << "Main thread exception: " << e.what() << std::endl;
+        ret = 1;
+    }
+    return ret;
+}
@@ -15,9 +15,13 @@
 
 #include <iostream>
 #include <memory>
+#include <chrono>
+#include <vector>
 
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/base64.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/bufstr.hpp>
 
 using namespace openvpn;
 
@@ -176,3 +180,70 @@ TEST(Base64, binary_data)
         delete[] data;
     }
 }
+
+TEST(Base64, decode_paths_agree)
+{
+    // padding in the middle of the input and appending to a non-empty
+    // destination must behave the same on the fast and generic paths
+    const Base64 b64;
+    const std::string enc = b64.encode(std::string("ab")) + b64.encode(std::string("cdefgh"));
+
+    EXPECT_EQ(b64.decode(enc), "abcdefgh");
+
+    std::vector<unsigned char> vec{'x'};
+    b64.decode(vec, enc);
+    EXPECT_EQ(std::string(vec.begin(), vec.end()), "xabcdefgh");
+
+    unsigned char buf[16];
+    EXPECT_EQ(b64.decode(buf, sizeof(buf), enc), 8u);
+    EXPECT_EQ(std::string(reinterpret_cast<char *>(buf), 8), "abcdefgh");
+
+    unsigned char small[8];
+    EXPECT_EQ(b64.decode(small, sizeof(small), enc), 8u);
+
+    // a Buffer's resize() sets its capacity, it takes the generic path
+    BufferAllocated ba(4, BufAllocFlags::GROW);
+    ba.push_back('x');
+    b64.decode(ba, enc);
+    EXPECT_EQ(buf_to_string(ba), "xabcdefgh");
+
+    unsigned char keybuf[8];
+    Buffer fixed(keybuf, sizeof(keybuf), false);
+    b64.decode(fixed, enc);
+    EXPECT_EQ(buf_to_string(fixed), "abcdefgh");
+
+    b64_test_bad_decode(b64, enc + "\x80" "AAA");
+    b64_test_bad_decode(b64, "AAA\xff");
+}
+
+static std::string b64_random_data(const size_t size)
+{
+    std::string data(size, '\0');
+    std::srand(1);
+    for (auto &c : data)
+        c = static_cast<char>(std::rand() & 0xff);
+    return data;
+}
+
+TEST(Base64, decode_large)
+{
+    const Base64 b64;
+    const std::string data = b64_random_data(1 << 20);
+    EXPECT_EQ(b64.decode(b64.encode(data)), data);
+}
+
+TEST(Base64, DISABLED_decode_bench)
+{
+    const Base64 b64;
+    const std::string data = b64_random_data(1 << 20);
+    const std::string enc = b64.encode(data);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::string dec;
+    for (int i = 0; i < 16; ++i)
+        dec = b64.decode(enc);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(dec, data);
+    std::cout << "Base64 decode: " << (16.0 * double(enc.size()) / 1e6) / elapsed.count() << " MB/s" << std::endl;
+}
@@ -0,0 +1,232 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <openvpn/asio/asiobusypoll.hpp>
+#include <openvpn/asio/asiowork.hpp>
+
+using namespace openvpn;
+
+#ifndef BUSYPOLL_BENCH_PINGS
+#define BUSYPOLL_BENCH_PINGS 5000
+#endif
+
+namespace {
+
+AsioBusyPoll::Config make_config(const unsigned int min_us, const unsigned int max_us)
+{
+    AsioBusyPoll::Config config;
+    config.min_us = min_us;
+    config.max_us = max_us;
+    return config;
+}
+
+void spin_for(const std::chrono::microseconds d)
+{
+    const auto end = std::chrono::steady_clock::now() + d;
+    while (std::chrono::steady_clock::now() < end)
+        ;
+}
+
+double thread_cpu_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+} // namespace
+
+TEST(busypoll, runs_until_out_of_work)
+{
+    openvpn_io::io_context io(1);
+    int count = 0;
+    std::function<void()> next = [&]()
+    {
+        if (++count < 1000)
+            openvpn_io::post(io, next);
+    };
+    openvpn_io::post(io, next);
+
+    AsioBusyPoll bp(io, make_config(5, 100));
+    EXPECT_EQ(bp.run(), 1000u);
+    EXPECT_EQ(count, 1000);
+    EXPECT_EQ(bp.stats().handlers, 1000u);
+    EXPECT_TRUE(io.stopped());
+}
+
+TEST(busypoll, stop_while_spinning)
+{
+    openvpn_io::io_context io(1);
+    AsioWork work(io);
+    AsioBusyPoll bp(io, make_config(1000000, 1000000));
+    std::thread t([&]()
+                  {
+                      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                      io.stop(); });
+    bp.run();
+    t.join();
+    EXPECT_EQ(bp.stats().sleeps, 0u);
+    EXPECT_GT(bp.stats().spin_ns, 0u);
+}
+
+TEST(busypoll, budget_follows_short_gaps)
+{
+    // events 20us apart, well within max_us, are caught by spinning
+    if (std::thread::hardware_concurrency() < 2)
+        GTEST_SKIP() << "the spinning loop would starve the event source";
+    openvpn_io::io_context io(1);
+    AsioWork work(io);
+    AsioBusyPoll bp(io, make_config(5, 2000));
+    std::atomic<int> received{0};
+    std::thread t([&]()
+                  {
+                      for (int i = 0; i < 2000; ++i)
+                      {
+                          spin_for(std::chrono::microseconds(20));
+                          openvpn_io::post(io, [&]() { ++received; });
+                      }
+                      openvpn_io::post(io, [&]() { io.stop(); }); });
+    bp.run();
+    t.join();
+    EXPECT_EQ(received, 2000);
+    EXPECT_GT(bp.stats().hits, bp.stats().misses);
+    EXPECT_GE(bp.stats().budget_us, 5u);
+}
+
+TEST(busypoll, budget_decays_when_idle)
+{
+    // events 5ms apart, beyond max_us, send the loop to sleep and
+    // shrink the budget to min_us
+    openvpn_io::io_context io(1);
+    openvpn_io::steady_timer timer(io);
+    int ticks = 0;
+    std::function<void(const openvpn_io::error_code &)> tick = [&](const openvpn_io::error_code &error)
+    {
+        if (error || ++ticks == 20)
+            return;
+        timer.expires_after(std::chrono::milliseconds(5));
+        timer.async_wait(tick);
+    };
+    timer.expires_after(std::chrono::milliseconds(5));
+    timer.async_wait(tick);
+
+    AsioBusyPoll bp(io, make_config(10, 200));
+    bp.run();
+    EXPECT_EQ(ticks, 20);
+    EXPECT_GE(bp.stats().misses, 15u);
+    EXPECT_EQ(bp.stats().budget_us, 10u);
+    // at most max_us of spinning per tick
+    EXPECT_LT(bp.stats().spin_ns, 20u * 200000u + 10000000u);
+}
+
+TEST(busypoll, socket_option)
+{
+    openvpn_io::io_context io(1);
+    openvpn_io::ip::udp::socket sock(io, openvpn_io::ip::udp::v4());
+    if (!AsioBusyPoll::set_socket(sock, 50))
+        GTEST_SKIP() << "SO_BUSY_POLL not permitted";
+#ifdef SO_BUSY_POLL
+    int value = 0;
+    socklen_t len = sizeof(value);
+    ASSERT_EQ(::getsockopt(sock.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &value, &len), 0);
+    EXPECT_EQ(value, 50);
+#endif
+}
+
+namespace {
+
+// UDP echo on its own thread, driven by io_context::run() or AsioBusyPoll
+struct Echo
+{
+    openvpn_io::io_context io{1};
+    openvpn_io::ip::udp::socket sock{io, openvpn_io::ip::udp::endpoint(openvpn_io::ip::address_v4::loopback(), 0)};
+    openvpn_io::ip::udp::endpoint peer;
+    char data[64];
+    double cpu = 0;
+    AsioBusyPoll::Stats stats;
+
+    void read()
+    {
+        sock.async_receive_from(openvpn_io::buffer(data), peer, [this](const openvpn_io::error_code &error, const size_t size)
+                                {
+                                    if (error)
+                                        return;
+                                    sock.send_to(openvpn_io::buffer(data, size), peer);
+                                    read(); });
+    }
+
+    void run(const unsigned int busy_poll_us)
+    {
+        read();
+        const double start = thread_cpu_seconds();
+        if (busy_poll_us)
+        {
+            AsioBusyPoll bp(io, make_config(5, busy_poll_us));
+            bp.run();
+            stats = bp.stats();
+        }
+        else
+            io.run();
+        cpu = thread_cpu_seconds() - start;
+    }
+};
+
+} // namespace
+
+// Round trip latency to an echo thread with idle gaps between pings,
+// sleeping in epoll vs. busy polling, and the CPU the echo thread
+// burned for it.
+TEST(busypoll, DISABLED_bench_ping_latency)
+{
+    const unsigned int modes[] = {0, 200};
+    for (const unsigned int busy_poll_us : modes)
+    {
+        Echo echo;
+        std::thread t([&]()
+                      { echo.run(busy_poll_us); });
+
+        openvpn_io::io_context io(1);
+        openvpn_io::ip::udp::socket sock(io, openvpn_io::ip::udp::v4());
+        sock.connect(echo.sock.local_endpoint());
+        std::vector<double> rtt;
+        rtt.reserve(BUSYPOLL_BENCH_PINGS);
+        char buf[64] = {};
+        for (int i = 0; i < BUSYPOLL_BENCH_PINGS; ++i)
+        {
+            // idle gap, so that run() goes back to sleep
+            spin_for(std::chrono::microseconds(50));
+            const auto start = std::chrono::steady_clock::now();
+            sock.send(openvpn_io::buffer(buf, 32));
+            sock.receive(openvpn_io::buffer(buf));
+            rtt.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        openvpn_io::post(echo.io, [&]()
+                         { echo.io.stop(); });
+        t.join();
+
+        std::sort(rtt.begin(), rtt.end());
+        std::cerr << "*** busypoll budget_us=" << busy_poll_us
+                  << " rtt_us p50=" << rtt[rtt.size() / 2]
+                  << " p99=" << rtt[rtt.size() * 99 / 100]
+                  << " echo_cpu_ms=" << echo.cpu * 1000
+                  << " " << echo.stats.to_string(20) << std::endl;
+    }
+}
@@ -0,0 +1,243 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <openvpn/common/jsonhelper.hpp>
+#include <openvpn/tun/builder/capturebin.hpp>
+
+// size of the capture used by the benchmark
+#ifndef TBC_BENCH_ROUTES
+#define TBC_BENCH_ROUTES 5000
+#endif
+#ifndef TBC_BENCH_DNS
+#define TBC_BENCH_DNS 1000
+#endif
+#ifndef TBC_BENCH_ITER
+#define TBC_BENCH_ITER 20
+#endif
+
+using namespace openvpn;
+
+namespace {
+
+TunBuilderCapture::Ptr make_capture(const unsigned int n_routes, const unsigned int n_dns)
+{
+    TunBuilderCapture::Ptr tbc(new TunBuilderCapture);
+    tbc->tun_builder_set_remote_address("52.7.171.249", false);
+    tbc->tun_builder_add_address("1.2.3.4", 24, "10.10.0.1", false, false);
+    tbc->tun_builder_add_address("fe80::c32:4ff:febf:97d9", 64, "9999::7777", true, false);
+    tbc->tun_builder_reroute_gw(true, false, 123);
+    tbc->tun_builder_set_route_metric_default(10);
+    for (unsigned int i = 0; i < n_routes; ++i)
+    {
+        const std::string v4 = "10." + std::to_string((i >> 8) & 0xff) + '.' + std::to_string(i & 0xff) + ".0";
+        tbc->tun_builder_add_route(v4, 24, (i % 3) ? -1 : int(i), false);
+        tbc->tun_builder_add_route("2001:db8:" + std::to_string(i % 10000) + "::", 48, -1, true);
+        if (i % 5 == 0)
+            tbc->tun_builder_exclude_route(v4, 28, 77, false);
+    }
+    tbc->tun_builder_exclude_route("::1", 128, -1, true);
+
+    DnsOptions dns;
+    for (unsigned int i = 0; i < n_dns; ++i)
+    {
+        DnsServer &server = dns.servers[int(i) - 5];
+        server.addresses = {{"10.8.0." + std::to_string(i % 250), 0}, {"fd00::" + std::to_string(i % 1000), 5353}};
+        server.domains = {{"d" + std::to_string(i) + ".example.com"}};
+        server.dnssec = DnsServer::Security(i % 4);
+        server.transport = DnsServer::Transport(i % 4);
+        if (i % 2)
+            server.sni = "dns" + std::to_string(i) + ".example.net";
+        dns.search_domains.push_back({"s" + std::to_string(i) + ".example.org"});
+    }
+    dns.from_dhcp_options = true;
+    tbc->tun_builder_set_dns_options(dns);
+
+    tbc->tun_builder_set_mtu(1500);
+    tbc->tun_builder_set_session_name("onewaytickettothemoon");
+    tbc->tun_builder_add_proxy_bypass("bypass.example.com");
+    tbc->tun_builder_set_proxy_auto_config_url("http://wpad.yonan.net/");
+    tbc->tun_builder_set_proxy_http("foo.bar.gov", 1234);
+    tbc->tun_builder_set_proxy_https("zoo.bar.gov", 4321);
+    tbc->tun_builder_add_wins_server("6.6.6.6");
+    tbc->tun_builder_add_wins_server("7.7.7.7");
+    tbc->tun_builder_set_allow_family(AF_INET, false);
+    tbc->tun_builder_set_allow_local_dns(false);
+    return tbc;
+}
+
+std::string json_text(const TunBuilderCapture &tbc)
+{
+    return tbc.to_json().toStyledString();
+}
+
+double elapsed_ms(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+TEST(capturebin, round_trip)
+{
+    const TunBuilderCapture::Ptr tbc = make_capture(300, 20);
+    const BufferPtr bin = TunBuilderCaptureBinary::serialize(*tbc);
+    const TunBuilderCapture::Ptr tbc2 = TunBuilderCaptureBinary::deserialize(*bin);
+    tbc2->validate();
+    EXPECT_EQ(json_text(*tbc), json_text(*tbc2));
+    EXPECT_EQ(tbc2->to_string(), tbc->to_string());
+    EXPECT_TRUE(tbc2->block_ipv4);
+    EXPECT_TRUE(tbc2->dns_options == tbc->dns_options);
+
+    // JSON -> binary -> JSON is the identity as well
+    const TunBuilderCapture::Ptr tbc3 = TunBuilderCapture::from_json(tbc->to_json());
+    const TunBuilderCapture::Ptr tbc4 = TunBuilderCaptureBinary::deserialize(*TunBuilderCaptureBinary::serialize(*tbc3));
+    EXPECT_EQ(json_text(*tbc3), json_text(*tbc4));
+
+    // empty capture
+    const TunBuilderCapture empty;
+    EXPECT_EQ(json_text(empty), json_text(*TunBuilderCaptureBinary::deserialize(*TunBuilderCaptureBinary::serialize(empty))));
+}
+
+TEST(capturebin, reader_views)
+{
+    const TunBuilderCapture::Ptr tbc = make_capture(100, 10);
+    const BufferPtr bin = TunBuilderCaptureBinary::serialize(*tbc);
+    const TunBuilderCaptureBinary::Reader r(*bin);
+
+    // views point into the buffer
+    const char *begin = reinterpret_cast<const char *>(bin->c_data());
+    const char *end = begin + bin->size();
+    EXPECT_EQ(r.session_name(), "onewaytickettothemoon");
+    EXPECT_TRUE(r.session_name().data() >= begin && r.session_name().data() < end);
+
+    ASSERT_EQ(r.add_routes().size(), tbc->add_routes.size());
+    size_t i = 0;
+    for (const auto &route : r.add_routes())
+    {
+        const TunBuilderCapture::Route &expect = tbc->add_routes[i++];
+        EXPECT_EQ(route.address, expect.address);
+        EXPECT_EQ(route.prefix_length, expect.prefix_length);
+        EXPECT_EQ(route.metric, expect.metric);
+        EXPECT_EQ(route.ipv6, expect.ipv6);
+        EXPECT_TRUE(route.address.data() >= begin && route.address.data() < end);
+    }
+    EXPECT_EQ(i, tbc->add_routes.size());
+
+    ASSERT_EQ(r.dns_servers().size(), 10u);
+    auto s = r.dns_servers().begin();
+    EXPECT_EQ(s->priority, -5);
+    EXPECT_EQ(s->addresses.size(), 2u);
+    EXPECT_EQ((++s->addresses.begin())->port, 5353u);
+    EXPECT_EQ(*s->domains.begin(), "d0.example.com");
+    EXPECT_EQ(r.http_proxy().host, "foo.bar.gov");
+    EXPECT_EQ(r.https_proxy().port, 4321);
+    EXPECT_TRUE(r.block_ipv4());
+    EXPECT_TRUE(r.block_outside_dns());
+}
+
+TEST(capturebin, rejects_malformed)
+{
+    const TunBuilderCapture::Ptr tbc = make_capture(10, 2);
+    const BufferPtr bin = TunBuilderCaptureBinary::serialize(*tbc);
+    const std::string good(reinterpret_cast<const char *>(bin->c_data()), bin->size());
+
+    auto parse = [](const std::string &s)
+    {
+        TunBuilderCaptureBinary::deserialize(reinterpret_cast<const unsigned char *>(s.data()), s.size());
+    };
+    EXPECT_NO_THROW(parse(good));
+
+    // every truncation
+    for (size_t len = 0; len < good.size(); ++len)
+        EXPECT_THROW(parse(good.substr(0, len)), TunBuilderCaptureBinary::tun_builder_capture_binary_error) << len;
+
+    // trailing data, even with a consistent body size
+    std::string s = good + '\0';
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+    s[8] = char(s[8] + 1);
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+
+    // magic and version
+    s = good;
+    s[0] = 'X';
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+    s = good;
+    s[4] = 2;
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+
+    // first section: wrong tag, then a bad length
+    s = good;
+    s[12] = TunBuilderCaptureBinary::MTU;
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+    s = good;
+    s[16] = char(0x7f);
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+
+    // a bool that is neither 0 nor 1: remote_address.ipv6
+    s = good;
+    const size_t ipv6_offset = 12 + 1 + 4 + tbc->session_name.size() + 1 + 4 + 1 + 4 + 1 + 4 + tbc->remote_address.address.size();
+    ASSERT_EQ(s[ipv6_offset], 0);
+    s[ipv6_offset] = 2;
+    EXPECT_THROW(parse(s), TunBuilderCaptureBinary::tun_builder_capture_binary_error);
+}
+
+TEST(capturebin, DISABLED_bench)
+{
+    const TunBuilderCapture::Ptr tbc = make_capture(TBC_BENCH_ROUTES, TBC_BENCH_DNS);
+    const int iter = TBC_BENCH_ITER;
+    size_t json_size = 0;
+    size_t bin_size = 0;
+    size_t n = 0;
+
+    auto t = std::chrono::steady_clock::now();
+    for (int i = 0; i < iter; ++i)
+    {
+        const std::string text = json::format_compact(tbc->to_json());
+        json_size = text.size();
+        const TunBuilderCapture::Ptr out = TunBuilderCapture::from_json(json::parse(text));
+        n += out->add_routes.size();
+    }
+    const double json_ms = elapsed_ms(t) / iter;
+
+    t = std::chrono::steady_clock::now();
+    for (int i = 0; i < iter; ++i)
+    {
+        const BufferPtr bin = TunBuilderCaptureBinary::serialize(*tbc);
+        bin_size = bin->size();
+        const TunBuilderCapture::Ptr out = TunBuilderCaptureBinary::deserialize(*bin);
+        n += out->add_routes.size();
+    }
+    const double bin_ms = elapsed_ms(t) / iter;
+
+    t = std::chrono::steady_clock::now();
+    for (int i = 0; i < iter; ++i)
+    {
+        const BufferPtr bin = TunBuilderCaptureBinary::serialize(*tbc);
+        const TunBuilderCaptureBinary::Reader r(*bin);
+        for (const auto &route : r.add_routes())
+            n += route.prefix_length != 0;
+    }
+    const double view_ms = elapsed_ms(t) / iter;
+
+    EXPECT_EQ(n, size_t(iter) * 3 * tbc->add_routes.size());
+    std::cerr << "*** capturebin routes=" << tbc->add_routes.size() + tbc->exclude_routes.size()
+              << " dns_servers=" << tbc->dns_options.servers.size()
+              << " json=" << json_size << "B " << json_ms << "ms"
+              << " binary=" << bin_size << "B " << bin_ms << "ms"
+              << " binary+reader=" << view_ms << "ms"
+              << " speedup=" << json_ms / bin_ms << "x/" << json_ms / view_ms << "x" << std::endl;
+}
@@ -0,0 +1,266 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <iomanip>
+
+#include <openvpn/tun/tunmtu.hpp>
+#include <openvpn/tun/builder/capturediff.hpp>
+#include <openvpn/tun/linux/client/tunnetlink.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+typedef TunBuilderCapture::Route Route;
+
+TunBuilderCapture::Ptr make_capture()
+{
+    TunBuilderCapture::Ptr tbc(new TunBuilderCapture());
+    tbc->tun_builder_set_remote_address("192.0.2.1", false);
+    tbc->tun_builder_add_address("10.8.0.2", 24, "10.8.0.1", false, false);
+    tbc->tun_builder_add_address("fd00::2", 64, "fd00::1", true, false);
+    tbc->tun_builder_set_mtu(1500);
+    return tbc;
+}
+
+// n /24 routes from 10.16.0.0 on
+void add_routes(TunBuilderCapture &tbc, const unsigned int first, const unsigned int n)
+{
+    for (unsigned int i = first; i < first + n; ++i)
+        tbc.tun_builder_add_route("10." + std::to_string(16 + (i >> 8)) + '.' + std::to_string(i & 0xff) + ".0", 24, -1, false);
+}
+
+std::vector<std::string> keys(const TunBuilderCaptureDiff::RouteList &routes)
+{
+    std::vector<std::string> ret;
+    for (const auto &r : routes)
+        ret.push_back(r.to_string());
+    return ret;
+}
+
+// records commands instead of running them
+struct LogAction : public Action
+{
+    explicit LogAction(std::string text_arg)
+        : text(std::move(text_arg))
+    {
+    }
+
+    void execute(std::ostream &os) override
+    {
+        os << text << '\n';
+    }
+
+    std::string to_string() const override
+    {
+        return text;
+    }
+
+    std::string text;
+};
+
+struct LogTunMethods
+{
+    static void tun_config(const std::string &iface_name,
+                           const TunBuilderCapture &pull,
+                           std::vector<IP::Route> *rtvec,
+                           ActionList &create,
+                           ActionList &destroy,
+                           const unsigned int flags)
+    {
+        if (!(flags & TunConfigFlags::ROUTES_ONLY))
+        {
+            create.add(new LogAction("up " + iface_name));
+            destroy.add(new LogAction("down " + iface_name));
+        }
+        for (const auto &r : pull.add_routes)
+        {
+            create.add(new LogAction("add " + r.to_string()));
+            destroy.add(new LogAction("del " + r.to_string()));
+        }
+        for (const auto &r : pull.exclude_routes)
+        {
+            create.add(new LogAction("add exclude " + r.to_string()));
+            destroy.add(new LogAction("del exclude " + r.to_string()));
+        }
+    }
+};
+
+} // namespace
+
+TEST(capturediff, routes)
+{
+    TunBuilderCapture::Ptr from = make_capture();
+    from->tun_builder_add_route("10.1.0.0", 16, -1, false);
+    from->tun_builder_add_route("10.2.0.0", 16, -1, false);
+    from->tun_builder_add_route("10.2.0.0", 16, -1, false);
+    from->tun_builder_add_route("fd01::", 64, -1, true);
+    from->tun_builder_exclude_route("198.51.100.0", 24, -1, false);
+
+    TunBuilderCapture::Ptr to = make_capture();
+    to->tun_builder_add_route("10.4.0.0", 16, -1, false);
+    to->tun_builder_add_route("fd01::", 64, -1, true);
+    to->tun_builder_add_route("10.1.0.0", 16, 50, false); // metric change
+    to->tun_builder_add_route("10.3.0.0", 16, -1, false);
+    to->tun_builder_add_route("10.4.0.0", 16, -1, false);
+    to->tun_builder_exclude_route("198.51.100.0", 24, -1, false);
+
+    const TunBuilderCaptureDiff diff(*from, *to);
+    EXPECT_FALSE(diff.reconfigure);
+    EXPECT_FALSE(diff.dns_changed);
+    EXPECT_EQ(keys(diff.add_routes), std::vector<std::string>({"10.4.0.0/16", "10.1.0.0/16 [METRIC=50]", "10.3.0.0/16"}));
+    EXPECT_EQ(keys(diff.remove_routes), std::vector<std::string>({"10.1.0.0/16", "10.2.0.0/16"}));
+    EXPECT_TRUE(diff.add_exclude_routes.empty());
+    EXPECT_TRUE(diff.remove_exclude_routes.empty());
+    EXPECT_EQ(diff.n_route_ops(), 5u);
+    EXPECT_EQ(diff.to_string(), "routes +3 -2 exclude +0 -0");
+
+    const TunBuilderCaptureDiff same(*to, *to);
+    EXPECT_TRUE(same.empty());
+
+    to->exclude_routes.clear();
+    to->dns_options.from_dhcp_options = true;
+    const TunBuilderCaptureDiff dns(*from, *to);
+    EXPECT_TRUE(dns.dns_changed);
+    EXPECT_EQ(keys(dns.remove_exclude_routes), std::vector<std::string>({"198.51.100.0/24"}));
+    EXPECT_EQ(dns.to_string(), "routes +3 -2 exclude +0 -1 dns");
+}
+
+TEST(capturediff, reconfigure)
+{
+    TunBuilderCapture::Ptr from = make_capture();
+
+    TunBuilderCapture::Ptr mtu = make_capture();
+    mtu->tun_builder_set_mtu(1400);
+    EXPECT_EQ(TunBuilderCaptureDiff(*from, *mtu).reconfigure_reason, "mtu");
+
+    TunBuilderCapture::Ptr addr = make_capture();
+    addr->tunnel_addresses[0].address = "10.8.0.3";
+    EXPECT_EQ(TunBuilderCaptureDiff(*from, *addr).reconfigure_reason, "tunnel addresses");
+
+    TunBuilderCapture::Ptr rgw = make_capture();
+    rgw->tun_builder_reroute_gw(true, false, 0);
+    const TunBuilderCaptureDiff diff(*from, *rgw);
+    EXPECT_TRUE(diff.reconfigure);
+    EXPECT_FALSE(diff.empty());
+    EXPECT_EQ(diff.to_string(), "reconfigure (redirect-gateway)");
+}
+
+TEST(capturediff, netlink_routes_only)
+{
+    TunBuilderCapture::Ptr tbc = make_capture();
+    tbc->tun_builder_reroute_gw(true, true, 0);
+    tbc->tun_builder_add_route("10.1.0.0", 16, -1, false);
+    tbc->tun_builder_add_route("fd01::", 64, -1, true);
+
+    ActionList create, destroy;
+    TunNetlink::TunMethods::tun_config("tun9", *tbc, nullptr, create, destroy, TunConfigFlags::ROUTES_ONLY);
+    ASSERT_EQ(create.size(), 2u);
+    ASSERT_EQ(destroy.size(), 2u);
+    EXPECT_EQ(create[0]->to_string(), "netlink route add dev tun9 10.1.0.0/16 via 10.8.0.1 metric -1");
+    EXPECT_EQ(destroy[1]->to_string(), "netlink route del dev tun9 fd01::/64 via fd00::1 metric -1");
+}
+
+TEST(capturediff, setup_update)
+{
+    TunLinuxSetup::Setup<LogTunMethods>::Ptr setup(new TunLinuxSetup::Setup<LogTunMethods>());
+    TunLinuxSetup::Setup<LogTunMethods>::Config conf;
+    conf.dco = true; // no tun device to open
+    conf.iface_name = "tun9";
+
+    TunBuilderCapture::Ptr from = make_capture();
+    from->tun_builder_add_route("10.1.0.0", 16, -1, false);
+    from->tun_builder_add_route("10.2.0.0", 16, -1, false);
+    from->tun_builder_exclude_route("198.51.100.0", 24, -1, false);
+    {
+        std::ostringstream os;
+        setup->establish(*from, &conf, nullptr, os);
+        EXPECT_EQ(os.str(), "up tun9\nadd 10.1.0.0/16\nadd 10.2.0.0/16\nadd exclude 198.51.100.0/24\n");
+    }
+
+    TunBuilderCapture::Ptr to = make_capture();
+    to->tun_builder_add_route("10.2.0.0", 16, -1, false);
+    to->tun_builder_add_route("10.0.0.0", 8, -1, false);
+    {
+        const TunBuilderCaptureDiff diff(*from, *to);
+        std::ostringstream os;
+        EXPECT_TRUE(setup->update(*to, diff, os));
+
+        // new routes first, the interface is left alone
+        EXPECT_EQ(os.str(), "add 10.0.0.0/8\ndel exclude 198.51.100.0/24\ndel 10.1.0.0/16\n");
+    }
+
+    TunBuilderCapture::Ptr mtu = make_capture();
+    mtu->tun_builder_set_mtu(1400);
+    {
+        std::ostringstream os;
+        EXPECT_FALSE(setup->update(*mtu, TunBuilderCaptureDiff(*to, *mtu), os));
+        EXPECT_TRUE(os.str().empty());
+    }
+
+    // teardown removes what is installed now, newest first
+    std::ostringstream os;
+    setup->destroy(os);
+    EXPECT_EQ(os.str(), "del 10.0.0.0/8\ndel 10.2.0.0/16\ndown tun9\n");
+}
+
+// Time to turn a PUSH_UPDATE that changes one route into netlink
+// commands, incrementally and by rebuilding the whole configuration
+// as a full tun restart does.  Running the commands isn't measured,
+// each one is a netlink round trip and a restart runs all of them
+// twice, once to remove and once to add.
+TEST(capturediff, DISABLED_bench)
+{
+    typedef std::chrono::steady_clock Clock;
+    for (const unsigned int n : {100u, 1000u, 10000u})
+    {
+        TunBuilderCapture::Ptr from = make_capture();
+        add_routes(*from, 0, n);
+        TunBuilderCapture::Ptr to = make_capture();
+        add_routes(*to, 1, n);
+
+        const int reps = 100000 / n;
+        size_t ops = 0;
+        Clock::time_point begin = Clock::now();
+        for (int i = 0; i < reps; ++i)
+        {
+            ActionList create, destroy;
+            TunNetlink::TunMethods::tun_config("tun9", *to, nullptr, create, destroy, 0);
+            ops += create.size() + destroy.size();
+        }
+        const double full = std::chrono::duration<double>(Clock::now() - begin).count() / reps;
+        EXPECT_EQ(ops, size_t(reps) * 2 * (n + 3));
+
+        ops = 0;
+        begin = Clock::now();
+        for (int i = 0; i < reps; ++i)
+        {
+            const TunBuilderCaptureDiff diff(*from, *to);
+            TunBuilderCapture::Ptr routes(new TunBuilderCapture());
+            routes->tunnel_addresses = to->tunnel_addresses;
+            routes->tunnel_address_index_ipv4 = to->tunnel_address_index_ipv4;
+            routes->add_routes = diff.add_routes;
+            routes->add_routes.insert(routes->add_routes.end(), diff.remove_routes.begin(), diff.remove_routes.end());
+            ActionList create, destroy;
+            TunNetlink::TunMethods::tun_config("tun9", *routes, nullptr, create, destroy, TunConfigFlags::ROUTES_ONLY);
+            ops += create.size();
+        }
+        const double incr = std::chrono::duration<double>(Clock::now() - begin).count() / reps;
+        EXPECT_EQ(ops, size_t(reps) * 2);
+
+        std::cerr << "*** capturediff routes=" << n << std::fixed << std::setprecision(1)
+                  << " full=" << full * 1e6 << "us (" << 2 * (n + 3) << " commands)"
+                  << " incremental=" << incr * 1e6 << "us (2 commands)" << std::endl;
+    }
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <chrono>
 #include "test_common.hpp"
 
 /* if initproces.hpp is not included, mingw/windows compilation fails with
@@ -8,6 +9,7 @@
 
 #include <client/ovpncli.hpp>
 #include <openvpn/client/cliopt.hpp>
+#include <openvpn/options/merge.hpp>
 
 using namespace openvpn;
 
@@ -297,3 +299,62 @@ TEST(config, meta_option_in_content)
     ASSERT_TRUE(opt.meta());
     ASSERT_EQ(opt.get(1, 256), "DDD");
 }
+
+// A large inline profile: a CA bundle and as many route directives as
+// the profile size limits allow
+static std::string large_profile(const int n_routes, std::string &ca_bundle)
+{
+    for (int i = 0; i < 32; ++i)
+        ca_bundle += dummysecp256cert;
+
+    std::string profile = "client\nremote wooden.box\n<ca>\n" + ca_bundle + "</ca>\n"
+                          + "<cert>\n" + dummysecp256cert + "</cert>\n"
+                          + "<key>\n" + dummysecp256key + "</key>\n";
+    for (int i = 0; i < n_routes; ++i)
+        profile += "route 10." + std::to_string(i / 256) + "." + std::to_string(i % 256) + ".0 255.255.255.0\n";
+    return profile;
+}
+
+// the same merge and parse steps that the client API uses
+static void parse_large_profile(const std::string &profile, const int n_routes, const std::string &ca_bundle)
+{
+    ProfileMergeFromString pm(profile, "", ProfileMerge::FOLLOW_NONE, ProfileParseLimits::MAX_LINE_SIZE, ProfileParseLimits::MAX_PROFILE_SIZE);
+    ASSERT_EQ(pm.status(), ProfileMerge::MERGE_SUCCESS);
+
+    OptionList options;
+    const ParseClientConfig cc = ParseClientConfig::parse(pm.profile_content(), nullptr, options);
+    ASSERT_FALSE(cc.error()) << cc.message();
+    ASSERT_EQ(options.get_index("route").size(), size_t(n_routes));
+    ASSERT_EQ(options.get("ca").get(1, 0).size(), ca_bundle.size());
+}
+
+TEST(config, parse_large_profile)
+{
+    const int n_routes = 1000;
+    std::string ca_bundle;
+    const std::string profile = large_profile(n_routes, ca_bundle);
+    parse_large_profile(profile, n_routes, ca_bundle);
+
+    // the SSL parameters are parsed on demand when rendering the config
+    const ParseClientConfig cc = ParseClientConfig::parse(profile);
+    const std::string rendered = cc.to_string_config();
+    EXPECT_NE(rendered.find("<ca>"), std::string::npos);
+    EXPECT_NE(rendered.find("<cert>"), std::string::npos);
+}
+
+// Cold-start cost of evaluating a large inline profile
+TEST(config, DISABLED_parse_large_profile_bench)
+{
+    const int n_routes = 1000;
+    std::string ca_bundle;
+    const std::string profile = large_profile(n_routes, ca_bundle);
+
+    const int iterations = 10;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        parse_large_profile(profile, n_routes, ca_bundle);
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "parse_large_profile: " << profile.size() << " bytes, "
+              << elapsed.count() / iterations << " ms per profile" << std::endl;
+}
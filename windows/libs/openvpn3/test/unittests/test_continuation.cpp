@@ -13,6 +13,9 @@
 // #define OPENVPN_BUFFER_ABORT
 
 #include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
 
 #include "test_common.hpp"
 
@@ -21,6 +24,8 @@
 
 #include <openvpn/options/continuation_fragment.hpp>
 #include <openvpn/options/continuation.hpp>
+#include <openvpn/options/servpush_compiled.hpp>
+#include <openvpn/server/manage.hpp>
 
 using namespace openvpn;
 
@@ -320,3 +325,162 @@ TEST(continuation, push_update_add_multiple)
 
     ASSERT_EQ(cc.size(), 10);
 }
+
+static std::vector<std::string> random_push_list(RandomAPI &prng, const int max_len)
+{
+    std::vector<std::string> ret;
+    const int len = prng.randrange32(0, max_len);
+    for (int i = 0; i < len; ++i)
+        ret.push_back(random_opt(prng).escape(false));
+    return ret;
+}
+
+// reference: render the whole push list as CSV and fragment it
+static std::vector<BufferPtr> fragment_push_list(const std::vector<std::string> &common,
+                                                 const std::vector<std::string> &tail,
+                                                 const std::string &prefix)
+{
+    ServerPushList pl;
+    pl.extend(common);
+    pl.extend(tail);
+    BufferAllocated buf(65536, BufAllocFlags::GROW);
+    std::ostringstream os;
+    os << prefix;
+    pl.output_csv(os);
+    buf_append_string(buf, os.str());
+    return PushContinuationFragment(buf, prefix);
+}
+
+static void require_equal(const std::vector<BufferPtr> &bv1, const std::vector<BufferPtr> &bv2)
+{
+    ASSERT_EQ(bv1.size(), bv2.size());
+    for (size_t i = 0; i < bv1.size(); ++i)
+        require_equal(*bv1[i], *bv2[i], "COMPILED_PUSH_LIST");
+}
+
+TEST(continuation, compiled_push_list_random)
+{
+    RandomAPI::Ptr prng(new MTRand);
+    for (int i = 0; i < 200; ++i)
+    {
+        const std::vector<std::string> common = random_push_list(*prng, 400);
+        const std::vector<std::string> tail = random_push_list(*prng, 40);
+        const CompiledPushList cpl(common, "PUSH_REPLY");
+        require_equal(cpl.render(tail), fragment_push_list(common, tail, "PUSH_REPLY"));
+        require_equal(cpl.render(), fragment_push_list(common, {}, "PUSH_REPLY"));
+    }
+}
+
+TEST(continuation, compiled_push_list_buffers_not_shared)
+{
+    const CompiledPushList cpl({"route 10.0.0.0 255.0.0.0", "ping 10"}, "PUSH_REPLY");
+    std::vector<BufferPtr> a = cpl.render({"ifconfig 10.8.0.2 255.255.255.0"});
+    std::vector<BufferPtr> b = cpl.render({"ifconfig 10.8.0.3 255.255.255.0"});
+    ASSERT_EQ(a.size(), 1u);
+    ASSERT_EQ(b.size(), 1u);
+    a[0]->null_terminate();
+    EXPECT_EQ(buf_to_string(*a[0]), std::string("PUSH_REPLY,route 10.0.0.0 255.0.0.0,ping 10,ifconfig 10.8.0.2 255.255.255.0") + '\0');
+    EXPECT_EQ(buf_to_string(*b[0]), "PUSH_REPLY,route 10.0.0.0 255.0.0.0,ping 10,ifconfig 10.8.0.3 255.255.255.0");
+    EXPECT_TRUE(CompiledPushList({}, "PUSH_REPLY").render().empty());
+}
+
+namespace {
+
+// collects the push messages a server session would send
+struct PushRecv : public ManClientInstance::Recv
+{
+    std::vector<std::string> msgs;
+
+    void push_reply(std::vector<BufferPtr> &&push_msgs) override
+    {
+        for (auto &bp : push_msgs)
+            msgs.push_back(buf_to_string(*bp));
+    }
+
+    void stop() override
+    {
+    }
+    void auth_failed(const std::string &, const std::string &) override
+    {
+    }
+    void push_halt_restart_msg(const HaltRestart::Type, const std::string &, const std::string &) override
+    {
+    }
+    void post_cc_msg(BufferPtr &&) override
+    {
+    }
+    void schedule_disconnect(const unsigned int) override
+    {
+    }
+    void schedule_auth_pending_timeout(const unsigned int) override
+    {
+    }
+    void relay(const IP::Addr &, const int) override
+    {
+    }
+    PeerStats stats_poll() override
+    {
+        return PeerStats();
+    }
+    bool should_preserve_session_id() override
+    {
+        return false;
+    }
+    TunClientInstance::NativeHandle tun_native_handle() override
+    {
+        return TunClientInstance::NativeHandle();
+    }
+};
+
+} // namespace
+
+// one compiled push list serves the sessions of several clients
+TEST(continuation, compiled_push_list_sessions)
+{
+    std::vector<std::string> common;
+    for (int i = 0; i < 100; ++i)
+        common.push_back("route 10.0." + std::to_string(i) + ".0 255.255.255.0");
+    const CompiledPushList::Ptr cpl(new CompiledPushList(common, "PUSH_REPLY"));
+
+    for (const std::string addr : {"10.8.0.2", "10.8.0.3"})
+    {
+        const std::vector<std::string> tail = {"ifconfig " + addr + " 255.255.255.0"};
+        RCPtr<PushRecv> recv(new PushRecv);
+        recv->push_reply_compiled(*cpl, tail);
+
+        std::vector<std::string> expect;
+        for (const auto &bp : fragment_push_list(common, tail, "PUSH_REPLY"))
+            expect.push_back(buf_to_string(*bp));
+        EXPECT_GT(expect.size(), 1u);
+        EXPECT_EQ(recv->msgs, expect);
+    }
+}
+
+// Cost of producing the push messages for one client, for a push list
+// that fragments into several messages
+TEST(continuation, DISABLED_compiled_push_list_perf)
+{
+    std::vector<std::string> common;
+    for (int i = 0; i < 300; ++i)
+        common.push_back("route 10." + std::to_string(i / 256) + '.' + std::to_string(i % 256) + ".0 255.255.255.0");
+    common.push_back("dhcp-option DNS 10.0.0.1");
+    common.push_back("redirect-gateway def1");
+    const std::vector<std::string> tail = {"ifconfig 10.8.0.2 255.255.255.0", "peer-id 7", "auth-token SESS_ID_AT_0123456789abcdef"};
+
+    const int n = 2000;
+    size_t check = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i)
+        check += fragment_push_list(common, tail, "PUSH_REPLY").size();
+    auto t1 = std::chrono::steady_clock::now();
+    const CompiledPushList cpl(common, "PUSH_REPLY");
+    for (int i = 0; i < n; ++i)
+        check -= cpl.render(tail).size();
+    auto t2 = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(check, 0u);
+    const std::chrono::duration<double, std::micro> rebuild = (t1 - t0) / n;
+    const std::chrono::duration<double, std::micro> compiled = (t2 - t1) / n;
+    std::cout << "push reply per client: rebuild=" << rebuild.count() << "us compiled="
+              << compiled.count() << "us" << std::endl;
+}
@@ -0,0 +1,225 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <sched.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <openvpn/common/runcontext.hpp>
+#include <openvpn/log/sessionstats.hpp>
+#include <openvpn/linux/cpuplace.hpp>
+
+using namespace openvpn;
+using CPUPlace::CPUList;
+namespace fs = std::filesystem;
+
+namespace {
+
+// fake sysfs and procfs trees
+class FakeRoot
+{
+  public:
+    FakeRoot()
+        : root(getTempDirPath("ovpn_cpuplace_" + std::to_string(::getpid())))
+    {
+        fs::remove_all(root);
+        fs::create_directories(root);
+    }
+
+    ~FakeRoot()
+    {
+        fs::remove_all(root);
+    }
+
+    void write(const std::string &fn, const std::string &text) const
+    {
+        const fs::path p = root + fn;
+        fs::create_directories(p.parent_path());
+        std::ofstream(p) << text;
+    }
+
+    void mkdir(const std::string &dir) const
+    {
+        fs::create_directories(root + dir);
+    }
+
+    void symlink(const std::string &target, const std::string &link) const
+    {
+        const fs::path p = root + link;
+        fs::create_directories(p.parent_path());
+        fs::create_directory_symlink(target, p);
+    }
+
+    std::string sys() const
+    {
+        return root + "/sys";
+    }
+
+    std::string proc() const
+    {
+        return root + "/proc";
+    }
+
+  private:
+    std::string root;
+};
+
+struct TestStats : public SessionStats
+{
+    typedef RCPtr<TestStats> Ptr;
+
+    std::string dump() const
+    {
+        return std::string();
+    }
+};
+
+typedef RunContext<ServerThreadBase, TestStats> TestRunContext;
+
+} // namespace
+
+TEST(cpuplace, parse_cpu_list)
+{
+    EXPECT_EQ(CPUPlace::parse_cpu_list("0-3,8,10-11"), CPUList({0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(CPUPlace::parse_cpu_list(" 5,1-2,2 \n"), CPUList({1, 2, 5}));
+    EXPECT_TRUE(CPUPlace::parse_cpu_list("").empty());
+    EXPECT_EQ(CPUPlace::cpu_list_to_string({0, 1, 2, 3, 8, 10, 11}), "0-3,8,10-11");
+    EXPECT_EQ(CPUPlace::cpu_list_to_string({}), "");
+
+    EXPECT_THROW(CPUPlace::parse_cpu_list("a"), CPUPlace::cpu_place_error);
+    EXPECT_THROW(CPUPlace::parse_cpu_list("3-1"), CPUPlace::cpu_place_error);
+    EXPECT_THROW(CPUPlace::parse_cpu_list("1-"), CPUPlace::cpu_place_error);
+}
+
+TEST(cpuplace, cpu_node)
+{
+    FakeRoot fr;
+    fr.mkdir("/sys/devices/system/cpu/cpu0/node0");
+    fr.mkdir("/sys/devices/system/cpu/cpu5/node1");
+    fr.mkdir("/sys/devices/system/cpu/cpu6/topology");
+    EXPECT_EQ(CPUPlace::cpu_node(0, fr.sys()), 0);
+    EXPECT_EQ(CPUPlace::cpu_node(5, fr.sys()), 1);
+    EXPECT_EQ(CPUPlace::cpu_node(6, fr.sys()), -1);
+    EXPECT_EQ(CPUPlace::cpu_node(7, fr.sys()), -1);
+}
+
+TEST(cpuplace, nic_msi_irqs)
+{
+    FakeRoot fr;
+    fr.mkdir("/sys/class/net/eth0/device/msi_irqs/120");
+    fr.mkdir("/sys/class/net/eth0/device/msi_irqs/121");
+    fr.write("/proc/irq/120/effective_affinity_list", "8\n");
+    fr.write("/proc/irq/121/effective_affinity_list", "");
+    fr.write("/proc/irq/121/smp_affinity_list", "9-10\n");
+    EXPECT_EQ(CPUPlace::nic_irqs("eth0", fr.sys(), fr.proc()), std::vector<unsigned int>({120, 121}));
+    EXPECT_EQ(CPUPlace::nic_irq_cpus("eth0", fr.sys(), fr.proc()), CPUList({8, 9, 10}));
+    EXPECT_TRUE(CPUPlace::nic_irq_cpus("eth1", fr.sys(), fr.proc()).empty());
+}
+
+TEST(cpuplace, nic_proc_interrupts)
+{
+    // no MSI vectors, the IRQs are named after the interface or its
+    // bus device in /proc/interrupts
+    FakeRoot fr;
+    fr.mkdir("/sys/devices/virtio3");
+    fr.symlink("../../../devices/virtio3", "/sys/class/net/eth0/device");
+    fr.write("/proc/interrupts",
+             "            CPU0       CPU1\n"
+             " 39:          0          0  PCI-MSIX-0000:00:04.0   0-edge      virtio3-config\n"
+             " 40:         13          2  PCI-MSIX-0000:00:04.0   1-edge      virtio3-input.0\n"
+             " 41:         13          0  PCI-MSIX-0000:00:04.0   2-edge      virtio3-output.0\n"
+             " 42:          0          0  PCI-MSIX-0000:00:05.0   1-edge      virtio30-input.0\n"
+             " 50:          7          0  IR-PCI-MSI 524288-edge      eth0-TxRx-0\n"
+             "NMI:          0          0   Non-maskable interrupts\n");
+    fr.write("/proc/irq/40/effective_affinity_list", "1");
+    fr.write("/proc/irq/41/effective_affinity_list", "0");
+    fr.write("/proc/irq/50/effective_affinity_list", "3");
+    EXPECT_EQ(CPUPlace::nic_irqs("eth0", fr.sys(), fr.proc()), std::vector<unsigned int>({40, 41, 50}));
+    EXPECT_EQ(CPUPlace::nic_irq_cpus("eth0", fr.sys(), fr.proc()), CPUList({0, 1, 3}));
+}
+
+TEST(cpuplace, placement)
+{
+    FakeRoot fr;
+    fr.mkdir("/sys/devices/system/cpu/cpu0/node0");
+
+    CPUPlace::Config config;
+    config.cpus = {0};
+    CPUPlace::Placement p(config, fr.sys(), fr.proc());
+    EXPECT_EQ(p.cpu(0), 0);
+    EXPECT_EQ(p.cpu(3), 0);
+    EXPECT_EQ(p.node(1), 0);
+
+    int status = -1;
+    int cpu = -1;
+    std::thread t([&]()
+                  {
+                      status = p.place_thread(1);
+                      cpu = ::sched_getcpu(); });
+    t.join();
+    EXPECT_EQ(status, 0);
+    EXPECT_EQ(cpu, 0);
+
+    CPUPlace::Config nic;
+    nic.nic = "eth9";
+    EXPECT_THROW(CPUPlace::Placement(nic, fr.sys(), fr.proc()), CPUPlace::cpu_place_error);
+
+    // no CPUs, nothing to do
+    CPUPlace::Placement none{CPUPlace::Config()};
+    EXPECT_EQ(none.cpu(0), -1);
+    EXPECT_EQ(none.place_thread(0), 0);
+}
+
+TEST(cpuplace, incoming_cpu)
+{
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+    EXPECT_TRUE(CPUPlace::set_incoming_cpu(fd, 0));
+    int value = -1;
+    socklen_t len = sizeof(value);
+    ASSERT_EQ(::getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &value, &len), 0);
+    EXPECT_EQ(value, 0);
+    ::close(fd);
+}
+
+TEST(cpuplace, runcontext_thread_load)
+{
+    TestRunContext::Ptr runctx(new TestRunContext());
+    CPUPlace::Config config;
+    config.cpus = {0};
+    runctx->set_placement(config);
+
+    std::vector<TestRunContext::ThreadLoad> load;
+    std::thread t([&]()
+                  {
+                      TestRunContext::ThreadContext thread_ctx(*runctx, 2);
+                      EXPECT_EQ(::sched_getcpu(), 0);
+                      const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+                      while (std::chrono::steady_clock::now() < end)
+                          ;
+                      load = runctx->thread_load(); });
+    t.join();
+
+    ASSERT_EQ(load.size(), 1u);
+    EXPECT_EQ(load[0].unit, 2u);
+    EXPECT_EQ(load[0].cpu, 0);
+    EXPECT_GE(load[0].cpu_seconds, 0.0);
+    EXPECT_GE(load[0].load, 0.0);
+
+    // the thread is gone, so is its load
+    EXPECT_TRUE(runctx->thread_load().empty());
+}
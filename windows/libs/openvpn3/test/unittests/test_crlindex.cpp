@@ -0,0 +1,388 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <openvpn/ssl/sslchoose.hpp>
+#include <openvpn/ssl/sslapi.hpp>
+#include <openvpn/openssl/pki/crlindex.hpp>
+
+// largest CRL used by the benchmark, and handshakes per CRL size
+#ifndef CRL_BENCH_MAX
+#define CRL_BENCH_MAX 200000
+#endif
+#ifndef CRL_BENCH_HANDSHAKES
+#define CRL_BENCH_HANDSHAKES 50
+#endif
+
+using namespace openvpn;
+using OpenSSLPKI::CRLIndex;
+using OpenSSLPKI::CRLStore;
+
+namespace {
+
+struct Free
+{
+    void operator()(EVP_PKEY *p) const
+    {
+        EVP_PKEY_free(p);
+    }
+    void operator()(::X509 *p) const
+    {
+        X509_free(p);
+    }
+    void operator()(X509_CRL *p) const
+    {
+        X509_CRL_free(p);
+    }
+    void operator()(BIO *p) const
+    {
+        BIO_free(p);
+    }
+};
+
+typedef std::unique_ptr<EVP_PKEY, Free> PKey;
+typedef std::unique_ptr<::X509, Free> Cert;
+typedef std::unique_ptr<X509_CRL, Free> CRLObj;
+
+PKey make_key()
+{
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EXPECT_TRUE(ctx && EVP_PKEY_keygen_init(ctx) == 1
+                && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) == 1
+                && EVP_PKEY_keygen(ctx, &key) == 1);
+    EVP_PKEY_CTX_free(ctx);
+    return PKey(key);
+}
+
+void add_ext(::X509 *cert, const int nid, const char *value)
+{
+    X509_EXTENSION *ext = X509V3_EXT_conf_nid(nullptr, nullptr, nid, value);
+    ASSERT_TRUE(ext);
+    X509_add_ext(cert, ext, -1);
+    X509_EXTENSION_free(ext);
+}
+
+// self-signed CA if issuer is null
+Cert make_cert(const std::string &cn, EVP_PKEY *key, const long serial, ::X509 *issuer, EVP_PKEY *issuer_key)
+{
+    Cert cert(X509_new());
+    X509_set_version(cert.get(), 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), serial);
+    X509_gmtime_adj(X509_getm_notBefore(cert.get()), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(cert.get()), 86400);
+    X509_NAME *name = X509_get_subject_name(cert.get());
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>(cn.c_str()), -1, -1, 0);
+    X509_set_issuer_name(cert.get(), issuer ? X509_get_subject_name(issuer) : name);
+    X509_set_pubkey(cert.get(), key);
+    if (!issuer)
+    {
+        add_ext(cert.get(), NID_basic_constraints, "critical,CA:TRUE");
+        add_ext(cert.get(), NID_key_usage, "critical,keyCertSign,cRLSign");
+    }
+    X509_sign(cert.get(), issuer ? issuer_key : key, EVP_sha256());
+    return cert;
+}
+
+// n filler entries, plus the given serials
+CRLObj make_crl(::X509 *issuer, EVP_PKEY *key, const size_t n, const std::vector<long> &serials = {}, const long next_update = 3600, const long last_update = -60)
+{
+    CRLObj crl(X509_CRL_new());
+    X509_CRL_set_version(crl.get(), 1);
+    X509_CRL_set_issuer_name(crl.get(), X509_get_subject_name(issuer));
+    ASN1_TIME *t = X509_gmtime_adj(nullptr, next_update);
+    X509_CRL_set1_nextUpdate(crl.get(), t);
+    X509_gmtime_adj(t, last_update);
+    X509_CRL_set1_lastUpdate(crl.get(), t);
+    std::vector<std::uint64_t> all(serials.begin(), serials.end());
+    for (size_t i = 0; i < n; ++i)
+        all.push_back(0x1000000000ull + i * 7919);
+    for (const auto s : all)
+    {
+        X509_REVOKED *r = X509_REVOKED_new();
+        ASN1_INTEGER *ai = ASN1_INTEGER_new();
+        ASN1_INTEGER_set_uint64(ai, s);
+        X509_REVOKED_set_serialNumber(r, ai);
+        X509_REVOKED_set_revocationDate(r, t);
+        X509_CRL_add0_revoked(crl.get(), r);
+        ASN1_INTEGER_free(ai);
+    }
+    ASN1_TIME_free(t);
+    X509_CRL_sort(crl.get());
+    X509_CRL_sign(crl.get(), key, EVP_sha256());
+    return crl;
+}
+
+template <typename WRITE>
+std::string pem(WRITE write)
+{
+    std::unique_ptr<BIO, Free> bio(BIO_new(BIO_s_mem()));
+    write(bio.get());
+    char *data = nullptr;
+    const long len = BIO_get_mem_data(bio.get(), &data);
+    return std::string(data, size_t(len));
+}
+
+std::string pem(::X509 *cert)
+{
+    return pem([cert](BIO *b)
+               { PEM_write_bio_X509(b, cert); });
+}
+
+std::string pem(X509_CRL *crl)
+{
+    return pem([crl](BIO *b)
+               { PEM_write_bio_X509_CRL(b, crl); });
+}
+
+std::string pem(EVP_PKEY *key)
+{
+    return pem([key](BIO *b)
+               { PEM_write_bio_PrivateKey(b, key, nullptr, nullptr, 0, nullptr, nullptr); });
+}
+
+OpenSSLPKI::X509List x509_list(const std::string &pem_txt)
+{
+    OpenSSLPKI::X509List ret;
+    CRLIndex::CertCRLList::from_string(pem_txt, "ca", &ret, nullptr);
+    return ret;
+}
+
+struct PKI
+{
+    PKI()
+        : ca_key(make_key()),
+          ca(make_cert("Test CA", ca_key.get(), 1, nullptr, nullptr)),
+          leaf_key(make_key()),
+          revoked(make_cert("revoked", leaf_key.get(), 1001, ca.get(), ca_key.get())),
+          good(make_cert("good", leaf_key.get(), 1002, ca.get(), ca_key.get()))
+    {
+    }
+
+    PKey ca_key;
+    Cert ca;
+    PKey leaf_key;
+    Cert revoked;
+    Cert good;
+};
+
+SSLLib::SSLAPI::Config::Ptr make_config(const bool server, const PKI &pki, ::X509 *cert)
+{
+    static Frame::Ptr frame(new Frame(Frame::Context(128, 4096, 4096 - 128, 0, 16, BufAllocFlags::NO_FLAGS)));
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    config->set_rng(StrongRandomAPI::Ptr(new SSLLib::RandomAPI()));
+    config->set_mode(Mode(server ? Mode::SERVER : Mode::CLIENT));
+    config->load_cert(pem(cert));
+    config->load_private_key(pem(pki.leaf_key.get()));
+    config->load_ca(pem(pki.ca.get()), false);
+    config->set_frame(frame);
+    return config;
+}
+
+// true if the handshake completes and data gets through
+bool handshake(SSLFactoryAPI &client_factory, SSLFactoryAPI &server_factory)
+{
+    SSLAPI::Ptr client = client_factory.ssl();
+    SSLAPI::Ptr server = server_factory.ssl();
+    try
+    {
+        client->start_handshake();
+        server->start_handshake();
+        char msg[] = "ping";
+        bool sent = false;
+        unsigned char buf[64];
+        for (int i = 0; i < 20; ++i)
+        {
+            // retried until the handshake is done
+            if (!sent)
+                sent = client->write_cleartext_unbuffered(msg, 4) == 4;
+            while (client->read_ciphertext_ready())
+                server->write_ciphertext(client->read_ciphertext());
+            if (server->read_cleartext(buf, sizeof(buf)) == 4)
+                return true;
+            while (server->read_ciphertext_ready())
+                client->write_ciphertext(server->read_ciphertext());
+            client->read_cleartext(buf, sizeof(buf));
+        }
+    }
+    catch (const std::exception &)
+    {
+    }
+    return false;
+}
+
+double elapsed_ms(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+TEST(crlindex, lookup)
+{
+    const PKI pki;
+    const OpenSSLPKI::X509List ca = x509_list(pem(pki.ca.get()));
+    const CRLObj crl = make_crl(pki.ca.get(), pki.ca_key.get(), 1000, {1001});
+    OpenSSLPKI::CRLList crls;
+    crls.emplace_back(pem(crl.get()));
+
+    const CRLIndex::Ptr idx = CRLIndex::build(crls, ca);
+    EXPECT_EQ(idx->n_crls(), 1u);
+    EXPECT_EQ(idx->size(), 1001u);
+    const std::time_t now = std::time(nullptr);
+    EXPECT_EQ(idx->check(pki.revoked.get(), now), CRLIndex::REVOKED);
+    EXPECT_EQ(idx->check(pki.good.get(), now), CRLIndex::GOOD);
+    EXPECT_EQ(idx->check(pki.ca.get(), now), CRLIndex::GOOD);
+    EXPECT_EQ(idx->check(pki.good.get(), now + 7200), CRLIndex::CRL_EXPIRED);
+    EXPECT_EQ(idx->check(pki.good.get(), now - 3600), CRLIndex::CRL_NOT_YET_VALID);
+    EXPECT_EQ(CRLIndex::x509_error(CRLIndex::REVOKED), X509_V_ERR_CERT_REVOKED);
+
+    // cert from another CA
+    const PKey other_key = make_key();
+    const Cert other_ca = make_cert("Other CA", other_key.get(), 1, nullptr, nullptr);
+    const Cert other = make_cert("other", pki.leaf_key.get(), 1001, other_ca.get(), other_key.get());
+    EXPECT_EQ(idx->check(other.get(), now), CRLIndex::NO_CRL);
+
+    // CRL not signed by a known CA
+    const CRLObj forged = make_crl(pki.ca.get(), other_key.get(), 0, {1002});
+    EXPECT_THROW(CRLIndex::build(pem(forged.get()), ca), CRLIndex::crl_index_error);
+    EXPECT_THROW(CRLIndex::build(pem(crl.get()), x509_list(pem(other_ca.get()))), CRLIndex::crl_index_error);
+}
+
+TEST(crlindex, incremental_rebuild)
+{
+    const PKI pki;
+    const PKey key2 = make_key();
+    const Cert ca2 = make_cert("Test CA 2", key2.get(), 2, nullptr, nullptr);
+    const OpenSSLPKI::X509List ca = x509_list(pem(pki.ca.get()) + pem(ca2.get()));
+
+    const std::string crl1 = pem(make_crl(pki.ca.get(), pki.ca_key.get(), 100, {1001}).get());
+    const std::string crl2 = pem(make_crl(ca2.get(), key2.get(), 100).get());
+    const CRLIndex::Ptr a = CRLIndex::build(crl1 + crl2, ca);
+    EXPECT_EQ(a->n_crls(), 2u);
+
+    // only the changed CRL is rebuilt
+    const std::string crl2_new = pem(make_crl(ca2.get(), key2.get(), 200).get());
+    const CRLIndex::Ptr b = CRLIndex::build(crl1 + crl2_new, ca, a.get());
+    EXPECT_TRUE(b->shares_table(*a, X509_get_subject_name(pki.ca.get())));
+    EXPECT_FALSE(b->shares_table(*a, X509_get_subject_name(ca2.get())));
+    EXPECT_EQ(b->size(), 301u);
+
+    // the most recent CRL of an issuer wins
+    const std::string crl1_new = pem(make_crl(pki.ca.get(), pki.ca_key.get(), 100, {}, 3600, -30).get());
+    const CRLIndex::Ptr c = CRLIndex::build(crl1 + crl1_new, ca);
+    EXPECT_EQ(c->n_crls(), 1u);
+    EXPECT_EQ(c->check(pki.revoked.get(), std::time(nullptr)), CRLIndex::GOOD);
+}
+
+TEST(crlindex, store_background_reload)
+{
+    const PKI pki;
+    CRLStore::Ptr store(new CRLStore(x509_list(pem(pki.ca.get()))));
+    const std::time_t now = std::time(nullptr);
+    EXPECT_EQ(store->check(pki.good.get(), now), CRLIndex::NO_CRL);
+
+    store->reload_background(pem(make_crl(pki.ca.get(), pki.ca_key.get(), 1000, {1001}).get()));
+    store->wait();
+    EXPECT_EQ(store->check(pki.revoked.get(), now), CRLIndex::REVOKED);
+    const CRLIndex::Ptr before = store->index();
+
+    // a bad CRL keeps the current index
+    store->reload_background("-----BEGIN X509 CRL-----\ngarbage\n-----END X509 CRL-----\n");
+    store->wait();
+    EXPECT_EQ(store->index(), before);
+    EXPECT_EQ(store->stats().failures, 1u);
+    EXPECT_FALSE(store->stats().last_error.empty());
+
+    // back-to-back reloads end with the last one
+    for (int i = 0; i < 5; ++i)
+        store->reload_background(pem(make_crl(pki.ca.get(), pki.ca_key.get(), 10, {1001}).get()));
+    const std::string last = pem(make_crl(pki.ca.get(), pki.ca_key.get(), 10, {}).get());
+    store->reload_background(last);
+    store->wait();
+    EXPECT_EQ(store->check(pki.revoked.get(), now), CRLIndex::GOOD);
+    EXPECT_GE(store->stats().reloads, 2u);
+}
+
+TEST(crlindex, handshake)
+{
+    const PKI pki;
+    CRLStore::Ptr store(new CRLStore(x509_list(pem(pki.ca.get()))));
+    store->reload(pem(make_crl(pki.ca.get(), pki.ca_key.get(), 1000, {1001}).get()));
+
+    SSLLib::SSLAPI::Config::Ptr server_config = make_config(true, pki, pki.good.get());
+    server_config->set_crl_store(store);
+    SSLFactoryAPI::Ptr server = server_config->new_factory();
+    SSLFactoryAPI::Ptr good_client = make_config(false, pki, pki.good.get())->new_factory();
+    SSLFactoryAPI::Ptr revoked_client = make_config(false, pki, pki.revoked.get())->new_factory();
+
+    EXPECT_TRUE(handshake(*good_client, *server));
+    EXPECT_FALSE(handshake(*revoked_client, *server));
+
+    // reloading the store affects the existing server context
+    store->reload(pem(make_crl(pki.ca.get(), pki.ca_key.get(), 1000).get()));
+    EXPECT_TRUE(handshake(*revoked_client, *server));
+}
+
+TEST(crlindex, DISABLED_bench)
+{
+    const PKI pki;
+    const std::string ca_pem = pem(pki.ca.get());
+    SSLFactoryAPI::Ptr client = make_config(false, pki, pki.good.get())->new_factory();
+
+    for (const size_t n : {size_t(0), size_t(1000), size_t(10000), size_t(CRL_BENCH_MAX)})
+    {
+        const std::string crl = pem(make_crl(pki.ca.get(), pki.ca_key.get(), n, {1001}).get());
+
+        // CRL in the cert store: reload means a new SSL context
+        auto t = std::chrono::steady_clock::now();
+        SSLLib::SSLAPI::Config::Ptr store_config = make_config(true, pki, pki.good.get());
+        store_config->load_crl(crl);
+        SSLFactoryAPI::Ptr store_server = store_config->new_factory();
+        const double store_reload_ms = elapsed_ms(t);
+
+        // CRL index
+        t = std::chrono::steady_clock::now();
+        CRLStore::Ptr crl_store(new CRLStore(x509_list(ca_pem)));
+        crl_store->reload(crl);
+        const double index_reload_ms = elapsed_ms(t);
+        SSLLib::SSLAPI::Config::Ptr index_config = make_config(true, pki, pki.good.get());
+        index_config->set_crl_store(crl_store);
+        SSLFactoryAPI::Ptr index_server = index_config->new_factory();
+
+        double rate[2];
+        SSLFactoryAPI *servers[2] = {store_server.get(), index_server.get()};
+        for (int s = 0; s < 2; ++s)
+        {
+            t = std::chrono::steady_clock::now();
+            int ok = 0;
+            for (int i = 0; i < CRL_BENCH_HANDSHAKES; ++i)
+                ok += handshake(*client, *servers[s]);
+            rate[s] = CRL_BENCH_HANDSHAKES * 1000.0 / elapsed_ms(t);
+            EXPECT_EQ(ok, CRL_BENCH_HANDSHAKES);
+        }
+
+        std::cerr << "*** crlindex entries=" << n
+                  << " handshakes/s x509_store=" << rate[0] << " index=" << rate[1]
+                  << " reload_ms x509_store=" << store_reload_ms << " index=" << index_reload_ms << std::endl;
+    }
+}
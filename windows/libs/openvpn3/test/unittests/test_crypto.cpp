@@ -21,6 +21,9 @@
 #include <openvpn/crypto/data_epoch.hpp>
 #include <openvpn/crypto/cryptodcsel.hpp>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <vector>
 
 
 static uint8_t testkey[20] = {0x0b, 0x00};
@@ -91,7 +94,9 @@ static openvpn::Frame::Context frame_ctx()
 }
 
 
-openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch)
+openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch,
+                                                      openvpn::CryptoAlgs::Type cipher = openvpn::CryptoAlgs::AES_256_GCM,
+                                                      openvpn::CryptoAlgs::Type digest = openvpn::CryptoAlgs::NONE)
 {
     openvpn::CryptoDCInstance::Ptr cryptodc;
     auto frameptr = openvpn::Frame::Ptr{new openvpn::Frame{frame_ctx()}};
@@ -99,11 +104,13 @@ openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch)
 
 
     openvpn::CryptoDCSettingsData dc;
-    dc.set_cipher(openvpn::CryptoAlgs::AES_256_GCM);
+    dc.set_cipher(cipher);
+    dc.set_digest(digest);
     dc.set_use_epoch_keys(use_epoch);
 
     openvpn::SSLLib::Ctx libctx = nullptr;
-    openvpn::CryptoDCFactory::Ptr dc_factory_sel{new openvpn::CryptoDCSelect<openvpn::SSLLib::CryptoAPI>(libctx, frameptr, statsptr, nullptr)};
+    openvpn::StrongRandomAPI::Ptr rng{new FakeSecureRand{0x42}};
+    openvpn::CryptoDCFactory::Ptr dc_factory_sel{new openvpn::CryptoDCSelect<openvpn::SSLLib::CryptoAPI>(libctx, frameptr, statsptr, rng)};
 
     auto dc_factory = dc_factory_sel->new_obj(dc);
 
@@ -514,6 +521,10 @@ public:
 
     openvpn::EpochDataChannelCryptoContext &retire_() { return retiring_decrypt_ctx; }
 
+    openvpn::EpochDataChannelCryptoContext &next_send_ctx_() { return next_encrypt_ctx; }
+
+    std::size_t future_keys_size_() const { return future_keys.size(); }
+
 };
 
 class EpochTest :  public testing::Test
@@ -527,13 +538,18 @@ protected:
     }
 
     void initDCE(uint16_t numfuture)
+    {
+        dce_ = createDCE(numfuture);
+    }
+
+    static DataChannelEpochTest createDCE(uint16_t numfuture)
     {
         uint8_t e1send_data[32] = { 0x23 };
         uint8_t e1recv_data[32] = { 0x27 };
         openvpn::StaticKey e1send{e1send_data, sizeof (e1send_data)};
         openvpn::StaticKey e1recv{e1send_data, sizeof (e1recv_data)};
 
-        dce_ = DataChannelEpochTest{openvpn::CryptoAlgs::AES_256_GCM, std::move(e1send), std::move(e1recv), numfuture};
+        return DataChannelEpochTest{openvpn::CryptoAlgs::AES_256_GCM, std::move(e1send), std::move(e1recv), numfuture};
     }
 
     DataChannelEpochTest dce_;
@@ -685,4 +701,206 @@ TEST_F(EpochTest, key_overflow)
     EXPECT_EQ(dce_.lookup_decrypt_key( UINT16_MAX - 33)->epoch, UINT16_MAX - 33);
     EXPECT_EQ(dce_.lookup_decrypt_key(UINT16_MAX - 32), nullptr);
     EXPECT_EQ(dce_.lookup_decrypt_key(UINT16_MAX), nullptr);
-}
\ No newline at end of file
+}
+
+TEST_F(EpochTest, prepared_send_key)
+{
+    /* key derived in advance must match the one derived on demand */
+    DataChannelEpochTest inline_dce = createDCE(13);
+    inline_dce.iterate_send_key();
+
+    dce_.prepare_keys();
+    EXPECT_EQ(dce_.next_send_ctx_().epoch, 2);
+    EXPECT_EQ(dce_.send_ctx_().epoch, 1);
+
+    dce_.iterate_send_key();
+    EXPECT_EQ(dce_.send_ctx_().epoch, 2);
+    EXPECT_EQ(dce_.send_().epoch, 2);
+    EXPECT_EQ(dce_.next_send_ctx_().epoch, 0);
+    EXPECT_EQ(dce_.send_ctx_().implicit_iv, inline_dce.send_ctx_().implicit_iv);
+    EXPECT_EQ(dce_.send_().keydata, inline_dce.send_().keydata);
+
+    /* without preparing, the switch still works */
+    dce_.iterate_send_key();
+    EXPECT_EQ(dce_.send_ctx_().epoch, 3);
+
+    /* a prepared key that has been overtaken is not used */
+    dce_.prepare_keys();
+    openvpn::SessionStats::Ptr stats{new openvpn::SessionStats{}};
+    dce_.replace_update_recv_key(6, stats);
+    EXPECT_EQ(dce_.send_ctx_().epoch, 6);
+    dce_.iterate_send_key();
+    EXPECT_EQ(dce_.send_ctx_().epoch, 7);
+}
+
+TEST_F(EpochTest, deferred_receive_keys)
+{
+    openvpn::SessionStats::Ptr stats{new openvpn::SessionStats{}};
+    EXPECT_EQ(dce_.future_keys_size_(), 13u);
+
+    /* switching the receive epoch only drops keys */
+    dce_.replace_update_recv_key(5, stats);
+    EXPECT_EQ(dce_.recv_ctx_().epoch, 5);
+    EXPECT_EQ(dce_.future_keys_size_(), 9u);
+
+    /* and the window is topped up outside of the packet path */
+    dce_.prepare_keys();
+    EXPECT_EQ(dce_.future_keys_size_(), 13u);
+    EXPECT_EQ(dce_.get_future_key(12).epoch, 18);
+
+    /* or on demand when a packet from further ahead arrives first */
+    dce_.replace_update_recv_key(10, stats);
+    EXPECT_EQ(dce_.future_keys_size_(), 8u);
+    EXPECT_EQ(dce_.lookup_decrypt_key(21)->epoch, 21);
+    EXPECT_EQ(dce_.future_keys_size_(), 11u);
+    EXPECT_EQ(dce_.lookup_decrypt_key(23)->epoch, 23);
+    EXPECT_EQ(dce_.lookup_decrypt_key(24), nullptr);
+}
+
+/* Per-packet encrypt+decrypt latency while the sender moves to a new
+ * epoch every few packets, with and without deriving the keys in advance */
+static std::vector<double> epoch_switch_latencies(bool prepare)
+{
+    openvpn::CryptoDCInstance::Ptr send = create_dctest_instance(true);
+    openvpn::CryptoDCInstance::Ptr recv = create_dctest_instance(true);
+    auto *epochsend = dynamic_cast<openvpn::AEADEpoch::Crypto<openvpn::SSLLib::CryptoAPI> *>(send.get());
+
+    const unsigned char op32[]{7, 0, 0, 23};
+    const int packets = 20000;
+    const int packets_per_epoch = 50;
+    std::vector<double> ret;
+    ret.reserve(packets);
+
+    openvpn::BufferAllocated work{2048};
+    for (int i = 0; i < packets; ++i)
+    {
+        if (prepare)
+        {
+            /* what ProtoContext::housekeeping() does between packets */
+            send->prepare_keys();
+            recv->prepare_keys();
+        }
+
+        work.reset(128, 2048, openvpn::BufAllocFlags::NO_FLAGS);
+        std::memset(work.write_alloc(1400), 'x', 1400);
+
+        const auto start = std::chrono::steady_clock::now();
+        if (i % packets_per_epoch == packets_per_epoch - 1)
+            epochsend->increase_send_epoch();
+        send->encrypt(work, op32);
+        const auto ret_decrypt = recv->decrypt(work, 42, op32);
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(ret_decrypt, openvpn::Error::SUCCESS);
+        ret.push_back(elapsed.count());
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+TEST(crypto, DISABLED_epoch_switch_latency)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, true, false);
+
+    for (bool prepare : {false, true})
+    {
+        const std::vector<double> lat = epoch_switch_latencies(prepare);
+        auto pct = [&lat](double p)
+        { return lat[static_cast<std::size_t>(p * double(lat.size() - 1))]; };
+        std::cout << "epoch switch latency (" << (prepare ? "prepared" : "inline") << ", us): "
+                  << "p50=" << pct(0.5) << " p99=" << pct(0.99) << " p99.9=" << pct(0.999)
+                  << " max=" << lat.back() << std::endl;
+    }
+}
+
+/* Encrypt the same packets with CBC+HMAC once in a buffer with enough
+ * headroom and tailroom to be processed in place, and once in a buffer
+ * without, which forces the copy through the work buffer.  Only crypto
+ * libraries that allow in == out process packets in place. */
+TEST(crypto, dccbc_hmac_in_place)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, false, false);
+
+    openvpn::CryptoDCInstance::Ptr inplace = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA256);
+    openvpn::CryptoDCInstance::Ptr copy = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA256);
+
+    const unsigned char op32[]{7, 0, 0, 23};
+    const bool in_place = openvpn::SSLLib::CryptoAPI::CipherContext::SUPPORTS_IN_PLACE;
+
+    for (size_t len : {1, 15, 16, 17, 100, 1400})
+    {
+        std::vector<uint8_t> plain(len);
+        for (size_t i = 0; i < len; ++i)
+            plain[i] = static_cast<uint8_t>(i * 7 + len);
+
+        openvpn::BufferAllocated a{2048, openvpn::BufAllocFlags::NO_FLAGS};
+        a.realign(128);
+        std::memcpy(a.write_alloc(len), plain.data(), len);
+        const unsigned char *a_mem = a.c_data_raw();
+
+        /* only room for the packet ID */
+        openvpn::BufferAllocated b{4 + len, openvpn::BufAllocFlags::NO_FLAGS};
+        b.realign(4);
+        std::memcpy(b.write_alloc(len), plain.data(), len);
+
+        inplace->encrypt(a, op32);
+        copy->encrypt(b, op32);
+
+        /* 32 bytes HMAC + 16 bytes IV + ciphertext of packet ID and payload */
+        EXPECT_EQ(a.size(), 32 + 16 + ((4 + len) / 16 + 1) * 16);
+        ASSERT_EQ(a.size(), b.size());
+        EXPECT_EQ(std::memcmp(a.c_data(), b.c_data(), a.size()), 0);
+        EXPECT_EQ(a.c_data_raw() == a_mem, in_place);
+
+        EXPECT_EQ(inplace->decrypt(a, 42, op32), openvpn::Error::SUCCESS);
+        EXPECT_EQ(copy->decrypt(b, 42, op32), openvpn::Error::SUCCESS);
+        EXPECT_EQ(a.c_data_raw() == a_mem, in_place);
+        ASSERT_EQ(a.size(), len);
+        ASSERT_EQ(b.size(), len);
+        EXPECT_EQ(std::memcmp(a.c_data(), plain.data(), len), 0);
+        EXPECT_EQ(std::memcmp(b.c_data(), plain.data(), len), 0);
+    }
+
+    /* a corrupted packet must still be rejected by the HMAC check */
+    openvpn::BufferAllocated c{2048, openvpn::BufAllocFlags::NO_FLAGS};
+    c.realign(128);
+    std::memset(c.write_alloc(100), 'x', 100);
+    inplace->encrypt(c, op32);
+    c.data()[c.size() - 1] ^= 1;
+    EXPECT_EQ(inplace->decrypt(c, 42, op32), openvpn::Error::HMAC_ERROR);
+}
+
+static double cbc_hmac_throughput(bool in_place)
+{
+    openvpn::CryptoDCInstance::Ptr send = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA256);
+    openvpn::CryptoDCInstance::Ptr recv = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA256);
+
+    const unsigned char op32[]{7, 0, 0, 23};
+    const size_t len = 1400;
+    const int packets = 20000;
+
+    openvpn::BufferAllocated work{2048};
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < packets; ++i)
+    {
+        if (in_place)
+            work.reset(128, 2048, openvpn::BufAllocFlags::NO_FLAGS);
+        else
+            work.reset(4, 4 + len, openvpn::BufAllocFlags::NO_FLAGS);
+        std::memset(work.write_alloc(len), 'x', len);
+        send->encrypt(work, op32);
+        EXPECT_EQ(recv->decrypt(work, 42, op32), openvpn::Error::SUCCESS);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return double(len) * packets / elapsed.count() / 1e6;
+}
+
+TEST(crypto, DISABLED_dccbc_hmac_throughput)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, false, false);
+
+    const double copy = cbc_hmac_throughput(false);
+    const double inplace = cbc_hmac_throughput(true);
+    std::cout << "AES-256-CBC/HMAC-SHA256 encrypt+decrypt, 1400 byte packets: "
+              << "copy=" << copy << " MB/s in-place=" << inplace << " MB/s" << std::endl;
+}
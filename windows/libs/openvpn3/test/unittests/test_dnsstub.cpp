@@ -0,0 +1,589 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <iomanip>
+
+#include <openvpn/client/dnsstub.hpp>
+#include <openvpn/frame/frame_init.hpp>
+
+using namespace openvpn;
+using namespace openvpn::DnsStub;
+
+namespace {
+
+typedef std::vector<std::uint8_t> Bytes;
+
+const IP::Addr client4 = IP::Addr::from_string("10.8.0.2");
+const IP::Addr server4 = IP::Addr::from_string("10.8.0.1");
+const IP::Addr client6 = IP::Addr::from_string("fd00::1000");
+const IP::Addr server6 = IP::Addr::from_string("fd00::53");
+
+enum
+{
+    TYPE_A = 1,
+    TYPE_AAAA = 28,
+    RCODE_SERVFAIL = 2,
+};
+
+void put16(Bytes &b, const unsigned int v)
+{
+    b.push_back(std::uint8_t(v >> 8));
+    b.push_back(std::uint8_t(v));
+}
+
+void put32(Bytes &b, const std::uint32_t v)
+{
+    put16(b, v >> 16);
+    put16(b, v & 0xffff);
+}
+
+void put_name(Bytes &b, const std::string &name)
+{
+    size_t begin = 0;
+    while (begin < name.size())
+    {
+        size_t end = name.find('.', begin);
+        if (end == std::string::npos)
+            end = name.size();
+        b.push_back(std::uint8_t(end - begin));
+        b.insert(b.end(), name.begin() + begin, name.begin() + end);
+        begin = end + 1;
+    }
+    b.push_back(0);
+}
+
+Bytes make_query(const std::uint16_t id, const std::string &name, const unsigned int type = TYPE_A, const bool dnssec_ok = false)
+{
+    Bytes b;
+    put16(b, id);
+    put16(b, 0x0100); // RD
+    put16(b, 1);
+    put16(b, 0);
+    put16(b, 0);
+    put16(b, 1);
+    put_name(b, name);
+    put16(b, type);
+    put16(b, 1);
+
+    // OPT
+    b.push_back(0);
+    put16(b, Message::TYPE_OPT);
+    put16(b, 1232);
+    put16(b, 0);
+    put16(b, dnssec_ok ? Message::EDNS_DO : 0);
+    put16(b, 0);
+    return b;
+}
+
+struct Record
+{
+    unsigned int type;
+    std::uint32_t ttl;
+};
+
+// A response to make_query(), answers compressed against the question
+// name, or with an SOA in the authority section if soa_minimum is set.
+Bytes make_response(const std::uint16_t id,
+                    const std::string &name,
+                    const unsigned int rcode,
+                    const std::vector<Record> &answers,
+                    const std::uint32_t soa_ttl = 0,
+                    const std::uint32_t soa_minimum = 0,
+                    const unsigned int extra_flags = 0)
+{
+    Bytes b;
+    put16(b, id);
+    put16(b, 0x8180 | extra_flags | rcode);
+    put16(b, 1);
+    put16(b, unsigned(answers.size()));
+    put16(b, soa_minimum ? 1 : 0);
+    put16(b, 1);
+    put_name(b, name);
+    put16(b, answers.empty() ? TYPE_A : answers[0].type);
+    put16(b, 1);
+    for (const auto &a : answers)
+    {
+        put16(b, 0xc00c);
+        put16(b, a.type);
+        put16(b, 1);
+        put32(b, a.ttl);
+        const size_t len = a.type == TYPE_AAAA ? 16 : 4;
+        put16(b, unsigned(len));
+        for (size_t i = 0; i < len; ++i)
+            b.push_back(std::uint8_t(i + 1));
+    }
+    if (soa_minimum)
+    {
+        put16(b, 0xc00c);
+        put16(b, Message::TYPE_SOA);
+        put16(b, 1);
+        put32(b, soa_ttl);
+        put16(b, 2 + 2 + 20);
+        put16(b, 0xc00c); // mname
+        put16(b, 0xc00c); // rname
+        put32(b, 2024010101);
+        put32(b, 7200);
+        put32(b, 3600);
+        put32(b, 1209600);
+        put32(b, soa_minimum);
+    }
+    b.push_back(0);
+    put16(b, Message::TYPE_OPT);
+    put16(b, 1232);
+    put32(b, 0);
+    put16(b, 0);
+    return b;
+}
+
+// dns in a UDP packet from src:sport to dst:dport
+BufferAllocated make_packet(const IP::Addr &src,
+                            const std::uint16_t sport,
+                            const IP::Addr &dst,
+                            const std::uint16_t dport,
+                            const Bytes &dns)
+{
+    const bool ipv6 = src.is_ipv6();
+    const size_t ip_len = ipv6 ? sizeof(IPv6Header) : sizeof(IPv4Header);
+    const size_t udp_len = sizeof(UDPHeader) + dns.size();
+    BufferAllocated buf(ip_len + udp_len);
+    std::uint8_t *data = buf.write_alloc(ip_len + udp_len);
+    std::memset(data, 0, ip_len);
+    if (ipv6)
+    {
+        IPv6Header *ip = reinterpret_cast<IPv6Header *>(data);
+        ip->version_prio = 6 << 4;
+        ip->payload_len = htons(std::uint16_t(udp_len));
+        ip->nexthdr = IPCommon::UDP;
+        ip->hop_limit = 64;
+        src.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->saddr));
+        dst.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->daddr));
+    }
+    else
+    {
+        IPv4Header *ip = reinterpret_cast<IPv4Header *>(data);
+        ip->version_len = IPv4Header::ver_len(4, sizeof(IPv4Header));
+        ip->tot_len = htons(std::uint16_t(ip_len + udp_len));
+        ip->ttl = 64;
+        ip->protocol = IPCommon::UDP;
+        src.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->saddr));
+        dst.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->daddr));
+    }
+    UDPHeader *udp = reinterpret_cast<UDPHeader *>(data + ip_len);
+    udp->source = htons(sport);
+    udp->dest = htons(dport);
+    udp->len = htons(std::uint16_t(udp_len));
+    udp->check = 0;
+    std::memcpy(data + ip_len + sizeof(UDPHeader), dns.data(), dns.size());
+    return buf;
+}
+
+struct Reply
+{
+    IP::Addr src;
+    IP::Addr dst;
+    std::uint16_t sport;
+    std::uint16_t dport;
+    Bytes dns;
+    bool checksum_ok;
+};
+
+struct Collector : public Link
+{
+    void dns_stub_reply(BufferAllocated &buf) override
+    {
+        Reply r;
+        const std::uint8_t *data = buf.c_data();
+        size_t ip_len;
+        if (IPCommon::version(data[0]) == IPCommon::IPv6)
+        {
+            const IPv6Header *ip = reinterpret_cast<const IPv6Header *>(data);
+            ip_len = sizeof(IPv6Header);
+            r.src = IP::Addr::from_ipv6(IPv6::Addr::from_in6_addr(&ip->saddr));
+            r.dst = IP::Addr::from_ipv6(IPv6::Addr::from_in6_addr(&ip->daddr));
+            EXPECT_EQ(ntohs(ip->payload_len), buf.size() - ip_len);
+            r.checksum_ok = Ping6::csum_ipv6_pseudo(&ip->saddr,
+                                                    &ip->daddr,
+                                                    std::uint32_t(buf.size() - ip_len),
+                                                    IPCommon::UDP,
+                                                    IPChecksum::compute(data + ip_len, buf.size() - ip_len))
+                            == 0;
+        }
+        else
+        {
+            const IPv4Header *ip = reinterpret_cast<const IPv4Header *>(data);
+            ip_len = sizeof(IPv4Header);
+            r.src = IP::Addr::from_ipv4(IPv4::Addr::from_uint32_net(ip->saddr));
+            r.dst = IP::Addr::from_ipv4(IPv4::Addr::from_uint32_net(ip->daddr));
+            EXPECT_EQ(ntohs(ip->tot_len), buf.size());
+            r.checksum_ok = IPChecksum::checksum(data, ip_len) == 0
+                            && udp_checksum(data + ip_len,
+                                            static_cast<unsigned int>(buf.size() - ip_len),
+                                            reinterpret_cast<const std::uint8_t *>(&ip->saddr),
+                                            reinterpret_cast<const std::uint8_t *>(&ip->daddr))
+                                   == 0;
+        }
+        const UDPHeader *udp = reinterpret_cast<const UDPHeader *>(data + ip_len);
+        r.sport = ntohs(udp->source);
+        r.dport = ntohs(udp->dest);
+        EXPECT_EQ(ntohs(udp->len), buf.size() - ip_len);
+        r.dns.assign(data + ip_len + sizeof(UDPHeader), data + buf.size());
+        replies.push_back(std::move(r));
+    }
+
+    std::vector<Reply> replies;
+};
+
+struct Fixture
+{
+    explicit Fixture(const Config &config = Config())
+        : stats(new SessionStats()),
+          stub(new Stub(link, frame_init_simple(2048), stats, config))
+    {
+        DnsOptions dns;
+        DnsServer &s = dns.servers[0];
+        s.addresses.push_back({server4.to_string(), 0});
+        s.addresses.push_back({server6.to_string(), 53});
+        DnsServer &dot = dns.servers[1];
+        dot.addresses.push_back({"10.8.0.9", 0});
+        dot.transport = DnsServer::Transport::TLS;
+        stub->set_servers(dns);
+    }
+
+    bool query(const Bytes &dns, const std::uint16_t sport = 40000, const bool ipv6 = false)
+    {
+        BufferAllocated buf = make_packet(ipv6 ? client6 : client4, sport, ipv6 ? server6 : server4, 53, dns);
+        return stub->query(buf, now);
+    }
+
+    void response(const Bytes &dns, const std::uint16_t dport = 40000, const bool ipv6 = false)
+    {
+        BufferAllocated buf = make_packet(ipv6 ? server6 : server4, 53, ipv6 ? client6 : client4, dport, dns);
+        stub->response(buf, now);
+    }
+
+    Collector link;
+    SessionStats::Ptr stats;
+    Stub::Ptr stub;
+    Time now = Time::now();
+};
+
+std::uint32_t answer_ttl(const Bytes &dns, const size_t i)
+{
+    std::string key;
+    Message::Response r;
+    EXPECT_TRUE(Message::parse_response(dns.data(), dns.size(), key, r));
+    return Message::get32(dns.data() + r.ttl_offsets.at(i));
+}
+
+} // namespace
+
+TEST(dnsstub, parse)
+{
+    std::string key, key2;
+    const Bytes q = make_query(1, "www.Example.com");
+    const size_t end = Message::parse_query(q.data(), q.size(), key);
+    EXPECT_EQ(end, size_t(Message::HEADER_SIZE + 17 + 4));
+    EXPECT_EQ(key.substr(0, 17), std::string("\3www\7example\3com\0", 17));
+
+    // case doesn't matter, type and the DO bit do
+    const Bytes lower = make_query(2, "www.example.com");
+    EXPECT_TRUE(Message::parse_query(lower.data(), lower.size(), key2));
+    EXPECT_EQ(key, key2);
+    const Bytes aaaa = make_query(1, "www.example.com", TYPE_AAAA);
+    EXPECT_TRUE(Message::parse_query(aaaa.data(), aaaa.size(), key2));
+    EXPECT_NE(key, key2);
+    const Bytes dnssec = make_query(1, "www.example.com", TYPE_A, true);
+    EXPECT_TRUE(Message::parse_query(dnssec.data(), dnssec.size(), key2));
+    EXPECT_NE(key, key2);
+
+    // not a standard query
+    Bytes notify = q;
+    notify[2] |= 0x20;
+    std::string bad;
+    EXPECT_FALSE(Message::parse_query(notify.data(), notify.size(), bad));
+    EXPECT_FALSE(Message::parse_query(q.data(), 20, bad));
+
+    Message::Response r;
+    const Bytes a = make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 300}, {TYPE_A, 60}});
+    ASSERT_TRUE(Message::parse_response(a.data(), a.size(), key2, r));
+    EXPECT_EQ(key2, key);
+    EXPECT_TRUE(r.cacheable);
+    EXPECT_FALSE(r.negative);
+    EXPECT_EQ(r.ttl, 60u);
+    EXPECT_EQ(r.ttl_offsets.size(), 2u);
+
+    // negative answers are cached for min(SOA TTL, SOA MINIMUM)
+    const Bytes nx = make_response(1, "www.example.com", Message::NXDOMAIN, {}, 900, 120);
+    ASSERT_TRUE(Message::parse_response(nx.data(), nx.size(), key2, r));
+    EXPECT_TRUE(r.cacheable);
+    EXPECT_TRUE(r.negative);
+    EXPECT_EQ(r.ttl, 120u);
+    const Bytes nodata = make_response(1, "www.example.com", Message::NOERROR, {}, 30, 120);
+    ASSERT_TRUE(Message::parse_response(nodata.data(), nodata.size(), key2, r));
+    EXPECT_TRUE(r.negative);
+    EXPECT_EQ(r.ttl, 30u);
+
+    // without SOA, truncated, failed or with TTL 0 they aren't
+    const Bytes nosoa = make_response(1, "www.example.com", Message::NXDOMAIN, {});
+    ASSERT_TRUE(Message::parse_response(nosoa.data(), nosoa.size(), key2, r));
+    EXPECT_FALSE(r.cacheable);
+    const Bytes tc = make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}, 0, 0, Message::TC);
+    ASSERT_TRUE(Message::parse_response(tc.data(), tc.size(), key2, r));
+    EXPECT_FALSE(r.cacheable);
+    const Bytes servfail = make_response(1, "www.example.com", RCODE_SERVFAIL, {}, 300, 300);
+    ASSERT_TRUE(Message::parse_response(servfail.data(), servfail.size(), key2, r));
+    EXPECT_FALSE(r.cacheable);
+    const Bytes zero = make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 0}});
+    ASSERT_TRUE(Message::parse_response(zero.data(), zero.size(), key2, r));
+    EXPECT_FALSE(r.cacheable);
+
+    // cut off records
+    EXPECT_FALSE(Message::parse_response(a.data(), a.size() - 20, key2, r));
+    EXPECT_FALSE(Message::parse_response(q.data(), q.size(), key2, r));
+}
+
+TEST(dnsstub, hit)
+{
+    for (const bool ipv6 : {false, true})
+    {
+        Fixture f;
+        EXPECT_FALSE(f.query(make_query(0x1111, "www.example.com"), 40000, ipv6));
+        f.response(make_response(0x1111, "www.example.com", Message::NOERROR, {{TYPE_A, 300}, {TYPE_A, 600}}), 40000, ipv6);
+        EXPECT_EQ(f.stub->size(), 1u);
+        EXPECT_TRUE(f.link.replies.empty());
+
+        // answered locally with the ID and spelling of the question,
+        // TTLs count down
+        f.now += Time::Duration::seconds(100);
+        EXPECT_TRUE(f.query(make_query(0x2222, "WWW.example.COM"), 40001, ipv6));
+        ASSERT_EQ(f.link.replies.size(), 1u);
+        const Reply &r = f.link.replies[0];
+        EXPECT_TRUE(r.checksum_ok);
+        EXPECT_EQ(r.src, ipv6 ? server6 : server4);
+        EXPECT_EQ(r.dst, ipv6 ? client6 : client4);
+        EXPECT_EQ(r.sport, 53);
+        EXPECT_EQ(r.dport, 40001);
+        const Bytes expect = make_response(0x2222, "WWW.example.COM", Message::NOERROR, {{TYPE_A, 200}, {TYPE_A, 200}});
+        EXPECT_EQ(r.dns, expect);
+
+        // expired
+        f.now += Time::Duration::seconds(200);
+        EXPECT_FALSE(f.query(make_query(0x3333, "www.example.com"), 40000, ipv6));
+        EXPECT_EQ(f.stub->size(), 0u);
+
+        const Stats &s = f.stub->stats();
+        EXPECT_EQ(s.queries, 3);
+        EXPECT_EQ(s.hits, 1);
+        EXPECT_EQ(s.forwarded, 2);
+        EXPECT_DOUBLE_EQ(s.hit_rate(), 1.0 / 3.0);
+        EXPECT_EQ(f.stats->get_stat(SessionStats::DNS_CACHE_QUERIES), 3);
+        EXPECT_EQ(f.stats->get_stat(SessionStats::DNS_CACHE_HITS), 1);
+        EXPECT_EQ(f.stats->get_stat(SessionStats::DNS_CACHE_FORWARDED), 2);
+    }
+}
+
+TEST(dnsstub, ttl_caps)
+{
+    Config config;
+    config.max_ttl = 60;
+    config.max_negative_ttl = 10;
+    Fixture f(config);
+    f.query(make_query(1, "a.example.com"));
+    f.response(make_response(1, "a.example.com", Message::NOERROR, {{TYPE_A, 86400}}));
+    f.query(make_query(2, "b.example.com"));
+    f.response(make_response(2, "b.example.com", Message::NXDOMAIN, {}, 3600, 3600));
+
+    EXPECT_TRUE(f.query(make_query(3, "a.example.com")));
+    EXPECT_TRUE(f.query(make_query(4, "b.example.com")));
+    ASSERT_EQ(f.link.replies.size(), 2u);
+    EXPECT_EQ(answer_ttl(f.link.replies[0].dns, 0), 60u);
+    EXPECT_EQ(answer_ttl(f.link.replies[1].dns, 0), 10u);
+    EXPECT_EQ(Message::get16(f.link.replies[1].dns.data() + 2) & Message::RCODE_MASK, Message::NXDOMAIN);
+    EXPECT_EQ(f.stub->stats().negative_hits, 1);
+
+    f.now += Time::Duration::seconds(10);
+    EXPECT_TRUE(f.query(make_query(5, "a.example.com")));
+    EXPECT_FALSE(f.query(make_query(6, "b.example.com")));
+}
+
+TEST(dnsstub, not_cached)
+{
+    Fixture f;
+    f.query(make_query(1, "a.example.com"));
+    f.response(make_response(1, "a.example.com", Message::NOERROR, {{TYPE_A, 300}}, 0, 0, Message::TC));
+    f.query(make_query(2, "b.example.com"));
+    f.response(make_response(2, "b.example.com", RCODE_SERVFAIL, {}, 300, 300));
+    f.query(make_query(3, "c.example.com"));
+    f.response(make_response(3, "c.example.com", Message::NXDOMAIN, {}));
+    EXPECT_EQ(f.stub->size(), 0u);
+
+    // responses from anything but a plain DNS server are left alone
+    f.query(make_query(4, "d.example.com"));
+    BufferAllocated dot = make_packet(IP::Addr::from_string("10.8.0.9"), 53, client4, 40000, make_response(4, "d.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    f.stub->response(dot, f.now);
+    BufferAllocated port = make_packet(server4, 5353, client4, 40000, make_response(4, "d.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    f.stub->response(port, f.now);
+    EXPECT_EQ(f.stub->size(), 0u);
+
+    // as are queries to them
+    BufferAllocated q = make_packet(client4, 40000, IP::Addr::from_string("192.0.2.53"), 53, make_query(5, "a.example.com"));
+    EXPECT_FALSE(f.stub->query(q, f.now));
+    EXPECT_EQ(f.stub->stats().queries, 4);
+
+    // and everything else
+    BufferAllocated garbage(64);
+    garbage.write_alloc(64);
+    std::memset(garbage.data(), 0x45, 64);
+    EXPECT_FALSE(f.stub->query(garbage, f.now));
+    f.stub->response(garbage, f.now);
+    EXPECT_TRUE(f.link.replies.empty());
+}
+
+TEST(dnsstub, unsolicited)
+{
+    Fixture f;
+
+    // a response to no query
+    f.response(make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    EXPECT_EQ(f.stub->size(), 0u);
+    EXPECT_FALSE(f.query(make_query(2, "www.example.com")));
+
+    // responses that don't match the pending query in ID, client or question
+    f.response(make_response(3, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    f.response(make_response(2, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}), 40001);
+    f.response(make_response(2, "WWW.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    f.response(make_response(2, "www.example.com", Message::NOERROR, {{TYPE_AAAA, 300}}));
+    EXPECT_EQ(f.stub->size(), 0u);
+    EXPECT_TRUE(f.link.replies.empty());
+
+    // the query is still pending, and its response is cached
+    f.response(make_response(2, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    EXPECT_EQ(f.stub->size(), 1u);
+    EXPECT_TRUE(f.query(make_query(4, "www.example.com")));
+}
+
+TEST(dnsstub, coalesce)
+{
+    Fixture f;
+    EXPECT_FALSE(f.query(make_query(1, "www.example.com"), 40000));
+    EXPECT_TRUE(f.query(make_query(2, "www.EXAMPLE.com"), 40001));
+    EXPECT_TRUE(f.query(make_query(3, "www.example.com"), 40002));
+
+    // a retransmission waits for the answer to the first copy
+    EXPECT_TRUE(f.query(make_query(2, "www.EXAMPLE.com"), 40001));
+    EXPECT_EQ(f.stub->stats().coalesced, 2);
+
+    // a different question doesn't
+    EXPECT_FALSE(f.query(make_query(4, "www.example.com", TYPE_AAAA), 40000));
+
+    f.response(make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    ASSERT_EQ(f.link.replies.size(), 2u);
+    EXPECT_EQ(f.link.replies[0].dport, 40001);
+    EXPECT_EQ(f.link.replies[0].dns, make_response(2, "www.EXAMPLE.com", Message::NOERROR, {{TYPE_A, 300}}));
+    EXPECT_EQ(f.link.replies[1].dport, 40002);
+    EXPECT_EQ(Message::get16(f.link.replies[1].dns.data()), 3);
+
+    // uncacheable responses are handed to the waiters too
+    f.link.replies.clear();
+    EXPECT_FALSE(f.query(make_query(5, "x.example.com"), 40000));
+    EXPECT_TRUE(f.query(make_query(6, "x.example.com"), 40001));
+    f.response(make_response(5, "x.example.com", RCODE_SERVFAIL, {}));
+    ASSERT_EQ(f.link.replies.size(), 1u);
+    EXPECT_EQ(Message::get16(f.link.replies[0].dns.data()), 6);
+
+    // a query that got no answer in time is sent again
+    EXPECT_FALSE(f.query(make_query(7, "y.example.com"), 40000));
+    f.now += Time::Duration::seconds(3);
+    EXPECT_FALSE(f.query(make_query(8, "y.example.com"), 40001));
+    EXPECT_EQ(f.stub->stats().forwarded, 5);
+}
+
+TEST(dnsstub, lru)
+{
+    Config config;
+    config.max_entries = 2;
+    Fixture f(config);
+    for (const char *name : {"a.example.com", "b.example.com"})
+    {
+        f.query(make_query(1, name));
+        f.response(make_response(1, name, Message::NOERROR, {{TYPE_A, 300}}));
+    }
+    EXPECT_TRUE(f.query(make_query(2, "a.example.com")));
+
+    // b is the least recently used
+    f.query(make_query(3, "c.example.com"));
+    f.response(make_response(3, "c.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    EXPECT_EQ(f.stub->size(), 2u);
+    EXPECT_TRUE(f.query(make_query(4, "a.example.com")));
+    EXPECT_TRUE(f.query(make_query(5, "c.example.com")));
+    EXPECT_FALSE(f.query(make_query(6, "b.example.com")));
+}
+
+TEST(dnsstub, servers)
+{
+    Fixture f;
+    f.query(make_query(1, "www.example.com"));
+    f.response(make_response(1, "www.example.com", Message::NOERROR, {{TYPE_A, 300}}));
+    EXPECT_EQ(f.stub->size(), 1u);
+
+    // a PUSH_UPDATE with other servers drops the cache
+    DnsOptions dns;
+    dns.servers[0].addresses.push_back({"10.8.0.10", 0});
+    f.stub->set_servers(dns);
+    EXPECT_TRUE(f.stub->enabled());
+    EXPECT_EQ(f.stub->size(), 0u);
+
+    // no plain servers
+    DnsOptions doh;
+    doh.servers[0].addresses.push_back({"10.8.0.10", 0});
+    doh.servers[0].transport = DnsServer::Transport::HTTPS;
+    f.stub->set_servers(doh);
+    EXPECT_FALSE(f.stub->enabled());
+    EXPECT_FALSE(f.query(make_query(2, "www.example.com")));
+}
+
+// Time to answer a query from the cache, compared to the round trip
+// through the tunnel it saves.
+TEST(dnsstub, DISABLED_bench)
+{
+    typedef std::chrono::steady_clock Clock;
+    Fixture f;
+    const unsigned int names = 1000;
+    for (unsigned int i = 0; i < names; ++i)
+    {
+        const std::string name = "host" + std::to_string(i) + ".example.com";
+        f.query(make_query(std::uint16_t(i), name));
+        f.response(make_response(std::uint16_t(i), name, Message::NOERROR, {{TYPE_A, 300}, {TYPE_A, 300}}));
+    }
+
+    std::vector<BufferAllocated> queries;
+    for (unsigned int i = 0; i < names; ++i)
+        queries.push_back(make_packet(client4, 40000, server4, 53, make_query(std::uint16_t(i), "host" + std::to_string(i) + ".example.com")));
+
+    const int reps = 200;
+    size_t hits = 0;
+    const Clock::time_point begin = Clock::now();
+    for (int r = 0; r < reps; ++r)
+    {
+        for (const auto &q : queries)
+            hits += f.stub->query(q, f.now);
+        f.link.replies.clear();
+    }
+    const double t = std::chrono::duration<double>(Clock::now() - begin).count() / (reps * names);
+    EXPECT_EQ(hits, size_t(reps) * names);
+    EXPECT_DOUBLE_EQ(f.stub->stats().hit_rate(), double(reps * names) / double((reps + 1) * names));
+
+    std::cerr << "*** dnsstub names=" << names << std::fixed << std::setprecision(2)
+              << " hit=" << t * 1e6 << "us " << f.stub->stats().to_string() << std::endl;
+}
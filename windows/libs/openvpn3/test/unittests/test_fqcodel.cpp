@@ -0,0 +1,238 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <openvpn/ip/flowhash.hpp>
+#include <openvpn/transport/fqcodel.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// IPv4 TCP/UDP packet with the given ports, padded to size
+BufferPtr make_ipv4(const std::uint8_t proto, const std::uint16_t sport, const std::uint16_t dport, const size_t size)
+{
+    auto bp = BufferAllocatedRc::Create(size, BufAllocFlags::CONSTRUCT_ZERO | BufAllocFlags::ARRAY);
+    auto *ip = reinterpret_cast<IPv4Header *>(bp->data());
+    ip->version_len = IPv4Header::ver_len(IPCommon::IPv4, sizeof(IPv4Header));
+    ip->tot_len = htons(static_cast<std::uint16_t>(size));
+    ip->protocol = proto;
+    ip->saddr = htonl(0x0a080002);
+    ip->daddr = htonl(0xc0a80001);
+    auto *udp = reinterpret_cast<UDPHeader *>(bp->data() + sizeof(IPv4Header));
+    udp->source = htons(sport);
+    udp->dest = htons(dport);
+    return bp;
+}
+
+std::uint32_t flow_of(const BufferPtr &bp)
+{
+    return IPFlow::hash(bp->c_data(), bp->size(), 0x1234);
+}
+
+} // namespace
+
+TEST(fqcodel, flow_hash)
+{
+    const BufferPtr a = make_ipv4(IPCommon::TCP, 40000, 22, 60);
+    const BufferPtr a2 = make_ipv4(IPCommon::TCP, 40000, 22, 1400);
+    const BufferPtr b = make_ipv4(IPCommon::TCP, 40001, 22, 60);
+    const BufferPtr c = make_ipv4(IPCommon::UDP, 40000, 22, 60);
+    EXPECT_EQ(flow_of(a), flow_of(a2));
+    EXPECT_NE(flow_of(a), flow_of(b));
+    EXPECT_NE(flow_of(a), flow_of(c));
+    EXPECT_NE(IPFlow::hash(a->c_data(), a->size(), 1), IPFlow::hash(a->c_data(), a->size(), 2));
+
+    // fragments of a flow are classified without ports
+    BufferPtr f1 = make_ipv4(IPCommon::UDP, 1, 2, 60);
+    BufferPtr f2 = make_ipv4(IPCommon::UDP, 3, 4, 60);
+    reinterpret_cast<IPv4Header *>(f1->data())->frag_off = htons(0x2000);
+    reinterpret_cast<IPv4Header *>(f2->data())->frag_off = htons(0x2000);
+    EXPECT_EQ(flow_of(f1), flow_of(f2));
+
+    // truncated and non-IP packets must not be read beyond their end
+    EXPECT_EQ(IPFlow::hash(a->c_data(), 10, 7), 7u);
+    const unsigned char junk[] = {0x00, 0x01};
+    EXPECT_EQ(IPFlow::hash(junk, sizeof(junk), 7), 7u);
+}
+
+TEST(fqcodel, sparse_flow_bypasses_bulk_backlog)
+{
+    FQCoDel fq;
+    const Time now = Time::now();
+    for (int i = 0; i < 100; ++i)
+        fq.enqueue(make_ipv4(IPCommon::TCP, 5001, 80, 1400), 1, now);
+    fq.dequeue(now);
+    fq.enqueue(make_ipv4(IPCommon::UDP, 5060, 5060, 200), 2, now);
+
+    // the new flow is served within the next quantum
+    bool seen = false;
+    for (int i = 0; i < 2 && !seen; ++i)
+        seen = fq.dequeue(now)->size() == 200;
+    EXPECT_TRUE(seen);
+    EXPECT_EQ(fq.backlog_packets(), 98u);
+}
+
+TEST(fqcodel, byte_limit_drops_from_fattest_flow)
+{
+    FQCoDel::Config config;
+    config.byte_limit = 20 * 1000;
+    FQCoDel fq(config);
+    const Time now = Time::now();
+
+    size_t dropped = 0;
+    for (int i = 0; i < 40; ++i)
+        dropped += fq.enqueue(make_ipv4(IPCommon::TCP, 5001, 80, 1000), 1, now);
+    dropped += fq.enqueue(make_ipv4(IPCommon::UDP, 53, 53, 100), 2, now);
+
+    EXPECT_EQ(dropped, 21u);
+    EXPECT_EQ(fq.stats().overlimit_drops, 21u);
+    EXPECT_LE(fq.backlog_bytes(), config.byte_limit);
+
+    // the small flow survived
+    bool seen = false;
+    while (BufferPtr p = fq.dequeue(now))
+        seen |= p->size() == 100;
+    EXPECT_TRUE(seen);
+    EXPECT_TRUE(fq.empty());
+}
+
+// A TCP-like bulk flow (window halved on loss, grown by one packet per
+// round trip) saturates a bottleneck of one 1400 byte packet per ms,
+// while an interactive flow sends a small packet every 20 ms.  Returns
+// the p99 latency of the interactive packets in ms, with a tail-drop
+// FIFO or FQ-CoDel in front of the bottleneck.
+static double interactive_p99_ms(const bool fq_codel, FQCoDel::Stats *stats = nullptr)
+{
+    FQCoDel fq;
+    std::deque<std::pair<BufferPtr, Time>> fifo;
+    const size_t fifo_limit = 1000; // packets
+
+    const BufferPtr bulk = make_ipv4(IPCommon::TCP, 5001, 443, 1400);
+    const BufferPtr interactive = make_ipv4(IPCommon::TCP, 40000, 22, 100);
+    const Time::Duration rtt = Time::Duration::milliseconds(20);
+
+    std::vector<double> latency;
+    std::deque<Time> interactive_sent;
+    std::deque<Time> bulk_acks; // delivery time of bulk packets still in the return path
+    size_t bulk_queued = 0;
+    double cwnd = 10.0;
+    Time last_cut;
+    Time now = Time::now();
+    const Time start = now;
+
+    auto loss = [&]()
+    {
+        if (!last_cut.defined() || now >= last_cut + rtt)
+        {
+            cwnd = std::max(cwnd / 2.0, 2.0);
+            last_cut = now;
+        }
+    };
+
+    // 20 seconds in 1 ms steps
+    for (int ms = 0; ms < 20000; ++ms)
+    {
+        while (!bulk_acks.empty() && bulk_acks.front() + rtt <= now)
+        {
+            bulk_acks.pop_front();
+            cwnd += 1.0 / cwnd;
+        }
+        while (double(bulk_queued + bulk_acks.size()) < cwnd)
+        {
+            BufferPtr p = BufferAllocatedRc::Create(*bulk);
+            if (fq_codel)
+            {
+                const size_t dropped = fq.enqueue(std::move(p), flow_of(bulk), now);
+                bulk_queued += 1 - dropped;
+                if (dropped)
+                    loss();
+            }
+            else if (fifo.size() < fifo_limit)
+            {
+                fifo.emplace_back(std::move(p), now);
+                ++bulk_queued;
+            }
+            else
+            {
+                loss();
+                break;
+            }
+        }
+        if (ms % 20 == 0)
+        {
+            BufferPtr p = BufferAllocatedRc::Create(*interactive);
+            interactive_sent.push_back(now);
+            if (fq_codel)
+                fq.enqueue(std::move(p), flow_of(interactive), now);
+            else
+                fifo.emplace_back(std::move(p), now);
+        }
+
+        BufferPtr out;
+        if (fq_codel)
+        {
+            const std::uint64_t drops_before = fq.stats().codel_drops;
+            out = fq.dequeue(now);
+            const std::uint64_t drops = fq.stats().codel_drops - drops_before;
+            if (drops)
+            {
+                bulk_queued -= drops;
+                loss();
+            }
+        }
+        else if (!fifo.empty())
+        {
+            out = std::move(fifo.front().first);
+            fifo.pop_front();
+        }
+        if (out && out->size() == 100)
+        {
+            latency.push_back((now - interactive_sent.front()).to_double() * 1000.0);
+            interactive_sent.pop_front();
+        }
+        else if (out)
+        {
+            --bulk_queued;
+            bulk_acks.push_back(now);
+        }
+        now = start + Time::Duration::milliseconds(ms + 1);
+    }
+
+    if (stats)
+        *stats = fq.stats();
+    if (latency.empty())
+        return 1e9;
+    std::sort(latency.begin(), latency.end());
+    return latency[latency.size() * 99 / 100];
+}
+
+TEST(fqcodel, interactive_latency_under_bulk_load)
+{
+    FQCoDel::Stats stats;
+    const double fifo = interactive_p99_ms(false);
+    const double fq = interactive_p99_ms(true, &stats);
+    std::cout << "interactive p99 latency with saturating bulk flow: fifo=" << fifo
+              << "ms fq-codel=" << fq << "ms (" << stats.to_string() << ')' << std::endl;
+
+    EXPECT_LE(fq, 5.0);
+    EXPECT_GT(fifo, 100.0);
+
+    // CoDel keeps the bulk flow's standing queue near the target delay
+    EXPECT_GT(stats.codel_drops, 0u);
+    EXPECT_EQ(stats.overlimit_drops, 0u);
+    EXPECT_LT(stats.avg_sojourn_ms, 30.0);
+}
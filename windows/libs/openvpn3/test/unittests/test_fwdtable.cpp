@@ -0,0 +1,380 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <openvpn/server/fwdtable.hpp>
+
+using namespace openvpn;
+
+// size of the lookup benchmark
+#ifndef FWDTABLE_BENCH_SESSIONS
+#define FWDTABLE_BENCH_SESSIONS 100000
+#endif
+#ifndef FWDTABLE_BENCH_IROUTES
+#define FWDTABLE_BENCH_IROUTES 500000
+#endif
+
+namespace {
+
+typedef ForwardTable<unsigned int> Table;
+
+IP::Addr v4(const std::uint32_t a)
+{
+    return IP::Addr::from_ipv4(IPv4::Addr::from_uint32(a));
+}
+
+IP::Route route(const std::string &s)
+{
+    return IP::Route(s);
+}
+
+int lookup(Table::Reader &r, const std::string &addr)
+{
+    unsigned int v;
+    if (!r.lookup(IP::Addr(addr), v))
+        return -1;
+    return static_cast<int>(v);
+}
+
+// reference longest-prefix match
+int linear_lookup(const std::vector<std::pair<IP::Route, unsigned int>> &routes, const IP::Addr &addr)
+{
+    int best = -1;
+    unsigned int best_len = 0;
+    for (const auto &r : routes)
+        if (r.first.contains(addr) && (best < 0 || r.first.prefix_len >= best_len))
+        {
+            best = static_cast<int>(r.second);
+            best_len = r.first.prefix_len;
+        }
+    return best;
+}
+
+} // namespace
+
+TEST(fwdtable, longest_prefix)
+{
+    Table t;
+    Table::Reader r(t);
+
+    EXPECT_EQ(lookup(r, "10.8.0.2"), -1);
+    EXPECT_TRUE(t.add(route("10.0.0.0/8"), 1));
+    EXPECT_TRUE(t.add(route("10.8.0.0/16"), 2));
+    EXPECT_TRUE(t.add(route("10.8.0.2/32"), 3));
+    EXPECT_TRUE(t.add(route("10.8.0.0/23"), 4));
+    EXPECT_TRUE(t.add(route("0.0.0.0/0"), 5));
+    EXPECT_EQ(t.size(), 5u);
+
+    EXPECT_EQ(lookup(r, "10.8.0.2"), 3);
+    EXPECT_EQ(lookup(r, "10.8.0.3"), 4);
+    EXPECT_EQ(lookup(r, "10.8.1.255"), 4);
+    EXPECT_EQ(lookup(r, "10.8.2.0"), 2);
+    EXPECT_EQ(lookup(r, "10.9.0.1"), 1);
+    EXPECT_EQ(lookup(r, "11.0.0.1"), 5);
+
+    // replace keeps one route
+    EXPECT_FALSE(t.add(route("10.8.0.2/32"), 6));
+    EXPECT_EQ(lookup(r, "10.8.0.2"), 6);
+    EXPECT_EQ(t.size(), 5u);
+
+    // removing uncovers the next shorter route
+    EXPECT_TRUE(t.remove(route("10.8.0.0/23")));
+    EXPECT_FALSE(t.remove(route("10.8.0.0/23")));
+    EXPECT_EQ(lookup(r, "10.8.0.3"), 2);
+    EXPECT_TRUE(t.remove(route("10.8.0.2/32")));
+    EXPECT_EQ(lookup(r, "10.8.0.2"), 2);
+    EXPECT_TRUE(t.remove(route("0.0.0.0/0")));
+    EXPECT_EQ(lookup(r, "11.0.0.1"), -1);
+
+    // host bits are ignored
+    EXPECT_FALSE(t.add(route("10.1.2.3/8"), 7));
+    EXPECT_EQ(lookup(r, "10.9.0.1"), 7);
+
+    // IPv6 is separate
+    EXPECT_EQ(lookup(r, "::ffff:10.9.0.1"), -1);
+    EXPECT_TRUE(t.add(route("fd00::/8"), 10));
+    EXPECT_TRUE(t.add(route("fd00:1::/64"), 11));
+    EXPECT_TRUE(t.add(route("fd00:1::1000/128"), 12));
+    EXPECT_EQ(lookup(r, "fd00:1::1000"), 12);
+    EXPECT_EQ(lookup(r, "fd00:1::1001"), 11);
+    EXPECT_EQ(lookup(r, "fd00:2::1"), 10);
+    EXPECT_EQ(lookup(r, "fe00::1"), -1);
+
+    EXPECT_THROW(t.add(IP::Route(IP::Addr::from_string("10.0.0.0"), 33), 1), Table::forward_table_error);
+}
+
+TEST(fwdtable, empty_nodes_are_freed)
+{
+    Table t;
+    EXPECT_EQ(t.node_count(), 0u);
+    t.add(route("fd00:1:2:3::1/128"), 1);
+    EXPECT_EQ(t.node_count(), 16u);
+    t.add(route("10.8.0.1/32"), 2);
+    EXPECT_EQ(t.node_count(), 20u);
+    t.remove(route("fd00:1:2:3::1/128"));
+    t.remove(route("10.8.0.1/32"));
+    EXPECT_EQ(t.node_count(), 0u);
+    EXPECT_EQ(t.size(), 0u);
+}
+
+TEST(fwdtable, packet_lookup)
+{
+    Table t;
+    Table::Reader r(t);
+    t.add(route("10.8.0.2/32"), 1);
+    t.add(route("2001:db8::2/128"), 2);
+
+    unsigned char p4[20] = {0x45};
+    IP::Addr("10.8.0.2").to_byte_string_variable(p4 + 16);
+    unsigned char p6[40] = {0x60};
+    IP::Addr("2001:db8::2").to_byte_string_variable(p6 + 24);
+
+    unsigned int v = 0;
+    EXPECT_TRUE(r.lookup_packet(p4, sizeof(p4), v));
+    EXPECT_EQ(v, 1u);
+    EXPECT_TRUE(r.lookup_packet(p6, sizeof(p6), v));
+    EXPECT_EQ(v, 2u);
+    EXPECT_FALSE(r.lookup_packet(p4, 19, v));
+    EXPECT_FALSE(r.lookup_packet(p6, 39, v));
+}
+
+TEST(fwdtable, matches_linear_search)
+{
+    std::mt19937 rng(7);
+    Table t;
+    Table::Reader r(t);
+    std::vector<std::pair<IP::Route, unsigned int>> routes;
+
+    // clustered prefixes, so that many of them overlap
+    auto random_addr = [&rng]()
+    { return v4(0x0A000000u | (rng() & 0x000F0FFFu)); };
+    {
+        Table::Transaction txn(t);
+        for (unsigned int i = 0; i < 3000; ++i)
+        {
+            IP::Route rt(random_addr(), 8 + rng() % 25);
+            rt.force_canonical();
+            if (std::any_of(routes.begin(), routes.end(), [&rt](const auto &x)
+                            { return x.first == rt; }))
+                continue;
+            routes.emplace_back(rt, i);
+            EXPECT_TRUE(txn.add(rt, i));
+        }
+    }
+
+    auto check = [&]()
+    {
+        for (int i = 0; i < 20000; ++i)
+        {
+            const IP::Addr a = random_addr();
+            unsigned int v;
+            const int expect = linear_lookup(routes, a);
+            const int got = r.lookup(a, v) ? static_cast<int>(v) : -1;
+            ASSERT_EQ(got, expect) << a;
+        }
+    };
+    check();
+
+    {
+        Table::Transaction txn(t);
+        for (size_t i = 0; i < routes.size(); i += 2)
+            EXPECT_TRUE(txn.remove(routes[i].first));
+    }
+    std::vector<std::pair<IP::Route, unsigned int>> rest;
+    for (size_t i = 1; i < routes.size(); i += 2)
+        rest.push_back(routes[i]);
+    routes = rest;
+    EXPECT_EQ(t.size(), routes.size());
+    check();
+}
+
+TEST(fwdtable, readers_during_updates)
+{
+    Table t;
+    t.add(route("10.0.0.0/8"), 1);
+    t.add(route("10.8.0.0/16"), 2);
+
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long> lookups{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i)
+        readers.emplace_back([&]()
+                             {
+            Table::Reader r(t);
+            unsigned long n = 0;
+            std::uint32_t a = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                a = (a + 2654435761u) & 0xFFFF;
+                unsigned int v = 0;
+                // every address in 10.8/16 matches the /16 or a host
+                // route carrying its own address
+                ASSERT_TRUE(r.lookup(v4(0x0A080000u | a), v));
+                ASSERT_TRUE(v == 2 || v == (0x0A080000u | a));
+                ASSERT_TRUE(r.lookup(v4(0x0A090000u | a), v));
+                ASSERT_EQ(v, 1u);
+                n += 2;
+            }
+            lookups += n; });
+
+    // sessions connecting and disconnecting
+    for (std::uint32_t i = 0; i < 20000; ++i)
+    {
+        const std::uint32_t a = 0x0A080000u | (i * 7 & 0xFFFF);
+        Table::Transaction txn(t);
+        txn.add(IP::Route(v4(a), 32), a);
+        if (i >= 100)
+            txn.remove(IP::Route(v4(0x0A080000u | ((i - 100) * 7 & 0xFFFF)), 32));
+    }
+    stop = true;
+    for (auto &th : readers)
+        th.join();
+
+    EXPECT_GT(lookups.load(), 0u);
+    EXPECT_EQ(t.size(), 102u);
+    t.reclaim();
+    EXPECT_EQ(t.reclaim(), 0u);
+}
+
+// Lookup rate with FWDTABLE_BENCH_SESSIONS sessions, each with a /32
+// VPN IP and FWDTABLE_BENCH_IROUTES / FWDTABLE_BENCH_SESSIONS iroutes
+TEST(fwdtable, DISABLED_bench)
+{
+    typedef std::chrono::steady_clock Clock;
+    constexpr std::uint32_t n_sessions = FWDTABLE_BENCH_SESSIONS;
+    constexpr std::uint32_t n_iroutes = FWDTABLE_BENCH_IROUTES;
+    constexpr std::uint32_t per_session = n_iroutes / n_sessions;
+
+    // VPN IPs from 10.0.0.0/8, iroutes are /24s from 11.0.0.0 on
+    auto vpn_ip = [](const std::uint32_t s)
+    { return 0x0A000002u + s; };
+    auto iroute = [](const std::uint32_t s, const std::uint32_t j)
+    { return 0x0B000000u + ((s * per_session + j) << 8); };
+
+    Table t;
+    Clock::time_point begin = Clock::now();
+    {
+        Table::Transaction txn(t);
+        for (std::uint32_t s = 0; s < n_sessions; ++s)
+        {
+            txn.add(IP::Route(v4(vpn_ip(s)), 32), s);
+            for (std::uint32_t j = 0; j < per_session; ++j)
+                txn.add(IP::Route(v4(iroute(s, j)), 24), s);
+        }
+    }
+    const double build = std::chrono::duration<double>(Clock::now() - begin).count();
+    ASSERT_EQ(t.size(), size_t(n_sessions) * (per_session + 1));
+
+    // destinations: half VPN IPs, half hosts behind iroutes
+    std::vector<std::uint32_t> dest(1 << 20);
+    std::mt19937 rng(1);
+    for (auto &d : dest)
+    {
+        const std::uint32_t s = rng() % n_sessions;
+        d = (rng() & 1) ? vpn_ip(s) : iroute(s, rng() % per_session) + 1 + (rng() % 254);
+    }
+    std::vector<unsigned char> packets(dest.size() * 20);
+    for (size_t i = 0; i < dest.size(); ++i)
+    {
+        unsigned char *p = &packets[i * 20];
+        p[0] = 0x45;
+        v4(dest[i]).to_byte_string_variable(p + 16);
+    }
+
+    // one thread, lookups batched like a tun read
+    constexpr size_t batch = 64;
+    std::uint64_t sum = 0;
+    size_t n = 0;
+    {
+        Table::Reader r(t);
+        begin = Clock::now();
+        for (int pass = 0; pass < 4; ++pass)
+            for (size_t i = 0; i < dest.size(); i += batch)
+            {
+                Table::Batch b(r);
+                for (size_t k = i; k < i + batch; ++k)
+                    if (const unsigned int *v = b.lookup_packet(&packets[k * 20], 20))
+                        sum += *v;
+                n += batch;
+            }
+    }
+    const double single = n / std::chrono::duration<double>(Clock::now() - begin).count();
+    EXPECT_GT(sum, 0u);
+
+    // several threads while sessions connect and disconnect
+    const unsigned int n_threads = std::max(2u, std::min(4u, std::thread::hardware_concurrency()));
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::vector<std::thread> threads;
+    begin = Clock::now();
+    for (unsigned int th = 0; th < n_threads; ++th)
+        threads.emplace_back([&, th]()
+                             {
+            Table::Reader r(t);
+            std::uint64_t count = 0, miss = 0;
+            size_t i = (th * dest.size() / n_threads) & ~(batch - 1);
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                Table::Batch b(r);
+                for (size_t k = i; k < i + batch; ++k)
+                    if (!b.lookup_packet(&packets[k * 20], 20))
+                        ++miss;
+                count += batch;
+                i = (i + batch) % dest.size();
+            }
+            total += count;
+            misses += miss; });
+
+    unsigned int churn = 0;
+    const Clock::time_point churn_end = Clock::now() + std::chrono::milliseconds(500);
+    while (Clock::now() < churn_end)
+    {
+        // a session disconnects and reconnects with the same routes
+        const std::uint32_t s = rng() % n_sessions;
+        {
+            Table::Transaction txn(t);
+            txn.remove(IP::Route(v4(vpn_ip(s)), 32));
+            for (std::uint32_t j = 0; j < per_session; ++j)
+                txn.remove(IP::Route(v4(iroute(s, j)), 24));
+        }
+        {
+            Table::Transaction txn(t);
+            txn.add(IP::Route(v4(vpn_ip(s)), 32), s);
+            for (std::uint32_t j = 0; j < per_session; ++j)
+                txn.add(IP::Route(v4(iroute(s, j)), 24), s);
+        }
+        churn += 2;
+    }
+    stop = true;
+    for (auto &th : threads)
+        th.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::cerr << "*** fwdtable sessions=" << n_sessions << " iroutes=" << size_t(n_sessions) * per_session
+              << " nodes=" << t.node_count() << std::fixed << std::setprecision(2)
+              << " build=" << build << "s"
+              << " lookups/s: 1 thread=" << single / 1e6 << "M"
+              << ", " << n_threads << " threads with " << churn / elapsed << " updates/s="
+              << total.load() / elapsed / 1e6 << "M" << std::endl;
+
+    // only lookups racing with the disconnected window may miss
+    EXPECT_LT(misses.load(), total.load() / 100 + 1);
+    EXPECT_EQ(t.size(), size_t(n_sessions) * (per_session + 1));
+}
@@ -0,0 +1,153 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <vector>
+
+#include <openvpn/transport/gremlinsim.hpp>
+
+using namespace openvpn;
+using namespace openvpn::Gremlin;
+
+namespace {
+
+BufferPtr make_packet(const size_t size, const unsigned char tag)
+{
+    auto bp = BufferAllocatedRc::Create(size, BufAllocFlags::ARRAY);
+    std::memset(bp->data(), tag, size);
+    return bp;
+}
+
+// Push n packets through the link, one every ms, and return the
+// send index of every packet in delivery order.
+std::vector<int> run_link(SimLink &link, const int n, const size_t size = 100)
+{
+    std::vector<int> order;
+    Time now;
+    for (int i = 0; i < n; ++i)
+    {
+        auto bp = make_packet(size, static_cast<unsigned char>(i));
+        link.send(bp, now);
+        now += Time::Duration::milliseconds(1);
+        while (BufferPtr r = link.recv(now))
+            order.push_back(r->data()[0]);
+    }
+    while (link.in_flight())
+    {
+        now = link.next_delivery();
+        while (BufferPtr r = link.recv(now))
+            order.push_back(r->data()[0]);
+    }
+    return order;
+}
+
+} // namespace
+
+TEST(Gremlin, profile_parse)
+{
+    const Profile p = Profile::parse("delay=40,jitter=10,loss=1.5,reorder=2,gap=20,rate=8000,queue=64000");
+    EXPECT_EQ(p.delay_ms, 40u);
+    EXPECT_EQ(p.jitter_ms, 10u);
+    EXPECT_DOUBLE_EQ(p.loss_percent, 1.5);
+    EXPECT_DOUBLE_EQ(p.reorder_percent, 2.0);
+    EXPECT_EQ(p.reorder_gap_ms, 20u);
+    EXPECT_EQ(p.rate_kbps, 8000u);
+    EXPECT_EQ(p.queue_bytes, 64000u);
+}
+
+TEST(Gremlin, profile_preset_override)
+{
+    const Profile p = Profile::parse("lte,loss=5");
+    EXPECT_EQ(p.name, "lte");
+    EXPECT_EQ(p.delay_ms, Profile::preset("lte").delay_ms);
+    EXPECT_DOUBLE_EQ(p.loss_percent, 5.0);
+}
+
+TEST(Gremlin, profile_parse_errors)
+{
+    EXPECT_THROW(Profile::parse("delay=abc"), gremlin_profile_error);
+    EXPECT_THROW(Profile::parse("loss=101"), gremlin_profile_error);
+    EXPECT_THROW(Profile::parse("bogus=1"), gremlin_profile_error);
+    EXPECT_THROW(Profile::parse("no-such-preset"), gremlin_profile_error);
+    EXPECT_THROW(Profile::parse("delay=1,lte"), gremlin_profile_error);
+}
+
+TEST(Gremlin, ideal_link_preserves_order)
+{
+    SimLink link(Profile::preset("ideal"), 1);
+    const std::vector<int> order = run_link(link, 200);
+    ASSERT_EQ(order.size(), 200u);
+    for (size_t i = 0; i < order.size(); ++i)
+        EXPECT_EQ(order[i], static_cast<int>(i & 0xff));
+    EXPECT_EQ(link.stats().reordered, 0u);
+    EXPECT_EQ(link.stats().dropped, 0u);
+}
+
+TEST(Gremlin, seeded_runs_are_reproducible)
+{
+    const Profile p = Profile::parse("delay=20,jitter=15,loss=5,reorder=5,gap=10");
+    SimLink a(p, 42);
+    SimLink b(p, 42);
+    SimLink c(p, 43);
+    const std::vector<int> oa = run_link(a, 2000);
+    const std::vector<int> ob = run_link(b, 2000);
+    const std::vector<int> oc = run_link(c, 2000);
+    EXPECT_EQ(oa, ob);
+    EXPECT_NE(oa, oc);
+    EXPECT_EQ(a.stats().dropped, b.stats().dropped);
+    EXPECT_EQ(a.stats().reordered, b.stats().reordered);
+    EXPECT_GT(a.stats().reordered, 0u);
+}
+
+TEST(Gremlin, loss_rate)
+{
+    SimLink link(Profile::parse("loss=10"), 7);
+    run_link(link, 20000);
+    const double rate = double(link.stats().dropped) / double(link.stats().sent);
+    EXPECT_NEAR(rate, 0.10, 0.01);
+    EXPECT_EQ(link.stats().delivered + link.stats().dropped, link.stats().sent);
+}
+
+TEST(Gremlin, delay)
+{
+    SimLink link(Profile::parse("delay=100"), 1);
+    Time now;
+    link.send(make_packet(10, 0), now);
+    EXPECT_FALSE(link.recv(now + Time::Duration::milliseconds(99)));
+    EXPECT_TRUE(link.recv(now + Time::Duration::milliseconds(100)));
+}
+
+TEST(Gremlin, rate_limit_and_queue)
+{
+    // 8 Mbit/s == 1000 bytes per ms, with room for 10 packets in the queue
+    SimLink link(Profile::parse("rate=8000,queue=10000"), 1);
+    Time now;
+    size_t accepted = 0;
+    for (int i = 0; i < 50; ++i)
+        if (link.send(make_packet(1000, 0), now))
+            ++accepted;
+    EXPECT_GE(accepted, 10u);
+    EXPECT_LE(accepted, 11u);
+    EXPECT_EQ(link.stats().queue_drops, 50u - accepted);
+
+    // the last accepted packet leaves the bottleneck ~accepted ms later
+    size_t delivered = 0;
+    Time t = now;
+    while (link.in_flight())
+    {
+        t = link.next_delivery();
+        while (link.recv(t))
+            ++delivered;
+    }
+    EXPECT_EQ(delivered, accepted);
+    EXPECT_NEAR(double((t - now).to_milliseconds()), double(accepted), 2.0);
+}
@@ -0,0 +1,362 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/http/status.hpp>
+#include <openvpn/server/listenlist.hpp>
+#include <openvpn/ws/httpserv.hpp>
+#include <openvpn/ws/httpcliset.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+unsigned short free_port()
+{
+    openvpn_io::io_context io_context;
+    openvpn_io::ip::tcp::acceptor a(io_context, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0));
+    return a.local_endpoint().port();
+}
+
+// keep-alive HTTP server that counts accepted connections
+class EchoServer
+{
+  public:
+    EchoServer(const unsigned short port)
+    {
+        WS::Server::Config::Ptr config = new WS::Server::Config();
+        config->http_server_id = "test";
+        config->frame = frame_init_simple(2048);
+        config->stats.reset(new SessionStats());
+        config->max_content_bytes = 4096;
+        config->general_timeout = 15;
+
+        Listen::Item li;
+        li.directive = "listen";
+        li.addr = "127.0.0.1";
+        li.port = openvpn::to_string(port);
+        li.proto = Protocol(Protocol::TCP);
+        li.n_threads = 1;
+
+        listener.reset(new WS::Server::Listener(io_context, config, li, new Factory(connections)));
+        listener->start();
+        thread = std::thread([this]()
+                             { io_context.run(); });
+    }
+
+    ~EchoServer()
+    {
+        openvpn_io::post(io_context, [this]()
+                         { listener->stop(); });
+        thread.join();
+    }
+
+    std::atomic<unsigned int> connections{0};
+
+  private:
+    class Instance : public WS::Server::Listener::Client
+    {
+      public:
+        Instance(WS::Server::Listener::Client::Initializer &ci)
+            : WS::Server::Listener::Client(ci)
+        {
+        }
+
+      private:
+        void http_request_received() override
+        {
+            out = buf_from_string(request().uri);
+            WS::Server::ContentInfo ci;
+            ci.http_status = HTTP::Status::OK;
+            ci.type = "text/plain";
+            ci.length = out->size();
+            ci.keepalive = keepalive_request();
+            generate_reply_headers(ci);
+        }
+
+        BufferPtr http_content_out() override
+        {
+            BufferPtr ret;
+            ret.swap(out);
+            return ret;
+        }
+
+        BufferPtr out;
+    };
+
+    class Factory : public WS::Server::Listener::Client::Factory
+    {
+      public:
+        Factory(std::atomic<unsigned int> &connections_arg)
+            : connections(connections_arg)
+        {
+        }
+
+        WS::Server::Listener::Client::Ptr new_client(WS::Server::Listener::Client::Initializer &ci) override
+        {
+            ++connections;
+            return new Instance(ci);
+        }
+
+      private:
+        std::atomic<unsigned int> &connections;
+    };
+
+    openvpn_io::io_context io_context{1};
+    WS::Server::Listener::Ptr listener;
+    std::thread thread;
+};
+
+// connections are pooled per Config, so all requests share one
+WS::Client::Config::Ptr client_config()
+{
+    static const WS::Client::Config::Ptr config = []()
+    {
+        WS::Client::Config::Ptr c(new WS::Client::Config());
+        c->frame = frame_init_simple(2048);
+        c->stats.reset(new SessionStats());
+        c->connect_timeout = 10;
+        c->general_timeout = 10;
+        return c;
+    }();
+    return config;
+}
+
+WS::ClientSet::TransactionSet::Ptr make_ts(const unsigned short port,
+                                           const std::string &method,
+                                           const std::string &uri,
+                                           const WS::ClientSet::ConnectionPool::Ptr &pool)
+{
+    WS::ClientSet::TransactionSet::Ptr ts(new WS::ClientSet::TransactionSet);
+    ts->host.host = "127.0.0.1";
+    ts->host.port = openvpn::to_string(port);
+    ts->http_config = client_config();
+    ts->debug_level = 0;
+    ts->pool = pool;
+
+    std::unique_ptr<WS::ClientSet::Transaction> t(new WS::ClientSet::Transaction);
+    t->req.method = method;
+    t->req.uri = uri;
+    ts->transactions.push_back(std::move(t));
+    return ts;
+}
+
+} // namespace
+
+TEST(httpcliset, pool_reuses_connection)
+{
+    const unsigned short port = free_port();
+    EchoServer server(port);
+
+    openvpn_io::io_context io_context(1);
+    WS::ClientSet::Ptr cs(new WS::ClientSet(io_context));
+    WS::ClientSet::ConnectionPool::Ptr pool(new WS::ClientSet::ConnectionPool(io_context));
+
+    // run the transaction sets one after another, every set
+    // must find the connection of the previous one idle
+    std::vector<std::string> replies;
+    std::function<void(int)> next = [&](const int i)
+    {
+        if (i == 5)
+        {
+            pool->clear();
+            return;
+        }
+        WS::ClientSet::TransactionSet::Ptr ts = make_ts(port, "GET", "/req" + std::to_string(i), pool);
+        ts->completion = [&, i](WS::ClientSet::TransactionSet &ts)
+        {
+            replies.push_back(ts.first_transaction().content_in_string());
+            EXPECT_TRUE(ts.http_status_success());
+            EXPECT_EQ(pool->n_busy(), 0u);
+            next(i + 1);
+        };
+        cs->new_request(ts);
+    };
+    next(0);
+    io_context.run();
+
+    ASSERT_EQ(replies.size(), 5u);
+    EXPECT_EQ(replies[4], "/req4");
+    EXPECT_EQ(pool->stats().connects, 1u);
+    EXPECT_EQ(pool->stats().reuses, 4u);
+    EXPECT_EQ(pool->n_idle(), 0u);
+    EXPECT_EQ(server.connections, 1u);
+}
+
+TEST(httpcliset, pool_per_host_limit)
+{
+    const unsigned short port = free_port();
+    EchoServer server(port);
+
+    openvpn_io::io_context io_context(1);
+    WS::ClientSet::Ptr cs(new WS::ClientSet(io_context));
+    WS::ClientSet::ConnectionPool::Ptr pool(new WS::ClientSet::ConnectionPool(io_context));
+    pool->max_per_host = 2;
+
+    const unsigned int n = 10;
+    unsigned int succeeded = 0;
+    unsigned int completed = 0;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        WS::ClientSet::TransactionSet::Ptr ts = make_ts(port, "GET", "/", pool);
+        ts->completion = [&](WS::ClientSet::TransactionSet &ts)
+        {
+            EXPECT_LE(pool->n_busy(), 2u);
+            if (ts.http_status_success())
+                ++succeeded;
+            if (++completed == n)
+                pool->clear();
+        };
+        cs->new_request(ts);
+    }
+    io_context.run();
+
+    EXPECT_EQ(succeeded, n);
+    EXPECT_EQ(pool->stats().connects, 2u);
+    EXPECT_EQ(pool->stats().reuses, n - 2);
+    EXPECT_EQ(pool->stats().waits, n - 2);
+    EXPECT_EQ(server.connections, 2u);
+}
+
+TEST(httpcliset, pool_stale_connection)
+{
+    // Server that answers the first request on every connection
+    // with keep-alive, then drops the connection when the next
+    // request arrives, like a server whose idle timeout raced
+    // with the request.
+    openvpn_io::io_context server_io;
+    openvpn_io::ip::tcp::acceptor acceptor(server_io, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0));
+    const unsigned short port = acceptor.local_endpoint().port();
+    const unsigned int n_conn = 2;
+    std::thread server([&]()
+                       {
+        for (unsigned int i = 0; i < n_conn; ++i)
+        {
+            openvpn_io::ip::tcp::socket sock(server_io);
+            acceptor.accept(sock);
+            openvpn_io::error_code ec;
+            openvpn_io::streambuf in;
+            openvpn_io::read_until(sock, in, "\r\n\r\n", ec);
+            if (ec)
+                continue;
+            const std::string reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+            openvpn_io::write(sock, openvpn_io::buffer(reply), ec);
+            in.consume(in.size());
+            openvpn_io::read_until(sock, in, "\r\n\r\n", ec);
+        } });
+
+    openvpn_io::io_context io_context(1);
+    WS::ClientSet::Ptr cs(new WS::ClientSet(io_context));
+    WS::ClientSet::ConnectionPool::Ptr pool(new WS::ClientSet::ConnectionPool(io_context));
+
+    // GET on the stale connection is retried on a new one, POST is not
+    std::vector<int> status;
+    std::function<void(int)> next = [&](const int i)
+    {
+        static const char *methods[] = {"GET", "GET", "POST"};
+        if (i == 3)
+        {
+            pool->clear();
+            return;
+        }
+        WS::ClientSet::TransactionSet::Ptr ts = make_ts(port, methods[i], "/", pool);
+        ts->completion = [&, i](WS::ClientSet::TransactionSet &ts)
+        {
+            status.push_back(ts.first_transaction().status);
+            next(i + 1);
+        };
+        cs->new_request(ts);
+    };
+    next(0);
+    io_context.run();
+    server.join();
+
+    ASSERT_EQ(status.size(), 3u);
+    EXPECT_EQ(status[0], WS::Client::Status::E_SUCCESS);
+    EXPECT_EQ(status[1], WS::Client::Status::E_SUCCESS);
+    EXPECT_NE(status[2], WS::Client::Status::E_SUCCESS);
+    EXPECT_EQ(pool->stats().connects, 2u);
+    EXPECT_EQ(pool->stats().reuses, 2u);
+}
+
+TEST(httpcliset, pool_stale_connection_retry_is_fresh)
+{
+    // Server that answers the first request on every connection and
+    // drops the connection on the second one
+    openvpn_io::io_context server_io;
+    openvpn_io::ip::tcp::acceptor acceptor(server_io, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0));
+    const unsigned short port = acceptor.local_endpoint().port();
+    const unsigned int n_conn = 3;
+    std::thread server([&]()
+                       {
+        std::vector<std::thread> conns;
+        for (unsigned int i = 0; i < n_conn; ++i)
+        {
+            auto sock = std::make_shared<openvpn_io::ip::tcp::socket>(server_io);
+            acceptor.accept(*sock);
+            conns.emplace_back([sock]()
+                               {
+                openvpn_io::error_code ec;
+                openvpn_io::streambuf in;
+                openvpn_io::read_until(*sock, in, "\r\n\r\n", ec);
+                if (ec)
+                    return;
+                const std::string reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+                openvpn_io::write(*sock, openvpn_io::buffer(reply), ec);
+                in.consume(in.size());
+                openvpn_io::read_until(*sock, in, "\r\n\r\n", ec); });
+        }
+        for (auto &t : conns)
+            t.join(); });
+
+    openvpn_io::io_context io_context(1);
+    WS::ClientSet::Ptr cs(new WS::ClientSet(io_context));
+    WS::ClientSet::ConnectionPool::Ptr pool(new WS::ClientSet::ConnectionPool(io_context));
+
+    // two concurrent GETs leave two idle connections, both of which go
+    // stale.  The third GET reuses one, and its retry must not be
+    // handed the other one.
+    std::vector<int> status;
+    auto get = [&](std::function<void()> then)
+    {
+        WS::ClientSet::TransactionSet::Ptr ts = make_ts(port, "GET", "/", pool);
+        ts->completion = [&, then](WS::ClientSet::TransactionSet &ts)
+        {
+            status.push_back(ts.first_transaction().status);
+            then();
+        };
+        cs->new_request(ts);
+    };
+    auto both_done = [&]()
+    {
+        if (status.size() == 2)
+            get([&]()
+                { pool->clear(); });
+    };
+    get(both_done);
+    get(both_done);
+    io_context.run();
+    server.join();
+
+    ASSERT_EQ(status.size(), 3u);
+    EXPECT_EQ(status[2], WS::Client::Status::E_SUCCESS);
+    EXPECT_EQ(pool->stats().connects, 3u);
+    EXPECT_EQ(pool->stats().reuses, 1u);
+}
@@ -0,0 +1,184 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <openvpn/log/metrics.hpp>
+#include <openvpn/ws/metricsserv.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+bool contains(const std::string &text, const std::string &line)
+{
+    return text.find(line) != std::string::npos;
+}
+
+Metrics::Snapshot make_snapshot(const count_t bytes_in, const count_t decrypt_errors, const bool connected)
+{
+    Metrics::Snapshot s;
+    s.stat(SessionStats::BYTES_IN) = bytes_in;
+    s.stat(SessionStats::TUN_PACKETS_OUT) = bytes_in / 100;
+    s.stat(SessionStats::DNS_CACHE_HITS) = bytes_in / 250;
+    s.error(Error::DECRYPT_ERROR) = decrypt_errors;
+    s.set_connected(connected);
+    return s;
+}
+
+// send a request and read the reply until the server closes
+std::string http_get(const unsigned short port, const std::string &request)
+{
+    openvpn_io::io_context io_context;
+    openvpn_io::ip::tcp::socket sock(io_context);
+    sock.connect(openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), port));
+    openvpn_io::write(sock, openvpn_io::buffer(request));
+    std::string reply;
+    char buf[4096];
+    openvpn_io::error_code ec;
+    while (true)
+    {
+        const size_t n = sock.read_some(openvpn_io::buffer(buf), ec);
+        if (ec)
+            break;
+        reply.append(buf, n);
+    }
+    return reply;
+}
+
+} // namespace
+
+TEST(metrics, render)
+{
+    Metrics::Ptr metrics(new Metrics);
+    Metrics::Slot::Ptr a = metrics->add("a");
+    Metrics::Slot::Ptr b = metrics->add("b \"2\"");
+    a->publish(make_snapshot(1000, 2, true));
+    b->publish(make_snapshot(500, 0, false));
+
+    const std::string text = metrics->prometheus();
+    EXPECT_TRUE(contains(text, "# TYPE openvpn_transport_bytes_in_total counter\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_sessions 2\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_sessions_connected 1\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_transport_bytes_in_total 1500\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_session_transport_bytes_in_total{session=\"a\"} 1000\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_session_transport_bytes_in_total{session=\"b \\\"2\\\"\"} 500\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_tun_packets_out_total 15\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_tls_crypt_v2_wkc_cache_hits_total 0\n"));
+    EXPECT_TRUE(contains(text, "# TYPE openvpn_dns_cache_hits_total counter\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_dns_cache_hits_total 6\n"));
+    EXPECT_FALSE(contains(text, "openvpn_transport_dns_cache"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_errors_total{type=\"decrypt_error\"} 2\n"));
+    EXPECT_TRUE(contains(text, "\nopenvpn_session_errors_total{session=\"a\",type=\"decrypt_error\"} 2\n"));
+    EXPECT_FALSE(contains(text, "hmac_error"));
+
+    const std::string json = metrics->json();
+    EXPECT_TRUE(contains(json, "{\"total\":{\"sessions\":2,\"connected\":1,\"stats\":{\"transport_bytes_in\":1500,"));
+    EXPECT_TRUE(contains(json, "\"errors\":{\"decrypt_error\":2}"));
+    EXPECT_TRUE(contains(json, "{\"name\":\"b \\\"2\\\"\",\"counters\":{\"connected\":0,"));
+}
+
+TEST(metrics, closed_slots_stay_in_total)
+{
+    Metrics::Ptr metrics(new Metrics);
+    Metrics::Slot::Ptr a = metrics->add("a");
+    Metrics::Slot::Ptr b = metrics->add("b");
+    a->publish(make_snapshot(1000, 1, true));
+    b->publish(make_snapshot(300, 0, true));
+    a->close();
+
+    Metrics::Report r = metrics->collect();
+    ASSERT_EQ(r.sessions.size(), 1u);
+    EXPECT_EQ(r.sessions[0].first, "b");
+    EXPECT_EQ(r.total.stat(SessionStats::BYTES_IN), 1300);
+    EXPECT_EQ(r.total.error(Error::DECRYPT_ERROR), 1);
+    EXPECT_EQ(r.total.v[Metrics::CONNECTED], 1);
+
+    // folded in once only
+    b->close();
+    r = metrics->collect();
+    EXPECT_TRUE(r.sessions.empty());
+    EXPECT_EQ(r.total.stat(SessionStats::BYTES_IN), 1300);
+    EXPECT_FALSE(r.total.connected());
+}
+
+TEST(metrics, concurrent_publish)
+{
+    // every published snapshot has all values equal, so a torn read
+    // would show up as a mix
+    Metrics::Ptr metrics(new Metrics);
+    Metrics::Slot::Ptr slot = metrics->add("s");
+    std::atomic<bool> done{false};
+    std::thread writer([&]()
+                       {
+        Metrics::Snapshot s;
+        for (count_t k = 1; k <= 200000; ++k)
+        {
+            for (auto &v : s.v)
+                v = k;
+            slot->publish(s);
+        }
+        done = true; });
+
+    count_t last = 0;
+    unsigned int reads = 0;
+    while (!done || reads < 10)
+    {
+        const Metrics::Snapshot s = slot->read();
+        for (const count_t v : s.v)
+            ASSERT_EQ(v, s.v[0]);
+        EXPECT_GE(s.v[0], last);
+        last = s.v[0];
+        ++reads;
+    }
+    writer.join();
+    EXPECT_EQ(slot->read().v[0], 200000);
+}
+
+TEST(metrics, http_endpoint)
+{
+    // find a free port
+    unsigned short port;
+    {
+        openvpn_io::io_context io_context;
+        openvpn_io::ip::tcp::acceptor a(io_context, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0));
+        port = a.local_endpoint().port();
+    }
+
+    Metrics::Ptr metrics(new Metrics);
+    metrics->add("a")->publish(make_snapshot(42, 0, true));
+
+    openvpn_io::io_context io_context(1);
+    WS::MetricsServer::Ptr server(new WS::MetricsServer(io_context, metrics, "127.0.0.1", openvpn::to_string(port)));
+    server->start();
+    std::thread t([&io_context]()
+                  { io_context.run(); });
+
+    const std::string text = http_get(port, "GET /metrics HTTP/1.0\r\n\r\n");
+    EXPECT_TRUE(contains(text, "HTTP/1.1 200 OK\r\n")) << text;
+    EXPECT_TRUE(contains(text, "Content-Type: text/plain; version=0.0.4")) << text;
+    EXPECT_TRUE(contains(text, "\nopenvpn_session_transport_bytes_in_total{session=\"a\"} 42\n")) << text;
+
+    const std::string json = http_get(port, "GET /metrics.json HTTP/1.0\r\n\r\n");
+    EXPECT_TRUE(contains(json, "Content-Type: application/json")) << json;
+    EXPECT_TRUE(contains(json, "\"transport_bytes_in\":42")) << json;
+
+    EXPECT_TRUE(contains(http_get(port, "GET /other HTTP/1.0\r\n\r\n"), "HTTP/1.1 404 "));
+    EXPECT_TRUE(contains(http_get(port, "POST /metrics HTTP/1.0\r\nContent-Length: 0\r\n\r\n"), "HTTP/1.1 400 "));
+
+    openvpn_io::post(io_context, [&server]()
+                     { server->stop(); });
+    t.join();
+}
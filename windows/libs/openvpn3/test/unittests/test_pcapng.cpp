@@ -0,0 +1,289 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <openvpn/ip/packetfilter.hpp>
+#include <openvpn/log/pcapng.hpp>
+#include <openvpn/log/packetcapture.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// minimal IPv4 or IPv6 packet with a TCP/UDP port pair
+BufferAllocated make_packet(const std::string &src,
+                            const std::string &dst,
+                            const unsigned char proto,
+                            const std::uint16_t sport,
+                            const std::uint16_t dport,
+                            const size_t size = 64)
+{
+    const IP::Addr s = IP::Addr::from_string(src);
+    const IP::Addr d = IP::Addr::from_string(dst);
+    BufferAllocated buf(size);
+    unsigned char *p = buf.write_alloc(size);
+    std::memset(p, 0, size);
+    size_t l4;
+    if (s.is_ipv6())
+    {
+        p[0] = 0x60;
+        p[6] = proto;
+        s.to_byte_string_variable(p + 8);
+        d.to_byte_string_variable(p + 24);
+        l4 = 40;
+    }
+    else
+    {
+        p[0] = 0x45;
+        p[9] = proto;
+        s.to_byte_string_variable(p + 12);
+        d.to_byte_string_variable(p + 16);
+        l4 = 20;
+    }
+    p[l4] = static_cast<unsigned char>(sport >> 8);
+    p[l4 + 1] = static_cast<unsigned char>(sport);
+    p[l4 + 2] = static_cast<unsigned char>(dport >> 8);
+    p[l4 + 3] = static_cast<unsigned char>(dport);
+    return buf;
+}
+
+bool matches(const std::string &expr, const Buffer &pkt)
+{
+    return PacketFilter(expr).match(pkt.c_data(), pkt.size());
+}
+
+std::uint32_t get32(const std::string &s, const size_t off)
+{
+    std::uint32_t v;
+    std::memcpy(&v, s.data() + off, sizeof(v));
+    return v;
+}
+
+struct Block
+{
+    std::uint32_t type;
+    std::string body;
+};
+
+// split a pcapng file into blocks, checking the framing of each
+std::vector<Block> parse_blocks(const std::string &data)
+{
+    std::vector<Block> ret;
+    size_t off = 0;
+    while (off < data.size())
+    {
+        EXPECT_LE(off + 12, data.size());
+        const std::uint32_t len = get32(data, off + 4);
+        EXPECT_EQ(len % 4, 0u);
+        EXPECT_LE(off + len, data.size());
+        if (len < 12 || off + len > data.size())
+            break;
+        EXPECT_EQ(get32(data, off + len - 4), len);
+        ret.push_back({get32(data, off), data.substr(off + 8, len - 12)});
+        off += len;
+    }
+    return ret;
+}
+
+std::string read_file(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+TEST(pcapng, filter_match)
+{
+    const BufferAllocated tcp4 = make_packet("10.8.0.2", "192.168.1.10", IPCommon::TCP, 40000, 443);
+    const BufferAllocated udp6 = make_packet("fd00::2", "2001:db8::53", IPCommon::UDP, 50000, 53, 100);
+
+    EXPECT_TRUE(matches("", tcp4));
+    EXPECT_TRUE(matches("ip", tcp4));
+    EXPECT_FALSE(matches("ip6", tcp4));
+    EXPECT_TRUE(matches("tcp and port 443", tcp4));
+    EXPECT_FALSE(matches("udp", tcp4));
+    EXPECT_TRUE(matches("dst port 443", tcp4));
+    EXPECT_FALSE(matches("src port 443", tcp4));
+    EXPECT_TRUE(matches("src host 10.8.0.2", tcp4));
+    EXPECT_FALSE(matches("dst host 10.8.0.2", tcp4));
+    EXPECT_TRUE(matches("net 192.168.0.0/16", tcp4));
+    EXPECT_TRUE(matches("dst net 192.168.1.8/29", tcp4));
+    EXPECT_FALSE(matches("dst net 192.168.1.0/29", tcp4));
+    EXPECT_TRUE(matches("not udp && (port 80 || port 443)", tcp4));
+    EXPECT_FALSE(matches("!tcp", tcp4));
+    EXPECT_TRUE(matches("greater 64 and less 64", tcp4));
+
+    EXPECT_TRUE(matches("ip6 and udp port 53", udp6));
+    EXPECT_TRUE(matches("host 2001:db8::53", udp6));
+    EXPECT_FALSE(matches("host 10.8.0.2", udp6));
+    EXPECT_TRUE(matches("src net fd00::/8", udp6));
+    EXPECT_FALSE(matches("less 99", udp6));
+
+    // truncated or non-IP packets never match a non-empty filter
+    BufferAllocated junk(4);
+    junk.push_back(0x45);
+    EXPECT_FALSE(matches("ip", junk));
+}
+
+TEST(pcapng, filter_errors)
+{
+    for (const char *expr : {"tcp and", "port", "port 70000", "host nothere", "(tcp", "tcp)", "bogus", "net 10.0.0.0/33"})
+        EXPECT_THROW(PacketFilter{expr}, std::exception) << expr;
+}
+
+TEST(pcapng, block_layout)
+{
+    std::string out;
+    PcapNG::section_header(out);
+    PcapNG::interface_description(out, PcapNG::LINKTYPE_RAW, 1500, "tun");
+    const unsigned char data[5] = {0x45, 1, 2, 3, 4};
+    PcapNG::enhanced_packet(out, 0, 0x0000000100000002ull, data, 5, 20, PcapNG::EPB_FLAGS_INBOUND);
+
+    const std::vector<Block> blocks = parse_blocks(out);
+    ASSERT_EQ(blocks.size(), 3u);
+
+    EXPECT_EQ(blocks[0].type, 0x0A0D0D0Au);
+    EXPECT_EQ(get32(blocks[0].body, 0), 0x1A2B3C4Du);
+
+    EXPECT_EQ(blocks[1].type, 1u);
+    std::uint16_t linktype;
+    std::memcpy(&linktype, blocks[1].body.data(), sizeof(linktype));
+    EXPECT_EQ(linktype, PcapNG::LINKTYPE_RAW);
+    EXPECT_EQ(get32(blocks[1].body, 4), 1500u);
+
+    const std::string &epb = blocks[2].body;
+    EXPECT_EQ(blocks[2].type, 6u);
+    EXPECT_EQ(get32(epb, 0), 0u);  // interface
+    EXPECT_EQ(get32(epb, 4), 1u);  // timestamp high
+    EXPECT_EQ(get32(epb, 8), 2u);  // timestamp low
+    EXPECT_EQ(get32(epb, 12), 5u); // captured length
+    EXPECT_EQ(get32(epb, 16), 20u);
+    EXPECT_EQ(std::memcmp(epb.data() + 20, data, 5), 0);
+    // padding to 4 bytes, then the flags option and end of options
+    EXPECT_EQ(epb.size(), 20u + 8u + 8u + 4u);
+    EXPECT_EQ(get32(epb, 32), PcapNG::EPB_FLAGS_INBOUND);
+}
+
+TEST(pcapng, capture_to_file)
+{
+    const std::string path = "test_pcapng_capture.pcapng";
+    PacketCapture::Ptr cap(new PacketCapture);
+
+    // disabled: nothing is recorded
+    const BufferAllocated pkt = make_packet("10.8.0.2", "10.8.0.1", IPCommon::UDP, 1000, 53);
+    cap->tun_packet(pkt, PacketCapture::OUT);
+    EXPECT_FALSE(cap->stats().running);
+    EXPECT_EQ(cap->stats().captured, 0u);
+
+    PacketCapture::Config config;
+    config.path = path;
+    config.filter = "udp port 53";
+    config.snaplen = 32;
+    config.transport = true;
+    cap->start(config);
+    ASSERT_TRUE(cap->enabled());
+
+    const BufferAllocated other = make_packet("10.8.0.2", "10.8.0.1", IPCommon::TCP, 1000, 80);
+    BufferAllocated wire(16);
+    wire.write(reinterpret_cast<const unsigned char *>("0123456789abcdef"), 16);
+    for (int i = 0; i < 10; ++i)
+    {
+        cap->tun_packet(pkt, i % 2 ? PacketCapture::IN : PacketCapture::OUT);
+        cap->tun_packet(other, PacketCapture::OUT);
+        cap->transport_packet(wire, PacketCapture::OUT);
+    }
+    cap->stop();
+
+    const PacketCapture::Stats stats = cap->stats();
+    EXPECT_FALSE(stats.running);
+    EXPECT_EQ(stats.captured, 20u);
+    EXPECT_EQ(stats.filtered, 10u);
+    EXPECT_EQ(stats.dropped, 0u);
+
+    const std::string data = read_file(path);
+    std::remove(path.c_str());
+    EXPECT_EQ(stats.bytes_written, data.size());
+
+    const std::vector<Block> blocks = parse_blocks(data);
+    ASSERT_EQ(blocks.size(), 3u + 20u);
+    unsigned int tun = 0, transport = 0;
+    for (size_t i = 3; i < blocks.size(); ++i)
+    {
+        ASSERT_EQ(blocks[i].type, 6u);
+        const std::uint32_t iface = get32(blocks[i].body, 0);
+        if (iface == 0)
+        {
+            ++tun;
+            EXPECT_EQ(get32(blocks[i].body, 12), 32u); // snaplen
+            EXPECT_EQ(get32(blocks[i].body, 16), 64u);
+        }
+        else
+        {
+            ++transport;
+            EXPECT_EQ(get32(blocks[i].body, 12), 16u);
+        }
+    }
+    EXPECT_EQ(tun, 10u);
+    EXPECT_EQ(transport, 10u);
+
+    // stopped again: nothing is recorded
+    cap->tun_packet(pkt, PacketCapture::OUT);
+    EXPECT_EQ(cap->stats().captured, 20u);
+}
+
+TEST(pcapng, ring_full_drops)
+{
+    const std::string path = "test_pcapng_drops.pcapng";
+    PacketCapture::Ptr cap(new PacketCapture);
+
+    PacketCapture::Config config;
+    config.path = path;
+    config.ring_bytes = 4096;
+    config.flush_interval = std::chrono::milliseconds(60000);
+    cap->start(config);
+
+    // the writer does not run before stop(), so the ring fills up
+    const BufferAllocated pkt = make_packet("10.8.0.2", "10.8.0.1", IPCommon::UDP, 1000, 53, 1000);
+    for (int i = 0; i < 20; ++i)
+        cap->tun_packet(pkt, PacketCapture::OUT);
+    cap->stop();
+
+    const PacketCapture::Stats stats = cap->stats();
+    EXPECT_GT(stats.captured, 0u);
+    EXPECT_GT(stats.dropped, 0u);
+    EXPECT_EQ(stats.captured + stats.dropped, 20u);
+
+    const std::string data = read_file(path);
+    std::remove(path.c_str());
+    EXPECT_EQ(parse_blocks(data).size(), 3u + stats.captured);
+}
+
+TEST(pcapng, bad_config_throws)
+{
+    PacketCapture cap;
+    PacketCapture::Config config;
+    config.path = "test_pcapng_bad.pcapng";
+    config.filter = "port";
+    EXPECT_THROW(cap.start(config), PacketFilter::packet_filter_error);
+    EXPECT_FALSE(cap.enabled());
+
+    config.filter.clear();
+    config.path = "/nonexistent-dir/x.pcapng";
+    EXPECT_THROW(cap.start(config), PacketCapture::packet_capture_error);
+    EXPECT_FALSE(cap.enabled());
+}
@@ -0,0 +1,230 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <openvpn/transport/dplpmtud.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// Drives PathMTUDiscovery over a simulated path that drops every probe
+// larger than path_mtu and answers the others after rtt.
+struct SimulatedPath
+{
+    explicit SimulatedPath(const PathMTUDiscovery::Config &config)
+        : pmtud(config)
+    {
+    }
+
+    void run_for(const Time::Duration &duration)
+    {
+        const Time end = now + duration;
+        while (now < end)
+        {
+            PathMTUDiscovery::Probe probe;
+            if (pmtud.poll(now, probe) && probe.size <= path_mtu)
+            {
+                const Time ack_time = now + rtt;
+                // nothing else happens before the ack arrives
+                if (ack_time < pmtud.next_event())
+                {
+                    now = ack_time;
+                    pmtud.acked(probe.seq, probe.size, now);
+                    continue;
+                }
+            }
+            now = std::min(pmtud.next_event(), end);
+        }
+    }
+
+    PathMTUDiscovery pmtud;
+    size_t path_mtu = 1500;
+    Time now = Time::now();
+    Time::Duration rtt = Time::Duration::milliseconds(50);
+};
+
+PathMTUDiscovery::Config test_config()
+{
+    PathMTUDiscovery::Config c;
+    c.base_plpmtu = 1200;
+    c.min_plpmtu = 576;
+    c.max_plpmtu = 1500;
+    return c;
+}
+
+} // namespace
+
+TEST(pmtud, message_roundtrip)
+{
+    BufferAllocated buf(2048);
+    PathMTUDiscovery::Message probe;
+    probe.seq = 0x01020304;
+    probe.size = 1400;
+    ASSERT_TRUE(probe.write(buf));
+    EXPECT_EQ(buf.size(), 1400u);
+
+    PathMTUDiscovery::Message msg;
+    ASSERT_TRUE(msg.read(buf));
+    EXPECT_EQ(msg.type, PathMTUDiscovery::Message::PROBE);
+    EXPECT_EQ(msg.seq, 0x01020304u);
+    EXPECT_EQ(msg.size, 1400u);
+
+    BufferAllocated ack_buf(64);
+    msg.type = PathMTUDiscovery::Message::ACK;
+    ASSERT_TRUE(msg.write(ack_buf));
+    EXPECT_EQ(ack_buf.size(), PathMTUDiscovery::Message::HEADER_SIZE);
+
+    PathMTUDiscovery::Message ack;
+    ASSERT_TRUE(ack.read(ack_buf));
+    EXPECT_EQ(ack.type, PathMTUDiscovery::Message::ACK);
+    EXPECT_EQ(ack.seq, 0x01020304u);
+    EXPECT_EQ(ack.size, 1400u);
+
+    // too small for the buffer
+    BufferAllocated small(100);
+    EXPECT_FALSE(probe.write(small));
+
+    // IP packets are not mistaken for probes
+    BufferAllocated ip(64);
+    ip.push_back(0x45);
+    ip.write(buf.c_data() + 1, 40);
+    EXPECT_FALSE(PathMTUDiscovery::Message::is_message(ip));
+    EXPECT_FALSE(ack.read(ip));
+}
+
+TEST(pmtud, search_converges)
+{
+    for (const size_t path_mtu : {1200, 1280, 1412, 1450, 1499})
+    {
+        SimulatedPath sim(test_config());
+        sim.path_mtu = path_mtu;
+        sim.pmtud.start(sim.now);
+        sim.run_for(Time::Duration::seconds(60));
+
+        EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::SEARCH_COMPLETE) << path_mtu;
+        EXPECT_LE(sim.pmtud.plpmtu(), path_mtu);
+        EXPECT_GT(sim.pmtud.plpmtu() + sim.pmtud.config().search_granularity, path_mtu);
+    }
+}
+
+TEST(pmtud, full_mtu_found_with_two_probes)
+{
+    SimulatedPath sim(test_config());
+    sim.pmtud.start(sim.now);
+    sim.run_for(Time::Duration::seconds(1));
+
+    EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::SEARCH_COMPLETE);
+    EXPECT_EQ(sim.pmtud.plpmtu(), 1500u);
+    EXPECT_EQ(sim.pmtud.stats().probes_sent, 2u);
+}
+
+TEST(pmtud, base_size_not_known_until_acked)
+{
+    PathMTUDiscovery pmtud(test_config());
+    Time now = Time::now();
+    EXPECT_FALSE(pmtud.plpmtu_known());
+    pmtud.start(now);
+
+    // base_plpmtu is only assumed until the first probe is acknowledged
+    PathMTUDiscovery::Probe base;
+    ASSERT_TRUE(pmtud.poll(now, base));
+    EXPECT_EQ(pmtud.plpmtu(), 1200u);
+    EXPECT_FALSE(pmtud.plpmtu_known());
+
+    ASSERT_TRUE(pmtud.acked(base.seq, base.size, now));
+    EXPECT_TRUE(pmtud.plpmtu_known());
+}
+
+TEST(pmtud, black_hole_falls_back)
+{
+    SimulatedPath sim(test_config());
+    sim.pmtud.start(sim.now);
+    sim.run_for(Time::Duration::seconds(10));
+    ASSERT_EQ(sim.pmtud.plpmtu(), 1500u);
+
+    // the path MTU shrinks without any ICMP feedback; the next
+    // confirmation probe fails and the search starts over
+    sim.path_mtu = 1300;
+    const PathMTUDiscovery::Config &c = sim.pmtud.config();
+    const Time::Duration detect = c.confirm_interval + c.probe_timeout * c.max_probes;
+    sim.run_for(detect + Time::Duration::seconds(1));
+    EXPECT_EQ(sim.pmtud.stats().black_holes, 1u);
+    EXPECT_LE(sim.pmtud.plpmtu(), 1300u);
+    EXPECT_TRUE(sim.pmtud.plpmtu_known());
+
+    sim.run_for(Time::Duration::seconds(60));
+    EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::SEARCH_COMPLETE);
+    EXPECT_LE(sim.pmtud.plpmtu(), 1300u);
+    EXPECT_GT(sim.pmtud.plpmtu() + c.search_granularity, 1300u);
+}
+
+TEST(pmtud, raise_after_path_grows)
+{
+    SimulatedPath sim(test_config());
+    sim.path_mtu = 1300;
+    sim.pmtud.start(sim.now);
+    sim.run_for(Time::Duration::seconds(60));
+    ASSERT_LE(sim.pmtud.plpmtu(), 1300u);
+
+    sim.path_mtu = 1500;
+    sim.run_for(sim.pmtud.config().raise_interval);
+    EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::SEARCH_COMPLETE);
+    EXPECT_EQ(sim.pmtud.plpmtu(), 1500u);
+    EXPECT_EQ(sim.pmtud.stats().black_holes, 0u);
+}
+
+TEST(pmtud, base_unreachable)
+{
+    SimulatedPath sim(test_config());
+    sim.path_mtu = 1000;
+    sim.pmtud.start(sim.now);
+    sim.run_for(Time::Duration::seconds(10));
+    EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::ERROR);
+    EXPECT_EQ(sim.pmtud.plpmtu(), 576u);
+    EXPECT_TRUE(sim.pmtud.plpmtu_known());
+
+    // base probes are retried periodically
+    sim.path_mtu = 1500;
+    sim.run_for(sim.pmtud.config().confirm_interval + Time::Duration::seconds(5));
+    EXPECT_EQ(sim.pmtud.state(), PathMTUDiscovery::SEARCH_COMPLETE);
+    EXPECT_EQ(sim.pmtud.plpmtu(), 1500u);
+}
+
+TEST(pmtud, stale_ack_ignored)
+{
+    PathMTUDiscovery pmtud(test_config());
+    Time now = Time::now();
+    pmtud.start(now);
+
+    PathMTUDiscovery::Probe base;
+    ASSERT_TRUE(pmtud.poll(now, base));
+    EXPECT_EQ(base.size, 1200u);
+    ASSERT_TRUE(pmtud.acked(base.seq, base.size, now));
+
+    PathMTUDiscovery::Probe max;
+    ASSERT_TRUE(pmtud.poll(now, max));
+    EXPECT_EQ(max.size, 1500u);
+
+    // a duplicate ack of the base probe must not confirm the max probe
+    EXPECT_FALSE(pmtud.acked(base.seq, base.size, now));
+    EXPECT_FALSE(pmtud.acked(max.seq, base.size, now));
+    EXPECT_EQ(pmtud.plpmtu(), 1200u);
+
+    // a late ack of a retransmitted probe still counts
+    now += pmtud.config().probe_timeout;
+    PathMTUDiscovery::Probe retransmit;
+    ASSERT_TRUE(pmtud.poll(now, retransmit));
+    EXPECT_EQ(retransmit.size, 1500u);
+    EXPECT_TRUE(pmtud.acked(max.seq, max.size, now));
+    EXPECT_EQ(pmtud.plpmtu(), 1500u);
+}
@@ -117,6 +117,20 @@
 #define SITER 1
 #endif
 
+// seed for the impairment decisions of the Gremlin benchmark
+#ifdef PROTO_GREMLIN_SEED
+#define GREMLIN_SEED PROTO_GREMLIN_SEED
+#else
+#define GREMLIN_SEED 1
+#endif
+
+// virtual seconds of bulk data transfer in the Gremlin benchmark
+#ifdef PROTO_GREMLIN_SECONDS
+#define GREMLIN_SECONDS PROTO_GREMLIN_SECONDS
+#else
+#define GREMLIN_SECONDS 20
+#endif
+
 // number of retries for failed test
 #ifndef N_RETRIES
 #define N_RETRIES 2
@@ -172,6 +186,7 @@
 #include <openvpn/init/initprocess.hpp>
 
 #include <openvpn/crypto/cryptodcsel.hpp>
+#include <openvpn/transport/gremlinsim.hpp>
 
 #if defined(USE_MBEDTLS_APPLE_HYBRID)
 #define USE_MBEDTLS
@@ -453,6 +468,13 @@ class TestProto : public ProtoContextCallbackInterface
     {
         return net_bytes_;
     }
+
+    void pmtu_probe_acked(std::uint32_t seq, size_t size) override
+    {
+        pmtu_acks.emplace_back(seq, size);
+    }
+
+    std::vector<std::pair<std::uint32_t, size_t>> pmtu_acks;
     size_t app_bytes() const
     {
         return app_bytes_;
@@ -970,12 +992,139 @@ static auto create_client_proto_context(ClientSSLAPI::Config::Ptr cc, Frame::Ptr
     return cp;
 }
 
+/**
+ * Create a server ssl config for testing.
+ * @return
+ */
+static auto create_server_ssl_config(Frame::Ptr frame, ServerRandomAPI::Ptr rng, bool tls_version_mismatch = false)
+{
+    const std::string ca_crt = read_text(TEST_KEYCERT_DIR "ca.crt");
+    const std::string server_crt = read_text(TEST_KEYCERT_DIR "server.crt");
+    const std::string server_key = read_text(TEST_KEYCERT_DIR "server.key");
+    const std::string dh_pem = read_text(TEST_KEYCERT_DIR "dh.pem");
+
+    ServerSSLAPI::Config::Ptr sc(new ServerSSLAPI::Config());
+    sc->set_mode(Mode(Mode::SERVER));
+    sc->set_frame(frame);
+    sc->set_rng(rng);
+    sc->load_ca(ca_crt, true);
+    sc->load_cert(server_crt);
+    sc->load_private_key(server_key);
+    sc->load_dh(dh_pem);
+    sc->set_tls_version_min(tls_version_mismatch ? TLSVersion::Type::V1_3 : TLS_VER_MIN);
+#ifdef VERBOSE
+    sc->set_debug_level(1);
+#endif
+    return sc;
+}
+
+static auto create_server_proto_context(ServerSSLAPI::Config::Ptr sc, Frame::Ptr frame, ServerRandomAPI::Ptr rng, MySessionStats::Ptr serv_stats, Time &time, const std::string &tls_crypt_v2_key_fn = "", bool use_tls_auth_with_tls_crypt_v2 = false, bool use_wkc_cache = false)
+{
+    const std::string tls_auth_key = read_text(TEST_KEYCERT_DIR "tls-auth.key");
+    const std::string tls_crypt_v2_server_key = tls_crypt_v2_key_fn.empty()
+                                                    ? read_text(TEST_KEYCERT_DIR "tls-crypt-v2-server.key")
+                                                    : "";
+
+    // server ProtoContext config
+    typedef ProtoContext ServerProtoContext;
+    ServerProtoContext::ProtoConfig::Ptr sp(new ServerProtoContext::ProtoConfig);
+    sp->ssl_factory = sc->new_factory();
+    sp->dc.set_factory(new CryptoDCSelect<ServerCryptoAPI>(sp->ssl_factory->libctx(), frame, serv_stats, rng));
+    sp->tlsprf_factory.reset(new CryptoTLSPRFFactory<ServerCryptoAPI>());
+    sp->frame = std::move(frame);
+    sp->now = &time;
+    sp->rng = rng;
+    sp->prng = rng;
+    sp->protocol = Protocol(Protocol::UDPv4);
+    sp->layer = Layer(Layer::OSI_LAYER_3);
+#ifdef PROTOv2
+    sp->enable_op32 = true;
+    sp->remote_peer_id = 101;
+#endif
+    sp->comp_ctx = CompressContext(COMP_METH, false);
+    sp->dc.set_cipher(CryptoAlgs::lookup(PROTO_CIPHER));
+    sp->dc.set_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+#ifdef USE_TLS_AUTH
+    sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
+    sp->tls_auth_key.parse(tls_auth_key);
+    sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+    sp->key_direction = 1;
+#endif
+#if defined(USE_TLS_CRYPT)
+    sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
+    sp->tls_crypt_key.parse(tls_auth_key);
+    sp->set_tls_crypt_algs();
+#endif
+#ifdef USE_TLS_CRYPT_V2
+    sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
+
+    if (tls_crypt_v2_key_fn.empty())
+    {
+        TLSCryptV2ServerKey tls_crypt_v2_key;
+        tls_crypt_v2_key.parse(tls_crypt_v2_server_key);
+        tls_crypt_v2_key.extract_key(sp->tls_crypt_key);
+    }
+
+    sp->set_tls_crypt_algs();
+    sp->tls_crypt_metadata_factory.reset(new CryptoTLSCryptMetadataFactory());
+    if (use_wkc_cache)
+        sp->tls_crypt_v2_wkc_cache.reset(new TLSCryptV2WKcCache(64, Time::Duration::seconds(3600)));
+    sp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V2;
+    sp->tls_crypt_v2_serverkey_id = !tls_crypt_v2_key_fn.empty();
+    sp->tls_crypt_v2_serverkey_dir = TEST_KEYCERT_DIR;
+
+    if (use_tls_auth_with_tls_crypt_v2)
+    {
+        sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
+        sp->tls_auth_key.parse(tls_auth_key);
+        sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+        sp->key_direction = 1;
+    }
+#endif
+#if defined(HANDSHAKE_WINDOW)
+    sp->handshake_window = Time::Duration::seconds(HANDSHAKE_WINDOW);
+#elif SITER > 1
+    sp->handshake_window = Time::Duration::seconds(30);
+#else
+    sp->handshake_window = Time::Duration::seconds(17) + Time::Duration::binary_ms(512);
+#endif
+#ifdef BECOME_PRIMARY_SERVER
+    sp->become_primary = Time::Duration::seconds(BECOME_PRIMARY_SERVER);
+#else
+    sp->become_primary = sp->handshake_window;
+#endif
+    sp->tls_timeout = Time::Duration::milliseconds(TLS_TIMEOUT_SERVER);
+#if defined(SERVER_NO_RENEG)
+    sp->renegotiate = Time::Duration::infinite();
+#else
+    // NOTE: if we don't add sp->handshake_window, both client and server reneg-sec (RENEG)
+    // will be equal and will therefore occasionally collide.  Such collisions can sometimes
+    // produce this OpenSSL error:
+    // OpenSSLContext::SSL::read_cleartext: BIO_read failed, cap=400 status=-1: error:140E0197:SSL routines:SSL_shutdown:shutdown while in init
+    // The issue was introduced by this patch in OpenSSL:
+    //   https://github.com/openssl/openssl/commit/64193c8218540499984cd63cda41f3cd491f3f59
+    sp->renegotiate = Time::Duration::seconds(RENEG) + sp->handshake_window;
+#endif
+    sp->expire = sp->renegotiate + sp->renegotiate;
+    sp->keepalive_ping = Time::Duration::seconds(5);
+    sp->keepalive_timeout = Time::Duration::seconds(60);
+    sp->keepalive_timeout_early = Time::Duration::seconds(10);
+
+#ifdef VERBOSE
+    std::cout << "SERVER OPTIONS: " << sp->options_string() << std::endl;
+    std::cout << "SERVER PEER INFO:" << std::endl;
+    std::cout << sp->peer_info_string();
+#endif
+    return sp;
+}
+
 // execute the unit test in one thread
 int test(const int thread_num,
          bool use_tls_ekm,
          bool tls_version_mismatch,
          const std::string &tls_crypt_v2_key_fn = "",
-         bool use_tls_auth_with_tls_crypt_v2 = false)
+         bool use_tls_auth_with_tls_crypt_v2 = false,
+         bool use_wkc_cache = false)
 {
     try
     {
@@ -991,16 +1140,6 @@ int test(const int thread_num,
         Time time;
         const Time::Duration time_step = Time::Duration::binary_ms(100);
 
-        // config files
-        const std::string ca_crt = read_text(TEST_KEYCERT_DIR "ca.crt");
-        const std::string server_crt = read_text(TEST_KEYCERT_DIR "server.crt");
-        const std::string server_key = read_text(TEST_KEYCERT_DIR "server.key");
-        const std::string dh_pem = read_text(TEST_KEYCERT_DIR "dh.pem");
-        const std::string tls_auth_key = read_text(TEST_KEYCERT_DIR "tls-auth.key");
-        const std::string tls_crypt_v2_server_key = tls_crypt_v2_key_fn.empty()
-                                                        ? read_text(TEST_KEYCERT_DIR "tls-crypt-v2-server.key")
-                                                        : "";
-
         // client config
         ClientSSLAPI::Config::Ptr cc = create_client_ssl_config(frame, prng_cli, tls_version_mismatch);
         MySessionStats::Ptr cli_stats(new MySessionStats);
@@ -1011,111 +1150,11 @@ int test(const int thread_num,
 
         // server config
         MySessionStats::Ptr serv_stats(new MySessionStats);
+        ServerSSLAPI::Config::Ptr sc = create_server_ssl_config(frame, prng_serv, tls_version_mismatch);
 
-        ServerSSLAPI::Config::Ptr sc(new ClientSSLAPI::Config());
-        sc->set_mode(Mode(Mode::SERVER));
-        sc->set_frame(frame);
-        sc->set_rng(prng_serv);
-        sc->load_ca(ca_crt, true);
-        sc->load_cert(server_crt);
-        sc->load_private_key(server_key);
-        sc->load_dh(dh_pem);
-        sc->set_tls_version_min(tls_version_mismatch ? TLSVersion::Type::V1_3 : TLS_VER_MIN);
-#ifdef VERBOSE
-        sc->set_debug_level(1);
-#endif
-
-        // server ProtoContext config
-        typedef ProtoContext ServerProtoContext;
-        ServerProtoContext::ProtoConfig::Ptr sp(new ServerProtoContext::ProtoConfig);
-        sp->ssl_factory = sc->new_factory();
-        sp->dc.set_factory(new CryptoDCSelect<ServerCryptoAPI>(sp->ssl_factory->libctx(), frame, serv_stats, prng_serv));
-        sp->tlsprf_factory.reset(new CryptoTLSPRFFactory<ServerCryptoAPI>());
-        sp->frame = frame;
-        sp->now = &time;
-        sp->rng = prng_serv;
-        sp->prng = prng_serv;
-        sp->protocol = Protocol(Protocol::UDPv4);
-        sp->layer = Layer(Layer::OSI_LAYER_3);
-#ifdef PROTOv2
-        sp->enable_op32 = true;
-        sp->remote_peer_id = 101;
-#endif
-        sp->comp_ctx = CompressContext(COMP_METH, false);
-        sp->dc.set_cipher(CryptoAlgs::lookup(PROTO_CIPHER));
-        sp->dc.set_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+        auto sp = create_server_proto_context(std::move(sc), frame, prng_serv, serv_stats, time, tls_crypt_v2_key_fn, use_tls_auth_with_tls_crypt_v2, use_wkc_cache);
         if (use_tls_ekm)
             sp->dc.set_key_derivation(CryptoAlgs::KeyDerivation::TLS_EKM);
-#ifdef USE_TLS_AUTH
-        sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
-        sp->tls_auth_key.parse(tls_auth_key);
-        sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
-        sp->key_direction = 1;
-#endif
-#if defined(USE_TLS_CRYPT)
-        sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
-        sp->tls_crypt_key.parse(tls_auth_key);
-        sp->set_tls_crypt_algs();
-        cp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V1;
-#endif
-#ifdef USE_TLS_CRYPT_V2
-        sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
-
-        if (tls_crypt_v2_key_fn.empty())
-        {
-            TLSCryptV2ServerKey tls_crypt_v2_key;
-            tls_crypt_v2_key.parse(tls_crypt_v2_server_key);
-            tls_crypt_v2_key.extract_key(sp->tls_crypt_key);
-        }
-
-        sp->set_tls_crypt_algs();
-        sp->tls_crypt_metadata_factory.reset(new CryptoTLSCryptMetadataFactory());
-        sp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V2;
-        sp->tls_crypt_v2_serverkey_id = !tls_crypt_v2_key_fn.empty();
-        sp->tls_crypt_v2_serverkey_dir = TEST_KEYCERT_DIR;
-
-        if (use_tls_auth_with_tls_crypt_v2)
-        {
-            sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
-            sp->tls_auth_key.parse(tls_auth_key);
-            sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
-            sp->key_direction = 1;
-        }
-#endif
-#if defined(HANDSHAKE_WINDOW)
-        sp->handshake_window = Time::Duration::seconds(HANDSHAKE_WINDOW);
-#elif SITER > 1
-        sp->handshake_window = Time::Duration::seconds(30);
-#else
-        sp->handshake_window = Time::Duration::seconds(17) + Time::Duration::binary_ms(512);
-#endif
-#ifdef BECOME_PRIMARY_SERVER
-        sp->become_primary = Time::Duration::seconds(BECOME_PRIMARY_SERVER);
-#else
-        sp->become_primary = sp->handshake_window;
-#endif
-        sp->tls_timeout = Time::Duration::milliseconds(TLS_TIMEOUT_SERVER);
-#if defined(SERVER_NO_RENEG)
-        sp->renegotiate = Time::Duration::infinite();
-#else
-        // NOTE: if we don't add sp->handshake_window, both client and server reneg-sec (RENEG)
-        // will be equal and will therefore occasionally collide.  Such collisions can sometimes
-        // produce this OpenSSL error:
-        // OpenSSLContext::SSL::read_cleartext: BIO_read failed, cap=400 status=-1: error:140E0197:SSL routines:SSL_shutdown:shutdown while in init
-        // The issue was introduced by this patch in OpenSSL:
-        //   https://github.com/openssl/openssl/commit/64193c8218540499984cd63cda41f3cd491f3f59
-        sp->renegotiate = Time::Duration::seconds(RENEG) + sp->handshake_window;
-#endif
-        sp->expire = sp->renegotiate + sp->renegotiate;
-        sp->keepalive_ping = Time::Duration::seconds(5);
-        sp->keepalive_timeout = Time::Duration::seconds(60);
-        sp->keepalive_timeout_early = Time::Duration::seconds(10);
-
-#ifdef VERBOSE
-        std::cout << "SERVER OPTIONS: " << sp->options_string() << std::endl;
-        std::cout << "SERVER PEER INFO:" << std::endl;
-        std::cout << sp->peer_info_string();
-#endif
 
         TestProtoClient cli_proto(cp, cli_stats);
         TestProtoServer serv_proto(sp, serv_stats);
@@ -1161,6 +1200,15 @@ int test(const int thread_num,
         cli_proto.finalize();
         serv_proto.finalize();
 
+        if (use_wkc_cache
+            && serv_stats->get_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_HITS)
+                       + serv_stats->get_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_MISSES)
+                   == 0)
+        {
+            std::cerr << "Exception: WKc cache was never consulted" << std::endl;
+            return 1;
+        }
+
         const size_t ab = cli_proto.app_bytes() + serv_proto.app_bytes();
         const size_t nb = cli_proto.net_bytes() + serv_proto.net_bytes();
         const size_t db = cli_proto.data_bytes() + serv_proto.data_bytes();
@@ -1202,12 +1250,13 @@ int test_retry(const int thread_num,
                bool use_tls_ekm,
                bool tls_version_mismatch = false,
                const std::string &tls_crypt_v2_key_fn = "",
-               bool use_tls_auth_with_tls_crypt_v2 = false)
+               bool use_tls_auth_with_tls_crypt_v2 = false,
+               bool use_wkc_cache = false)
 {
     int ret = 1;
     for (int i = 0; i < n_retries; ++i)
     {
-        ret = test(thread_num, use_tls_ekm, tls_version_mismatch, tls_crypt_v2_key_fn, use_tls_auth_with_tls_crypt_v2);
+        ret = test(thread_num, use_tls_ekm, tls_version_mismatch, tls_crypt_v2_key_fn, use_tls_auth_with_tls_crypt_v2, use_wkc_cache);
         if (!ret)
             return 0;
         std::cout << "Retry " << (i + 1) << '/' << n_retries << std::endl;
@@ -1295,6 +1344,18 @@ TEST_F(ProtoUnitTest, base_single_thread_tls_crypt_v2_with_tls_auth_also_active)
     int ret = test_retry(1, N_RETRIES, false, false, "tls-crypt-v2-client-with-serverkey.key", true);
     EXPECT_EQ(ret, 0);
 }
+
+TEST_F(ProtoUnitTest, base_single_thread_tls_crypt_v2_wkc_cache)
+{
+    int ret = test_retry(1, N_RETRIES, false, false, "", false, true);
+    EXPECT_EQ(ret, 0);
+}
+
+TEST_F(ProtoUnitTest, base_single_thread_tls_crypt_v2_wkc_cache_with_embedded_serverkey)
+{
+    int ret = test_retry(1, N_RETRIES, false, false, "tls-crypt-v2-client-with-serverkey.key", false, true);
+    EXPECT_EQ(ret, 0);
+}
 #endif
 
 TEST_F(ProtoUnitTest, base_multiple_thread)
@@ -1327,6 +1388,401 @@ TEST_F(ProtoUnitTest, base_multiple_thread)
     EXPECT_THAT(expected_results, ::testing::ContainerEq(results));
 }
 
+// Result of running a client/server pair over a simulated impaired network
+struct GremlinBenchResult
+{
+    bool handshake_done = false;
+    Time::Duration handshake_time;   // virtual time until both sides had a data channel
+    double goodput_kbps = 0.0;       // decrypted data channel payload at the server
+    count_t retransmits = 0;         // reliable-layer retransmits, both directions
+    count_t replay_drops = 0;        // data channel packets rejected by the replay window
+    Gremlin::SimLink::Stats c2s;
+    Gremlin::SimLink::Stats s2c;
+
+    std::string to_string() const
+    {
+        std::ostringstream os;
+        os << "hs_ms=" << (handshake_done ? std::to_string(handshake_time.to_milliseconds()) : std::string("FAIL"))
+           << " goodput_kbps=" << static_cast<unsigned long>(goodput_kbps)
+           << " retx=" << retransmits
+           << " replay_drops=" << replay_drops
+           << " c2s[" << c2s.to_string() << ']'
+           << " s2c[" << s2c.to_string() << ']';
+        return os.str();
+    }
+};
+
+// Deliver everything that has arrived on the link to the receiving side
+template <typename T>
+static void gremlin_deliver(Gremlin::SimLink &link, const Time &now, T &b)
+{
+    while (BufferPtr bp = link.recv(now))
+    {
+        const ProtoContext::PacketType pt = b.proto_context.packet_type(*bp);
+        if (pt.is_control())
+            b.proto_context.control_net_recv(pt, std::move(bp));
+        else if (pt.is_data())
+        {
+            try
+            {
+                b.data_decrypt(pt, *bp);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+    }
+    b.proto_context.flush(true);
+}
+
+template <typename T>
+static void gremlin_transmit(T &a, Gremlin::SimLink &link, const Time &now)
+{
+    while (!a.net_out.empty())
+    {
+        link.send(std::move(a.net_out.front()), now);
+        a.net_out.pop_front();
+    }
+}
+
+/**
+ * Run a client/server ProtoContext pair in virtual time over two seeded
+ * Gremlin::SimLink objects (one per direction).  Once the data channel is
+ * up, the client offers a constant stream of data channel packets for
+ * `seconds` virtual seconds.  Time advances from event to event, so the
+ * run does not depend on wall-clock time or on any network access.
+ */
+static GremlinBenchResult gremlin_bench(const Gremlin::Profile &profile,
+                                        const std::uint64_t seed,
+                                        const unsigned int seconds,
+                                        const unsigned int offered_pps = 1000)
+{
+    Frame::Ptr frame(new Frame(Frame::Context(128, 1400, 128, 0, 16, BufAllocFlags::NO_FLAGS)));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    Time time;
+
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(create_server_ssl_config(frame, prng_serv), frame, prng_serv, serv_stats, time);
+
+    // we are measuring recovery, not testing the handshake timeouts
+    cp->handshake_window = sp->handshake_window = Time::Duration::seconds(120);
+    cp->become_primary = sp->become_primary = cp->handshake_window;
+    cp->renegotiate = sp->renegotiate = Time::Duration::infinite();
+    cp->expire = sp->expire = Time::Duration::infinite();
+
+    TestProtoClient cli_proto(cp, cli_stats);
+    TestProtoServer serv_proto(sp, serv_stats);
+    cli_proto.reset();
+    serv_proto.reset();
+
+    Gremlin::SimLink c2s(profile, seed);
+    Gremlin::SimLink s2c(profile, seed ^ 0x5a5a5a5a5a5a5a5aull);
+
+    GremlinBenchResult res;
+    const Time::Duration send_interval = Time::Duration::binary_ms(std::max(1u, Time::prec / offered_pps));
+    const std::string payload(1000, 'G');
+    Time data_start = Time::infinite();
+    Time data_end = Time::infinite();
+    Time next_data_send = Time::infinite();
+    const Time deadline = time + Time::Duration::seconds(120 + seconds);
+
+    cli_proto.proto_context.start();
+    serv_proto.start();
+    cli_proto.proto_context.flush(true);
+
+    while (time < deadline && time < data_end)
+    {
+        cli_proto.check_invalidated();
+        serv_proto.check_invalidated();
+
+        cli_proto.do_housekeeping();
+        serv_proto.do_housekeeping();
+
+        if (!res.handshake_done
+            && cli_proto.proto_context.data_channel_ready()
+            && serv_proto.proto_context.data_channel_ready())
+        {
+            res.handshake_done = true;
+            res.handshake_time = time - Time();
+            data_start = next_data_send = time;
+            data_end = time + Time::Duration::seconds(seconds);
+        }
+
+        while (next_data_send <= time)
+        {
+            BufferPtr bp = cli_proto.data_encrypt_string(payload.c_str());
+            cli_proto.net_out.push_back(std::move(bp));
+            next_data_send += send_interval;
+        }
+
+        gremlin_transmit(cli_proto, c2s, time);
+        gremlin_transmit(serv_proto, s2c, time);
+        gremlin_deliver(c2s, time, serv_proto);
+        gremlin_deliver(s2c, time, cli_proto);
+        gremlin_transmit(cli_proto, c2s, time);
+        gremlin_transmit(serv_proto, s2c, time);
+
+        // advance virtual time to the next event
+        Time next = std::min(c2s.next_delivery(), s2c.next_delivery());
+        next.min(cli_proto.proto_context.next_housekeeping());
+        next.min(serv_proto.proto_context.next_housekeeping());
+        next.min(next_data_send);
+        next.min(data_end);
+        time = std::max(next, time + Time::Duration::binary_ms(1));
+    }
+
+    if (res.handshake_done)
+    {
+        const double secs = (time - data_start).to_double();
+        if (secs > 0.0)
+            res.goodput_kbps = double(serv_proto.data_bytes()) * 8.0 / secs / 1000.0;
+    }
+    res.retransmits = cli_proto.proto_context.control_retransmits() + serv_proto.proto_context.control_retransmits();
+    res.replay_drops = cli_stats->get_error_count(Error::REPLAY_ERROR) + serv_stats->get_error_count(Error::REPLAY_ERROR);
+    res.c2s = c2s.stats();
+    res.s2c = s2c.stats();
+    return res;
+}
+
+// Path MTU probes are answered by the peer's ProtoContext and never
+// reach its tun
+TEST(proto, pmtu_probe_answered)
+{
+    Frame::Ptr frame(new Frame(Frame::Context(128, 1400, 128, 0, 16, BufAllocFlags::NO_FLAGS)));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    Time time;
+
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(create_server_ssl_config(frame, prng_serv), frame, prng_serv, serv_stats, time);
+
+    TestProtoClient cli_proto(cp, cli_stats);
+    TestProtoServer serv_proto(sp, serv_stats);
+    cli_proto.reset();
+    serv_proto.reset();
+
+    const Gremlin::Profile profile = Gremlin::Profile::preset("ideal");
+    Gremlin::SimLink c2s(profile, 1);
+    Gremlin::SimLink s2c(profile, 2);
+
+    cli_proto.proto_context.start();
+    serv_proto.start();
+    cli_proto.proto_context.flush(true);
+
+    bool probed = false;
+    const Time deadline = time + Time::Duration::seconds(30);
+    while (time < deadline && cli_proto.pmtu_acks.size() < 2)
+    {
+        cli_proto.do_housekeeping();
+        serv_proto.do_housekeeping();
+
+        if (!probed && cli_proto.proto_context.data_channel_ready() && serv_proto.proto_context.data_channel_ready())
+        {
+            EXPECT_TRUE(cli_proto.proto_context.send_pmtu_probe(7, 1300));
+            EXPECT_TRUE(cli_proto.proto_context.send_pmtu_probe(8, 200));
+            probed = true;
+        }
+
+        gremlin_transmit(cli_proto, c2s, time);
+        gremlin_transmit(serv_proto, s2c, time);
+        gremlin_deliver(c2s, time, serv_proto);
+        gremlin_deliver(s2c, time, cli_proto);
+        gremlin_transmit(cli_proto, c2s, time);
+        gremlin_transmit(serv_proto, s2c, time);
+
+        Time next = std::min(c2s.next_delivery(), s2c.next_delivery());
+        next.min(cli_proto.proto_context.next_housekeeping());
+        next.min(serv_proto.proto_context.next_housekeeping());
+        time = std::max(next, time + Time::Duration::binary_ms(1));
+    }
+
+    ASSERT_TRUE(probed);
+    ASSERT_EQ(cli_proto.pmtu_acks.size(), 2u);
+    EXPECT_EQ(cli_proto.pmtu_acks[0], std::make_pair(std::uint32_t(7), size_t(1300)));
+    EXPECT_EQ(cli_proto.pmtu_acks[1], std::make_pair(std::uint32_t(8), size_t(200)));
+    EXPECT_EQ(serv_proto.data_bytes(), 0u);
+    EXPECT_TRUE(serv_proto.pmtu_acks.empty());
+}
+
+// An established session that has gone idle releases its control
+// channel queues, reliability windows and handshake state, and the
+// control channel keeps working afterwards
+TEST(proto, idle_session_memory_budget)
+{
+    Frame::Ptr frame(new Frame(Frame::Context(128, 1400, 128, 0, 16, BufAllocFlags::NO_FLAGS)));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    Time time;
+
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(create_server_ssl_config(frame, prng_serv), frame, prng_serv, serv_stats, time);
+
+    TestProtoClient cli_proto(cp, cli_stats);
+    TestProtoServer serv_proto(sp, serv_stats);
+    cli_proto.reset();
+    serv_proto.reset();
+
+    const Gremlin::Profile profile = Gremlin::Profile::preset("ideal");
+    Gremlin::SimLink c2s(profile, 1);
+    Gremlin::SimLink s2c(profile, 2);
+
+    const ProtoMemoryUsage before_start = serv_proto.proto_context.memory_usage();
+
+    cli_proto.proto_context.start();
+    serv_proto.start();
+    cli_proto.proto_context.flush(true);
+
+    auto run = [&](const Time::Duration &duration)
+    {
+        const Time end = time + duration;
+        while (time < end)
+        {
+            cli_proto.check_invalidated();
+            serv_proto.check_invalidated();
+            cli_proto.do_housekeeping();
+            serv_proto.do_housekeeping();
+
+            gremlin_transmit(cli_proto, c2s, time);
+            gremlin_transmit(serv_proto, s2c, time);
+            gremlin_deliver(c2s, time, serv_proto);
+            gremlin_deliver(s2c, time, cli_proto);
+            gremlin_transmit(cli_proto, c2s, time);
+            gremlin_transmit(serv_proto, s2c, time);
+
+            Time next = std::min(c2s.next_delivery(), s2c.next_delivery());
+            next.min(cli_proto.proto_context.next_housekeeping());
+            next.min(serv_proto.proto_context.next_housekeeping());
+            next.min(end);
+            time = std::max(next, time + Time::Duration::binary_ms(1));
+        }
+    };
+
+    // handshake and some data, then idle with keepalives
+    run(Time::Duration::seconds(5));
+    ASSERT_TRUE(cli_proto.proto_context.data_channel_ready());
+    ASSERT_TRUE(serv_proto.proto_context.data_channel_ready());
+    for (int i = 0; i < 10; ++i)
+        cli_proto.net_out.push_back(cli_proto.data_encrypt_string("data"));
+    run(Time::Duration::seconds(30));
+    EXPECT_EQ(serv_proto.data_bytes(), 40u);
+
+    // what housekeeping left allocated once everything drained
+    const ProtoMemoryUsage idle = serv_proto.proto_context.memory_usage();
+    OPENVPN_LOG("server session before start: " << before_start.to_string());
+    OPENVPN_LOG("server session idle: " << idle.to_string());
+    EXPECT_LE(idle.reliable, 64u); // just the short re-ACK history
+    EXPECT_EQ(idle.queues, 0u);
+    EXPECT_EQ(idle.ssl_queues, 0u);
+    EXPECT_EQ(idle.buffers, 0u);
+    EXPECT_LT(idle.total(), 10u * 1024u);
+    EXPECT_LT(cli_proto.proto_context.memory_usage().total(), 10u * 1024u);
+
+    // the queues come back on demand
+    const size_t n_control_recv = cli_proto.n_control_recv();
+    serv_proto.control_send(BufferAllocated((const unsigned char *)"PUSH_REPLY", 11, BufAllocFlags::NO_FLAGS));
+    serv_proto.proto_context.flush(true);
+    EXPECT_GT(serv_proto.proto_context.memory_usage().total(), idle.total());
+    run(Time::Duration::seconds(1));
+    EXPECT_GT(cli_proto.n_control_recv(), n_control_recv);
+}
+
+class GremlinBenchTest : public ProtoUnitTest,
+                         public testing::WithParamInterface<std::string>
+{
+};
+
+TEST_P(GremlinBenchTest, profile)
+{
+    const Gremlin::Profile profile = Gremlin::Profile::preset(GetParam());
+    const GremlinBenchResult res = gremlin_bench(profile, GREMLIN_SEED, GREMLIN_SECONDS);
+
+    std::cerr << "*** gremlin " << profile.to_string() << " seed=" << GREMLIN_SEED << ' ' << res.to_string() << std::endl;
+
+    EXPECT_TRUE(res.handshake_done);
+    EXPECT_GT(res.goodput_kbps, 0.0);
+}
+
+INSTANTIATE_TEST_SUITE_P(DISABLED_ProtoGremlin,
+                         GremlinBenchTest,
+                         testing::Values("ideal", "lan", "wifi", "lte", "3g", "lossy", "satellite"));
+
+// short run of the impairment benchmark on the lossy profile
+TEST_F(ProtoUnitTest, gremlin_lossy)
+{
+    const GremlinBenchResult res = gremlin_bench(Gremlin::Profile::preset("lossy"), GREMLIN_SEED, 5);
+    EXPECT_TRUE(res.handshake_done);
+    EXPECT_GT(res.goodput_kbps, 0.0);
+}
+
+TEST(proto, tls_timeout_options)
+{
+    ProtoContext::ProtoConfig conf;
+    EXPECT_FALSE(conf.tls_timeout_adaptive);
+    EXPECT_EQ(conf.tls_send_window, 6u);
+
+    ProtoContextCompressionOptions pco;
+    OptionList opt;
+    opt.parse_from_config("tls-timeout-adaptive 1\n"
+                          "tls-timeout-min-ms 300\n"
+                          "tls-timeout-max 30\n"
+                          "tls-send-window 8\n",
+                          nullptr);
+    opt.update_map();
+    conf.process_push(opt, pco);
+    EXPECT_TRUE(conf.tls_timeout_adaptive);
+    EXPECT_EQ(conf.tls_timeout_min, Time::Duration::milliseconds(300));
+    EXPECT_EQ(conf.tls_timeout_max, Time::Duration::seconds(30));
+
+    // the send window is not taken from the server
+    EXPECT_EQ(conf.tls_send_window, 6u);
+
+    // but from the local configuration, up to the receive window of the peer
+    OptionList local;
+    local.parse_from_config("dev tun\n"
+                            "tls-send-window 8\n",
+                            nullptr);
+    local.update_map();
+    conf.load(local, pco, 0, false);
+    EXPECT_EQ(conf.tls_send_window, 8u);
+
+    OptionList bad;
+    bad.parse_from_config("dev tun\n"
+                          "tls-send-window 9\n",
+                          nullptr);
+    bad.update_map();
+    EXPECT_THROW(conf.load(bad, pco, 0, false), option_error);
+}
+
+TEST(proto, iv_pmtu_probe)
+{
+    auto protoConf = openvpn::ProtoContext::ProtoConfig();
+
+    std::string infostring = protoConf.peer_info_string(false);
+    EXPECT_EQ(infostring.find("IV_PMTU_PROBE"), std::string::npos);
+    OptionList peer_info;
+    peer_info.parse_from_peer_info(infostring, nullptr);
+    peer_info.update_map();
+    EXPECT_FALSE(ProtoContext::IvProtoHelper(peer_info).client_supports_pmtu_probe());
+
+    protoConf.pmtu_probe_advertise = true;
+    infostring = protoConf.peer_info_string(false);
+    EXPECT_NE(infostring.find("\nIV_PMTU_PROBE=1\n"), std::string::npos);
+    peer_info.clear();
+    peer_info.parse_from_peer_info(infostring, nullptr);
+    peer_info.update_map();
+    EXPECT_TRUE(ProtoContext::IvProtoHelper(peer_info).client_supports_pmtu_probe());
+
+    // bit 13 of IV_PROTO belongs to OpenVPN 2, not to path MTU probes
+    EXPECT_EQ(peer_info.get_num<unsigned int>("IV_PROTO", 1, 0) & (1 << 13), 0u);
+}
+
 TEST(proto, iv_ciphers_aead)
 {
     CryptoAlgs::allow_default_dc_algs<SSLLib::CryptoAPI>(nullptr, true, false);
@@ -1508,3 +1964,131 @@ TEST(proto, client_proto_check_cc_msg)
     EXPECT_EQ(uf->name, "Invalid chars in control message");
     EXPECT_EQ(uf->reason, "Control channel message with invalid characters not allowed to be send with post_cc_msg");
 }
+
+class CountingTLSCryptMetadata : public TLSCryptMetadata
+{
+  public:
+    bool verify(int type, Buffer &metadata) const override
+    {
+        ++n_verify;
+        return true;
+    }
+
+    mutable int n_verify = 0;
+};
+
+// Wrap a WKc in a minimal P_CONTROL_HARD_RESET_CLIENT_V3 packet.  Only the
+// size of the tls-crypt frame in front of the WKc matters for unwrapping.
+static BufferAllocated wkc_hard_reset_packet(const Buffer &wkc, const size_t hmac_size)
+{
+    const size_t frame_size = 1 + ProtoSessionID::SIZE + PacketIDControl::size() + hmac_size + 1 + 4;
+    BufferAllocated pkt(frame_size + wkc.size(), BufAllocFlags::CONSTRUCT_ZERO);
+    pkt.set_size(frame_size);
+    pkt[0] = 10 << 3; // P_CONTROL_HARD_RESET_CLIENT_V3, key ID 0
+    pkt.write(wkc.c_data(), wkc.size());
+    return pkt;
+}
+
+TEST(proto, tls_crypt_v2_wkc_cache)
+{
+    Time now(Time::now());
+
+    ProtoContext::ProtoConfig sp;
+    sp.now = &now;
+    sp.tls_crypt_factory.reset(new CryptoTLSCryptFactory<SSLLib::CryptoAPI>());
+    sp.set_tls_crypt_algs();
+    sp.tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V2;
+    TLSCryptV2ServerKey server_key;
+    server_key.parse(read_text(TEST_KEYCERT_DIR "tls-crypt-v2-server.key"));
+    server_key.extract_key(sp.tls_crypt_key);
+    sp.tls_crypt_v2_wkc_cache.reset(new TLSCryptV2WKcCache(16, Time::Duration::seconds(60)));
+
+    TLSCryptInstance::Ptr tls_crypt_server = sp.tls_crypt_context->new_obj_recv();
+    tls_crypt_server->init(nullptr,
+                           sp.tls_crypt_key.slice(OpenVPNStaticKey::HMAC),
+                           sp.tls_crypt_key.slice(OpenVPNStaticKey::CIPHER));
+
+    BufferAllocated wkc;
+    OpenVPNStaticKey client_key;
+    TLSCryptV2ClientKey tls_crypt_v2_key(sp.tls_crypt_context);
+    tls_crypt_v2_key.parse(read_text(TEST_KEYCERT_DIR "tls-crypt-v2-client.key"));
+    tls_crypt_v2_key.extract_key(client_key);
+    tls_crypt_v2_key.extract_wkc(wkc);
+
+    const size_t hmac_size = sp.tls_crypt_context->digest_size();
+    RCPtr<CountingTLSCryptMetadata> metadata(new CountingTLSCryptMetadata);
+    SessionStats::Ptr session_stats(new SessionStats);
+    auto unwrap = [&](Buffer &&pkt) -> Error::Type
+    {
+        sp.wrapped_tls_crypt_key.erase();
+        const size_t frame_size = pkt.size() - wkc.size();
+        const Error::Type ret = ProtoContext::KeyContext::unwrap_tls_crypt_wkc(pkt, sp, *tls_crypt_server, metadata, session_stats.get());
+        if (ret == Error::SUCCESS)
+        {
+            EXPECT_EQ(pkt.size(), frame_size);
+            EXPECT_EQ(sp.wrapped_tls_crypt_key.render(), client_key.render());
+        }
+        return ret;
+    };
+
+    // first unwrap populates the cache, the second is served from it
+    EXPECT_EQ(unwrap(wkc_hard_reset_packet(wkc, hmac_size)), Error::SUCCESS);
+    EXPECT_EQ(unwrap(wkc_hard_reset_packet(wkc, hmac_size)), Error::SUCCESS);
+    EXPECT_EQ(metadata->n_verify, 1);
+    TLSCryptV2WKcCache::Stats stats = sp.tls_crypt_v2_wkc_cache->stats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.size, 1u);
+    EXPECT_EQ(session_stats->get_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_HITS), 1);
+    EXPECT_EQ(session_stats->get_stat(SessionStats::TLS_CRYPT_V2_WKC_CACHE_MISSES), 1);
+
+    // a tampered WKc misses the cache and fails authentication
+    BufferAllocated bad = wkc_hard_reset_packet(wkc, hmac_size);
+    bad[bad.size() - wkc.size() + hmac_size + 5] ^= 1;
+    EXPECT_EQ(unwrap(std::move(bad)), Error::HMAC_ERROR);
+    EXPECT_EQ(sp.tls_crypt_v2_wkc_cache->stats().size, 1u);
+
+    // expired entries are unwrapped and verified again
+    now += Time::Duration::seconds(61);
+    EXPECT_EQ(unwrap(wkc_hard_reset_packet(wkc, hmac_size)), Error::SUCCESS);
+    EXPECT_EQ(metadata->n_verify, 2);
+    EXPECT_EQ(sp.tls_crypt_v2_wkc_cache->stats().expired, 1u);
+
+    // explicit invalidation, e.g. after revoking the client
+    EXPECT_EQ(sp.tls_crypt_v2_wkc_cache->invalidate_if([](const TLSCryptV2WKcCache::Entry &)
+                                                       { return true; }),
+              1u);
+    EXPECT_EQ(unwrap(wkc_hard_reset_packet(wkc, hmac_size)), Error::SUCCESS);
+    EXPECT_EQ(metadata->n_verify, 3);
+
+    // without metadata verification nothing new is cached
+    sp.tls_crypt_v2_wkc_cache->clear();
+    BufferAllocated pkt = wkc_hard_reset_packet(wkc, hmac_size);
+    EXPECT_EQ(ProtoContext::KeyContext::unwrap_tls_crypt_wkc(pkt, sp, *tls_crypt_server), Error::SUCCESS);
+    EXPECT_EQ(sp.tls_crypt_v2_wkc_cache->stats().size, 0u);
+}
+
+TEST(proto, tls_crypt_v2_wkc_cache_lru)
+{
+    TLSCryptV2WKcCache cache(2, Time::Duration::seconds(60));
+    const Time now(Time::now());
+    const unsigned char a[] = "wkc-a", b[] = "wkc-b", c[] = "wkc-c";
+    OpenVPNStaticKey key;
+
+    cache.insert(a, sizeof(a), now, key, -1, "");
+    cache.insert(b, sizeof(b), now, key, -1, "");
+    EXPECT_TRUE(cache.lookup(a, sizeof(a), now, key)); // b is now least recently used
+    cache.insert(c, sizeof(c), now, key, -1, "");
+    EXPECT_TRUE(cache.lookup(a, sizeof(a), now, key));
+    EXPECT_FALSE(cache.lookup(b, sizeof(b), now, key));
+    EXPECT_TRUE(cache.lookup(c, sizeof(c), now, key));
+    EXPECT_TRUE(cache.invalidate(c, sizeof(c)));
+    EXPECT_FALSE(cache.invalidate(c, sizeof(c)));
+
+    const TLSCryptV2WKcCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 3u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.invalidated, 1u);
+    EXPECT_EQ(stats.size, 1u);
+}
@@ -18,6 +18,7 @@
 #include <openvpn/reliable/relrecv.hpp>
 #include <openvpn/reliable/relsend.hpp>
 #include <openvpn/reliable/relack.hpp>
+#include <openvpn/reliable/relrtt.hpp>
 #include <openvpn/crypto/packet_id_control.hpp>
 
 using namespace openvpn;
@@ -369,6 +370,131 @@ TEST(reliable, simulation)
     }
 }
 
+TEST(reliable, rtt_estimator)
+{
+    ReliableRTT rtt(Time::Duration::seconds(1),
+                    Time::Duration::milliseconds(200),
+                    Time::Duration::seconds(16));
+    EXPECT_EQ(rtt.rto(), Time::Duration::seconds(1));
+
+    // first sample: SRTT = R, RTTVAR = R/2, RTO = SRTT + 4*RTTVAR
+    rtt.sample(Time::Duration::binary_ms(100));
+    EXPECT_EQ(rtt.srtt().raw(), 100u);
+    EXPECT_EQ(rtt.rttvar().raw(), 50u);
+    EXPECT_EQ(rtt.rto().raw(), 300u);
+
+    // steady samples converge on the sample value, bounded below by min_rto
+    for (int i = 0; i < 50; ++i)
+        rtt.sample(Time::Duration::binary_ms(100));
+    EXPECT_EQ(rtt.srtt().raw(), 100u);
+    EXPECT_EQ(rtt.rto(), Time::Duration::milliseconds(200));
+    EXPECT_EQ(rtt.n_samples(), 51u);
+
+    // exponential backoff, bounded by max_rto
+    EXPECT_EQ(rtt.backoff(0), rtt.rto());
+    EXPECT_EQ(rtt.backoff(1).raw(), 2 * rtt.rto().raw());
+    EXPECT_EQ(rtt.backoff(3).raw(), 8 * rtt.rto().raw());
+    EXPECT_EQ(rtt.backoff(20), Time::Duration::seconds(16));
+}
+
+namespace {
+BufferPtr rel_packet()
+{
+    return BufferAllocatedRc::Create(16, BufAllocFlags::ARRAY);
+}
+} // namespace
+
+TEST(reliable, adaptive_timeout)
+{
+    const Time::Duration tls_timeout = Time::Duration::seconds(2);
+    ReliableSend send(4);
+    send.enable_adaptive_timeout(tls_timeout, Time::Duration::milliseconds(200), Time::Duration::seconds(16));
+    Time now = Time::now();
+
+    // before any RTT sample the initial timeout is used
+    ReliableSend::Message &m0 = send.send(now, tls_timeout);
+    m0.packet = Packet(rel_packet());
+    EXPECT_EQ(send.until_retransmit(now), tls_timeout);
+
+    // an ACK after 100 ms yields RTO = 100 + 4 * 50 ms
+    now += Time::Duration::binary_ms(100);
+    send.ack(m0.id(), now);
+    EXPECT_EQ(send.rtt().n_samples(), 1u);
+
+    ReliableSend::Message &m1 = send.send(now, tls_timeout);
+    m1.packet = Packet(rel_packet());
+    EXPECT_EQ(send.until_retransmit(now).raw(), 300u);
+
+    // timeouts back off exponentially
+    now += Time::Duration::binary_ms(300);
+    EXPECT_TRUE(m1.ready_retransmit(now));
+    send.retransmitted(m1, now, tls_timeout);
+    EXPECT_EQ(send.until_retransmit(now).raw(), 600u);
+    now += Time::Duration::binary_ms(600);
+    send.retransmitted(m1, now, tls_timeout);
+    EXPECT_EQ(send.until_retransmit(now).raw(), 1200u);
+    EXPECT_EQ(m1.n_sent(), 3u);
+
+    // ACK of a retransmitted message is not used as an RTT sample (Karn)
+    send.ack(m1.id(), now + Time::Duration::binary_ms(10));
+    EXPECT_EQ(send.rtt().n_samples(), 1u);
+}
+
+TEST(reliable, fast_retransmit)
+{
+    const Time::Duration tls_timeout = Time::Duration::seconds(1);
+    ReliableSend send(8);
+    send.enable_adaptive_timeout(tls_timeout, Time::Duration::milliseconds(200), Time::Duration::seconds(16));
+    Time now = Time::now();
+
+    std::vector<id_t> ids;
+    for (int i = 0; i < 4; ++i)
+    {
+        ReliableSend::Message &m = send.send(now, tls_timeout);
+        m.packet = Packet(rel_packet());
+        ids.push_back(m.id());
+    }
+    now += Time::Duration::binary_ms(50);
+
+    // first message lost: one later ACK is not enough, the second one triggers
+    send.ack(ids[1], now);
+    EXPECT_FALSE(send.fast_retransmit_pending());
+    EXPECT_FALSE(send.ref_by_id(ids[0]).ready_retransmit(now));
+    send.ack(ids[2], now);
+    EXPECT_TRUE(send.fast_retransmit_pending());
+    EXPECT_FALSE(send.fast_retransmit_pending());
+    ReliableSend::Message &lost = send.ref_by_id(ids[0]);
+    EXPECT_TRUE(lost.ready_retransmit(now));
+
+    // a fast retransmit does not back off the timer
+    send.retransmitted(lost, now, tls_timeout);
+    EXPECT_EQ(lost.until_retransmit(now), send.rtt().rto());
+
+    // the retransmission overtakes nothing that was sent before it
+    send.ack(ids[3], now);
+    EXPECT_FALSE(send.fast_retransmit_pending());
+}
+
+TEST(reliable, fixed_timeout)
+{
+    // without enable_adaptive_timeout() the fixed tls_timeout is always used
+    const Time::Duration tls_timeout = Time::Duration::seconds(2);
+    ReliableSend send(4);
+    Time now = Time::now();
+    ReliableSend::Message &m0 = send.send(now, tls_timeout);
+    m0.packet = Packet(rel_packet());
+    ReliableSend::Message &m1 = send.send(now, tls_timeout);
+    m1.packet = Packet(rel_packet());
+    ReliableSend::Message &m2 = send.send(now, tls_timeout);
+    m2.packet = Packet(rel_packet());
+    send.ack(m1.id(), now);
+    send.ack(m2.id(), now);
+    EXPECT_FALSE(send.fast_retransmit_pending());
+    now += tls_timeout;
+    send.retransmitted(m0, now, tls_timeout);
+    EXPECT_EQ(send.until_retransmit(now), tls_timeout);
+}
+
 /*
 // following are adapted from the original unit tests in common; preserved here
 // to show the ranges of test parameters, relsize, wiresize, reorder_prob, and
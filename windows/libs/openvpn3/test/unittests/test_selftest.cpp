@@ -0,0 +1,294 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <memory>
+#include <optional>
+
+#include <openvpn/client/acc_selftest.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/ip/csum.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+const IP::Addr client4 = IP::Addr::from_string("10.8.0.2");
+const IP::Addr gw4 = IP::Addr::from_string("10.8.0.1");
+const IP::Addr client6 = IP::Addr::from_string("fd00::1000");
+const IP::Addr gw6 = IP::Addr::from_string("fd00::1");
+
+// one direction of an in-memory tunnel, delivering to the engine at
+// the other end from the event loop
+struct Wire : public SelfTest::Link
+{
+    explicit Wire(openvpn_io::io_context &io_arg)
+        : io(io_arg)
+    {
+    }
+
+    void selftest_send_packet(BufferAllocated &buf) override
+    {
+        ++packets;
+        if (drop_every && packets % drop_every == 0)
+            return;
+        auto pkt = std::make_shared<BufferAllocated>(buf);
+        if (hold_every && packets % hold_every == 0)
+        {
+            // deliver after the next packet
+            held = pkt;
+            return;
+        }
+        deliver(pkt);
+        if (held)
+        {
+            deliver(held);
+            held.reset();
+        }
+    }
+
+    void selftest_send_control(const std::string &msg) override
+    {
+        openvpn_io::post(io, [peer = peer, msg]()
+                         { peer->recv_control(msg); });
+    }
+
+    void selftest_done(const SelfTest::Result &r) override
+    {
+        result = r;
+    }
+
+    void deliver(std::shared_ptr<BufferAllocated> pkt)
+    {
+        openvpn_io::post(io, [peer = peer, pkt, this]()
+                         {
+                             if (!peer->recv_packet(*pkt))
+                                 ++passed; });
+    }
+
+    openvpn_io::io_context &io;
+    SelfTest::Engine::Ptr peer;
+    unsigned int drop_every = 0;
+    unsigned int hold_every = 0;
+    size_t packets = 0;
+    size_t passed = 0; // not consumed by the peer, would go to its tun
+    std::shared_ptr<BufferAllocated> held;
+    std::optional<SelfTest::Result> result;
+};
+
+// initiator and responder back to back
+struct BackToBack
+{
+    BackToBack(const SelfTest::Initiator::Config &config,
+               const IP::Addr &local,
+               const IP::Addr &peer,
+               const bool peer_supported = true)
+    {
+        responder.reset(new SelfTest::Responder(io, down, frame, SelfTest::Responder::Config()));
+        initiator.reset(new SelfTest::Initiator(io, up, frame, config, local, peer, peer_supported, 7));
+        up.peer = responder;
+        down.peer = initiator;
+    }
+
+    ~BackToBack()
+    {
+        initiator->stop();
+        responder->stop();
+        up.peer.reset();
+        down.peer.reset();
+    }
+
+    const SelfTest::Result &run()
+    {
+        initiator->start();
+        io.run();
+        EXPECT_TRUE(up.result.has_value());
+        return initiator->result();
+    }
+
+    openvpn_io::io_context io{1};
+    Frame::Ptr frame = frame_init_simple(2048);
+    Wire up{io};
+    Wire down{io};
+    SelfTest::Initiator::Ptr initiator;
+    SelfTest::Responder::Ptr responder;
+};
+
+SelfTest::Initiator::Config make_config(const unsigned int pings, const unsigned int count)
+{
+    SelfTest::Initiator::Config config;
+    config.pings = pings;
+    config.ping_interval_ms = 1;
+    config.count = count;
+    config.size = 1000;
+    config.timeout_ms = 2000;
+    config.drain_ms = 20;
+    return config;
+}
+
+} // namespace
+
+TEST(selftest, probe)
+{
+    for (const bool ipv6 : {false, true})
+    {
+        const IP::Addr &src = ipv6 ? client6 : client4;
+        const IP::Addr &dst = ipv6 ? gw6 : gw4;
+        BufferAllocated buf(2048);
+        SelfTest::make_probe(buf, src, dst, SelfTest::PING, 0x12345678, 99, 0x0102030405060708ull, 500);
+        EXPECT_EQ(buf.size(), 500u);
+
+        SelfTest::Probe p;
+        ASSERT_TRUE(SelfTest::parse_probe(buf, p));
+        EXPECT_EQ(p.kind, SelfTest::PING);
+        EXPECT_TRUE(p.request);
+        EXPECT_EQ(p.test_id, 0x12345678u);
+        EXPECT_EQ(p.seq, 99u);
+        EXPECT_EQ(p.time_ns, 0x0102030405060708ull);
+
+        SelfTest::echo_reply(buf);
+        ASSERT_TRUE(SelfTest::parse_probe(buf, p));
+        EXPECT_FALSE(p.request);
+
+        // data packets are replies from src to dst with a valid checksum
+        buf = BufferAllocated(2048);
+        SelfTest::make_probe(buf, src, dst, SelfTest::DATA, 1, 2, 3, 0);
+        EXPECT_EQ(buf.size(), SelfTest::min_probe_size(ipv6));
+        ASSERT_TRUE(SelfTest::parse_probe(buf, p));
+        EXPECT_EQ(p.kind, SelfTest::DATA);
+        EXPECT_FALSE(p.request);
+        if (ipv6)
+        {
+            const ICMPv6 *icmp = reinterpret_cast<const ICMPv6 *>(buf.c_data());
+            EXPECT_EQ(IPv6::Addr::from_in6_addr(&icmp->head.saddr), src.to_ipv6());
+            EXPECT_EQ(Ping6::csum_icmp(icmp, buf.size()), 0);
+        }
+        else
+        {
+            const ICMPv4 *icmp = reinterpret_cast<const ICMPv4 *>(buf.c_data());
+            EXPECT_EQ(IPv4::Addr::from_uint32_net(icmp->head.saddr), src.to_ipv4());
+            EXPECT_EQ(IPChecksum::checksum(buf.c_data() + sizeof(IPv4Header), buf.size() - sizeof(IPv4Header)), 0);
+        }
+
+        // not a probe
+        buf.data()[ipv6 ? sizeof(ICMPv6) : sizeof(ICMPv4)] ^= 0xff;
+        EXPECT_FALSE(SelfTest::parse_probe(buf, p));
+        buf.set_size(20);
+        EXPECT_FALSE(SelfTest::parse_probe(buf, p));
+    }
+}
+
+TEST(selftest, message)
+{
+    const SelfTest::Message m = SelfTest::Message::parse("start id=7 dir=down count=1000 src=10.8.0.2");
+    EXPECT_EQ(m.verb, "start");
+    EXPECT_EQ(m.get_num<unsigned int>("id"), 7u);
+    EXPECT_EQ(m.get("dir"), "down");
+    EXPECT_EQ(m.get("src"), "10.8.0.2");
+    EXPECT_THROW(m.get("size"), SelfTest::selftest_error);
+    EXPECT_THROW(m.get_num<unsigned int>("dir"), SelfTest::selftest_error);
+    EXPECT_THROW(SelfTest::Message::parse("start id"), SelfTest::selftest_error);
+
+    SelfTest::Message r("end");
+    r.set("id", 3).set("sent", 100);
+    EXPECT_EQ(r.to_string(), "end id=3 sent=100");
+}
+
+TEST(selftest, receiver)
+{
+    SelfTest::Receiver r;
+    r.reset(10);
+    const std::uint32_t order[] = {0, 1, 3, 2, 4, 4, 6, 7, 9, 12};
+    std::uint64_t now = 0;
+    for (const std::uint32_t seq : order)
+        r.add(seq, 100, now += 1000000);
+
+    const SelfTest::Throughput t = r.result(10);
+    EXPECT_EQ(t.received, 8u); // 5 and 8 lost, 12 out of range
+    EXPECT_EQ(t.duplicates, 1u);
+    EXPECT_EQ(t.reordered, 1u);
+    EXPECT_EQ(t.bytes, 800u);
+    EXPECT_EQ(t.usec, 8000u);
+    EXPECT_DOUBLE_EQ(t.loss(), 0.2);
+    EXPECT_DOUBLE_EQ(t.goodput_mbps(), 0.8);
+
+    const SelfTest::Throughput u = SelfTest::Throughput::from_message(t.to_message(1), 10);
+    EXPECT_EQ(u.received, t.received);
+    EXPECT_EQ(u.usec, t.usec);
+}
+
+TEST(selftest, back_to_back)
+{
+    for (const bool ipv6 : {false, true})
+    {
+        BackToBack b(make_config(10, 500), ipv6 ? client6 : client4, ipv6 ? gw6 : gw4);
+        const SelfTest::Result &r = b.run();
+        EXPECT_EQ(r.status, "ok");
+        EXPECT_EQ(r.ping.sent, 10u);
+        EXPECT_EQ(r.ping.received, 10u);
+        EXPECT_EQ(r.ping.rtt_ms.size(), 10u);
+        EXPECT_LE(r.ping.percentile(50), r.ping.percentile(99));
+        for (const SelfTest::Throughput *t : {&r.up, &r.down})
+        {
+            EXPECT_TRUE(t->defined);
+            EXPECT_EQ(t->sent, 500u);
+            EXPECT_EQ(t->received, 500u);
+            EXPECT_EQ(t->reordered, 0u);
+            EXPECT_EQ(t->bytes, 500u * 1000u);
+            EXPECT_EQ(t->loss(), 0.0);
+        }
+        // every probe was consumed by the engines
+        EXPECT_EQ(b.up.passed, 0u);
+        EXPECT_EQ(b.down.passed, 0u);
+    }
+}
+
+TEST(selftest, loss_and_reordering)
+{
+    SelfTest::Initiator::Config config = make_config(20, 1000);
+    config.timeout_ms = 200;
+    BackToBack b(config, client4, gw4);
+    b.up.drop_every = 10;
+    b.down.hold_every = 7;
+    const SelfTest::Result &r = b.run();
+    EXPECT_EQ(r.status, "ok");
+    EXPECT_EQ(r.ping.received, 18u);
+    EXPECT_NEAR(r.ping.loss(), 0.1, 1e-9);
+
+    // the up blast loses every 10th packet counted across pings and data
+    EXPECT_EQ(r.up.sent, 1000u);
+    EXPECT_EQ(r.up.received, 900u);
+    EXPECT_EQ(r.up.reordered, 0u);
+
+    EXPECT_EQ(r.down.received, 1000u);
+    EXPECT_GT(r.down.reordered, 100u);
+}
+
+TEST(selftest, peer_without_support)
+{
+    // only the ping phase runs, the gateway answers those anyway
+    BackToBack b(make_config(5, 100), client4, gw4, false);
+    const SelfTest::Result &r = b.run();
+    EXPECT_NE(r.status.find("doesn't support"), std::string::npos);
+    EXPECT_EQ(r.ping.received, 5u);
+    EXPECT_FALSE(r.up.defined);
+    EXPECT_FALSE(r.down.defined);
+}
+
+TEST(selftest, responder_rejects_large_blast)
+{
+    SelfTest::Initiator::Config config = make_config(0, 1000000);
+    BackToBack b(config, client4, gw4);
+    const SelfTest::Result &r = b.run();
+    EXPECT_NE(r.status.find("peer error"), std::string::npos);
+    EXPECT_NE(r.status.find("exceeds"), std::string::npos);
+}
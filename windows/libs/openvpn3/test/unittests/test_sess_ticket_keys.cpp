@@ -0,0 +1,158 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openvpn/ssl/sslchoose.hpp>
+#include <openvpn/ssl/sess_ticket_keys.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+TLSSessionTicketKeys::Config make_config(const unsigned int period, const unsigned int overlap)
+{
+    TLSSessionTicketKeys::Config config;
+    config.session_id_context = "test";
+    config.rotation_period = period;
+    config.overlap = overlap;
+    return config;
+}
+
+} // namespace
+
+TEST(sess_ticket_keys, rotation_and_overlap)
+{
+    const std::time_t t = std::time(nullptr);
+    StrongRandomAPI::Ptr rng(new SSLLib::RandomAPI());
+    TLSSessionTicketKeys::Ptr keys(new TLSSessionTicketKeys(make_config(100, 50), rng, t));
+    EXPECT_EQ(keys->size(), 1u);
+    EXPECT_EQ(keys->next_rotation_time(), t + 100);
+
+    TLSSessionTicketBase::Name name0(*rng);
+    TLSSessionTicketBase::Key key0(*rng);
+    ASSERT_EQ(keys->create_session_ticket_key(name0, key0), TLSSessionTicketBase::TICKET_AVAILABLE);
+
+    TLSSessionTicketBase::Key k(*rng);
+    EXPECT_EQ(keys->lookup_session_ticket_key(name0, k), TLSSessionTicketBase::TICKET_AVAILABLE);
+    EXPECT_TRUE(k == key0);
+
+    // not due yet
+    EXPECT_FALSE(keys->maintain(t + 99));
+    EXPECT_EQ(keys->size(), 1u);
+
+    // rotation: the old key still decrypts, but asks for a renewal
+    EXPECT_TRUE(keys->maintain(t + 100));
+    EXPECT_FALSE(keys->maintain(t + 100));
+    EXPECT_EQ(keys->size(), 2u);
+    EXPECT_EQ(keys->next_rotation_time(), t + 200);
+    EXPECT_EQ(keys->lookup_session_ticket_key(name0, k), TLSSessionTicketBase::TICKET_EXPIRING);
+    EXPECT_TRUE(k == key0);
+
+    TLSSessionTicketBase::Name name1(name0);
+    TLSSessionTicketBase::Key key1(key0);
+    keys->create_session_ticket_key(name1, key1);
+    EXPECT_TRUE(name1 != name0);
+    EXPECT_TRUE(key1 != key0);
+
+    // an unknown name misses
+    const TLSSessionTicketBase::Name unknown(*rng);
+    EXPECT_EQ(keys->lookup_session_ticket_key(unknown, k), TLSSessionTicketBase::NO_TICKET);
+
+    // past the overlap window the old key is gone
+    keys->rotate(t + 160);
+    EXPECT_EQ(keys->size(), 2u);
+    EXPECT_EQ(keys->next_rotation_time(), t + 260);
+    EXPECT_EQ(keys->lookup_session_ticket_key(name0, k), TLSSessionTicketBase::NO_TICKET);
+
+    const TLSSessionTicketKeys::Stats s = keys->stats();
+    EXPECT_EQ(s.issued, 2u);
+    EXPECT_EQ(s.resumed, 1u);
+    EXPECT_EQ(s.renewed, 1u);
+    EXPECT_EQ(s.missed, 2u);
+    EXPECT_DOUBLE_EQ(s.hit_rate(), 0.5);
+}
+
+TEST(sess_ticket_keys, persist)
+{
+    char fn[] = "/tmp/sess_ticket_keys_XXXXXX";
+    const int fd = ::mkstemp(fn);
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+    ::unlink(fn);
+
+    const std::time_t t = std::time(nullptr);
+    TLSSessionTicketKeys::Config config = make_config(1000, 1000);
+    config.persist_file = fn;
+    StrongRandomAPI::Ptr rng(new SSLLib::RandomAPI());
+
+    TLSSessionTicketKeys::Ptr keys(new TLSSessionTicketKeys(config, rng, t));
+    keys->rotate(t + 10);
+    TLSSessionTicketBase::Name name(*rng);
+    TLSSessionTicketBase::Key key(*rng);
+    keys->create_session_ticket_key(name, key);
+
+    struct stat st;
+    ASSERT_EQ(::stat(fn, &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+
+    // a restarted server picks up both keys and keeps the current one
+    TLSSessionTicketKeys::Ptr restarted(new TLSSessionTicketKeys(config, rng, t + 20));
+    EXPECT_EQ(restarted->size(), 2u);
+    EXPECT_EQ(restarted->next_rotation_time(), t + 1010);
+    EXPECT_EQ(restarted->persist_string(), keys->persist_string());
+    TLSSessionTicketBase::Key k(*rng);
+    EXPECT_EQ(restarted->lookup_session_ticket_key(name, k), TLSSessionTicketBase::TICKET_AVAILABLE);
+    EXPECT_TRUE(k == key);
+
+    // a server restarted after the current key is due rotates at once
+    TLSSessionTicketKeys::Ptr late(new TLSSessionTicketKeys(config, rng, t + 1010));
+    EXPECT_EQ(late->size(), 2u);
+    EXPECT_EQ(late->lookup_session_ticket_key(name, k), TLSSessionTicketBase::TICKET_EXPIRING);
+
+    ::unlink(fn);
+}
+
+// a failed save from a ticket callback is logged, not thrown, and
+// retried by the next persist()
+TEST(sess_ticket_keys, persist_error)
+{
+    char dir[] = "/tmp/sess_ticket_keys_XXXXXX";
+    ASSERT_NE(::mkdtemp(dir), nullptr);
+    const std::string fn = std::string(dir) + "/keys";
+
+    const std::time_t t = std::time(nullptr);
+    TLSSessionTicketKeys::Config config = make_config(100, 100);
+    config.persist_file = fn;
+    StrongRandomAPI::Ptr rng(new SSLLib::RandomAPI());
+    TLSSessionTicketKeys::Ptr keys(new TLSSessionTicketKeys(config, rng, t));
+
+    ASSERT_EQ(::unlink(fn.c_str()), 0);
+    ASSERT_EQ(::rmdir(dir), 0);
+    EXPECT_TRUE(keys->maintain(t + 100));
+    EXPECT_EQ(keys->size(), 2u);
+    EXPECT_FALSE(keys->persist());
+
+    ASSERT_EQ(::mkdir(dir, 0700), 0);
+    EXPECT_TRUE(keys->persist());
+    TLSSessionTicketKeys::Ptr restarted(new TLSSessionTicketKeys(config, rng, t + 110));
+    EXPECT_EQ(restarted->persist_string(), keys->persist_string());
+
+    ::unlink(fn.c_str());
+    ::rmdir(dir);
+}
@@ -16,6 +16,7 @@
 
 
 #include <openvpn/ssl/sslapi.hpp>
+#include <openvpn/ssl/sess_ticket_keys.hpp>
 
 using namespace openvpn;
 
@@ -493,6 +494,66 @@ TEST(sslctx_ut, handshake_fail)
     FAIL();
 }
 
+#ifdef USE_OPENSSL
+TEST(sslctx_ut, shared_ticket_keys_resume)
+{
+    // two server "workers" with their own SSL contexts share one ticket key
+    // manager, and the client side shares one session cache
+    Frame::Ptr frame(new Frame(Frame::Context(128, 4096, 4096 - 128, 0, 16, BufAllocFlags::NO_FLAGS)));
+    StrongRandomAPI::Ptr rng(new SSLLib::RandomAPI());
+    TLSSessionTicketKeys::Config tkconf;
+    tkconf.session_id_context = "sslctx_ut";
+    TLSSessionTicketKeys::Ptr keys(new TLSSessionTicketKeys(tkconf, rng));
+
+    auto make_server_factory = [&]()
+    {
+        SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+        config->set_rng(rng);
+        config->set_mode(Mode(Mode::SERVER));
+        config->load_cert(cert_txt);
+        config->load_private_key(pvt_key_txt);
+        config->load_ca(cert_txt, false);
+        config->set_frame(frame);
+        config->load_dh(dhparam_txt);
+        config->set_session_ticket_handler(keys.get());
+        return config->new_factory();
+    };
+    SSLFactoryAPI::Ptr worker[2] = {make_server_factory(), make_server_factory()};
+
+    OpenSSLSessionCache::Ptr cache(new OpenSSLSessionCache);
+    SSLLib::SSLAPI::Config::Ptr clientconfig = new SSLLib::SSLAPI::Config;
+    clientconfig->set_rng(rng);
+    clientconfig->set_mode(Mode(Mode::CLIENT));
+    clientconfig->load_cert(cert_txt);
+    clientconfig->load_private_key(pvt_key_txt);
+    clientconfig->set_frame(frame);
+    clientconfig->set_flags(SSLConfigAPI::LF_ALLOW_CLIENT_CERT_NOT_REQUIRED);
+    clientconfig->set_client_session_tickets(true);
+    clientconfig->set_client_session_cache(cache);
+
+    const std::string cache_key = "server.example.com:443";
+    bool full[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        // a fresh client factory each time, as after a client restart
+        SSLFactoryAPI::Ptr clientfactory = clientconfig->new_factory();
+        SSLAPI::Ptr client = clientfactory->ssl(nullptr, &cache_key);
+        SSLAPI::Ptr server = worker[i]->ssl();
+        client->start_handshake();
+        for (int j = 0; j < 100; ++j)
+            xfer(*client, *server);
+        full[i] = server->did_full_handshake();
+        EXPECT_EQ(client->did_full_handshake(), full[i]);
+    }
+
+    EXPECT_TRUE(full[0]);
+    EXPECT_FALSE(full[1]);
+    EXPECT_GE(keys->stats().issued, 1u);
+    EXPECT_EQ(keys->stats().resumed, 1u);
+    EXPECT_EQ(cache->stats().hits, 1u);
+}
+#endif
+
 TEST(sslctx_ut, clienthello)
 {
     /* Checks that a server context correctly responds to a TLS 1.3 client hello */
@@ -0,0 +1,378 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/transport/udplink.hpp>
+#include <openvpn/tun/tunio.hpp>
+
+using namespace openvpn;
+
+#ifndef URING_TEST_PACKETS
+#define URING_TEST_PACKETS 2000
+#endif
+
+#ifndef URING_BENCH_PACKETS
+#define URING_BENCH_PACKETS 200000
+#endif
+
+namespace {
+
+const Frame::Context fc(512, 2048, 512, 0, 16, BufAllocFlags::NO_FLAGS);
+
+std::string make_payload(const unsigned int i)
+{
+    std::string ret = "packet " + std::to_string(i) + " ";
+    ret.resize(64 + (i % 512), char('a' + i % 26));
+    return ret;
+}
+
+BufferAllocated make_buf(const std::string &s)
+{
+    BufferAllocated buf;
+    fc.prepare(buf);
+    buf.write(s.data(), s.size());
+    return buf;
+}
+
+// Collects the packets read on a link and stops the io_context
+// once all of them arrived.
+struct Receiver
+{
+    std::vector<std::string> packets;
+    size_t expected = 0;
+    openvpn_io::io_context *io = nullptr;
+
+    void received(const Buffer &buf)
+    {
+        packets.emplace_back(reinterpret_cast<const char *>(buf.c_data()), buf.size());
+        if (packets.size() == expected)
+            io->stop();
+    }
+};
+
+struct UDPHandler : public Receiver
+{
+    void udp_read_handler(UDPTransport::PacketFrom::SPtr &pfp)
+    {
+        received(pfp->buf);
+    }
+};
+
+typedef UDPTransport::UDPLink<UDPHandler *> Link;
+
+// two loopback UDP sockets connected to each other
+struct UDPPair
+{
+    openvpn_io::io_context io{1};
+    openvpn_io::ip::udp::socket sock[2] = {openvpn_io::ip::udp::socket(io), openvpn_io::ip::udp::socket(io)};
+    UDPHandler handler[2];
+    Link::Ptr link[2];
+    SessionStats::Ptr stats[2] = {new SessionStats(), new SessionStats()};
+
+    UDPPair()
+    {
+        const openvpn_io::ip::udp::endpoint local(openvpn_io::ip::address_v4::loopback(), 0);
+        for (int i = 0; i < 2; ++i)
+        {
+            sock[i].open(openvpn_io::ip::udp::v4());
+            sock[i].bind(local);
+            sock[i].set_option(openvpn_io::socket_base::receive_buffer_size(4 << 20));
+            sock[i].set_option(openvpn_io::socket_base::send_buffer_size(4 << 20));
+            handler[i].io = &io;
+            link[i].reset(new Link(&handler[i], sock[i], fc, stats[i]));
+        }
+        sock[0].connect(sock[1].local_endpoint());
+        sock[1].connect(sock[0].local_endpoint());
+    }
+
+    ~UDPPair()
+    {
+        for (auto &l : link)
+            if (l)
+                l->stop();
+    }
+
+    // send n packets from link[from] in bursts posted to the io_context,
+    // so that completions of one burst are reaped with the next, holding
+    // back while more than window packets are on the way
+    void send(const int from, const unsigned int n, const unsigned int burst = 32, const size_t window = 1024)
+    {
+        send_more(from, n, burst, window, 0);
+    }
+
+    void send_more(const int from, const unsigned int n, const unsigned int burst, const size_t window, const unsigned int start)
+    {
+        openvpn_io::post(io, [this, from, n, burst, window, i = start]() mutable
+                         {
+                             if (i - handler[1 - from].packets.size() <= window)
+                             {
+                                 const unsigned int end = std::min(n, i + burst);
+                                 for (; i < end; ++i)
+                                 {
+                                     BufferAllocated buf = make_buf(make_payload(i));
+                                     link[from]->send(buf, nullptr);
+                                 }
+                             }
+                             if (i < n)
+                                 send_more(from, n, burst, window, i); });
+    }
+
+    void run(const std::chrono::milliseconds timeout)
+    {
+        openvpn_io::steady_timer timer(io);
+        timer.expires_after(timeout);
+        timer.async_wait([this](const openvpn_io::error_code &error)
+                         {
+                             if (!error)
+                                 io.stop(); });
+        io.run();
+        io.restart();
+    }
+};
+
+// Check the received packets, which may be lost on loopback only
+// under extreme pressure, but are never reordered or corrupted.
+void check_packets(const std::vector<std::string> &packets, const unsigned int n)
+{
+    ASSERT_EQ(packets.size(), n);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ(packets[i], make_payload(i)) << "packet " << i;
+}
+
+double thread_cpu_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+} // namespace
+
+TEST(uring, udp_loopback)
+{
+    UDPPair p;
+    if (!p.link[0]->use_io_uring())
+        GTEST_SKIP() << "io_uring is not available";
+
+    // link[0] on io_uring, link[1] on the reactor
+    for (auto &l : p.link)
+        l->start(8);
+
+    for (int from = 0; from < 2; ++from)
+    {
+        Receiver &r = p.handler[1 - from];
+        r.expected = URING_TEST_PACKETS;
+        p.send(from, URING_TEST_PACKETS);
+        p.run(std::chrono::seconds(10));
+        check_packets(r.packets, URING_TEST_PACKETS);
+    }
+
+    EXPECT_EQ(p.stats[0]->get_stat(SessionStats::PACKETS_OUT), URING_TEST_PACKETS);
+    EXPECT_EQ(p.stats[0]->get_stat(SessionStats::PACKETS_IN), URING_TEST_PACKETS);
+}
+
+TEST(uring, udp_stop)
+{
+    // stopping with receives and sends in flight must cancel all of
+    // them before the buffers go away
+    UDPPair p;
+    if (!p.link[0]->use_io_uring())
+        GTEST_SKIP() << "io_uring is not available";
+    p.link[0]->start(1);
+    for (unsigned int i = 0; i < 64; ++i)
+    {
+        BufferAllocated buf = make_buf(make_payload(i));
+        p.link[0]->send(buf, nullptr);
+    }
+    p.link[0]->stop();
+    p.io.poll();
+    p.link[0].reset();
+}
+
+namespace {
+
+struct TunPacketFrom
+{
+    typedef std::unique_ptr<TunPacketFrom> SPtr;
+    BufferAllocated buf;
+};
+
+struct TunHandler : public Receiver
+{
+    int errors = 0;
+
+    void tun_read_handler(TunPacketFrom::SPtr &pfp)
+    {
+        received(pfp->buf);
+    }
+
+    void tun_error_handler(const Error::Type, const openvpn_io::error_code *)
+    {
+        ++errors;
+        io->stop();
+    }
+};
+
+// TunIO over one end of a SOCK_SEQPACKET socketpair, which keeps the
+// packet boundaries of a tun fd
+class TestTun : public TunIO<TunHandler *, TunPacketFrom, openvpn_io::posix::stream_descriptor>
+{
+  public:
+    typedef RCPtr<TestTun> Ptr;
+
+    TestTun(openvpn_io::io_context &io, const int fd, TunHandler *handler, const SessionStats::Ptr &stats)
+        : TunIO(handler, fc, stats)
+    {
+        name_ = "test";
+        stream = new openvpn_io::posix::stream_descriptor(io, fd);
+    }
+
+    ~TestTun()
+    {
+        stop();
+    }
+};
+
+} // namespace
+
+TEST(uring, tun_socketpair)
+{
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    // a tun fd is non-blocking, so reads hit EAGAIN and go to poll
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    int rcvbuf = 4 << 20;
+    ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &rcvbuf, sizeof(rcvbuf));
+
+    openvpn_io::io_context io(1);
+    TunHandler handler;
+    handler.io = &io;
+    SessionStats::Ptr stats(new SessionStats());
+    TestTun::Ptr tun(new TestTun(io, fds[0], &handler, stats));
+    if (!tun->use_io_uring())
+    {
+        ::close(fds[1]);
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    tun->start(4);
+
+    // peer -> tun, the peer writes from its own thread as the
+    // socketpair queue is short
+    const unsigned int n = 256;
+    handler.expected = n;
+    std::thread writer([&]()
+                       {
+                           for (unsigned int i = 0; i < n; ++i)
+                           {
+                               const std::string s = make_payload(i);
+                               if (::send(fds[1], s.data(), s.size(), 0) != ssize_t(s.size()))
+                                   break;
+                           } });
+    openvpn_io::steady_timer timer(io);
+    timer.expires_after(std::chrono::seconds(10));
+    timer.async_wait([&](const openvpn_io::error_code &error)
+                     {
+                         if (!error)
+                             io.stop(); });
+    io.run();
+    io.restart();
+    writer.join();
+    EXPECT_EQ(handler.errors, 0);
+    check_packets(handler.packets, n);
+
+    // tun -> peer, a tun device never returns EAGAIN on write, so let
+    // the writes block in the kernel rather than fail
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) & ~O_NONBLOCK);
+    std::vector<std::string> out;
+    std::atomic<bool> done{false};
+    std::thread reader([&]()
+                       {
+                           char data[4096];
+                           while (out.size() < n)
+                           {
+                               const ssize_t size = ::recv(fds[1], data, sizeof(data), 0);
+                               if (size <= 0)
+                                   break;
+                               out.emplace_back(data, size_t(size));
+                           }
+                           done = true; });
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        BufferAllocated buf = make_buf(make_payload(i));
+        ASSERT_TRUE(tun->write(buf));
+        if (i % 32 == 31)
+            io.poll();
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done && std::chrono::steady_clock::now() < deadline)
+        io.run_for(std::chrono::milliseconds(10));
+    if (!done)
+        ::shutdown(fds[1], SHUT_RD);
+    reader.join();
+    check_packets(out, n);
+    EXPECT_EQ(stats->get_stat(SessionStats::TUN_PACKETS_OUT), n);
+    EXPECT_EQ(stats->get_stat(SessionStats::TUN_PACKETS_IN), n);
+
+    tun->stop();
+    io.poll();
+    tun.reset();
+    ::close(fds[1]);
+}
+
+// Single threaded loopback UDP throughput, reactor vs. io_uring
+// on both ends.
+TEST(uring, DISABLED_bench_udp_loopback)
+{
+    double pps[2] = {};
+    double cpu_ns[2] = {};
+    size_t lost[2] = {};
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        UDPPair p;
+        if (mode && (!p.link[0]->use_io_uring() || !p.link[1]->use_io_uring()))
+            GTEST_SKIP() << "io_uring is not available";
+        for (auto &l : p.link)
+            l->start(8);
+
+        Receiver &r = p.handler[1];
+        r.expected = URING_BENCH_PACKETS;
+        r.packets.reserve(URING_BENCH_PACKETS);
+        const auto t = std::chrono::steady_clock::now();
+        const double cpu = thread_cpu_seconds();
+        p.send(0, URING_BENCH_PACKETS, 64, 256);
+        p.run(std::chrono::seconds(10));
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        const size_t got = r.packets.size();
+        pps[mode] = got / secs;
+        cpu_ns[mode] = got ? (thread_cpu_seconds() - cpu) * 1e9 / got : 0;
+        lost[mode] = URING_BENCH_PACKETS - got;
+    }
+
+    std::cerr << "*** uring udp packets=" << URING_BENCH_PACKETS
+              << " pps reactor=" << pps[0] << " io_uring=" << pps[1]
+              << " cpu_ns/pkt reactor=" << cpu_ns[0] << " io_uring=" << cpu_ns[1]
+              << " lost reactor=" << lost[0] << " io_uring=" << lost[1] << std::endl;
+}
@@ -0,0 +1,366 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <openvpn/tun/vnethdr.hpp>
+
+using namespace openvpn;
+using VirtioNet::Coalescer;
+using VirtioNet::Header;
+using VirtioNet::segment;
+namespace vdetail = VirtioNet::detail;
+
+namespace {
+
+const Frame::Context fc(128, 1500, 128, 0, 16, BufAllocFlags::NO_FLAGS);
+
+std::vector<std::uint8_t> make_payload(const size_t size)
+{
+    std::vector<std::uint8_t> ret(size);
+    for (size_t i = 0; i < size; ++i)
+        ret[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    return ret;
+}
+
+// IP packet with valid checksums, proto is IPCommon::TCP or IPCommon::UDP
+std::vector<std::uint8_t> make_packet(const bool ipv6,
+                                      const std::uint8_t proto,
+                                      const std::uint8_t *payload,
+                                      const size_t size,
+                                      const std::uint32_t seq = 1000,
+                                      const std::uint8_t flags = vdetail::TCP_ACK)
+{
+    const size_t ip_len = ipv6 ? sizeof(IPv6Header) : sizeof(IPv4Header);
+    const size_t l4_len = proto == IPCommon::TCP ? sizeof(TCPHeader) : sizeof(UDPHeader);
+    std::vector<std::uint8_t> pkt(ip_len + l4_len + size);
+    std::uint8_t *d = pkt.data();
+    if (ipv6)
+    {
+        IPv6Header *h = reinterpret_cast<IPv6Header *>(d);
+        d[0] = 0x60;
+        h->nexthdr = proto;
+        h->hop_limit = 64;
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            h->saddr.s6_addr[i] = static_cast<std::uint8_t>(0x20 + i);
+            h->daddr.s6_addr[i] = static_cast<std::uint8_t>(0x40 + i);
+        }
+    }
+    else
+    {
+        IPv4Header *h = reinterpret_cast<IPv4Header *>(d);
+        h->version_len = IPv4Header::ver_len(4, sizeof(IPv4Header));
+        h->id = htons(0x1234);
+        h->frag_off = htons(0x4000); // DF
+        h->ttl = 64;
+        h->protocol = proto;
+        h->saddr = htonl(0x0a080001);
+        h->daddr = htonl(0x0a080002);
+    }
+    if (proto == IPCommon::TCP)
+    {
+        TCPHeader *t = reinterpret_cast<TCPHeader *>(d + ip_len);
+        t->source = htons(40000);
+        t->dest = htons(443);
+        t->seq = htonl(seq);
+        t->ack_seq = htonl(555);
+        t->doff_res = sizeof(TCPHeader) << 2;
+        t->flags = flags;
+        t->window = htons(512);
+    }
+    else
+    {
+        UDPHeader *u = reinterpret_cast<UDPHeader *>(d + ip_len);
+        u->source = htons(40000);
+        u->dest = htons(1194);
+        u->len = htons(static_cast<std::uint16_t>(sizeof(UDPHeader) + size));
+    }
+    std::memcpy(d + ip_len + l4_len, payload, size);
+
+    vdetail::L4Packet p;
+    p.ip = d;
+    p.ip_len = ip_len;
+    p.l4_len = l4_len;
+    p.proto = proto;
+    p.ipv6 = ipv6;
+    vdetail::set_ip_len(p, pkt.size());
+    vdetail::set_l4_check(p, d, pkt.size());
+    return pkt;
+}
+
+BufferAllocated with_header(const Header &h, const std::vector<std::uint8_t> &pkt)
+{
+    BufferAllocated ret(sizeof(Header) + pkt.size(), BufAllocFlags::NO_FLAGS);
+    ret.write(&h, sizeof(h));
+    ret.write(pkt.data(), pkt.size());
+    return ret;
+}
+
+Header gso_header(const std::uint8_t gso_type, const size_t hdr_len, const size_t mss)
+{
+    Header h = {};
+    h.gso_type = gso_type;
+    h.hdr_len = static_cast<std::uint16_t>(hdr_len);
+    h.gso_size = static_cast<std::uint16_t>(mss);
+    return h;
+}
+
+std::vector<std::vector<std::uint8_t>> run_segment(const Buffer &in, bool &ok)
+{
+    std::vector<std::vector<std::uint8_t>> ret;
+    BufferAllocated out;
+    ok = segment(in, out, fc, [&ret](BufferAllocated &seg)
+                 { ret.emplace_back(seg.c_data(), seg.c_data() + seg.size()); });
+    return ret;
+}
+
+std::vector<std::vector<std::uint8_t>> run_segment(const Buffer &in)
+{
+    bool ok = false;
+    auto ret = run_segment(in, ok);
+    EXPECT_TRUE(ok);
+    return ret;
+}
+
+void check_super_packet(const bool ipv6, const std::uint8_t proto, const std::uint8_t gso_type)
+{
+    const size_t mss = 1400;
+    const auto payload = make_payload(mss * 4 + 321);
+    const std::uint8_t flags = vdetail::TCP_ACK | vdetail::TCP_PSH | vdetail::TCP_FIN | vdetail::TCP_CWR;
+    const auto super = make_packet(ipv6, proto, payload.data(), payload.size(), 1000, flags);
+    const size_t ip_len = ipv6 ? sizeof(IPv6Header) : sizeof(IPv4Header);
+    const size_t hdr_len = ip_len + (proto == IPCommon::TCP ? sizeof(TCPHeader) : sizeof(UDPHeader));
+
+    const auto segs = run_segment(with_header(gso_header(gso_type, hdr_len, mss), super));
+    ASSERT_EQ(segs.size(), 5u);
+    size_t off = 0;
+    for (size_t i = 0; i < segs.size(); ++i)
+    {
+        const size_t n = std::min(mss, payload.size() - off);
+        std::uint8_t f = vdetail::TCP_ACK;
+        if (i == 0)
+            f |= vdetail::TCP_CWR;
+        if (i == segs.size() - 1)
+            f |= vdetail::TCP_PSH | vdetail::TCP_FIN;
+        auto expect = make_packet(ipv6, proto, payload.data() + off, n, static_cast<std::uint32_t>(1000 + off), f);
+        if (!ipv6)
+        {
+            // IPv4 ids count up from the super-packet's
+            IPv4Header *h = reinterpret_cast<IPv4Header *>(expect.data());
+            h->id = htons(static_cast<std::uint16_t>(0x1234 + i));
+            h->check = 0;
+            h->check = IPChecksum::checksum(h, sizeof(IPv4Header));
+        }
+        EXPECT_EQ(segs[i], expect) << "segment " << i;
+        off += n;
+    }
+}
+
+} // namespace
+
+TEST(vnethdr, segment_tcp4)
+{
+    check_super_packet(false, IPCommon::TCP, Header::GSO_TCPV4);
+}
+
+TEST(vnethdr, segment_tcp6)
+{
+    check_super_packet(true, IPCommon::TCP, Header::GSO_TCPV6);
+}
+
+TEST(vnethdr, segment_udp_l4)
+{
+    check_super_packet(false, IPCommon::UDP, Header::GSO_UDP_L4);
+    check_super_packet(true, IPCommon::UDP, Header::GSO_UDP_L4);
+}
+
+TEST(vnethdr, needs_csum)
+{
+    const auto payload = make_payload(333);
+    const auto pkt = make_packet(false, IPCommon::TCP, payload.data(), payload.size());
+
+    // what the kernel hands over with TUN_F_CSUM: pseudo-header sum only
+    auto partial = pkt;
+    vdetail::L4Packet p;
+    ASSERT_TRUE(p.parse(partial.data(), partial.size()));
+    p.tcp()->check = IPChecksum::fold(vdetail::pseudo_header_sum(p, partial.size() - p.ip_len));
+    Header h = {};
+    h.flags = Header::F_NEEDS_CSUM;
+    h.csum_start = sizeof(IPv4Header);
+    h.csum_offset = vdetail::TCP_CHECK_OFFSET;
+
+    const auto segs = run_segment(with_header(h, partial));
+    ASSERT_EQ(segs.size(), 1u);
+    EXPECT_EQ(segs[0], pkt);
+
+    // no offload, passed through as is
+    const auto plain = run_segment(with_header(Header{}, pkt));
+    ASSERT_EQ(plain.size(), 1u);
+    EXPECT_EQ(plain[0], pkt);
+}
+
+TEST(vnethdr, segment_malformed)
+{
+    const auto payload = make_payload(4000);
+    const auto tcp4 = make_packet(false, IPCommon::TCP, payload.data(), payload.size());
+    const size_t hdr_len = sizeof(IPv4Header) + sizeof(TCPHeader);
+    bool ok = true;
+
+    // short read
+    BufferAllocated shortbuf(4, BufAllocFlags::NO_FLAGS);
+    shortbuf.write("\0\0\0\0", 4);
+    EXPECT_TRUE(run_segment(shortbuf, ok).empty());
+    EXPECT_FALSE(ok);
+
+    // GSO type does not match the packet
+    EXPECT_TRUE(run_segment(with_header(gso_header(Header::GSO_TCPV6, hdr_len, 1400), tcp4), ok).empty());
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(run_segment(with_header(gso_header(Header::GSO_UDP, hdr_len, 1400), tcp4), ok).empty());
+    EXPECT_FALSE(ok);
+
+    // zero or oversized segment size
+    EXPECT_TRUE(run_segment(with_header(gso_header(Header::GSO_TCPV4, hdr_len, 0), tcp4), ok).empty());
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(run_segment(with_header(gso_header(Header::GSO_TCPV4, hdr_len, 3000), tcp4), ok).empty());
+    EXPECT_FALSE(ok);
+
+    // too big for the frame without GSO
+    EXPECT_TRUE(run_segment(with_header(Header{}, tcp4), ok).empty());
+    EXPECT_FALSE(ok);
+
+    // truncated packet
+    auto truncated = with_header(gso_header(Header::GSO_TCPV4, hdr_len, 1400), tcp4);
+    truncated.set_size(truncated.size() - 1);
+    EXPECT_TRUE(run_segment(truncated, ok).empty());
+    EXPECT_FALSE(ok);
+
+    // checksum field outside the packet
+    const auto small = make_packet(false, IPCommon::UDP, payload.data(), 10);
+    Header h = {};
+    h.flags = Header::F_NEEDS_CSUM;
+    h.csum_start = static_cast<std::uint16_t>(small.size() - 1);
+    h.csum_offset = 6;
+    EXPECT_TRUE(run_segment(with_header(h, small), ok).empty());
+    EXPECT_FALSE(ok);
+}
+
+TEST(vnethdr, coalesce_round_trip)
+{
+    for (const bool ipv6 : {false, true})
+    {
+        const size_t mss = 1200;
+        const auto payload = make_payload(mss * 5 + 100);
+        std::vector<std::vector<std::uint8_t>> pkts;
+        for (size_t off = 0; off < payload.size(); off += mss)
+        {
+            const size_t n = std::min(mss, payload.size() - off);
+            const std::uint8_t flags = vdetail::TCP_ACK | (off + n == payload.size() ? vdetail::TCP_PSH : 0);
+            pkts.push_back(make_packet(ipv6, IPCommon::TCP, payload.data() + off, n, static_cast<std::uint32_t>(1000 + off), flags));
+        }
+
+        Coalescer c;
+        std::vector<BufferAllocated> written;
+        std::vector<size_t> counts;
+        auto write = [&](const Buffer &b, const size_t n)
+        {
+            written.emplace_back(b);
+            counts.push_back(n);
+        };
+        for (const auto &pkt : pkts)
+            c.add(BufferAllocated(pkt.data(), pkt.size(), BufAllocFlags::NO_FLAGS), write);
+        EXPECT_TRUE(written.empty());
+        ASSERT_TRUE(c.pending());
+        c.flush(write);
+        EXPECT_FALSE(c.pending());
+        ASSERT_EQ(written.size(), 1u);
+        EXPECT_EQ(counts[0], pkts.size());
+
+        Header h;
+        std::memcpy(&h, written[0].c_data(), sizeof(h));
+        EXPECT_EQ(h.gso_type, ipv6 ? Header::GSO_TCPV6 : Header::GSO_TCPV4);
+        EXPECT_EQ(h.gso_size, mss);
+        EXPECT_EQ(h.flags, Header::F_NEEDS_CSUM);
+
+        // what the kernel would do with it
+        const auto segs = run_segment(written[0]);
+        ASSERT_EQ(segs.size(), pkts.size());
+        for (size_t i = 0; i < segs.size(); ++i)
+        {
+            auto expect = pkts[i];
+            if (!ipv6)
+            {
+                IPv4Header *ip = reinterpret_cast<IPv4Header *>(expect.data());
+                ip->id = htons(static_cast<std::uint16_t>(0x1234 + i));
+                ip->check = 0;
+                ip->check = IPChecksum::checksum(ip, sizeof(IPv4Header));
+            }
+            EXPECT_EQ(segs[i], expect) << "segment " << i;
+        }
+    }
+}
+
+TEST(vnethdr, coalesce_passthrough)
+{
+    const auto payload = make_payload(2000);
+    Coalescer c;
+    std::vector<std::vector<std::uint8_t>> written;
+    auto write = [&](const Buffer &b, const size_t n)
+    {
+        EXPECT_EQ(n, 1u);
+        Header h;
+        std::memcpy(&h, b.c_data(), sizeof(h));
+        EXPECT_EQ(h.gso_type, Header::GSO_NONE);
+        EXPECT_EQ(h.flags, 0);
+        written.emplace_back(b.c_data() + sizeof(Header), b.c_data() + b.size());
+    };
+    auto add = [&](const std::vector<std::uint8_t> &pkt)
+    { c.add(BufferAllocated(pkt.data(), pkt.size(), BufAllocFlags::NO_FLAGS), write); };
+
+    // a lone segment is written as is once flushed
+    const auto a = make_packet(false, IPCommon::TCP, payload.data(), 1000, 1000);
+    add(a);
+    EXPECT_TRUE(written.empty());
+
+    // out of order segment flushes the pending one and starts over
+    const auto b = make_packet(false, IPCommon::TCP, payload.data(), 1000, 5000);
+    add(b);
+    ASSERT_EQ(written.size(), 1u);
+    EXPECT_EQ(written[0], a);
+
+    // UDP, SYN and empty ACKs are never held back
+    const auto udp = make_packet(false, IPCommon::UDP, payload.data(), 100);
+    add(udp);
+    const auto syn = make_packet(false, IPCommon::TCP, payload.data(), 0, 1, 0x02);
+    add(syn);
+    const auto ack = make_packet(true, IPCommon::TCP, payload.data(), 0, 1);
+    add(ack);
+    ASSERT_EQ(written.size(), 5u);
+    EXPECT_EQ(written[1], b);
+    EXPECT_EQ(written[2], udp);
+    EXPECT_EQ(written[3], syn);
+    EXPECT_EQ(written[4], ack);
+
+    // a bigger segment cannot follow a smaller one
+    const auto s1 = make_packet(false, IPCommon::TCP, payload.data(), 500, 100);
+    const auto s2 = make_packet(false, IPCommon::TCP, payload.data(), 1000, 600);
+    add(s1);
+    add(s2);
+    c.flush(write);
+    ASSERT_EQ(written.size(), 7u);
+    EXPECT_EQ(written[5], s1);
+    EXPECT_EQ(written[6], s2);
+    EXPECT_FALSE(c.pending());
+}